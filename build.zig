@@ -48,6 +48,8 @@ pub fn build(b: *std.Build) void {
 
             "SQArray.hpp",
             "SQArray.cpp",
+            "SQCensus.hpp",
+            "SQCensus.cpp",
             "SQClass.hpp",
             "SQClass.cpp",
             "SQClosure.hpp",
@@ -60,6 +62,8 @@ pub fn build(b: *std.Build) void {
             "SQFunctionProto.cpp",
             "SQGenerator.hpp",
             "SQGenerator.cpp",
+            "SQImage.hpp",
+            "SQImage.cpp",
             "SQInstance.hpp",
             "SQInstance.cpp",
             "SQNativeClosure.hpp",
@@ -118,6 +122,9 @@ pub fn build(b: *std.Build) void {
             "sqstdstring.cpp",
             "sqstdaux.cpp",
             "sqstdrex.cpp",
+            "sqstdsched.cpp",
+            "sqstdjson.cpp",
+            "sqstdpack.cpp",
         },
         .flags = base_c_flags,
     });
@@ -162,12 +169,33 @@ pub fn build(b: *std.Build) void {
     const run_step = b.step("run", "Run the interpreter");
     run_step.dependOn(&run_cmd.step);
 
-    // const sq_exe_unit_tests = b.addTest(.{
-    //     .root_module = sq_exe_mod,
-    // });
-    // const run_sq_exe_unit_tests = b.addRunArtifact(sq_exe_unit_tests);
-
-    // const test_step = b.step("test", "Run unit tests");
-    // // test_step.dependOn(&run_lib_unit_tests.step);
-    // test_step.dependOn(&run_sq_exe_unit_tests.step);
+    // C API tests, each a program in tests/api/<name>/<name>.c
+    const test_step = b.step("test", "Run the C API tests");
+    const api_tests: []const []const u8 = &.{
+        "image",
+        "snapshot",
+        "refs",
+        "keys",
+    };
+    for (api_tests) |name| {
+        const test_mod = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+            .link_libc = true,
+        });
+        test_mod.addCMacro("_SQ64", "1");
+        test_mod.addIncludePath(b.path("include/"));
+        test_mod.addCSourceFile(.{
+            .file = b.path(b.fmt("tests/api/{s}/{s}.c", .{ name, name })),
+            .flags = base_c_flags,
+        });
+        test_mod.linkLibrary(squirrel_lib);
+        test_mod.linkLibrary(sqstdlib_lib);
+        const test_exe = b.addExecutable(.{
+            .name = b.fmt("test-{s}", .{name}),
+            .root_module = test_mod,
+        });
+        const run_test = b.addRunArtifact(test_exe);
+        test_step.dependOn(&run_test.step);
+    }
 }
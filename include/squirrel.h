@@ -69,6 +69,10 @@ struct SQOuter;
 #define SQUIRREL_EOB 0
 #define SQ_BYTECODE_STREAM_TAG  0xFAFA
 
+/*weak table modes, see sq_setweakmode*/
+#define SQ_WEAK_KEYS            0x01
+#define SQ_WEAK_VALUES          0x02
+
 #define SQOBJECT_REF_COUNTED    0x08000000
 #define SQOBJECT_NUMERIC        0x04000000
 #define SQOBJECT_DELEGABLE      0x02000000
@@ -159,6 +163,12 @@ typedef struct  tagSQMemberHandle {
     SQInteger _index;
 } SQMemberHandle;
 
+/* a string key interned once, see sq_internkey() */
+typedef struct tagSQKeyHandle {
+    SQObject _key;
+    SQUnsignedInteger _ref;
+} SQKeyHandle;
+
 typedef struct tagSQStackInfos {
     SQChar const* funcname;
     SQChar const* source;
@@ -166,8 +176,12 @@ typedef struct tagSQStackInfos {
 } SQStackInfos;
 
 typedef struct SQVM* HSQUIRRELVM;
+typedef struct SQImage* HSQIMAGE;
+typedef struct SQChannel* HSQCHANNEL;
 typedef SQObject HSQOBJECT;
 typedef SQMemberHandle HSQMEMBERHANDLE;
+typedef SQUnsignedInteger HSQREF; /* 0 is never a valid reference */
+typedef SQKeyHandle HSQKEY;
 typedef SQInteger (*SQFUNCTION)(HSQUIRRELVM);
 typedef SQInteger (*SQRELEASEHOOK)(SQUserPointer,SQInteger size);
 typedef void (*SQCOMPILERERROR)(HSQUIRRELVM,const SQChar * /*desc*/,const SQChar * /*source*/,SQInteger /*line*/,SQInteger /*column*/);
@@ -175,6 +189,8 @@ typedef void (*SQPRINTFUNCTION)(HSQUIRRELVM,const SQChar * ,...);
 typedef void (*SQDEBUGHOOK)(HSQUIRRELVM /*v*/, SQInteger /*type*/, const SQChar * /*sourcename*/, SQInteger /*line*/, const SQChar * /*funcname*/);
 typedef SQInteger (*SQWRITEFUNC)(SQUserPointer,SQUserPointer,SQInteger);
 typedef SQInteger (*SQREADFUNC)(SQUserPointer,SQUserPointer,SQInteger);
+typedef SQInteger (*SQFREEZEHOOK)(HSQUIRRELVM,SQInteger /*idx*/,SQWRITEFUNC,SQUserPointer);
+typedef SQInteger (*SQTHAWHOOK)(HSQUIRRELVM,SQInteger /*idx*/,SQREADFUNC,SQUserPointer);
 
 typedef uint8_t (*SQLEXREADFUNC)(SQUserPointer);
 
@@ -192,9 +208,26 @@ typedef struct tagSQFunctionInfo {
     SQInteger line;
 }SQFunctionInfo;
 
+typedef struct tagSQGCParams {
+    SQInteger growth;   /* % the heap may grow past the live size of the last collection, 0 disables automatic collection */
+    SQInteger minheap;  /* bytes below which no automatic collection happens */
+    SQInteger maxpause; /* microseconds, 0 for no limit; longer automatic pauses space out the next ones */
+}SQGCParams;
+
+typedef struct tagSQGCStats {
+    SQInteger livebytes;        /* bytes held by collectable objects */
+    SQInteger threshold;        /* livebytes at which the next automatic collection is due */
+    SQInteger collections;
+    SQInteger autocollections;
+    SQInteger freed;            /* objects freed by all collections */
+    SQInteger lastpause;        /* microseconds */
+    SQInteger totalpause;
+}SQGCStats;
+
 /*vm*/
 SQUIRREL_API HSQUIRRELVM sq_open(SQInteger initialstacksize);
 SQUIRREL_API HSQUIRRELVM sq_newthread(HSQUIRRELVM friendvm, SQInteger initialstacksize);
+SQUIRREL_API void sq_setthreadpool(HSQUIRRELVM v, SQInteger maxpooled, SQInteger threadstacksize);
 SQUIRREL_API void sq_seterrorhandler(HSQUIRRELVM v);
 SQUIRREL_API void sq_close(HSQUIRRELVM v);
 SQUIRREL_API void sq_setforeignptr(HSQUIRRELVM v,SQUserPointer p);
@@ -210,6 +243,8 @@ SQUIRREL_API SQPRINTFUNCTION sq_getprintfunc(HSQUIRRELVM v);
 SQUIRREL_API SQPRINTFUNCTION sq_geterrorfunc(HSQUIRRELVM v);
 SQUIRREL_API SQRESULT sq_suspendvm(HSQUIRRELVM v);
 SQUIRREL_API SQRESULT sq_wakeupvm(HSQUIRRELVM v,SQBool resumedret,SQBool retval,SQBool raiseerror,SQBool throwerror);
+SQUIRREL_API void sq_setbudget(HSQUIRRELVM v,SQInteger budget);
+SQUIRREL_API SQInteger sq_getbudget(HSQUIRRELVM v);
 SQUIRREL_API SQInteger sq_getvmstate(HSQUIRRELVM v);
 SQUIRREL_API SQInteger sq_getversion();
 
@@ -236,6 +271,8 @@ SQUIRREL_API SQUserPointer sq_newuserdata(HSQUIRRELVM v,SQUnsignedInteger size);
 SQUIRREL_API void sq_newtable(HSQUIRRELVM v);
 SQUIRREL_API void sq_newtableex(HSQUIRRELVM v,SQInteger initialcapacity);
 SQUIRREL_API void sq_newarray(HSQUIRRELVM v,SQInteger size);
+SQUIRREL_API SQRESULT sq_newarrayfrom(HSQUIRRELVM v,SQInteger n);
+SQUIRREL_API SQRESULT sq_newtablefrom(HSQUIRRELVM v,SQInteger npairs);
 SQUIRREL_API void sq_newclosure(HSQUIRRELVM v,SQFUNCTION func,SQUnsignedInteger nfreevars);
 SQUIRREL_API SQRESULT sq_setparamscheck(HSQUIRRELVM v,SQInteger nparamscheck,const SQChar *typemask);
 SQUIRREL_API SQRESULT sq_bindenv(HSQUIRRELVM v,SQInteger idx);
@@ -286,6 +323,13 @@ SQUIRREL_API SQRESULT sq_getdefaultdelegate(HSQUIRRELVM v,SQObjectType t);
 SQUIRREL_API SQRESULT sq_getmemberhandle(HSQUIRRELVM v,SQInteger idx,HSQMEMBERHANDLE *handle);
 SQUIRREL_API SQRESULT sq_getbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handle);
 SQUIRREL_API SQRESULT sq_setbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handle);
+SQUIRREL_API void sq_internkey(HSQUIRRELVM v,const SQChar *s,SQInteger len,HSQKEY *key);
+SQUIRREL_API SQRESULT sq_releasekey(HSQUIRRELVM v,HSQKEY *key);
+SQUIRREL_API SQRESULT sq_getbykey(HSQUIRRELVM v,SQInteger idx,const HSQKEY *key);
+SQUIRREL_API SQRESULT sq_rawgetbykey(HSQUIRRELVM v,SQInteger idx,const HSQKEY *key);
+SQUIRREL_API SQRESULT sq_setbykey(HSQUIRRELVM v,SQInteger idx,const HSQKEY *key);
+SQUIRREL_API SQRESULT sq_rawsetbykey(HSQUIRRELVM v,SQInteger idx,const HSQKEY *key);
+SQUIRREL_API SQRESULT sq_newslotbykey(HSQUIRRELVM v,SQInteger idx,const HSQKEY *key,SQBool bstatic);
 
 /*object manipulation*/
 SQUIRREL_API void sq_pushroottable(HSQUIRRELVM v);
@@ -315,6 +359,8 @@ SQUIRREL_API SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedI
 SQUIRREL_API SQRESULT sq_next(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_getweakrefval(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_clear(HSQUIRRELVM v,SQInteger idx);
+SQUIRREL_API SQRESULT sq_setweakmode(HSQUIRRELVM v,SQInteger idx,SQInteger mode);
+SQUIRREL_API SQInteger sq_getweakmode(HSQUIRRELVM v,SQInteger idx);
 
 /*calls*/
 SQUIRREL_API SQRESULT sq_call(HSQUIRRELVM v,SQInteger params,SQBool retval,SQBool raiseerror);
@@ -342,16 +388,43 @@ SQUIRREL_API SQFloat sq_objtofloat(const HSQOBJECT *o);
 SQUIRREL_API SQUserPointer sq_objtouserpointer(const HSQOBJECT *o);
 SQUIRREL_API SQRESULT sq_getobjtypetag(const HSQOBJECT *o,SQUserPointer * typetag);
 SQUIRREL_API SQUnsignedInteger sq_getvmrefcount(HSQUIRRELVM v, const HSQOBJECT *po);
+SQUIRREL_API HSQREF sq_newref(HSQUIRRELVM v,SQInteger idx);
+SQUIRREL_API SQRESULT sq_pushref(HSQUIRRELVM v,HSQREF ref);
+SQUIRREL_API SQRESULT sq_freeref(HSQUIRRELVM v,HSQREF ref);
 
 
 /*GC*/
 SQUIRREL_API SQInteger sq_collectgarbage(HSQUIRRELVM v);
 SQUIRREL_API SQRESULT sq_resurrectunreachable(HSQUIRRELVM v);
+SQUIRREL_API void sq_setgcparams(HSQUIRRELVM v,const SQGCParams *params);
+SQUIRREL_API void sq_getgcparams(HSQUIRRELVM v,SQGCParams *params);
+SQUIRREL_API void sq_getgcstats(HSQUIRRELVM v,SQGCStats *stats);
+SQUIRREL_API SQBool sq_collectifdue(HSQUIRRELVM v);
+SQUIRREL_API void sq_heapcensus(HSQUIRRELVM v,SQInteger ntop);
+SQUIRREL_API void sq_setcensusinterval(HSQUIRRELVM v,SQInteger ncollections);
 
 /*serialization*/
 SQUIRREL_API SQRESULT sq_writeclosure(HSQUIRRELVM vm,SQWRITEFUNC writef,SQUserPointer up);
 SQUIRREL_API SQRESULT sq_readclosure(HSQUIRRELVM vm,SQREADFUNC readf,SQUserPointer up);
 
+/*images and channels, usable from VMs running on different threads*/
+SQUIRREL_API SQRESULT sq_freeze(HSQUIRRELVM v,SQInteger idx,HSQIMAGE *img);
+SQUIRREL_API SQRESULT sq_thaw(HSQUIRRELVM v,HSQIMAGE img);
+SQUIRREL_API SQRESULT sq_thawbuffer(HSQUIRRELVM v,SQUserPointer data,SQInteger size,SQBool allowcode);
+SQUIRREL_API void sq_getimagebytes(HSQIMAGE img,SQUserPointer *data,SQInteger *size);
+SQUIRREL_API void sq_setsnapshotbaseline(HSQUIRRELVM v);
+SQUIRREL_API SQRESULT sq_snapshot(HSQUIRRELVM v,SQWRITEFUNC writef,SQUserPointer up);
+SQUIRREL_API SQRESULT sq_restore(HSQUIRRELVM v,SQREADFUNC readf,SQUserPointer up);
+SQUIRREL_API SQRESULT sq_setimagehooks(HSQUIRRELVM v,SQInteger idx,SQFREEZEHOOK freeze,SQTHAWHOOK thaw);
+SQUIRREL_API void sq_retainimage(HSQIMAGE img);
+SQUIRREL_API void sq_releaseimage(HSQIMAGE img);
+SQUIRREL_API HSQCHANNEL sq_newchannel();
+SQUIRREL_API void sq_retainchannel(HSQCHANNEL ch);
+SQUIRREL_API void sq_releasechannel(HSQCHANNEL ch);
+SQUIRREL_API void sq_closechannel(HSQCHANNEL ch);
+SQUIRREL_API SQRESULT sq_channelsend(HSQUIRRELVM v,HSQCHANNEL ch,SQInteger idx);
+SQUIRREL_API SQInteger sq_channelrecv(HSQUIRRELVM v,HSQCHANNEL ch,SQBool wait);
+
 /*mem allocation*/
 SQUIRREL_API void *sq_malloc(SQUnsignedInteger size);
 SQUIRREL_API void *sq_realloc(void* p,SQUnsignedInteger oldsize,SQUnsignedInteger newsize);
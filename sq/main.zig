@@ -13,6 +13,8 @@ const csq = @cImport({
     @cInclude("sqstdio.h");
     @cInclude("sqstdmath.h");
     @cInclude("sqstdstring.h");
+    @cInclude("sqstdsched.h");
+    @cInclude("sqstdjson.h");
     @cInclude("sqstdaux.h");
 });
 
@@ -333,6 +335,8 @@ pub fn main() !u8 {
     _ = csq.sqstd_register_systemlib(vm);
     _ = csq.sqstd_register_mathlib(vm);
     _ = csq.sqstd_register_stringlib(vm);
+    _ = csq.sqstd_register_schedlib(vm);
+    _ = csq.sqstd_register_jsonlib(vm);
     _ = csq.sqstd_seterrorhandlers(vm);
 
     var ret: csq.SQInteger = 0;
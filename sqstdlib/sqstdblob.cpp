@@ -6,6 +6,7 @@
 #include <sqstdblob.h>
 #include "sqstdstream.h"
 #include "sqstdblobimpl.h"
+#include "sqstdpack.h"
 
 #define SQSTD_BLOB_TYPE_TAG ((SQUnsignedInteger)(SQSTD_STREAM_TYPE_TAG | 0x00000002))
 
@@ -167,6 +168,32 @@ static SQInteger _blob__cloned(HSQUIRRELVM v)
     return 0;
 }
 
+static SQInteger _blob_freezehook(HSQUIRRELVM v,SQInteger idx,SQWRITEFUNC write,SQUserPointer up)
+{
+    SQBlob *self = NULL;
+    if(SQ_FAILED(sq_getinstanceup(v,idx,(SQUserPointer*)&self,(SQUserPointer)SQSTD_BLOB_TYPE_TAG,SQTrue)))
+        return SQ_ERROR;
+    SQInteger len = self->Len();
+    write(up,&len,sizeof(len));
+    write(up,self->GetBuf(),len);
+    return SQ_OK;
+}
+
+static SQInteger _blob_thawhook(HSQUIRRELVM v,SQInteger idx,SQREADFUNC read,SQUserPointer up)
+{
+    SQInteger len;
+    if(read(up,&len,sizeof(len)) != sizeof(len) || len < 0)
+        return sq_throwerror(v,_SC("corrupted image"));
+    SQBlob *b = new (sq_malloc(sizeof(SQBlob)))SQBlob(len);
+    if(read(up,b->GetBuf(),len) != len || SQ_FAILED(sq_setinstanceup(v,idx,b))) {
+        b->~SQBlob();
+        sq_free(b,sizeof(SQBlob));
+        return sq_throwerror(v,_SC("corrupted image"));
+    }
+    sq_setreleasehook(v,idx,_blob_releasehook);
+    return SQ_OK;
+}
+
 #define _DECL_BLOB_FUNC(name,nparams,typecheck) {_SC(#name),_blob_##name,nparams,typecheck}
 static const SQRegFunction _blob_methods[] = {
     _DECL_BLOB_FUNC(constructor,-1,_SC("xn")),
@@ -229,6 +256,67 @@ static SQInteger _g_blob_swapfloat(HSQUIRRELVM v)
     return 1;
 }
 
+static SQInteger _g_blob_serialize(HSQUIRRELVM v)
+{
+    HSQIMAGE img;
+    if(SQ_FAILED(sq_freeze(v,2,&img)))
+        return SQ_ERROR;
+    SQUserPointer data;
+    SQInteger size;
+    sq_getimagebytes(img,&data,&size);
+    SQUserPointer buf = sqstd_createblob(v,size);
+    if(buf)
+        memcpy(buf,data,size);
+    sq_releaseimage(img);
+    if(!buf)
+        return sq_throwerror(v,_SC("cannot create blob"));
+    return 1;
+}
+
+static SQInteger _g_blob_deserialize(HSQUIRRELVM v)
+{
+    SQUserPointer data;
+    if(SQ_FAILED(sqstd_getblob(v,2,&data)))
+        return SQ_ERROR;
+    // bytes from scripts may be forged, functions load through the C API only
+    if(SQ_FAILED(sq_thawbuffer(v,data,sqstd_getblobsize(v,2),SQFalse)))
+        return SQ_ERROR;
+    return 1;
+}
+
+static SQInteger _g_blob_pack(HSQUIRRELVM v)
+{
+    SQPackFormat *fmt = pack_format(v,2);
+    if(!fmt)
+        return SQ_ERROR;
+    SQInteger nargs = sq_gettop(v) - 2;
+    unsigned char *buf = (unsigned char *)sqstd_createblob(v,pack_size(fmt));
+    if(!buf)
+        return sq_throwerror(v,_SC("cannot create blob"));
+    if(SQ_FAILED(pack_write(v,fmt,3,nargs,buf)))
+        return SQ_ERROR;
+    return 1;
+}
+
+static SQInteger _g_blob_unpack(HSQUIRRELVM v)
+{
+    SQPackFormat *fmt = pack_format(v,2);
+    if(!fmt)
+        return SQ_ERROR;
+    SQUserPointer data;
+    if(SQ_FAILED(sqstd_getblob(v,3,&data)))
+        return SQ_ERROR;
+    SQInteger offset = 0;
+    if(sq_gettop(v) > 3)
+        sq_getinteger(v,4,&offset);
+    SQInteger size = pack_size(fmt), blobsize = sqstd_getblobsize(v,3);
+    if(offset < 0 || size > blobsize || offset > blobsize - size)
+        return sq_throwerror(v,_SC("out of range"));
+    if(SQ_FAILED(pack_read(v,fmt,(const unsigned char *)data + offset)))
+        return SQ_ERROR;
+    return 1;
+}
+
 #define _DECL_GLOBALBLOB_FUNC(name,nparams,typecheck) {_SC(#name),_g_blob_##name,nparams,typecheck}
 static const SQRegFunction bloblib_funcs[]={
     _DECL_GLOBALBLOB_FUNC(casti2f,2,_SC(".n")),
@@ -236,6 +324,10 @@ static const SQRegFunction bloblib_funcs[]={
     _DECL_GLOBALBLOB_FUNC(swap2,2,_SC(".n")),
     _DECL_GLOBALBLOB_FUNC(swap4,2,_SC(".n")),
     _DECL_GLOBALBLOB_FUNC(swapfloat,2,_SC(".n")),
+    _DECL_GLOBALBLOB_FUNC(serialize,2,_SC("..")),
+    _DECL_GLOBALBLOB_FUNC(deserialize,2,_SC(".x")),
+    _DECL_GLOBALBLOB_FUNC(pack,-2,_SC(".s")),
+    _DECL_GLOBALBLOB_FUNC(unpack,-3,_SC(".sxn")),
     {NULL,(SQFUNCTION)0,0,NULL}
 };
 
@@ -278,6 +370,13 @@ SQUserPointer sqstd_createblob(HSQUIRRELVM v, SQInteger size)
 
 SQRESULT sqstd_register_bloblib(HSQUIRRELVM v)
 {
-    return declare_stream(v,_SC("blob"),(SQUserPointer)SQSTD_BLOB_TYPE_TAG,_SC("std_blob"),_blob_methods,bloblib_funcs);
+    if(SQ_FAILED(declare_stream(v,_SC("blob"),(SQUserPointer)SQSTD_BLOB_TYPE_TAG,_SC("std_blob"),_blob_methods,bloblib_funcs)))
+        return SQ_ERROR;
+    sq_pushregistrytable(v);
+    sq_pushstring(v,_SC("std_blob"),-1);
+    sq_get(v,-2);
+    sq_setimagehooks(v,-1,_blob_freezehook,_blob_thawhook);
+    sq_pop(v,2);
+    return SQ_OK;
 }
 
@@ -396,6 +396,24 @@ SQRESULT sqstd_writeclosuretofile(HSQUIRRELVM v,const SQChar *filename)
     return SQ_ERROR; //forward the error
 }
 
+SQRESULT sqstd_writesnapshottofile(HSQUIRRELVM v,const SQChar *filename)
+{
+    SQFILE file = sqstd_fopen(filename,_SC("wb+"));
+    if(!file) return sq_throwerror(v,_SC("cannot open the file"));
+    SQRESULT res = sq_snapshot(v,file_write,file);
+    sqstd_fclose(file);
+    return res; //forward the error
+}
+
+SQRESULT sqstd_loadsnapshotfromfile(HSQUIRRELVM v,const SQChar *filename)
+{
+    SQFILE file = sqstd_fopen(filename,_SC("rb"));
+    if(!file) return sq_throwerror(v,_SC("cannot open the file"));
+    SQRESULT res = sq_restore(v,file_read,file);
+    sqstd_fclose(file);
+    return res; //forward the error
+}
+
 SQInteger _g_io_loadfile(HSQUIRRELVM v)
 {
     const SQChar *filename;
@@ -0,0 +1,785 @@
+/* see copyright notice in squirrel.h */
+#include <new>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <squirrel.h>
+#include <sqstdio.h>
+#include <sqstdblob.h>
+#include <sqstdjson.h>
+
+// JSON encoder and decoder. The decoder pushes the members of an object or
+// array on the stack and builds the container from them in one go
+// (sq_newtablefrom, sq_newarrayfrom), so it is allocated at its final size.
+// Strings are scanned a word at a time for the bytes that end a plain run.
+
+#define JSON_MAX_DEPTH 512
+#define JSON_CHUNK 4096
+
+#define JSON_ONES UINT64_C(0x0101010101010101)
+#define JSON_HIGHS UINT64_C(0x8080808080808080)
+
+// nonzero if any byte of w is a quote, a backslash or a control character
+static inline uint64_t _json_special(uint64_t w)
+{
+    uint64_t const q = w ^ (JSON_ONES * '"');
+    uint64_t const b = w ^ (JSON_ONES * '\\');
+    return (((q - JSON_ONES) & ~q) | ((b - JSON_ONES) & ~b) | ((w - JSON_ONES * 0x20) & ~w)) & JSON_HIGHS;
+}
+
+static inline bool _json_plain(unsigned char c)
+{
+    return c != '"' && c != '\\' && c >= 0x20;
+}
+
+// length of the run of plain bytes at the start of s
+static SQInteger _json_plainrun(const char *s, SQInteger n)
+{
+    SQInteger i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (_json_special(w)) {
+            break;
+        }
+    }
+    while (i < n && _json_plain((unsigned char)s[i])) {
+        i++;
+    }
+    return i;
+}
+
+// length of the valid UTF-8 at the start of s; overlong forms, surrogates
+// and code points past U+10FFFF are invalid
+static SQInteger _json_utf8valid(const char *s, SQInteger n)
+{
+    SQInteger i = 0;
+    while (i < n) {
+        if (i + 8 <= n) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            if (!(w & JSON_HIGHS)) {
+                i += 8;
+                continue;
+            }
+        }
+        unsigned char const c = (unsigned char)s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        SQInteger len;
+        unsigned char lo = 0x80, hi = 0xBF; // range of the second byte
+        if (c >= 0xC2 && c <= 0xDF) {
+            len = 2;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            len = 3;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            len = 4;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return i;
+        }
+        if (n - i < len || (unsigned char)s[i + 1] < lo || (unsigned char)s[i + 1] > hi) {
+            return i;
+        }
+        for (SQInteger k = 2; k < len; k++) {
+            if (((unsigned char)s[i + k] & 0xC0) != 0x80) {
+                return i;
+            }
+        }
+        i += len;
+    }
+    return n;
+}
+
+//Decoder
+
+struct JSONReader {
+    HSQUIRRELVM v;
+    const char *begin;
+    const char *p;
+    const char *end;
+    SQInteger depth;
+    bool floats;    // numbers are all decoded as floats
+};
+
+static bool _json_fail(JSONReader *r, const char *what)
+{
+    char buf[96];
+    snprintf(buf, sizeof(buf), "json: %s at offset %lld", what, (long long)(r->p - r->begin));
+    sq_throwerror(r->v, buf);
+    return false;
+}
+
+static inline void _json_skipws(JSONReader *r)
+{
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\n' || *r->p == '\r' || *r->p == '\t')) {
+        r->p++;
+    }
+}
+
+static inline bool _json_digit(JSONReader *r, const char *p)
+{
+    return p < r->end && *p >= '0' && *p <= '9';
+}
+
+static bool _json_hex4(JSONReader *r, uint32_t *out)
+{
+    if (r->end - r->p < 4) {
+        return false;
+    }
+    uint32_t u = 0;
+    for (int i = 0; i < 4; i++) {
+        char const c = r->p[i];
+        char const l = c | 0x20;
+        u <<= 4;
+        if (c >= '0' && c <= '9') {
+            u |= c - '0';
+        } else if (l >= 'a' && l <= 'f') {
+            u |= l - 'a' + 10;
+        } else {
+            return false;
+        }
+    }
+    r->p += 4;
+    *out = u;
+    return true;
+}
+
+static SQInteger _json_utf8(char *out, uint32_t c)
+{
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+// a plain run ends on an ASCII byte, so it holds whole characters
+static bool _json_checkrun(JSONReader *r, const char *run, SQInteger n)
+{
+    SQInteger const valid = _json_utf8valid(run, n);
+    if (valid != n) {
+        r->p = run + valid;
+        return _json_fail(r, "invalid UTF-8 in string");
+    }
+    return true;
+}
+
+// r->p is past the opening quote
+static bool _json_readstring(JSONReader *r)
+{
+    const char *start = r->p;
+    SQInteger n = _json_plainrun(start, r->end - start);
+    if (!_json_checkrun(r, start, n)) {
+        return false;
+    }
+    r->p += n;
+    if (r->p < r->end && *r->p == '"') {
+        r->p++;
+        sq_pushstring(r->v, start, n);
+        return true;
+    }
+
+    // escaped strings are decoded in the scratchpad
+    SQInteger cap = n * 2 + 64;
+    char *buf = sq_getscratchpad(r->v, cap);
+    memcpy(buf, start, n);
+    SQInteger len = n;
+    for (;;) {
+        if (r->p >= r->end) {
+            return _json_fail(r, "unterminated string");
+        }
+        if (*r->p == '"') {
+            break;
+        }
+        if (*r->p != '\\') {
+            return _json_fail(r, "control character in string");
+        }
+        if (++r->p >= r->end) {
+            return _json_fail(r, "unterminated string");
+        }
+        if (len + 4 > cap) {
+            cap *= 2;
+            buf = sq_getscratchpad(r->v, cap);
+        }
+        switch (*r->p++) {
+        case '"': buf[len++] = '"'; break;
+        case '\\': buf[len++] = '\\'; break;
+        case '/': buf[len++] = '/'; break;
+        case 'b': buf[len++] = '\b'; break;
+        case 'f': buf[len++] = '\f'; break;
+        case 'n': buf[len++] = '\n'; break;
+        case 'r': buf[len++] = '\r'; break;
+        case 't': buf[len++] = '\t'; break;
+        case 'u': {
+            uint32_t u, lo;
+            if (!_json_hex4(r, &u)) {
+                return _json_fail(r, "invalid \\u escape");
+            }
+            if (u >= 0xD800 && u < 0xE000) {
+                if (u >= 0xDC00 || r->end - r->p < 2 || r->p[0] != '\\' || r->p[1] != 'u') {
+                    return _json_fail(r, "invalid surrogate pair");
+                }
+                r->p += 2;
+                if (!_json_hex4(r, &lo) || lo < 0xDC00 || lo >= 0xE000) {
+                    return _json_fail(r, "invalid surrogate pair");
+                }
+                u = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+            }
+            len += _json_utf8(buf + len, u);
+            break;
+        }
+        default:
+            r->p--;
+            return _json_fail(r, "invalid escape");
+        }
+        n = _json_plainrun(r->p, r->end - r->p);
+        if (!_json_checkrun(r, r->p, n)) {
+            return false;
+        }
+        if (len + n > cap) {
+            cap = (len + n) * 2;
+            buf = sq_getscratchpad(r->v, cap);
+        }
+        memcpy(buf + len, r->p, n);
+        len += n;
+        r->p += n;
+    }
+    r->p++;
+    sq_pushstring(r->v, buf, len);
+    return true;
+}
+
+static bool _json_readnumber(JSONReader *r)
+{
+    const char *start = r->p;
+    const char *p = r->p;
+    bool const neg = *p == '-';
+    if (neg) {
+        p++;
+    }
+    if (!_json_digit(r, p)) {
+        r->p = p;
+        return _json_fail(r, "invalid number");
+    }
+
+    uint64_t m = 0;
+    bool overflow = false;
+    if (*p == '0') {
+        p++;
+    } else {
+        for (; _json_digit(r, p); p++) {
+            unsigned const d = *p - '0';
+            if (m > (UINT64_MAX - d) / 10) {
+                overflow = true;
+            } else {
+                m = m * 10 + d;
+            }
+        }
+    }
+    bool integral = true;
+    if (p < r->end && *p == '.') {
+        integral = false;
+        if (!_json_digit(r, ++p)) {
+            r->p = p;
+            return _json_fail(r, "invalid number");
+        }
+        while (_json_digit(r, p)) {
+            p++;
+        }
+    }
+    if (p < r->end && (*p | 0x20) == 'e') {
+        integral = false;
+        p++;
+        if (p < r->end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (!_json_digit(r, p)) {
+            r->p = p;
+            return _json_fail(r, "invalid number");
+        }
+        while (_json_digit(r, p)) {
+            p++;
+        }
+    }
+    r->p = p;
+
+    if (integral && !overflow) {
+        uint64_t const imax = (uint64_t)(~(SQUnsignedInteger)0 >> 1);
+        if (r->floats) {
+            sq_pushfloat(r->v, (SQFloat)(neg ? -(double)m : (double)m));
+            return true;
+        }
+        if (m <= imax + (neg ? 1 : 0)) {
+            sq_pushinteger(r->v, neg ? (SQInteger)(0 - m) : (SQInteger)m);
+            return true;
+        }
+    }
+    // fractions, exponents and integers that do not fit
+    char tmp[64];
+    SQInteger const len = p - start;
+    char *s = len < (SQInteger)sizeof(tmp) ? tmp : sq_getscratchpad(r->v, len + 1);
+    memcpy(s, start, len);
+    s[len] = '\0';
+    sq_pushfloat(r->v, (SQFloat)strtod(s, NULL));
+    return true;
+}
+
+static bool _json_readliteral(JSONReader *r, const char *lit, SQInteger n)
+{
+    if (r->end - r->p < n || memcmp(r->p, lit, n) != 0) {
+        return _json_fail(r, "invalid literal");
+    }
+    r->p += n;
+    return true;
+}
+
+static bool _json_readvalue(JSONReader *r);
+
+static bool _json_readobject(JSONReader *r)
+{
+    SQInteger n = 0;
+    r->p++;
+    _json_skipws(r);
+    if (r->p < r->end && *r->p == '}') {
+        r->p++;
+        sq_newtable(r->v);
+        return true;
+    }
+    for (;;) {
+        if (SQ_FAILED(sq_reservestack(r->v, 2))) {
+            return false;
+        }
+        if (r->p >= r->end || *r->p != '"') {
+            return _json_fail(r, "expected a string key");
+        }
+        r->p++;
+        if (!_json_readstring(r)) {
+            return false;
+        }
+        _json_skipws(r);
+        if (r->p >= r->end || *r->p != ':') {
+            return _json_fail(r, "expected ':'");
+        }
+        r->p++;
+        if (!_json_readvalue(r)) {
+            return false;
+        }
+        n++;
+        _json_skipws(r);
+        if (r->p < r->end && *r->p == ',') {
+            r->p++;
+            _json_skipws(r);
+            continue;
+        }
+        if (r->p < r->end && *r->p == '}') {
+            r->p++;
+            break;
+        }
+        return _json_fail(r, "expected ',' or '}'");
+    }
+    return SQ_SUCCEEDED(sq_newtablefrom(r->v, n));
+}
+
+static bool _json_readarray(JSONReader *r)
+{
+    SQInteger n = 0;
+    r->p++;
+    _json_skipws(r);
+    if (r->p < r->end && *r->p == ']') {
+        r->p++;
+        sq_newarray(r->v, 0);
+        return true;
+    }
+    for (;;) {
+        if (SQ_FAILED(sq_reservestack(r->v, 1))) {
+            return false;
+        }
+        if (!_json_readvalue(r)) {
+            return false;
+        }
+        n++;
+        _json_skipws(r);
+        if (r->p < r->end && *r->p == ',') {
+            r->p++;
+            continue;
+        }
+        if (r->p < r->end && *r->p == ']') {
+            r->p++;
+            break;
+        }
+        return _json_fail(r, "expected ',' or ']'");
+    }
+    return SQ_SUCCEEDED(sq_newarrayfrom(r->v, n));
+}
+
+static bool _json_readvalue(JSONReader *r)
+{
+    _json_skipws(r);
+    if (r->p >= r->end) {
+        return _json_fail(r, "unexpected end of input");
+    }
+    switch (*r->p) {
+    case '{':
+    case '[': {
+        if (r->depth >= JSON_MAX_DEPTH) {
+            return _json_fail(r, "nesting too deep");
+        }
+        r->depth++;
+        bool const ok = *r->p == '{' ? _json_readobject(r) : _json_readarray(r);
+        r->depth--;
+        return ok;
+    }
+    case '"':
+        r->p++;
+        return _json_readstring(r);
+    case 't':
+        if (!_json_readliteral(r, "true", 4)) {
+            return false;
+        }
+        sq_pushbool(r->v, SQTrue);
+        return true;
+    case 'f':
+        if (!_json_readliteral(r, "false", 5)) {
+            return false;
+        }
+        sq_pushbool(r->v, SQFalse);
+        return true;
+    case 'n':
+        if (!_json_readliteral(r, "null", 4)) {
+            return false;
+        }
+        sq_pushnull(r->v);
+        return true;
+    default:
+        if (*r->p != '-' && (*r->p < '0' || *r->p > '9')) {
+            return _json_fail(r, "unexpected character");
+        }
+        return _json_readnumber(r);
+    }
+}
+
+static SQInteger _json_decode(HSQUIRRELVM v)
+{
+    const SQChar *s;
+    SQInteger len;
+    if (sq_gettype(v, 2) == OT_STRING) {
+        sq_getstringandsize(v, 2, &s, &len);
+    } else {
+        SQUserPointer data;
+        if (SQ_FAILED(sqstd_getblob(v, 2, &data))) {
+            return sq_throwerror(v, _SC("json: expected a string or a blob"));
+        }
+        s = (const SQChar *)data;
+        len = sqstd_getblobsize(v, 2);
+    }
+    SQBool floats = SQFalse;
+    if (sq_gettop(v) > 2) {
+        sq_getbool(v, 3, &floats);
+    }
+
+    JSONReader r;
+    r.v = v;
+    r.begin = r.p = s;
+    r.end = s + len;
+    r.depth = 0;
+    r.floats = floats ? true : false;
+    if (!_json_readvalue(&r)) {
+        return SQ_ERROR;
+    }
+    _json_skipws(&r);
+    if (r.p != r.end) {
+        _json_fail(&r, "unexpected trailing characters");
+        return SQ_ERROR;
+    }
+    return 1;
+}
+
+//Encoder
+
+// output is buffered and, when writing to a stream, flushed in chunks
+struct JSONWriter {
+    HSQUIRRELVM v;
+    SQStream *out;
+    char *buf;
+    SQInteger len;
+    SQInteger cap;
+    SQInteger depth;
+};
+
+static bool _json_flush(JSONWriter *w)
+{
+    if (w->out->Write(w->buf, w->len) != w->len) {
+        sq_throwerror(w->v, _SC("json: io error"));
+        return false;
+    }
+    w->len = 0;
+    return true;
+}
+
+// makes room for n more bytes
+static bool _json_reserve(JSONWriter *w, SQInteger n)
+{
+    if (w->len + n <= w->cap) {
+        return true;
+    }
+    if (w->out) {
+        if (!_json_flush(w)) {
+            return false;
+        }
+        if (n <= w->cap) {
+            return true;
+        }
+    }
+    SQInteger cap = w->cap * 2;
+    while (cap < w->len + n) {
+        cap *= 2;
+    }
+    w->buf = (char *)sq_realloc(w->buf, w->cap, cap);
+    w->cap = cap;
+    return true;
+}
+
+static inline bool _json_put(JSONWriter *w, const char *s, SQInteger n)
+{
+    if (!_json_reserve(w, n)) {
+        return false;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+    return true;
+}
+
+static inline bool _json_putc(JSONWriter *w, char c)
+{
+    if (!_json_reserve(w, 1)) {
+        return false;
+    }
+    w->buf[w->len++] = c;
+    return true;
+}
+
+static bool _json_writestring(JSONWriter *w, const SQChar *s, SQInteger n)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (!_json_putc(w, '"')) {
+        return false;
+    }
+    for (;;) {
+        SQInteger const run = _json_plainrun(s, n);
+        if (!_json_put(w, s, run)) {
+            return false;
+        }
+        s += run;
+        n -= run;
+        if (n == 0) {
+            break;
+        }
+        unsigned char const c = (unsigned char)*s++;
+        n--;
+        char esc[6] = {'\\', 0, '0', '0', 0, 0};
+        SQInteger elen = 2;
+        switch (c) {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xF];
+            elen = 6;
+            break;
+        }
+        if (!_json_put(w, esc, elen)) {
+            return false;
+        }
+    }
+    return _json_putc(w, '"');
+}
+
+static bool _json_writefloat(JSONWriter *w, SQFloat f)
+{
+    if (isnan(f) || isinf(f)) {
+        sq_throwerror(w->v, _SC("json: cannot encode nan or infinity"));
+        return false;
+    }
+    // the shortest form that reads back as the same value
+    char tmp[40];
+    int n = 0;
+    for (int prec = sizeof(SQFloat) == sizeof(float) ? FLT_DIG : DBL_DIG; prec <= 17; prec++) {
+        n = snprintf(tmp, sizeof(tmp), "%.*g", prec, (double)f);
+        if ((SQFloat)strtod(tmp, NULL) == f) {
+            break;
+        }
+    }
+    // keeps it a float when decoded
+    if (!strpbrk(tmp, ".e")) {
+        tmp[n++] = '.';
+        tmp[n++] = '0';
+    }
+    return _json_put(w, tmp, n);
+}
+
+static bool _json_writevalue(JSONWriter *w, SQInteger idx);
+
+static bool _json_writecontainer(JSONWriter *w, SQInteger idx)
+{
+    HSQUIRRELVM v = w->v;
+    bool const table = sq_gettype(v, idx) == OT_TABLE;
+    if (w->depth >= JSON_MAX_DEPTH) {
+        sq_throwerror(v, _SC("json: nesting too deep (is there a cycle?)"));
+        return false;
+    }
+    if (SQ_FAILED(sq_reservestack(v, 3)) || !_json_putc(w, table ? '{' : '[')) {
+        return false;
+    }
+    w->depth++;
+    bool first = true;
+    sq_pushnull(v);
+    while (SQ_SUCCEEDED(sq_next(v, idx))) {
+        if (!first && !_json_putc(w, ',')) {
+            return false;
+        }
+        first = false;
+        if (table) {
+            const SQChar *key;
+            SQInteger keylen;
+            if (sq_gettype(v, -2) != OT_STRING) {
+                sq_throwerror(v, _SC("json: table keys must be strings"));
+                return false;
+            }
+            sq_getstringandsize(v, -2, &key, &keylen);
+            if (!_json_writestring(w, key, keylen) || !_json_putc(w, ':')) {
+                return false;
+            }
+        }
+        if (!_json_writevalue(w, sq_gettop(v))) {
+            return false;
+        }
+        sq_pop(v, 2);
+    }
+    sq_pop(v, 1);
+    w->depth--;
+    return _json_putc(w, table ? '}' : ']');
+}
+
+static bool _json_writevalue(JSONWriter *w, SQInteger idx)
+{
+    HSQUIRRELVM v = w->v;
+    switch (sq_gettype(v, idx)) {
+    case OT_NULL:
+        return _json_put(w, "null", 4);
+    case OT_BOOL: {
+        SQBool b;
+        sq_getbool(v, idx, &b);
+        return b ? _json_put(w, "true", 4) : _json_put(w, "false", 5);
+    }
+    case OT_INTEGER: {
+        SQInteger i;
+        char tmp[24];
+        sq_getinteger(v, idx, &i);
+        return _json_put(w, tmp, snprintf(tmp, sizeof(tmp), "%lld", (long long)i));
+    }
+    case OT_FLOAT: {
+        SQFloat f;
+        sq_getfloat(v, idx, &f);
+        return _json_writefloat(w, f);
+    }
+    case OT_STRING: {
+        const SQChar *s;
+        SQInteger n;
+        sq_getstringandsize(v, idx, &s, &n);
+        return _json_writestring(w, s, n);
+    }
+    case OT_TABLE:
+    case OT_ARRAY:
+        return _json_writecontainer(w, idx);
+    default:
+        sq_throwerror(v, _SC("json: only null, bools, numbers, strings, tables and arrays can be encoded"));
+        return false;
+    }
+}
+
+static SQInteger _json_encode(HSQUIRRELVM v)
+{
+    JSONWriter w;
+    w.v = v;
+    w.out = NULL;
+    w.len = 0;
+    w.cap = JSON_CHUNK;
+    w.depth = 0;
+    if (sq_gettop(v) > 2) {
+        SQUserPointer p;
+        if (SQ_FAILED(sq_getinstanceup(v, 3, &p, (SQUserPointer)((SQUnsignedInteger)SQSTD_STREAM_TYPE_TAG), SQFalse))
+            || !p || !((SQStream *)p)->IsValid()) {
+            return sq_throwerror(v, _SC("json: expected a stream"));
+        }
+        w.out = (SQStream *)p;
+    }
+    w.buf = (char *)sq_malloc(w.cap);
+    bool const ok = _json_writevalue(&w, 2) && (!w.out || _json_flush(&w));
+    if (ok && !w.out) {
+        sq_pushstring(v, w.buf, w.len);
+    }
+    sq_free(w.buf, w.cap);
+    if (!ok) {
+        return SQ_ERROR;
+    }
+    if (w.out) {
+        sq_push(v, 3);
+    }
+    return 1;
+}
+
+#define _DECL_JSON_FUNC(name,nparams,typecheck) {_SC(#name),_json_##name,nparams,typecheck}
+static const SQRegFunction jsonlib_funcs[]={
+    _DECL_JSON_FUNC(decode,-2,_SC(".s|xb")),
+    _DECL_JSON_FUNC(encode,-2,_SC("..x")),
+    {NULL,(SQFUNCTION)0,0,NULL}
+};
+#undef _DECL_JSON_FUNC
+
+SQRESULT sqstd_register_jsonlib(HSQUIRRELVM v)
+{
+    sq_pushstring(v,_SC("json"),-1);
+    sq_newtable(v);
+    SQInteger i=0;
+    while(jsonlib_funcs[i].name!=0)
+    {
+        sq_pushstring(v,jsonlib_funcs[i].name,-1);
+        sq_newclosure(v,jsonlib_funcs[i].f,0);
+        sq_setparamscheck(v,jsonlib_funcs[i].nparamscheck,jsonlib_funcs[i].typemask);
+        sq_setnativeclosurename(v,-1,jsonlib_funcs[i].name);
+        sq_newslot(v,-3,SQFalse);
+        i++;
+    }
+    sq_newslot(v,-3,SQFalse);
+    return SQ_OK;
+}
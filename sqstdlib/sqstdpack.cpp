@@ -0,0 +1,437 @@
+/* see copyright notice in squirrel.h */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <squirrel.h>
+#include "sqstdpack.h"
+
+// Struct-style binary records. A format is an optional byte order
+// ('<' little, '>' or '!' big, '=' or '@' native) followed by fields, each
+// an optional count, a code and an optional name in parentheses:
+//
+//   x pad byte      b B int8    h H int16    i I l L int32    q Q int64
+//   f float32       d float64   ? bool       s string of count bytes
+//
+// No alignment padding is ever inserted. An unnamed field with a count
+// stands for that many values; a named field with a count other than 1
+// holds an array. Named records are packed from and unpacked into tables.
+// Formats are compiled once and cached in the registry.
+
+#define PACK_MAX_CACHED 256
+#define PACK_MAX_COUNT (1 << 24)
+// values unpacked onto the stack before they are gathered into an array
+#define PACK_MAX_PUSHED 64
+
+struct SQPackField {
+    SQInteger count;    // values, or bytes for 's' and 'x'
+    SQInteger name;     // offset in the names, -1 if unnamed
+    SQInteger namelen;
+    char code;
+    uint8_t width;      // bytes of one value
+};
+
+struct SQPackFormat {
+    SQPackField *fields;
+    char *names;
+    SQInteger nfields;
+    SQInteger size;
+    SQInteger nvalues;  // values of an unnamed record, fields of a named one
+    bool big;
+    bool named;
+};
+
+static bool _pack_hostbig()
+{
+    uint16_t const one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 0;
+}
+
+static int _pack_width(char code)
+{
+    switch (code) {
+    case 'x': case 'b': case 'B': case '?': case 's':
+        return 1;
+    case 'h': case 'H':
+        return 2;
+    case 'i': case 'I': case 'l': case 'L': case 'f':
+        return 4;
+    case 'q': case 'Q': case 'd':
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static void _pack_store(unsigned char *out, uint64_t u, int width, bool big)
+{
+    for (int i = 0; i < width; i++) {
+        out[big ? width - 1 - i : i] = (unsigned char)(u >> (i * 8));
+    }
+}
+
+static uint64_t _pack_load(const unsigned char *in, int width, bool big)
+{
+    uint64_t u = 0;
+    for (int i = 0; i < width; i++) {
+        u |= (uint64_t)in[big ? width - 1 - i : i] << (i * 8);
+    }
+    return u;
+}
+
+static SQRESULT _pack_error(HSQUIRRELVM v, const char *what, const char *detail, SQInteger len)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s%.*s", what, (int)len, detail);
+    return sq_throwerror(v, buf);
+}
+
+// pushes the compiled format as a userdata
+static SQRESULT _pack_compile(HSQUIRRELVM v, const SQChar *s, SQInteger len, SQPackFormat **out)
+{
+    // a field takes at least one character of the format
+    SQPackFormat *fmt = (SQPackFormat *)sq_newuserdata(v, sizeof(SQPackFormat) + len * (sizeof(SQPackField) + 1));
+    fmt->fields = (SQPackField *)(fmt + 1);
+    fmt->names = (char *)(fmt->fields + len);
+    fmt->nfields = 0;
+    fmt->size = 0;
+    fmt->nvalues = 0;
+    fmt->big = _pack_hostbig();
+    fmt->named = false;
+
+    const SQChar *p = s;
+    const SQChar *end = s + len;
+    if (p < end) {
+        switch (*p) {
+        case '<': fmt->big = false; p++; break;
+        case '>': case '!': fmt->big = true; p++; break;
+        case '=': case '@': p++; break;
+        }
+    }
+    SQInteger nnames = 0;
+    SQInteger nnamed = 0;
+    SQInteger nvaluefields = 0;
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+            continue;
+        }
+        SQInteger count = 1;
+        if (*p >= '0' && *p <= '9') {
+            for (count = 0; p < end && *p >= '0' && *p <= '9'; p++) {
+                count = count * 10 + (*p - '0');
+                if (count > PACK_MAX_COUNT) {
+                    return sq_throwerror(v, _SC("count too large in format"));
+                }
+            }
+            if (p == end) {
+                return sq_throwerror(v, _SC("missing format code after a count"));
+            }
+        }
+        char const code = *p;
+        int const width = _pack_width(code);
+        if (!width) {
+            return _pack_error(v, "invalid format code ", p, 1);
+        }
+        p++;
+
+        SQPackField &f = fmt->fields[fmt->nfields++];
+        f.code = code;
+        f.width = (uint8_t)width;
+        f.count = count;
+        f.name = -1;
+        f.namelen = 0;
+        if (p < end && *p == '(') {
+            const SQChar *name = ++p;
+            while (p < end && *p != ')') {
+                p++;
+            }
+            if (p == end || p == name || code == 'x') {
+                return sq_throwerror(v, _SC("invalid field name in format"));
+            }
+            f.name = nnames;
+            f.namelen = p - name;
+            memcpy(fmt->names + nnames, name, f.namelen);
+            nnames += f.namelen;
+            nnamed++;
+            p++;
+        }
+        fmt->size += count * width;
+        if (code != 'x') {
+            fmt->nvalues += code == 's' ? 1 : count;
+            nvaluefields++;
+        }
+    }
+    if (nnamed) {
+        if (nnamed != nvaluefields) {
+            return sq_throwerror(v, _SC("either all or none of the fields must be named"));
+        }
+        fmt->named = true;
+        fmt->nvalues = nnamed;
+    }
+    *out = fmt;
+    return SQ_OK;
+}
+
+SQPackFormat *pack_format(HSQUIRRELVM v, SQInteger idx)
+{
+    SQInteger const top = sq_gettop(v);
+    if (idx < 0) {
+        idx = top + idx + 1;
+    }
+    SQPackFormat *fmt = NULL;
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_packformats"), -1);
+    if (SQ_FAILED(sq_rawget(v, -2))) {
+        sq_pushstring(v, _SC("std_packformats"), -1);
+        sq_newtable(v);
+        sq_newslot(v, -3, SQFalse);
+        sq_pushstring(v, _SC("std_packformats"), -1);
+        sq_rawget(v, -2);
+    }
+    sq_push(v, idx);
+    if (SQ_SUCCEEDED(sq_rawget(v, -2))) {
+        sq_getuserdata(v, -1, (SQUserPointer *)&fmt, NULL);
+        sq_settop(v, top);
+        return fmt;
+    }
+
+    // formats built on the fly would otherwise grow the cache for good
+    if (sq_getsize(v, -1) >= PACK_MAX_CACHED) {
+        sq_clear(v, -1);
+    }
+    const SQChar *s;
+    SQInteger len;
+    sq_getstringandsize(v, idx, &s, &len);
+    sq_push(v, idx);
+    if (SQ_SUCCEEDED(_pack_compile(v, s, len, &fmt))) {
+        sq_newslot(v, -3, SQFalse);
+    } else {
+        fmt = NULL;
+    }
+    sq_settop(v, top);
+    return fmt;
+}
+
+SQInteger pack_size(const SQPackFormat *fmt)
+{
+    return fmt->size;
+}
+
+static SQRESULT _pack_put(HSQUIRRELVM v, const SQPackField &f, bool big, SQInteger idx, unsigned char *out)
+{
+    switch (f.code) {
+    case 's': {
+        const SQChar *s;
+        SQInteger n;
+        if (SQ_FAILED(sq_getstringandsize(v, idx, &s, &n))) {
+            break;
+        }
+        if (n > f.count) {
+            n = f.count;
+        }
+        memcpy(out, s, n);
+        memset(out + n, 0, f.count - n);
+        return SQ_OK;
+    }
+    case 'f': {
+        SQFloat x;
+        if (SQ_FAILED(sq_getfloat(v, idx, &x))) {
+            break;
+        }
+        float const y = (float)x;
+        uint32_t u;
+        memcpy(&u, &y, 4);
+        _pack_store(out, u, 4, big);
+        return SQ_OK;
+    }
+    case 'd': {
+        SQFloat x;
+        if (SQ_FAILED(sq_getfloat(v, idx, &x))) {
+            break;
+        }
+        double const y = (double)x;
+        uint64_t u;
+        memcpy(&u, &y, 8);
+        _pack_store(out, u, 8, big);
+        return SQ_OK;
+    }
+    default: {
+        SQInteger i;
+        if (SQ_FAILED(sq_getinteger(v, idx, &i))) {
+            break;
+        }
+        if (f.code == '?') {
+            i = i != 0;
+        }
+        _pack_store(out, (uint64_t)i, f.width, big);
+        return SQ_OK;
+    }
+    }
+    return _pack_error(v, "invalid value for format code ", &f.code, 1);
+}
+
+SQRESULT pack_write(HSQUIRRELVM v, const SQPackFormat *fmt, SQInteger first, SQInteger nargs, unsigned char *out)
+{
+    if (fmt->named) {
+        if (nargs != 1 || (sq_gettype(v, first) != OT_TABLE && sq_gettype(v, first) != OT_INSTANCE)) {
+            return sq_throwerror(v, _SC("expected a table of fields"));
+        }
+    } else if (nargs != fmt->nvalues) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "expected %lld values, got %lld", (long long)fmt->nvalues, (long long)nargs);
+        return sq_throwerror(v, buf);
+    }
+    if (SQ_FAILED(sq_reservestack(v, 3))) {
+        return SQ_ERROR;
+    }
+
+    SQInteger arg = first;
+    for (SQInteger i = 0; i < fmt->nfields; i++) {
+        const SQPackField &f = fmt->fields[i];
+        if (f.code == 'x') {
+            memset(out, 0, f.count);
+            out += f.count;
+            continue;
+        }
+        SQInteger const n = f.code == 's' ? 1 : f.count;
+        SQInteger const step = f.code == 's' ? f.count : f.width;
+        if (!fmt->named) {
+            for (SQInteger k = 0; k < n; k++, out += step) {
+                if (SQ_FAILED(_pack_put(v, f, fmt->big, arg++, out))) {
+                    return SQ_ERROR;
+                }
+            }
+            continue;
+        }
+
+        sq_pushstring(v, fmt->names + f.name, f.namelen);
+        if (SQ_FAILED(sq_rawget(v, first))) {
+            return _pack_error(v, "missing field ", fmt->names + f.name, f.namelen);
+        }
+        if (n == 1) {
+            if (SQ_FAILED(_pack_put(v, f, fmt->big, -1, out))) {
+                return SQ_ERROR;
+            }
+            out += step;
+        } else {
+            if (sq_gettype(v, -1) != OT_ARRAY || sq_getsize(v, -1) != n) {
+                return _pack_error(v, "wrong array size for field ", fmt->names + f.name, f.namelen);
+            }
+            for (SQInteger k = 0; k < n; k++, out += step) {
+                sq_pushinteger(v, k);
+                sq_rawget(v, -2);
+                if (SQ_FAILED(_pack_put(v, f, fmt->big, -1, out))) {
+                    return SQ_ERROR;
+                }
+                sq_poptop(v);
+            }
+        }
+        sq_poptop(v);
+    }
+    return SQ_OK;
+}
+
+static void _pack_get(HSQUIRRELVM v, const SQPackField &f, bool big, const unsigned char *in)
+{
+    if (f.code == 's') {
+        sq_pushstring(v, (const SQChar *)in, f.count);
+        return;
+    }
+    uint64_t const u = _pack_load(in, f.width, big);
+    switch (f.code) {
+    case 'f': {
+        uint32_t const bits = (uint32_t)u;
+        float x;
+        memcpy(&x, &bits, 4);
+        sq_pushfloat(v, (SQFloat)x);
+        break;
+    }
+    case 'd': {
+        double x;
+        memcpy(&x, &u, 8);
+        sq_pushfloat(v, (SQFloat)x);
+        break;
+    }
+    case '?':
+        sq_pushbool(v, u != 0);
+        break;
+    case 'b': case 'h': case 'i': case 'l': case 'q': {
+        int const shift = 64 - f.width * 8;
+        sq_pushinteger(v, (SQInteger)((int64_t)(u << shift) >> shift));
+        break;
+    }
+    default:
+        sq_pushinteger(v, (SQInteger)u);
+        break;
+    }
+}
+
+// pushes n values of f as an array; larger runs are appended one by one
+// so that the stack stays small
+static SQRESULT _pack_getarray(HSQUIRRELVM v, const SQPackField &f, bool big, const unsigned char *in, SQInteger n, SQInteger step)
+{
+    if (n > PACK_MAX_PUSHED) {
+        sq_newarray(v, 0);
+        for (SQInteger k = 0; k < n; k++, in += step) {
+            _pack_get(v, f, big, in);
+            sq_arrayappend(v, -2);
+        }
+        return SQ_OK;
+    }
+    if (SQ_FAILED(sq_reservestack(v, n))) {
+        return SQ_ERROR;
+    }
+    for (SQInteger k = 0; k < n; k++, in += step) {
+        _pack_get(v, f, big, in);
+    }
+    return sq_newarrayfrom(v, n);
+}
+
+SQRESULT pack_read(HSQUIRRELVM v, const SQPackFormat *fmt, const unsigned char *in)
+{
+    bool const append = !fmt->named && fmt->nvalues > PACK_MAX_PUSHED;
+    if (fmt->named) {
+        sq_newtableex(v, fmt->nvalues);
+    } else if (append) {
+        sq_newarray(v, 0);
+    } else if (SQ_FAILED(sq_reservestack(v, fmt->nvalues))) {
+        return SQ_ERROR;
+    }
+    for (SQInteger i = 0; i < fmt->nfields; i++) {
+        const SQPackField &f = fmt->fields[i];
+        if (f.code == 'x') {
+            in += f.count;
+            continue;
+        }
+        SQInteger const n = f.code == 's' ? 1 : f.count;
+        SQInteger const step = f.code == 's' ? f.count : f.width;
+        if (!fmt->named) {
+            for (SQInteger k = 0; k < n; k++, in += step) {
+                _pack_get(v, f, fmt->big, in);
+                if (append) {
+                    sq_arrayappend(v, -2);
+                }
+            }
+            continue;
+        }
+        if (SQ_FAILED(sq_reservestack(v, 2))) {
+            return SQ_ERROR;
+        }
+        sq_pushstring(v, fmt->names + f.name, f.namelen);
+        if (n == 1) {
+            _pack_get(v, f, fmt->big, in);
+        } else if (SQ_FAILED(_pack_getarray(v, f, fmt->big, in, n, step))) {
+            return SQ_ERROR;
+        }
+        in += n * step;
+        if (SQ_FAILED(sq_newslot(v, -3, SQFalse))) {
+            return SQ_ERROR;
+        }
+    }
+    if (!fmt->named && !append) {
+        return sq_newarrayfrom(v, fmt->nvalues);
+    }
+    return SQ_OK;
+}
@@ -0,0 +1,16 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQSTD_PACK_H_
+#define _SQSTD_PACK_H_
+
+struct SQPackFormat;
+
+// compiled form of the format string at idx, cached per format
+SQPackFormat *pack_format(HSQUIRRELVM v,SQInteger idx);
+// bytes of a record
+SQInteger pack_size(const SQPackFormat *fmt);
+// encodes the nargs values from stack index first on into out
+SQRESULT pack_write(HSQUIRRELVM v,const SQPackFormat *fmt,SQInteger first,SQInteger nargs,unsigned char *out);
+// pushes the record in as an array, or as a table if the fields are named
+SQRESULT pack_read(HSQUIRRELVM v,const SQPackFormat *fmt,const unsigned char *in);
+
+#endif /*_SQSTD_PACK_H_*/
@@ -0,0 +1,418 @@
+/* see copyright notice in squirrel.h */
+#include <new>
+#include <chrono>
+#include <thread>
+#include <string.h>
+#include <squirrel.h>
+#include <sqstdsched.h>
+
+// Cooperative scheduler over script threads. Every task runs in its own
+// thread VM with an instruction budget (sq_setbudget), so a task that
+// never yields is still suspended at its next loop back-edge or call once
+// the budget is spent and goes to the back of the run queue.
+
+#define SCHED_STACK_SIZE 64
+#define SCHED_DEFAULT_QUANTUM 10000
+
+enum SQTaskState {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_SLEEPING,
+    TASK_WAITING
+};
+
+struct SQSched;
+
+struct SQSchedTask {
+    SQSched *sched;
+    HSQUIRRELVM vm;     // NULL once the VM is torn down under the task
+    HSQOBJECT thread;
+    HSQOBJECT event;    // what wait() is waiting for
+    HSQOBJECT wakeval;  // what wait() returns
+    SQFloat wake;       // when sleep() ends
+    SQInteger nargs;    // arguments of the first run, -1 once started
+    SQTaskState state;
+};
+
+struct SQTaskList {
+    SQSchedTask **_vals;
+    SQUnsignedInteger _len;
+    SQUnsignedInteger _cap;
+
+    SQTaskList() : _vals(NULL), _len(0), _cap(0) {}
+
+    void push(SQSchedTask *t) {
+        if(_len == _cap) {
+            SQUnsignedInteger newcap = _cap ? _cap * 2 : 16;
+            _vals = (SQSchedTask **)sq_realloc(_vals, _cap * sizeof(SQSchedTask *), newcap * sizeof(SQSchedTask *));
+            _cap = newcap;
+        }
+        _vals[_len++] = t;
+    }
+    void release() {
+        if(_vals) sq_free(_vals, _cap * sizeof(SQSchedTask *));
+        _vals = NULL;
+        _len = _cap = 0;
+    }
+};
+
+struct SQSched {
+    SQTaskList ready;       // fifo, starts at readyhead
+    SQUnsignedInteger readyhead;
+    SQTaskList sleeping;    // min-heap on wake
+    SQTaskList waiting;
+    SQUnsignedInteger ntasks;
+    SQInteger quantum;
+    SQFloat slice;
+    bool running;
+
+    SQSched() : readyhead(0), ntasks(0), quantum(SCHED_DEFAULT_QUANTUM), slice(0), running(false) {}
+};
+
+static SQFloat _sched_now()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<SQFloat> >(steady_clock::now().time_since_epoch()).count();
+}
+
+static void _ready_push(SQSched *s, SQSchedTask *t)
+{
+    t->state = TASK_READY;
+    s->ready.push(t);
+}
+
+static SQSchedTask *_ready_pop(SQSched *s)
+{
+    SQSchedTask *t = s->ready._vals[s->readyhead++];
+    if(s->readyhead == s->ready._len) {
+        s->ready._len = s->readyhead = 0;
+    }
+    else if(s->readyhead > 64 && s->readyhead * 2 > s->ready._len) {
+        SQUnsignedInteger n = s->ready._len - s->readyhead;
+        memmove(s->ready._vals, s->ready._vals + s->readyhead, n * sizeof(SQSchedTask *));
+        s->ready._len = n;
+        s->readyhead = 0;
+    }
+    return t;
+}
+
+static void _sleep_push(SQSched *s, SQSchedTask *t)
+{
+    SQTaskList &h = s->sleeping;
+    h.push(t);
+    SQUnsignedInteger i = h._len - 1;
+    while(i > 0) {
+        SQUnsignedInteger p = (i - 1) / 2;
+        if(h._vals[p]->wake <= t->wake) break;
+        h._vals[i] = h._vals[p];
+        i = p;
+    }
+    h._vals[i] = t;
+}
+
+static SQSchedTask *_sleep_pop(SQSched *s)
+{
+    SQTaskList &h = s->sleeping;
+    SQSchedTask *top = h._vals[0];
+    SQSchedTask *last = h._vals[--h._len];
+    SQUnsignedInteger i = 0;
+    for(;;) {
+        SQUnsignedInteger c = i * 2 + 1;
+        if(c >= h._len) break;
+        if(c + 1 < h._len && h._vals[c + 1]->wake < h._vals[c]->wake) c++;
+        if(last->wake <= h._vals[c]->wake) break;
+        h._vals[i] = h._vals[c];
+        i = c;
+    }
+    if(h._len) h._vals[i] = last;
+    return top;
+}
+
+// drops the task and the references it holds, its thread last as that
+// may free the VM the references are released through
+static void _task_free(SQSchedTask *t)
+{
+    t->sched->ntasks--;
+    HSQUIRRELVM tv = t->vm;
+    if(tv) {
+        sq_release(tv, &t->event);
+        sq_release(tv, &t->wakeval);
+        sq_setvmreleasehook(tv, NULL);
+        sq_setforeignptr(tv, NULL);
+        sq_setbudget(tv, 0);
+        sq_release(tv, &t->thread);
+    }
+    sq_free(t, sizeof(SQSchedTask));
+}
+
+// The scheduler pins its threads, so they only go away with the shared
+// state, possibly before the scheduler itself
+static SQInteger _task_vmreleasehook(SQUserPointer p, SQInteger SQ_UNUSED_ARG(size))
+{
+    ((SQSchedTask *)p)->vm = NULL;
+    return 1;
+}
+
+// runs t until it finishes, blocks, yields or uses up its slice
+static void _task_run(HSQUIRRELVM v, SQSched *s, SQSchedTask *t)
+{
+    HSQUIRRELVM tv = t->vm;
+    SQFloat start = s->slice > 0 ? _sched_now() : 0;
+    t->state = TASK_RUNNING;
+    for(;;) {
+        SQRESULT r;
+        sq_setbudget(tv, s->quantum);
+        if(t->nargs >= 0) {
+            r = sq_call(tv, t->nargs + 1, SQTrue, SQTrue);
+            t->nargs = -1;
+        }
+        else {
+            bool hasval = !sq_isnull(t->wakeval);
+            if(hasval) {
+                sq_pushobject(tv, t->wakeval);
+                sq_release(v, &t->wakeval);
+                sq_resetobject(&t->wakeval);
+            }
+            r = sq_wakeupvm(tv, hasval, SQTrue, SQTrue, SQFalse);
+        }
+        if(SQ_FAILED(r) || sq_getvmstate(tv) != SQ_VMSTATE_SUSPENDED) {
+            _task_free(t);
+            return;
+        }
+        sq_pop(tv, 1);
+        if(t->state != TASK_RUNNING) {
+            return; // sleep() or wait() already parked it
+        }
+        if(sq_getbudget(tv) != 0 || s->slice <= 0 || _sched_now() - start >= s->slice) {
+            break;
+        }
+    }
+    _ready_push(s, t);
+}
+
+static void _sched_wakesleepers(SQSched *s, SQFloat now)
+{
+    while(s->sleeping._len && s->sleeping._vals[0]->wake <= now) {
+        _ready_push(s, _sleep_pop(s));
+    }
+}
+
+// one pass over the tasks that are ready now
+static void _sched_round(HSQUIRRELVM v, SQSched *s)
+{
+    _sched_wakesleepers(s, _sched_now());
+    SQUnsignedInteger n = s->ready._len - s->readyhead;
+    while(n--) {
+        _task_run(v, s, _ready_pop(s));
+    }
+}
+
+static SQSched *_sched_self(HSQUIRRELVM v)
+{
+    SQUserPointer p = NULL;
+    sq_getuserdata(v, sq_gettop(v), &p, NULL);
+    return (SQSched *)p;
+}
+
+static SQSchedTask *_sched_current(HSQUIRRELVM v, SQSched *s)
+{
+    SQSchedTask *t = (SQSchedTask *)sq_getforeignptr(v);
+    if(!t || t->sched != s || t->vm != v || t->state != TASK_RUNNING) return NULL;
+    return t;
+}
+
+static SQInteger _sched_releasehook(SQUserPointer p, SQInteger SQ_UNUSED_ARG(size))
+{
+    SQSched *s = (SQSched *)p;
+    while(s->readyhead < s->ready._len) _task_free(_ready_pop(s));
+    for(SQUnsignedInteger i = 0; i < s->sleeping._len; i++) _task_free(s->sleeping._vals[i]);
+    for(SQUnsignedInteger i = 0; i < s->waiting._len; i++) _task_free(s->waiting._vals[i]);
+    s->ready.release();
+    s->sleeping.release();
+    s->waiting.release();
+    s->~SQSched();
+    return 1;
+}
+
+static SQInteger _sched_spawn(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    SQInteger nargs = sq_gettop(v) - 3; // this, func, ..., scheduler
+    HSQUIRRELVM tv = sq_newthread(v, SCHED_STACK_SIZE);
+    sq_move(tv, v, 2);
+    sq_pushroottable(tv);
+    for(SQInteger i = 0; i < nargs; i++) {
+        sq_move(tv, v, 3 + i);
+    }
+    SQSchedTask *t = (SQSchedTask *)sq_malloc(sizeof(SQSchedTask));
+    t->sched = s;
+    t->vm = tv;
+    sq_getstackobj(v, -1, &t->thread);
+    sq_addref(v, &t->thread);
+    sq_resetobject(&t->event);
+    sq_resetobject(&t->wakeval);
+    t->wake = 0;
+    t->nargs = nargs;
+    sq_setforeignptr(tv, t);
+    sq_setvmreleasehook(tv, _task_vmreleasehook);
+    s->ntasks++;
+    _ready_push(s, t);
+    return 1;
+}
+
+static SQInteger _sched_pass(HSQUIRRELVM v)
+{
+    if(!_sched_current(v, _sched_self(v)))
+        return sq_throwerror(v, _SC("pass() must be called from a running task"));
+    return sq_suspendvm(v);
+}
+
+static SQInteger _sched_sleep(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    SQSchedTask *t = _sched_current(v, s);
+    if(!t)
+        return sq_throwerror(v, _SC("sleep() must be called from a running task"));
+    SQFloat secs;
+    sq_getfloat(v, 2, &secs);
+    SQRESULT r = sq_suspendvm(v);
+    if(r == SQ_ERROR) return r;
+    t->state = TASK_SLEEPING;
+    t->wake = _sched_now() + secs;
+    _sleep_push(s, t);
+    return r;
+}
+
+static SQInteger _sched_wait(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    SQSchedTask *t = _sched_current(v, s);
+    if(!t)
+        return sq_throwerror(v, _SC("wait() must be called from a running task"));
+    SQRESULT r = sq_suspendvm(v);
+    if(r == SQ_ERROR) return r;
+    t->state = TASK_WAITING;
+    sq_getstackobj(v, 2, &t->event);
+    sq_addref(v, &t->event);
+    s->waiting.push(t);
+    return r;
+}
+
+static SQInteger _sched_signal(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    bool hasval = sq_gettop(v) > 3;
+    HSQOBJECT ev, val;
+    sq_getstackobj(v, 2, &ev);
+    sq_resetobject(&val);
+    if(hasval) sq_getstackobj(v, 3, &val);
+    SQInteger woken = 0;
+    SQUnsignedInteger kept = 0;
+    // wake in the order the tasks started waiting
+    for(SQUnsignedInteger i = 0; i < s->waiting._len; i++) {
+        SQSchedTask *t = s->waiting._vals[i];
+        if(sq_type(t->event) != sq_type(ev) || t->event._unVal.raw != ev._unVal.raw) {
+            s->waiting._vals[kept++] = t;
+            continue;
+        }
+        sq_release(v, &t->event);
+        sq_resetobject(&t->event);
+        t->wakeval = val;
+        sq_addref(v, &t->wakeval);
+        _ready_push(s, t);
+        woken++;
+    }
+    s->waiting._len = kept;
+    sq_pushinteger(v, woken);
+    return 1;
+}
+
+static SQInteger _sched_step(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    if(s->running)
+        return sq_throwerror(v, _SC("the scheduler is already running"));
+    s->running = true;
+    _sched_round(v, s);
+    s->running = false;
+    sq_pushinteger(v, (SQInteger)s->ntasks);
+    return 1;
+}
+
+static SQInteger _sched_run(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    if(s->running)
+        return sq_throwerror(v, _SC("the scheduler is already running"));
+    s->running = true;
+    while(s->ntasks) {
+        _sched_round(v, s);
+        // the tasks run under this native call, so their safe points never
+        // collect; between rounds every task is pinned by the scheduler
+        sq_collectifdue(v);
+        if(s->ready._len > s->readyhead) continue;
+        if(!s->sleeping._len) break; // only tasks waiting on events nobody will signal
+        SQFloat idle = s->sleeping._vals[0]->wake - _sched_now();
+        if(idle > 0) std::this_thread::sleep_for(std::chrono::duration<SQFloat>(idle));
+    }
+    s->running = false;
+    sq_pushinteger(v, (SQInteger)s->ntasks);
+    return 1;
+}
+
+static SQInteger _sched_setbudget(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_self(v);
+    SQInteger quantum;
+    sq_getinteger(v, 2, &quantum);
+    if(quantum <= 0)
+        return sq_throwerror(v, _SC("the budget must be positive"));
+    s->quantum = quantum;
+    s->slice = 0;
+    if(sq_gettop(v) > 3) sq_getfloat(v, 3, &s->slice);
+    return 0;
+}
+
+static SQInteger _sched_count(HSQUIRRELVM v)
+{
+    sq_pushinteger(v, (SQInteger)_sched_self(v)->ntasks);
+    return 1;
+}
+
+#define _DECL_FUNC(name,nparams,pmask) {_SC(#name),_sched_##name,nparams,pmask}
+static const SQRegFunction schedlib_funcs[]={
+    _DECL_FUNC(spawn,-2,_SC(".c")),
+    _DECL_FUNC(pass,1,NULL),
+    _DECL_FUNC(sleep,2,_SC(".n")),
+    _DECL_FUNC(wait,2,NULL),
+    _DECL_FUNC(signal,-2,NULL),
+    _DECL_FUNC(step,1,NULL),
+    _DECL_FUNC(run,1,NULL),
+    _DECL_FUNC(setbudget,-2,_SC(".nn")),
+    _DECL_FUNC(count,1,NULL),
+    {NULL,(SQFUNCTION)0,0,NULL}
+};
+#undef _DECL_FUNC
+
+SQRESULT sqstd_register_schedlib(HSQUIRRELVM v)
+{
+    sq_pushstring(v,_SC("sched"),-1);
+    sq_newtable(v);
+    // every function shares the scheduler state as its free variable
+    new (sq_newuserdata(v,sizeof(SQSched))) SQSched();
+    sq_setreleasehook(v,-1,_sched_releasehook);
+    SQInteger i=0;
+    while(schedlib_funcs[i].name!=0)
+    {
+        sq_pushstring(v,schedlib_funcs[i].name,-1);
+        sq_push(v,-2);
+        sq_newclosure(v,schedlib_funcs[i].f,1);
+        sq_setparamscheck(v,schedlib_funcs[i].nparamscheck,schedlib_funcs[i].typemask);
+        sq_setnativeclosurename(v,-1,schedlib_funcs[i].name);
+        sq_newslot(v,-4,SQFalse);
+        i++;
+    }
+    sq_pop(v,1);
+    sq_newslot(v,-3,SQFalse);
+    return SQ_OK;
+}
@@ -8,6 +8,7 @@
 #include <sqstdblob.h>
 #include "sqstdstream.h"
 #include "sqstdblobimpl.h"
+#include "sqstdpack.h"
 
 #define SETUP_STREAM(v) \
     SQStream *self = NULL; \
@@ -180,6 +181,37 @@ SQInteger _stream_writen(HSQUIRRELVM v)
     return 0;
 }
 
+SQInteger _stream_pack(HSQUIRRELVM v)
+{
+    SETUP_STREAM(v);
+    SQPackFormat *fmt = pack_format(v, 2);
+    if(!fmt)
+        return SQ_ERROR;
+    SQInteger size = pack_size(fmt);
+    unsigned char *buf = (unsigned char *)sq_getscratchpad(v, size);
+    if(SQ_FAILED(pack_write(v, fmt, 3, sq_gettop(v) - 2, buf)))
+        return SQ_ERROR;
+    if(self->Write(buf, size) != size)
+        return sq_throwerror(v, _SC("io error"));
+    sq_pushinteger(v, size);
+    return 1;
+}
+
+SQInteger _stream_unpack(HSQUIRRELVM v)
+{
+    SETUP_STREAM(v);
+    SQPackFormat *fmt = pack_format(v, 2);
+    if(!fmt)
+        return SQ_ERROR;
+    SQInteger size = pack_size(fmt);
+    unsigned char *buf = (unsigned char *)sq_getscratchpad(v, size);
+    if(self->Read(buf, size) != size)
+        return sq_throwerror(v, _SC("io error"));
+    if(SQ_FAILED(pack_read(v, fmt, buf)))
+        return SQ_ERROR;
+    return 1;
+}
+
 SQInteger _stream_seek(HSQUIRRELVM v)
 {
     SETUP_STREAM(v);
@@ -243,6 +275,8 @@ static const SQRegFunction _stream_methods[] = {
     _DECL_STREAM_FUNC(readn,2,_SC("xn")),
     _DECL_STREAM_FUNC(writeblob,-2,_SC("xx")),
     _DECL_STREAM_FUNC(writen,3,_SC("xnn")),
+    _DECL_STREAM_FUNC(pack,-2,_SC("xs")),
+    _DECL_STREAM_FUNC(unpack,2,_SC("xs")),
     _DECL_STREAM_FUNC(seek,-2,_SC("xnn")),
     _DECL_STREAM_FUNC(tell,1,_SC("x")),
     _DECL_STREAM_FUNC(len,1,_SC("x")),
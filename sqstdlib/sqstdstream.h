@@ -7,6 +7,8 @@ SQInteger _stream_readline(HSQUIRRELVM v);
 SQInteger _stream_readn(HSQUIRRELVM v);
 SQInteger _stream_writeblob(HSQUIRRELVM v);
 SQInteger _stream_writen(HSQUIRRELVM v);
+SQInteger _stream_pack(HSQUIRRELVM v);
+SQInteger _stream_unpack(HSQUIRRELVM v);
 SQInteger _stream_seek(HSQUIRRELVM v);
 SQInteger _stream_tell(HSQUIRRELVM v);
 SQInteger _stream_len(HSQUIRRELVM v);
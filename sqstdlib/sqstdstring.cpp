@@ -12,7 +12,9 @@
 #define MAX_WFORMAT_LEN 3
 #define ADDITIONAL_FORMAT_SPACE (100*sizeof(SQChar))
 
-static SQUserPointer rex_typetag = NULL;
+// address-only tag, so the library keeps no mutable globals
+static const char rex_typetag_anchor = 0;
+#define rex_typetag ((SQUserPointer)&rex_typetag_anchor)
 
 static SQBool isfmtchr(SQChar ch)
 {
@@ -524,7 +526,6 @@ SQInteger sqstd_register_stringlib(HSQUIRRELVM v)
 {
     sq_pushstring(v,_SC("regexp"),-1);
     sq_newclass(v,SQFalse);
-	rex_typetag = (SQUserPointer)rexobj_funcs;
 	sq_settypetag(v, -1, rex_typetag);
     SQInteger i = 0;
     while(rexobj_funcs[i].name != 0) {
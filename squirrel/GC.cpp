@@ -1,5 +1,7 @@
 #include "GC.hpp"
 
+#include <limits>
+
 #include "SQArray.hpp"
 #include "SQClass.hpp"
 #include "SQClosure.hpp"
@@ -60,20 +62,74 @@ void GC::MarkObject(SQObjectPtr & o, SQCollectable ** chain) {
 }
 #endif
 
+#define SQ_GC_DEFAULT_GROWTH 100
+#define SQ_GC_DEFAULT_MINHEAP (4 << 20)
+
 GC::GC()
     : string_table()
+    , stringbytes(0)
 #ifndef NO_GARBAGE_COLLECTOR
     , chain_root(nullptr)
 #endif
-{}
+    , params()
+    , stats()
+    , due(false)
+{
+    params.growth = SQ_GC_DEFAULT_GROWTH;
+    params.minheap = SQ_GC_DEFAULT_MINHEAP;
+    params.maxpause = 0;
+    stats.threshold = params.minheap;
+}
 
 GC::~GC() {
 }
 
+void GC::SetParams(SQGCParams const & p) {
+    params.growth = p.growth > 0 ? p.growth : 0;
+    params.minheap = p.minheap > 0 ? p.minheap : 0;
+    params.maxpause = p.maxpause > 0 ? p.maxpause : 0;
+    CountStrings();
+    Pace(0);
+}
+
+void GC::Collected(SQInteger freed, SQInteger pause, bool automatic) {
+    stats.collections++;
+    stats.autocollections += automatic ? 1 : 0;
+    stats.freed += freed;
+    stats.lastpause = pause;
+    stats.totalpause += pause;
+    CountStrings();
+    Pace(automatic ? pause : 0);
+}
+
+void GC::Pace(SQInteger pause) {
+    SQInteger const unlimited = std::numeric_limits<SQInteger>::max();
+    if (params.growth == 0) {
+        stats.threshold = unlimited;
+        due = false;
+        return;
+    }
+    SQFloat next = SQFloat(stats.livebytes) * SQFloat(100 + params.growth) / 100;
+    // a pause over the limit means the heap is collected too eagerly for
+    // its size, stretch the interval in proportion
+    if (params.maxpause && pause > params.maxpause) {
+        next = next * SQFloat(pause) / SQFloat(params.maxpause);
+    }
+    if (next < SQFloat(params.minheap)) {
+        next = SQFloat(params.minheap);
+    }
+    stats.threshold = next >= SQFloat(unlimited) ? unlimited : SQInteger(next);
+    due = stats.livebytes > stats.threshold;
+}
+
 SQString * GC::AddString(char const * string, size_t length) {
-    return this->string_table.Add(string, length);
+    SQString * const s = this->string_table.Add(string, length);
+    CountStrings();
+    return s;
 }
 
 SQString * GC::ConcatStrings(char const * string_a, size_t length_a, char const * string_b, size_t length_b) {
-    return this->string_table.Concat(string_a, length_a, string_b, length_b);
+    SQString * const s = this->string_table.Concat(string_a, length_a, string_b, length_b);
+    CountStrings();
+    return s;
 }
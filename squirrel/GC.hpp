@@ -12,15 +12,57 @@ public:
 
 private:
     SQStringTable string_table;
+    // string table bytes last counted in stats.livebytes
+    size_t stringbytes;
 
 public:
 #ifndef NO_GARBAGE_COLLECTOR
     SQCollectable * chain_root;
 #endif
 
+    // Pacing: the bytes held by collectable objects and their buffers are
+    // counted as they are created, resized and released, a collection is
+    // due once they pass threshold. Strings are counted as they are added
+    // and again before pacing, to pick up the ones released since.
+    // It then runs at the next safe point of a VM with no native frames.
+    SQGCParams params;
+    SQGCStats stats;
+    bool due;
+
     GC();
     ~GC();
 
+    void Allocated(size_t size) {
+        stats.livebytes += SQInteger(size);
+        if (stats.livebytes > stats.threshold) {
+            due = true;
+        }
+    }
+
+    void Freed(size_t size) {
+        stats.livebytes -= SQInteger(size);
+    }
+
+    void SetParams(SQGCParams const & p);
+
+    void CountStrings() {
+        size_t const bytes = string_table.Bytes();
+        if (bytes > stringbytes) {
+            Allocated(bytes - stringbytes);
+        } else {
+            Freed(stringbytes - bytes);
+        }
+        stringbytes = bytes;
+    }
+
+    // called after each collection, pause in microseconds
+    void Collected(SQInteger freed, SQInteger pause, bool automatic);
+private:
+    void Pace(SQInteger pause);
+public:
+
+    SQStringTable const & Strings() const { return string_table; }
+
     SQString * AddString(char const * string, size_t length);
     SQString * ConcatStrings(char const * string_a, size_t length_a, char const * string_b, size_t length_b);
 };
@@ -10,6 +10,10 @@ RefTable::RefTable()
     , _nodes(nullptr)
     , _freelist(nullptr)
     , _buckets(nullptr)
+    , _handles()
+    , _handlelive()
+    , _freehandles()
+    , _finalized(false)
 {
     AllocNodes(4);
 }
@@ -19,15 +23,23 @@ RefTable::~RefTable() {
 }
 
 void RefTable::Finalize() {
+    _finalized = true;
     RefNode * nodes = _nodes;
 
     for (SQUnsignedInteger n = 0; n < _numofslots; n++) {
         nodes->obj.Null();
         nodes++;
     }
+
+    for (size_t n = 0; n < _handles.size(); n++) {
+        _handles[n].Null();
+    }
 }
 
 SQBool RefTable::Release(SQObject & obj) {
+    if (_finalized) {
+        return SQFalse;
+    }
     SQHash mainpos;
     RefNode *prev;
     RefNode *ref = Get(obj,mainpos,&prev,false);
@@ -44,7 +56,9 @@ SQBool RefTable::Release(SQObject & obj) {
             _freelist = ref;
             _slotused--;
             ref->obj.Null();
-            //<<FIXME>>test for shrink?
+            if (_numofslots > 4 && _slotused <= _numofslots >> 2) {
+                Resize(_numofslots >> 1);
+            }
             return SQTrue;
         }
     }
@@ -63,6 +77,10 @@ void RefTable::Mark(SQCollectable **chain) {
         }
         nodes++;
     }
+
+    for (size_t n = 0; n < _handles.size(); n++) {
+        GC::MarkObject(_handles[n], chain);
+    }
 }
 #endif
 
@@ -82,6 +100,29 @@ SQUnsignedInteger RefTable::GetRefCount(SQObject &obj)
      return ref->refs;
 }
 
+SQUnsignedInteger RefTable::NewHandle(SQObject const & obj) {
+    if (_freehandles.size()) {
+        SQUnsignedInteger const handle = _freehandles.back();
+        _freehandles.pop_back();
+        _handles[handle - 1] = obj;
+        _handlelive[handle - 1] = true;
+        return handle;
+    }
+    _handles.push_back(obj);
+    _handlelive.push_back(true);
+    return _handles.size();
+}
+
+bool RefTable::FreeHandle(SQUnsignedInteger handle) {
+    if (!IsHandle(handle)) {
+        return false;
+    }
+    _handles[handle - 1].Null();
+    _handlelive[handle - 1] = false;
+    _freehandles.push_back(handle);
+    return true;
+}
+
 void RefTable::Resize(SQUnsignedInteger size)
 {
     RefNode **oldbucks = _buckets;
@@ -89,7 +130,6 @@ void RefTable::Resize(SQUnsignedInteger size)
     SQUnsignedInteger oldnumofslots = _numofslots;
     AllocNodes(size);
     //rehash
-    SQUnsignedInteger nfound = 0;
     for(SQUnsignedInteger n = 0; n < oldnumofslots; n++) {
         if(sq_type(t->obj) != OT_NULL) {
             //add back;
@@ -97,12 +137,9 @@ void RefTable::Resize(SQUnsignedInteger size)
             RefNode *nn = Add(::HashObj(t->obj)&(_numofslots-1),t->obj);
             nn->refs = t->refs;
             t->obj.Null();
-            nfound++;
         }
         t++;
     }
-    (void)nfound;
-    assert(nfound == oldnumofslots);
     sq_vm_free(oldbucks,(oldnumofslots * sizeof(RefNode *)) + (oldnumofslots * sizeof(RefNode)));
 }
 
@@ -2,6 +2,7 @@
 
 #include "SQCollectable.hpp"
 #include "sqobject.h"
+#include "sqvector.hpp"
 
 struct RefTable {
 private:
@@ -16,6 +17,13 @@ private:
     RefNode *_nodes;
     RefNode *_freelist;
     RefNode **_buckets;
+    // handles are indices into _handles plus one, 0 is never a handle
+    sqvector<SQObjectPtr> _handles;
+    sqvector<bool> _handlelive; // cleared while the handle is free
+    sqvector<SQUnsignedInteger> _freehandles;
+    // set once the shared state drops every reference, release hooks that
+    // run from there on find their objects gone
+    bool _finalized;
 public:
     RefTable();
     ~RefTable();
@@ -26,11 +34,31 @@ public:
 
     SQUnsignedInteger GetRefCount(SQObject &obj);
 
+    // Each handle is a strong reference of its own, created and dropped in
+    // constant time. Freed handles are reused.
+    SQUnsignedInteger NewHandle(SQObject const & obj);
+
+    // true if handle came from NewHandle and was not freed since
+    bool IsHandle(SQUnsignedInteger handle) const {
+        return handle && handle <= _handles.size() && _handlelive[handle - 1];
+    }
+
+    SQObjectPtr & GetHandle(SQUnsignedInteger handle) {
+        assert(IsHandle(handle));
+        return _handles[handle - 1];
+    }
+
+    // false, and nothing changes, if handle is not live
+    bool FreeHandle(SQUnsignedInteger handle);
+
 #ifndef NO_GARBAGE_COLLECTOR
     void Mark(SQCollectable **chain);
 #endif
 
     void Finalize();
+
+    SQUnsignedInteger Count() const { return _slotused + _handles.size() - _freehandles.size(); }
+    SQUnsignedInteger Slots() const { return _numofslots + _handles.size(); }
 private:
     RefNode *Get(SQObject &obj,SQHash &mainpos,RefNode **prev,bool add);
     RefNode *Add(SQHash mainpos,SQObject &obj);
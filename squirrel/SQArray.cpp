@@ -1,23 +1,133 @@
 #include "SQArray.hpp"
 
+#include <algorithm>
+
 #include "GC.hpp"
 #include "sqstate.h"
 
 void SQArray::Extend(SQArray const * a) {
-    size_t const xlen = a->_values.size();
-    if (xlen) {
-        for (size_t i = 0; i < xlen; i++) {
+    size_t const xlen = a->Size();
+    if (!xlen) {
+        return;
+    }
+
+    if (a->_kind != OT_NULL) {
+        size_t const before = MemSize();
+        Prepare(a->_kind);
+        if (_kind == a->_kind) {
+            // reserve first, a may be this array
+            if (_raw.size() + xlen > _raw.capacity()) {
+                _raw.reserve(_raw.size() + xlen);
+            }
+            for (size_t i = 0; i < xlen; i++) {
+                _raw.push_back(a->_raw[i]);
+            }
+            Resized(before);
+            return;
+        }
+        Resized(before);
+    }
+
+    for (size_t i = 0; i < xlen; i++) {
+        if (a->_kind == OT_NULL) {
             Append(a->_values[i]);
+        } else {
+            Append(a->Unboxed(i));
         }
     }
 }
 
+bool SQArray::SortUnboxed() {
+    SQObjectValue * const first = _raw._vals;
+    size_t const n = _raw.size();
+    switch (_kind) {
+    case OT_INTEGER:
+        std::sort(first, first + n, [](SQObjectValue const & a, SQObjectValue const & b) {
+            return a.nInteger < b.nInteger;
+        });
+        return true;
+    case OT_FLOAT:
+        for (size_t i = 0; i < n; i++) {
+            if (first[i].fFloat != first[i].fFloat) {
+                return false;
+            }
+        }
+        std::sort(first, first + n, [](SQObjectValue const & a, SQObjectValue const & b) {
+            return a.fFloat < b.fFloat;
+        });
+        return true;
+    default:
+        return false;
+    }
+}
+
+void SQArray::Generalize() {
+    if (_kind == OT_NULL) {
+        return;
+    }
+
+    SQObjectType const kind = _kind;
+    size_t const n = _raw.size();
+    sqvector<SQObjectValue> raw;
+    raw.swap(_raw);
+    // the inline area is about to hold the objects, copy the values out
+    SQObjectValue saved[SQ_ARRAY_INLINE * SQ_ARRAY_UNBOXED_PER_SLOT];
+    SQObjectValue const * src = raw._vals;
+    if (raw.isborrowed()) {
+        memcpy(saved, raw._vals, n * sizeof(SQObjectValue));
+        src = saved;
+    }
+
+    _raw.~sqvector<SQObjectValue>();
+    new (&_values) sqvector<SQObjectPtr>();
+    _kind = OT_NULL;
+    if (_ninline && n <= _ninline) {
+        _values.borrow((SQObjectPtr *)(this + 1), _ninline);
+    } else if (n) {
+        _values.reserve(n);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        SQObject o;
+        o._type = kind;
+        o._unVal = src[i];
+        _values.push_back(o);
+    }
+}
+
+void SQArray::Retype(SQObjectType kind) {
+    if (kind == _kind) {
+        return;
+    }
+    if (kind == OT_NULL) {
+        Generalize();
+        return;
+    }
+    if (_kind != OT_NULL) {
+        _kind = kind;
+        return;
+    }
+
+    size_t const cap = _values.capacity();
+    bool const inplace = _values.isborrowed();
+    _values.~sqvector<SQObjectPtr>();
+    new (&_raw) sqvector<SQObjectValue>();
+    _kind = kind;
+    if (inplace) {
+        _raw.borrow((SQObjectValue *)(this + 1), _ninline * SQ_ARRAY_UNBOXED_PER_SLOT);
+    } else if (cap) {
+        _raw.reserve(cap);
+    }
+}
+
 #ifndef NO_GARBAGE_COLLECTOR
 void SQArray::Mark(SQCollectable ** chain) {
     START_MARK()
-        size_t const len = _values.size();
-        for (size_t i = 0; i < len; i++) {
-            GC::MarkObject(_values[i], chain);
+        if (_kind == OT_NULL) {
+            size_t const len = _values.size();
+            for (size_t i = 0; i < len; i++) {
+                GC::MarkObject(_values[i], chain);
+            }
         }
     END_MARK()
 }
@@ -5,23 +5,57 @@
 #include "SQCollectable.hpp"
 #include "SQVM.hpp"
 
+// Arrays expected to hold at most this many values keep them inline,
+// right after the header, instead of in a separate allocation
+#define SQ_ARRAY_INLINE 4
+
+// Unboxed values fitting in the inline area of a SQObjectPtr
+#define SQ_ARRAY_UNBOXED_PER_SLOT (sizeof(SQObjectPtr) / sizeof(SQObjectValue))
+
+// Arrays whose values are all integers or all floats store them unboxed in
+// _raw, _kind being their type. Any other array is mixed (_kind is
+// OT_NULL) and stores full objects in _values. Storing a value of another
+// type generalizes the array for good, unless it is empty at the time.
 struct SQArray : public CHAINABLE_OBJ
 {
 private:
-    SQArray(SQSharedState * ss, size_t nsize)
+    SQArray(SQSharedState * ss, size_t nsize, size_t ninline)
         : CHAINABLE_OBJ(ss)
+        , _values()
+        , _ninline(uint32_t(ninline))
+        , _kind(OT_NULL)
     {
+        if (ninline) {
+            _values.borrow((SQObjectPtr *)(this + 1), ninline);
+        }
         _values.resize(nsize);
     }
+
+    ~SQArray() {
+        if (_kind == OT_NULL) {
+            _values.~sqvector<SQObjectPtr>();
+        } else {
+            _raw.~sqvector<SQObjectValue>();
+        }
+    }
 public:
-    static SQArray* Create(SQSharedState *ss,SQInteger nInitialSize){
-        SQArray * newarray = (SQArray*)sq_vm_malloc(sizeof(SQArray));
-        new (newarray) SQArray(ss, nInitialSize);
+    // nReserve is the number of values the array is expected to hold
+    static SQArray* Create(SQSharedState *ss,SQInteger nInitialSize,SQInteger nReserve = 0){
+        size_t const expected = size_t(nInitialSize > nReserve ? nInitialSize : nReserve);
+        size_t const ninline = expected <= SQ_ARRAY_INLINE ? (expected < 2 ? 2 : expected) : 0;
+        SQArray * newarray = (SQArray*)sq_vm_malloc(sizeof(SQArray) + ninline * sizeof(SQObjectPtr));
+        new (newarray) SQArray(ss, nInitialSize, ninline);
+        if (expected > newarray->_values.capacity()) {
+            newarray->_values.reserve(expected);
+        }
+        ss->gc.Allocated(newarray->MemSize());
         return newarray;
     }
 
     void Finalize() {
-        _values.resize(0);
+        if (_kind == OT_NULL) {
+            _values.resize(0);
+        }
     }
 
 #ifndef NO_GARBAGE_COLLECTOR
@@ -33,45 +67,73 @@ public:
 #endif
 
     bool Get(SQInteger const nidx, SQObjectPtr & val) {
-        if (SQUnsignedInteger(nidx) >= _values.size()) {
+        if (SQUnsignedInteger(nidx) >= Size()) {
             return false;
         }
 
-        SQObjectPtr & o = _values[nidx];
-        val = _realval(o);
+        if (_kind == OT_NULL) {
+            SQObjectPtr & o = _values[nidx];
+            val = _realval(o);
+        } else {
+            val = Unboxed(nidx);
+        }
         return true;
     }
 
     bool Set(SQInteger const nidx, SQObjectPtr const & val) {
-        if (SQUnsignedInteger(nidx) >= _values.size()) {
+        if (SQUnsignedInteger(nidx) >= Size()) {
             return false;
         }
 
+        if (sq_type(val) == _kind && _kind != OT_NULL) {
+            _raw[nidx] = val._unVal;
+            return true;
+        }
+        if (_kind != OT_NULL) {
+            size_t const before = MemSize();
+            Generalize();
+            Resized(before);
+        }
         _values[nidx] = val;
         return true;
     }
 
     SQInteger Next(SQObjectPtr const & refpos, SQObjectPtr & outkey, SQObjectPtr & outval) {
         SQUnsignedInteger idx = TranslateIndex(refpos);
-        if (idx >= _values.size()) {
+        if (!Get(SQInteger(idx), outval)) {
             return -1;
         }
 
         outkey = SQInteger(idx);
-        SQObjectPtr & o = _values[idx];
-        outval = _realval(o);
-
         return idx + 1;
     }
 
     SQArray * Clone() {
-        SQArray * anew = Create(_opt_ss(this), 0);
-        anew->_values.copy(_values);
+        SQArray * anew = Create(_opt_ss(this), 0, Size());
+        size_t const before = anew->MemSize();
+        if (_kind == OT_NULL) {
+            anew->_values.copy(_values);
+        } else {
+            anew->Retype(_kind);
+            anew->_raw.copy(_raw);
+        }
+        anew->Resized(before);
         return anew;
     }
 
     size_t Size() const {
-        return _values.size();
+        return _kind == OT_NULL ? _values.size() : _raw.size();
+    }
+
+    // bytes held by the array and its storage
+    size_t MemSize() {
+        size_t bytes = sizeof(SQArray) + _ninline * sizeof(SQObjectPtr);
+        if (_kind == OT_NULL) {
+            bytes += _values.isborrowed() ? 0 : _values.capacity() * sizeof(SQObjectPtr);
+        } else {
+            bytes += _raw.isborrowed() ? 0 : _raw.capacity() * sizeof(SQObjectValue);
+        }
+        return bytes;
     }
 
     void Resize(SQInteger size) {
@@ -80,56 +142,162 @@ public:
     }
 
     void Resize(SQInteger size,SQObjectPtr &fill) {
-        _values.resize(size,fill);
+        size_t const before = MemSize();
+        if (size_t(size) > Size()) {
+            Prepare(sq_type(fill));
+        }
+        if (_kind == OT_NULL) {
+            _values.resize(size,fill);
+        } else {
+            _raw.resize(size,fill._unVal);
+        }
+        Resized(before);
         ShrinkIfNeeded();
     }
 
     void Reserve(SQInteger size) {
-        _values.reserve(size);
+        size_t const before = MemSize();
+        if (_kind == OT_NULL) {
+            if (size_t(size) > _values.capacity()) {
+                _values.reserve(size);
+            }
+        } else if (size_t(size) > _raw.capacity()) {
+            _raw.reserve(size);
+        }
+        Resized(before);
     }
 
     void Append(const SQObject &o) {
-        _values.push_back(o);
+        size_t const before = MemSize();
+        if (sq_type(o) != _kind) {
+            Prepare(sq_type(o));
+        }
+        if (_kind == OT_NULL) {
+            _values.push_back(o);
+        } else {
+            _raw.push_back(o._unVal);
+        }
+        Resized(before);
     }
 
     void Extend(const SQArray *a);
 
-    SQObjectPtr &Top() {
-        return _values.top();
+    SQObjectPtr Top() {
+        if (_kind == OT_NULL) {
+            return _values.top();
+        }
+        return Unboxed(_raw.size() - 1);
     }
 
     void Pop() {
-        _values.pop_back();
+        if (_kind == OT_NULL) {
+            _values.pop_back();
+        } else {
+            _raw.pop_back();
+        }
         ShrinkIfNeeded();
     }
 
     bool Insert(SQInteger idx,const SQObject &val){
-        if(idx < 0 || idx > (SQInteger)_values.size()) {
+        if(idx < 0 || idx > (SQInteger)Size()) {
             return false;
         }
-        _values.insert(idx,val);
+        size_t const before = MemSize();
+        Prepare(sq_type(val));
+        if (_kind == OT_NULL) {
+            _values.insert(idx,val);
+        } else {
+            _raw.insert(idx,val._unVal);
+        }
+        Resized(before);
         return true;
     }
 
     void ShrinkIfNeeded() {
-        if (_values.size() <= _values.capacity() >> 2) {
-            _values.shrinktofit();
+        size_t const before = MemSize();
+        if (_kind == OT_NULL) {
+            if (_values.size() <= _values.capacity() >> 2) {
+                _values.shrinktofit();
+            }
+        } else if (_raw.size() <= _raw.capacity() >> 2) {
+            _raw.shrinktofit();
         }
+        Resized(before);
     }
 
     bool Remove(SQInteger idx) {
-        if(idx < 0 || idx >= (SQInteger)_values.size()) {
+        if(idx < 0 || idx >= (SQInteger)Size()) {
             return false;
         }
-        _values.remove(idx);
+        if (_kind == OT_NULL) {
+            _values.remove(idx);
+        } else {
+            _raw.remove(idx);
+        }
         ShrinkIfNeeded();
         return true;
     }
 
+    void Swap(size_t i, size_t j) {
+        if (_kind == OT_NULL) {
+            _Swap(_values[i], _values[j]);
+        } else {
+            SQObjectValue const t = _raw[i];
+            _raw[i] = _raw[j];
+            _raw[j] = t;
+        }
+    }
+
+    // sorts an unboxed array in ascending order, false if it is mixed or
+    // its values are not totally ordered (NaN)
+    bool SortUnboxed();
+
     void Release() {
+        size_t const size = sizeof(*this) + _ninline * sizeof(SQObjectPtr);
+        _sharedstate->gc.Freed(MemSize());
         this->~SQArray();
-        sq_vm_free(this, sizeof(*this));
+        sq_vm_free(this, size);
+    }
+
+    union {
+        sqvector<SQObjectPtr> _values;
+        sqvector<SQObjectValue> _raw;
+    };
+    uint32_t _ninline;
+    SQObjectType _kind;
+private:
+    SQObject Unboxed(size_t idx) const {
+        SQObject o;
+        o._type = _kind;
+        o._unVal = _raw[idx];
+        return o;
+    }
+
+    // tells the collector how much MemSize() moved from before
+    void Resized(size_t before) {
+        size_t const after = MemSize();
+        if (after > before) {
+            _sharedstate->gc.Allocated(after - before);
+        } else if (after < before) {
+            _sharedstate->gc.Freed(before - after);
+        }
+    }
+
+    // moves unboxed values to _values, making the array mixed
+    void Generalize();
+
+    // makes room for a value of type t, storage changes are not accounted
+    void Prepare(SQObjectType t) {
+        if (t == _kind) {
+            return;
+        }
+        if (Size() == 0) {
+            Retype(t == OT_INTEGER || t == OT_FLOAT ? t : OT_NULL);
+        } else if (_kind != OT_NULL) {
+            Generalize();
+        }
     }
 
-    sqvector<SQObjectPtr> _values;
+    // changes the kind of an empty array
+    void Retype(SQObjectType kind);
 };
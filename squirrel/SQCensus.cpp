@@ -0,0 +1,297 @@
+#include "SQCensus.hpp"
+
+#include "SQArray.hpp"
+#include "SQClass.hpp"
+#include "SQClosure.hpp"
+#include "SQFunctionProto.hpp"
+#include "SQGenerator.hpp"
+#include "SQInstance.hpp"
+#include "SQNativeClosure.hpp"
+#include "SQOuter.hpp"
+#include "SQTable.hpp"
+#include "SQUserData.hpp"
+#include "SQVM.hpp"
+
+static SQObjectType const census_types[SQ_CENSUS_TYPES] = {
+    OT_TABLE, OT_ARRAY, OT_USERDATA, OT_CLOSURE, OT_NATIVECLOSURE, OT_GENERATOR,
+    OT_THREAD, OT_FUNCPROTO, OT_CLASS, OT_INSTANCE, OT_OUTER,
+};
+
+// typeof says "function" for three of them
+static SQChar const * const census_names[SQ_CENSUS_TYPES] = {
+    _SC("table"), _SC("array"), _SC("userdata"), _SC("closure"), _SC("nativeclosure"), _SC("generator"),
+    _SC("thread"), _SC("funcproto"), _SC("class"), _SC("instance"), _SC("outer"),
+};
+
+SQCensus::SQCensus(size_t ntop)
+    : _classes()
+    , _nclasses(0)
+    , _largest()
+    , _ntop(ntop < SQ_CENSUS_MAXTOP ? ntop : SQ_CENSUS_MAXTOP)
+    , _strings(0)
+    , _stringbytes(0)
+    , _stringslots(0)
+    , _stringslotsused(0)
+    , _longestchain(0)
+    , _refs(0)
+    , _refslots(0)
+    , _livebytes(0)
+{
+    for (size_t i = 0; i < SQ_CENSUS_TYPES; i++) {
+        _types[i].count = 0;
+        _types[i].bytes = 0;
+    }
+}
+
+void SQCensus::Take(SQSharedState * ss) {
+#ifndef NO_GARBAGE_COLLECTOR
+    for (SQCollectable * t = ss->gc.chain_root; t; t = t->_next) {
+        Count(t);
+    }
+#endif
+    SQStringTable const & st = ss->gc.Strings();
+    _strings = st.Count();
+    _stringslots = st.Slots();
+    st.Occupancy(_stringbytes, _stringslotsused, _longestchain);
+    _refs = ss->_refs_table.Count();
+    _refslots = ss->_refs_table.Slots();
+    ss->gc.CountStrings();
+    _livebytes = ss->gc.stats.livebytes;
+}
+
+void SQCensus::Count(SQCollectable * obj) {
+    SQObjectType const type = obj->GetType();
+    size_t bytes = 0;
+    switch (type) {
+    case OT_TABLE: {
+        SQTable * t = static_cast<SQTable *>(obj);
+        bytes = t->MemSize();
+        AddLargest(obj, type, t->CountLive(), bytes);
+        break;
+    }
+    case OT_ARRAY: {
+        SQArray * a = static_cast<SQArray *>(obj);
+        bytes = a->MemSize();
+        AddLargest(obj, type, a->Size(), bytes);
+        break;
+    }
+    case OT_USERDATA:
+        bytes = sizeof(SQUserData) + static_cast<SQUserData *>(obj)->_size;
+        break;
+    case OT_CLOSURE: {
+        SQFunctionProto * f = static_cast<SQClosure *>(obj)->_function;
+        bytes = sizeof(SQClosure) + (f->_noutervalues + f->_ndefaultparams) * sizeof(SQObjectPtr);
+        break;
+    }
+    case OT_NATIVECLOSURE: {
+        SQNativeClosure * nc = static_cast<SQNativeClosure *>(obj);
+        bytes = sizeof(SQNativeClosure) + nc->_noutervalues * sizeof(SQObjectPtr)
+            + nc->_typecheck.capacity() * sizeof(SQInteger);
+        break;
+    }
+    case OT_GENERATOR: {
+        SQGenerator * g = static_cast<SQGenerator *>(obj);
+        bytes = sizeof(SQGenerator) + g->stack.capacity() * sizeof(SQObjectPtr);
+        break;
+    }
+    case OT_THREAD: {
+        SQVM * vm = static_cast<SQVM *>(obj);
+        bytes = sizeof(SQVM) + vm->StackBytes();
+        break;
+    }
+    case OT_FUNCPROTO: {
+        SQFunctionProto * f = static_cast<SQFunctionProto *>(obj);
+        bytes = f->MemSize();
+        break;
+    }
+    case OT_CLASS: {
+        SQClass * c = static_cast<SQClass *>(obj);
+        bytes = sizeof(SQClass)
+            + (c->_defaultvalues.capacity() + c->_methods.capacity()) * sizeof(SQClassMember);
+        break;
+    }
+    case OT_INSTANCE: {
+        SQInstance * inst = static_cast<SQInstance *>(obj);
+        bytes = inst->_memsize;
+        AddClass(inst->klass, SQInteger(bytes));
+        break;
+    }
+    case OT_OUTER:
+        bytes = sizeof(SQOuter);
+        break;
+    default:
+        return;
+    }
+    for (size_t i = 0; i < SQ_CENSUS_TYPES; i++) {
+        if (census_types[i] == type) {
+            _types[i].count++;
+            _types[i].bytes += SQInteger(bytes);
+            break;
+        }
+    }
+}
+
+void SQCensus::AddClass(SQClass * klass, SQInteger bytes) {
+    if ((_nclasses + 1) * 2 > _classes.size()) {
+        sqvector<ClassEntry> old;
+        old.swap(_classes);
+        ClassEntry empty = {nullptr, {0, 0}};
+        _classes.resize(old.size() ? old.size() * 2 : 16, empty);
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i].klass) {
+                size_t h = size_t(hashptr(old[i].klass)) & (_classes.size() - 1);
+                while (_classes[h].klass) {
+                    h = (h + 1) & (_classes.size() - 1);
+                }
+                _classes[h] = old[i];
+            }
+        }
+    }
+    size_t h = size_t(hashptr(klass)) & (_classes.size() - 1);
+    while (_classes[h].klass && _classes[h].klass != klass) {
+        h = (h + 1) & (_classes.size() - 1);
+    }
+    if (!_classes[h].klass) {
+        _classes[h].klass = klass;
+        _nclasses++;
+    }
+    _classes[h].use.count++;
+    _classes[h].use.bytes += bytes;
+}
+
+void SQCensus::AddLargest(SQCollectable * obj, SQObjectType type, SQInteger size, SQInteger bytes) {
+    if (!_ntop || (_largest.size() == _ntop && _largest.top().bytes >= bytes)) {
+        return;
+    }
+    Largest l = {obj, type, size, bytes};
+    if (_largest.size() == _ntop) {
+        _largest.pop_back();
+    }
+    size_t i = _largest.size();
+    while (i > 0 && _largest[i - 1].bytes < bytes) {
+        i--;
+    }
+    _largest.insert(i, l);
+}
+
+static SQObjectPtr census_entry(SQSharedState * ss, SQCensus::Entry const & e) {
+    SQTable * t = SQTable::Create(ss, 2);
+    t->NewSlot(ss->gc.AddString("count", 5), e.count);
+    t->NewSlot(ss->gc.AddString("bytes", 5), e.bytes);
+    return t;
+}
+
+void SQCensus::Push(SQVM * v) {
+    SQSharedState * ss = _ss(v);
+#define _STR(s) ss->gc.AddString(s, sizeof(s) - 1)
+    SQObjectPtr res = SQTable::Create(ss, 6);
+    SQTable * t = _table(res);
+    t->NewSlot(_STR("livebytes"), _livebytes);
+
+    SQTable * types = SQTable::Create(ss, SQ_CENSUS_TYPES);
+    t->NewSlot(_STR("types"), types);
+    for (size_t i = 0; i < SQ_CENSUS_TYPES; i++) {
+        if (_types[i].count) {
+            char const * name = census_names[i];
+            types->NewSlot(ss->gc.AddString(name, strlen(name)), census_entry(ss, _types[i]));
+        }
+    }
+
+    // largest users first
+    sqvector<ClassEntry> classes;
+    for (size_t i = 0; i < _classes.size(); i++) {
+        if (_classes[i].klass) {
+            size_t k = classes.size();
+            classes.push_back(_classes[i]);
+            while (k > 0 && classes[k - 1].use.bytes < _classes[i].use.bytes) {
+                classes[k] = classes[k - 1];
+                k--;
+            }
+            classes[k] = _classes[i];
+        }
+    }
+    SQArray * byclass = SQArray::Create(ss, 0, classes.size());
+    t->NewSlot(_STR("classes"), byclass);
+    for (size_t i = 0; i < classes.size(); i++) {
+        SQObjectPtr e = census_entry(ss, classes[i].use);
+        _table(e)->NewSlot(_STR("class"), classes[i].klass);
+        byclass->Append(e);
+    }
+
+    SQArray * largest = SQArray::Create(ss, 0, _largest.size());
+    t->NewSlot(_STR("largest"), largest);
+    for (size_t i = 0; i < _largest.size(); i++) {
+        SQObject o;
+        o._type = _largest[i].type;
+        o._unVal.pRefCounted = _largest[i].obj;
+        SQTable * e = SQTable::Create(ss, 3);
+        e->NewSlot(_STR("value"), SQObjectPtr(o));
+        e->NewSlot(_STR("size"), _largest[i].size);
+        e->NewSlot(_STR("bytes"), _largest[i].bytes);
+        largest->Append(SQObjectPtr(e));
+    }
+
+    SQTable * strings = SQTable::Create(ss, 5);
+    t->NewSlot(_STR("strings"), strings);
+    strings->NewSlot(_STR("count"), SQInteger(_strings));
+    strings->NewSlot(_STR("bytes"), SQInteger(_stringbytes));
+    strings->NewSlot(_STR("slots"), SQInteger(_stringslots));
+    strings->NewSlot(_STR("used"), SQInteger(_stringslotsused));
+    strings->NewSlot(_STR("longest"), SQInteger(_longestchain));
+
+    SQTable * refs = SQTable::Create(ss, 2);
+    t->NewSlot(_STR("refs"), refs);
+    refs->NewSlot(_STR("count"), SQInteger(_refs));
+    refs->NewSlot(_STR("slots"), SQInteger(_refslots));
+#undef _STR
+    v->Push(res);
+}
+
+// the name a class is bound to in the root table, if any
+static SQChar const * census_classname(SQVM * v, SQClass * klass) {
+    if (sq_type(v->_roottable) != OT_TABLE) {
+        return nullptr;
+    }
+    SQObjectPtr key, val, it;
+    SQInteger idx;
+    while ((idx = _table(v->_roottable)->Next(false, it, key, val)) != -1) {
+        if (sq_type(val) == OT_CLASS && _class(val) == klass && sq_type(key) == OT_STRING) {
+            return _stringval(key);
+        }
+        it = idx;
+    }
+    return nullptr;
+}
+
+void SQCensus::Print(SQVM * v) {
+    SQPRINTFUNCTION pf = _ss(v)->_printfunc;
+    if (!pf) {
+        return;
+    }
+    pf(v, _SC("heap census: %lld live bytes\n"), (long long)_livebytes);
+    for (size_t i = 0; i < SQ_CENSUS_TYPES; i++) {
+        if (_types[i].count) {
+            pf(v, _SC("  %-14s %10lld objects %12lld bytes\n"), census_names[i],
+                (long long)_types[i].count, (long long)_types[i].bytes);
+        }
+    }
+    for (size_t i = 0; i < _classes.size(); i++) {
+        ClassEntry const & c = _classes[i];
+        if (c.klass) {
+            SQChar const * name = census_classname(v, c.klass);
+            if (name) {
+                pf(v, _SC("  instances of %s: %lld, %lld bytes\n"), name, (long long)c.use.count, (long long)c.use.bytes);
+            } else {
+                pf(v, _SC("  instances of class %p: %lld, %lld bytes\n"), (void *)c.klass, (long long)c.use.count, (long long)c.use.bytes);
+            }
+        }
+    }
+    for (size_t i = 0; i < _largest.size(); i++) {
+        Largest const & l = _largest[i];
+        pf(v, _SC("  %s %p: %lld slots, %lld bytes\n"), IdType2Name(l.type), (void *)l.obj, (long long)l.size, (long long)l.bytes);
+    }
+    pf(v, _SC("  strings: %lld, %lld bytes, %lld of %lld buckets used, longest chain %lld\n"),
+        (long long)_strings, (long long)_stringbytes, (long long)_stringslotsused,
+        (long long)_stringslots, (long long)_longestchain);
+    pf(v, _SC("  refs: %lld in %lld slots\n"), (long long)_refs, (long long)_refslots);
+}
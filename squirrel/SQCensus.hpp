@@ -0,0 +1,66 @@
+#pragma once
+
+#include "sqobject.h"
+#include "sqvector.hpp"
+
+struct SQClass;
+struct SQCollectable;
+struct SQSharedState;
+
+#define SQ_CENSUS_TYPES 11
+#define SQ_CENSUS_MAXTOP 1000
+#define SQ_CENSUS_DUMPTOP 8
+
+// What the heap holds: count and bytes of every collectable type and of
+// the instances of each class, the largest tables and arrays, and the
+// occupancy of the string and reference tables. Taking it walks the heap
+// without creating objects, so it sees the heap exactly as it was.
+struct SQCensus {
+    struct Entry {
+        SQInteger count;
+        SQInteger bytes;
+    };
+
+    struct ClassEntry {
+        SQClass * klass;
+        Entry use;
+    };
+
+    struct Largest {
+        SQCollectable * obj;
+        SQObjectType type;
+        SQInteger size;     // slots or elements
+        SQInteger bytes;
+    };
+
+    Entry _types[SQ_CENSUS_TYPES];
+    // open addressing on the class pointer
+    sqvector<ClassEntry> _classes;
+    size_t _nclasses;
+    // ordered by bytes, the biggest first
+    sqvector<Largest> _largest;
+    size_t _ntop;
+
+    size_t _strings;
+    size_t _stringbytes;
+    size_t _stringslots;
+    size_t _stringslotsused;
+    size_t _longestchain;
+    SQUnsignedInteger _refs;
+    SQUnsignedInteger _refslots;
+    SQInteger _livebytes;
+
+    SQCensus(size_t ntop);
+
+    void Take(SQSharedState * ss);
+
+    // {livebytes, types, classes, largest, strings, refs}
+    void Push(SQVM * v);
+
+    // a human readable summary through the print function of v
+    void Print(SQVM * v);
+private:
+    void Count(SQCollectable * obj);
+    void AddClass(SQClass * klass, SQInteger bytes);
+    void AddLargest(SQCollectable * obj, SQObjectType type, SQInteger size, SQInteger bytes);
+};
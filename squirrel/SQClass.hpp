@@ -36,6 +36,7 @@ public:
     static SQClass* Create(SQSharedState *ss,SQClass *base) {
         SQClass *newclass = (SQClass *)sq_vm_malloc(sizeof(SQClass));
         new (newclass) SQClass(ss, base);
+        ss->gc.Allocated(sizeof(SQClass));
         return newclass;
     }
     ~SQClass();
@@ -71,6 +72,7 @@ public:
         if (_hook) {
             _hook(_typetag,0);
         }
+        _sharedstate->gc.Freed(sizeof(*this));
         this->~SQClass();
         sq_vm_free(this, sizeof(*this));
     }
@@ -92,6 +94,8 @@ public:
     SQObjectPtr _attributes;
     SQUserPointer _typetag;
     SQRELEASEHOOK _hook;
+    SQFREEZEHOOK _freezehook;
+    SQTHAWHOOK _thawhook;
     bool _locked;
     SQInteger _constructoridx;
     SQInteger _udsize;
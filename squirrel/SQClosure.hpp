@@ -37,6 +37,7 @@ public:
         SQClosure * nc = (SQClosure *)sq_vm_malloc(sizeof(SQClosure));
 
         new (nc) SQClosure(ss, func, root);
+        ss->gc.Allocated(sizeof(SQClosure) + (func->_noutervalues + func->_ndefaultparams) * sizeof(SQObjectPtr));
 
         return nc;
     }
@@ -46,6 +47,7 @@ public:
     ~SQClosure();
 
     void Release() {
+        _sharedstate->gc.Freed(sizeof(SQClosure) + (_function->_noutervalues + _function->_ndefaultparams) * sizeof(SQObjectPtr));
         for (size_t i = 0; i < _function->_noutervalues; i++) {
             _outervalues[i].~SQObjectPtr();
         }
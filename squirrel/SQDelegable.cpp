@@ -28,7 +28,7 @@ bool SQDelegable::SetDelegate(SQTable * mt) {
 
 bool SQDelegable::GetMetaMethod(SQVM * v, SQMetaMethod mm, SQObjectPtr & res) {
     if (_delegate) {
-        return _delegate->Get(v->_sharedstate->_metamethods[mm], res);
+        return _delegate->GetMetaMethod(v->_sharedstate, mm, res);
     }
     return false;
 }
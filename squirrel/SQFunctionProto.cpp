@@ -1 +1,10 @@
 #include "SQFunctionProto.hpp"
+
+#include <cstring>
+
+SQSharedCode * SQSharedCode::Create(SQInstruction const * code, size_t n) {
+    SQSharedCode * c = (SQSharedCode *)sq_vm_malloc(Bytes(n));
+    new (c) SQSharedCode(n);
+    memcpy(c->_instructions, code, n * sizeof(SQInstruction));
+    return c;
+}
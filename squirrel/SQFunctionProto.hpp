@@ -1,14 +1,17 @@
 #pragma once
 
+#include <atomic>
 #include <new>
 
 #include "sqopcodes.h"
 
 #include "SQCollectable.hpp"
+#include "sqstate.h"
 
 enum SQOuterType {
     otLOCAL = 0,
-    otOUTER = 1
+    otOUTER = 1,
+    otVALUE = 2 // local that is never reassigned, copied into the closure
 };
 
 struct SQOuterVar {
@@ -34,14 +37,65 @@ struct SQLocalVarInfo {
 
 struct SQLineInfo { SQInteger _line;SQInteger _op; };
 
+// A try block: errors raised by instructions in [_start, _end) resume at
+// _handler with the error in the _extarget slot
+struct SQTrapInfo {
+    SQInteger _start;
+    SQInteger _end;
+    SQInteger _handler;
+    SQInteger _extarget;
+};
+
 typedef sqvector<SQOuterVar> SQOuterVarVec;
 typedef sqvector<SQLineInfo> SQLineInfoVec;
+typedef sqvector<SQTrapInfo> SQTrapInfoVec;
 
-#define _FUNC_SIZE(ni,nl,nparams,nfuncs,nouters,nlineinf,localinf,defparams) (sizeof(SQFunctionProto) \
-        +((ni-1)*sizeof(SQInstruction))+(nl*sizeof(SQObjectPtr)) \
+// Instructions of a frozen proto, shared read-only by the protos thawed
+// from its image in any number of shared states (see SQImage). Only the
+// reference count is ever written, so the VM never quickens them.
+struct SQSharedCode {
+    std::atomic<size_t> _refs;
+    size_t _ninstructions;
+    SQInstruction _instructions[1];
+
+    static SQSharedCode * Create(SQInstruction const * code, size_t n);
+
+    static size_t Bytes(size_t n) {
+        return sizeof(SQSharedCode) - sizeof(SQInstruction) + n * sizeof(SQInstruction);
+    }
+
+    void AddRef() {
+        _refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t const n = _ninstructions;
+            this->~SQSharedCode();
+            sq_vm_free(this, Bytes(n));
+        }
+    }
+private:
+    SQSharedCode(size_t n)
+        : _refs(1)
+        , _ninstructions(n)
+    {}
+};
+
+// Code blocks handed to SQFunctionProto::Load in the order their protos
+// were saved
+struct SQSharedCodes {
+    SQSharedCode * const * _codes;
+    size_t _count;
+    size_t _next;
+};
+
+#define _FUNC_SIZE(ni,nl,nparams,nfuncs,nouters,nlineinf,localinf,defparams,ntraps) (sizeof(SQFunctionProto) \
+        +(ni*sizeof(SQInstruction))+(nl*sizeof(SQObjectPtr)) \
         +(nparams*sizeof(SQObjectPtr))+(nfuncs*sizeof(SQObjectPtr)) \
         +(nouters*sizeof(SQOuterVar))+(nlineinf*sizeof(SQLineInfo)) \
-        +(localinf*sizeof(SQLocalVarInfo))+(defparams*sizeof(SQInteger)))
+        +(localinf*sizeof(SQLocalVarInfo))+(defparams*sizeof(SQInteger)) \
+        +(ntraps*sizeof(SQTrapInfo)))
 
 
 struct SQFunctionProto : public CHAINABLE_OBJ {
@@ -51,13 +105,17 @@ public:
     static SQFunctionProto *Create(SQSharedState *ss,SQInteger ninstructions,
         SQInteger nliterals,SQInteger nparameters,
         SQInteger nfunctions,SQInteger noutervalues,
-        SQInteger nlineinfos,SQInteger nlocalvarinfos,SQInteger ndefaultparams)
+        SQInteger nlineinfos,SQInteger nlocalvarinfos,SQInteger ndefaultparams,
+        SQInteger ntraps)
     {
         SQFunctionProto *f;
         //I compact the whole class and members in a single memory allocation
-        f = (SQFunctionProto *)sq_vm_malloc(_FUNC_SIZE(ninstructions,nliterals,nparameters,nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams));
+        f = (SQFunctionProto *)sq_vm_malloc(_FUNC_SIZE(ninstructions,nliterals,nparameters,nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams,ntraps));
         new (f) SQFunctionProto(ss);
+        ss->gc.Allocated(_FUNC_SIZE(ninstructions,nliterals,nparameters,nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams,ntraps));
         f->_ninstructions = ninstructions;
+        f->_instructions = (SQInstruction *)(f + 1);
+        f->_sharedcode = nullptr;
         f->_literals = (SQObjectPtr*)&f->_instructions[ninstructions];
         f->_nliterals = nliterals;
         f->_parameters = (SQObjectPtr*)&f->_literals[nliterals];
@@ -72,6 +130,8 @@ public:
         f->_nlocalvarinfos = nlocalvarinfos;
         f->_defaultparams = (SQInteger *)&f->_localvarinfos[nlocalvarinfos];
         f->_ndefaultparams = ndefaultparams;
+        f->_traps = (SQTrapInfo *)&f->_defaultparams[ndefaultparams];
+        f->_ntraps = ntraps;
 
         for (size_t i = 0; i < f->_nliterals; i++) {
             new (&f->_literals[i]) SQObjectPtr();
@@ -96,15 +156,42 @@ public:
         _DESTRUCT_VECTOR(SQObjectPtr,_nfunctions,_functions);
         _DESTRUCT_VECTOR(SQOuterVar,_noutervalues,_outervalues);
         _DESTRUCT_VECTOR(SQLocalVarInfo,_nlocalvarinfos,_localvarinfos);
-        SQInteger size = _FUNC_SIZE(_ninstructions,_nliterals,_nparameters,_nfunctions,_noutervalues,_nlineinfos,_nlocalvarinfos,_ndefaultparams);
+        size_t size = MemSize();
+        if (_sharedcode) {
+            _sharedcode->Release();
+        }
+        _sharedstate->gc.Freed(size);
         this->~SQFunctionProto();
         sq_vm_free(this,size);
     }
 
+    // bytes of the proto, shared instructions excluded
+    size_t MemSize() const {
+        return _FUNC_SIZE(_sharedcode ? 0 : _ninstructions,_nliterals,_nparameters,_nfunctions,_noutervalues,_nlineinfos,_nlocalvarinfos,_ndefaultparams,_ntraps);
+    }
+
+    // runs code instead of own instructions, the proto must have been
+    // created without any
+    void ShareCode(SQSharedCode * code) {
+        assert(!_ninstructions && !_sharedcode);
+        code->AddRef();
+        _sharedcode = code;
+        _instructions = code->_instructions;
+        _ninstructions = code->_ninstructions;
+    }
+
     const SQChar* GetLocal(SQVM *v,SQUnsignedInteger stackbase,SQUnsignedInteger nseq,SQUnsignedInteger nop);
     SQInteger GetLine(SQInstruction *curr);
-    bool Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write);
-    static bool Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret);
+    // true if curr is the first instruction of a line, the line going to line
+    bool LineStart(SQInstruction *curr, SQInteger & line);
+    // the innermost try block covering curr, null if there is none
+    const SQTrapInfo * FindTrap(SQInstruction *curr);
+    // if share is set, the instructions of this proto and its inner ones
+    // are also appended to it as shared blocks
+    bool Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write,sqvector<SQSharedCode *> *share = nullptr);
+    // if shared is set, the protos run its blocks instead of the saved
+    // instructions, which are skipped by calling read with a null buffer
+    static bool Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret,SQSharedCodes *shared = nullptr);
 #ifndef NO_GARBAGE_COLLECTOR
     void Mark(SQCollectable **chain);
     void Finalize() {
@@ -141,6 +228,14 @@ public:
     size_t _ndefaultparams;
     SQInteger *_defaultparams;
 
+    // inner blocks come before the blocks enclosing them
+    size_t _ntraps;
+    SQTrapInfo *_traps;
+
+    // not null if _instructions belong to a frozen image, see SQSharedCode
+    SQSharedCode * _sharedcode;
+
     size_t _ninstructions;
-    SQInstruction _instructions[1];
+    // right after the proto, unless shared
+    SQInstruction * _instructions;
 };
@@ -3,6 +3,21 @@
 #include "GC.hpp"
 #include "sqstate.h"
 
+SQGenerator * SQGenerator::Create(SQSharedState * ss, SQClosure * closure) {
+    SQGenerator * nc = (SQGenerator *)sq_vm_malloc(sizeof(SQGenerator));
+    new (nc) SQGenerator(ss, closure);
+    ss->_generatorstacks.Acquire(nc->stack, 0);
+    ss->gc.Allocated(sizeof(SQGenerator) + nc->stack.capacity() * sizeof(SQObjectPtr));
+    return nc;
+}
+
+void SQGenerator::Release() {
+    _sharedstate->gc.Freed(sizeof(*this) + stack.capacity() * sizeof(SQObjectPtr));
+    _sharedstate->_generatorstacks.Recycle(stack);
+    this->~SQGenerator();
+    sq_vm_free(this, sizeof(*this));
+}
+
 bool SQGenerator::Yield(SQVM *v, SQInteger target) {
     if (_state == eSuspended) {
         v->Raise_Error("internal vm error, yielding dead generator");
@@ -14,32 +29,31 @@ bool SQGenerator::Yield(SQVM *v, SQInteger target) {
     }
 
     SQInteger size = v->stack_top - v->_stackbase;
+    size_t const cap = stack.capacity();
     stack.resize(size);
+    if (stack.capacity() > cap) {
+        _sharedstate->gc.Allocated((stack.capacity() - cap) * sizeof(SQObjectPtr));
+    }
 
     SQObject _this = v->_stack[v->_stackbase];
     stack._vals[0] = ISREFCOUNTED(sq_type(_this))
         ? SQObjectPtr(_refcounted(_this)->GetWeakRef(sq_type(_this)))
         : _this;
 
+    // The slots of our stack are all null here, swapping moves the live
+    // values over and leaves the frame clean without touching refcounts
     // TODO: fix <=, see yield codegen in the compiler
+    v->_stack[v->_stackbase].Null();
     for (SQInteger n = 1; n <= target; n++) {
-        stack._vals[n] = v->_stack[v->_stackbase + n];
+        _Swap(stack._vals[n], v->_stack[v->_stackbase + n]);
     }
 
-    for (SQInteger j = 0; j < size; j++) {
+    for (SQInteger j = target + 1; j < size; j++) {
         v->_stack[v->_stackbase + j].Null();
     }
 
     _ci = *v->ci;
     _ci._generator = NULL;
-    for (SQInteger i = 0; i < _ci._etraps; i++) {
-        _etraps.push_back(v->_etraps.top());
-        v->_etraps.pop_back();
-        // store relative stack base and size in case of resume to other stack_top
-        SQExceptionTrap & et = _etraps.back();
-        et._stackbase -= v->_stackbase;
-        et._stacksize -= v->_stackbase;
-    }
 
     _state = eSuspended;
     return true;
@@ -59,7 +73,6 @@ bool SQGenerator::Resume(SQVM *v, SQObjectPtr & dest) {
     size_t const target = &dest - &(v->_stack._vals[v->_stackbase]);
     assert(target <= 255);
 
-    size_t const newbase = v->stack_top;
     if (!v->EnterFrame(v->stack_top, v->stack_top + size, false)) {
         return false;
     }
@@ -69,27 +82,15 @@ bool SQGenerator::Resume(SQVM *v, SQObjectPtr & dest) {
     v->ci->_ip          = _ci._ip;
     v->ci->_literals    = _ci._literals;
     v->ci->_ncalls      = _ci._ncalls;
-    v->ci->_etraps      = _ci._etraps;
     v->ci->_root        = _ci._root;
 
-
-    for (SQInteger i = 0; i < _ci._etraps; i++) {
-        v->_etraps.push_back(_etraps.top());
-        _etraps.pop_back();
-
-        // restore absolute stack base and size
-        SQExceptionTrap & et = v->_etraps.back();
-        et._stackbase += newbase;
-        et._stacksize += newbase;
-    }
-
     SQObject _this = stack._vals[0];
     v->_stack[v->_stackbase] = sq_type(_this) == OT_WEAKREF
         ? _weakref(_this)->_obj
         : _this;
 
     for (size_t n = 1; n < size; n++) {
-        v->_stack[v->_stackbase+n] = stack._vals[n];
+        _Swap(v->_stack[v->_stackbase + n], stack._vals[n]);
         stack._vals[n].Null();
     }
 
@@ -15,29 +15,20 @@ struct SQGenerator : public CHAINABLE_OBJ {
     SQObjectPtr closure;
     sqvector<SQObjectPtr> stack;
     SQVM::CallInfo _ci;
-    sqvector<SQExceptionTrap> _etraps;
     SQGeneratorState _state;
 private:
     SQGenerator(SQSharedState *ss, SQClosure *closure)
         : CHAINABLE_OBJ(ss)
         , closure(closure)
         , stack()
-        , _etraps()
         , _state(eRunning)
     {
         _ci._generator = nullptr;
     }
 public:
-    static SQGenerator *Create(SQSharedState *ss, SQClosure *closure){
-        SQGenerator *nc=(SQGenerator*)sq_vm_malloc(sizeof(SQGenerator));
-        new (nc) SQGenerator(ss,closure);
-        return nc;
-    }
+    static SQGenerator *Create(SQSharedState *ss, SQClosure *closure);
 
-    void Release() {
-        this->~SQGenerator();
-        sq_vm_free(this, sizeof(*this));
-    }
+    void Release();
 
     void Kill() {
         _state = eDead;
@@ -0,0 +1,915 @@
+#include "SQImage.hpp"
+
+#include <cstring>
+
+#include "SQArray.hpp"
+#include "SQClass.hpp"
+#include "SQClosure.hpp"
+#include "SQInstance.hpp"
+#include "SQOuter.hpp"
+#include "SQString.hpp"
+#include "SQTable.hpp"
+#include "SQVM.hpp"
+
+#define SQ_IMAGE_TAG (('S'<<24)|('Q'<<16)|('I'<<8)|('M'))
+#define SQ_SNAPSHOT_TAG (('S'<<24)|('Q'<<16)|('S'<<8)|('N'))
+#define SQ_IMAGE_MAXDEPTH 1024
+
+// records that stand in place of a type
+#define SQ_IMAGE_BACKREF 0      // the value was already written, an index follows
+#define SQ_IMAGE_BASELINE 1     // snapshots: a path into the baseline follows
+#define SQ_IMAGE_CLASSDEF 2     // snapshots: a complete class definition
+
+// where a class or a baseline path is looked up when thawing
+#define SQ_IMAGE_ROOT 0
+#define SQ_IMAGE_REGISTRY 1
+#define SQ_IMAGE_CONSTS 2
+
+struct SQImageWriter {
+    uint8_t * _buf;
+    size_t _len;
+    size_t _cap;
+    // reference values already written, mapped to their index
+    SQObjectPtr _refs;
+    // snapshots carry everything needed to rebuild a heap, see sq_snapshot
+    bool _snapshot;
+    // instructions of the protos written, images only
+    sqvector<SQSharedCode *> _codes;
+
+    SQImageWriter(SQSharedState * ss, bool snapshot)
+        : _buf(nullptr)
+        , _len(0)
+        , _cap(0)
+        , _refs(SQTable::Create(ss, 0))
+        , _snapshot(snapshot)
+    {}
+
+    ~SQImageWriter() {
+        if (_buf) {
+            sq_vm_free(_buf, _cap);
+        }
+        for (size_t i = 0; i < _codes.size(); i++) {
+            _codes[i]->Release();
+        }
+    }
+
+    void Put(void const * p, size_t n) {
+        if (_len + n > _cap) {
+            size_t newcap = _cap ? _cap * 2 : 256;
+            while (newcap < _len + n) {
+                newcap *= 2;
+            }
+            _buf = (uint8_t *)sq_vm_realloc(_buf, _cap, newcap);
+            _cap = newcap;
+        }
+        memcpy(_buf + _len, p, n);
+        _len += n;
+    }
+
+    template<typename T>
+    void Put(T const & val) {
+        Put(&val, sizeof(T));
+    }
+
+    // writes a back reference and returns true if o was seen before
+    bool PutRef(SQObjectPtr const & o) {
+        SQTable * refs = _table(_refs);
+        SQObjectPtr idx;
+        if (refs->Get(o, idx)) {
+            Put(SQUnsignedInteger32(SQ_IMAGE_BACKREF));
+            Put(_integer(idx));
+            return true;
+        }
+        refs->NewSlot(o, SQInteger(refs->CountUsed()));
+        return false;
+    }
+};
+
+struct SQImageReader {
+    uint8_t const * _p;
+    size_t _left;
+    // reference values in the order they were written
+    sqvector<SQObjectPtr> _refs;
+    bool _snapshot;
+    // bytecode is not verified, so only trusted images may carry closures
+    bool _code;
+    // instructions to run in place of the ones in the bytes, see SQImage
+    SQSharedCodes _shared = {nullptr, 0, 0};
+
+    // skips n bytes if dest is null
+    bool Get(void * dest, size_t n) {
+        if (n > _left) {
+            return false;
+        }
+        if (dest) {
+            memcpy(dest, _p, n);
+        }
+        _p += n;
+        _left -= n;
+        return true;
+    }
+
+    // numbers a value before it exists, for values built from their parts
+    size_t Reserve() {
+        _refs.push_back(SQObjectPtr());
+        return _refs.size() - 1;
+    }
+};
+
+static SQInteger image_write(SQUserPointer up, SQUserPointer p, SQInteger size) {
+    ((SQImageWriter *)up)->Put(p, size_t(size));
+    return size;
+}
+
+static SQInteger image_read(SQUserPointer up, SQUserPointer dest, SQInteger size) {
+    return ((SQImageReader *)up)->Get(dest, size_t(size)) ? size : -1;
+}
+
+static SQObjectPtr & ImageRoot(SQVM * v, uint8_t where) {
+    switch (where) {
+    case SQ_IMAGE_ROOT: return v->_roottable;
+    case SQ_IMAGE_REGISTRY: return _ss(v)->_registry;
+    default: return _ss(v)->_consts;
+    }
+}
+
+static bool FindClassName(SQObjectPtr const & where, SQClass * c, SQObjectPtr & name) {
+    if (sq_type(where) != OT_TABLE) {
+        return false;
+    }
+    SQObjectPtr key, val;
+    SQInteger idx = 0;
+    while ((idx = _table(where)->Next(false, idx, key, val)) != -1) {
+        if (sq_type(val) == OT_CLASS && _class(val) == c && sq_type(key) == OT_STRING) {
+            name = key;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool FreezeValue(SQVM * v, SQImageWriter & w, SQObjectPtr const & o, int depth);
+
+// writes o as a path into the baseline if it is part of it
+static bool FreezeBaseline(SQVM * v, SQImageWriter & w, SQObjectPtr const & o, bool & done, int depth) {
+    SQObjectPtr path;
+    SQObjectPtr const & base = _ss(v)->_snapshotbase;
+    done = sq_type(base) == OT_TABLE && _table(base)->Get(o, path);
+    if (!done) {
+        return true;
+    }
+    w.Put(SQUnsignedInteger32(SQ_IMAGE_BASELINE));
+    return FreezeValue(v, w, path, depth + 1);
+}
+
+static bool FreezeClassDef(SQVM * v, SQImageWriter & w, SQClass * c, int depth) {
+    if (c->_typetag || c->_hook || c->_udsize || c->_freezehook) {
+        v->Raise_Error(_SC("cannot snapshot a native class created after the baseline"));
+        return false;
+    }
+    w.Put(SQUnsignedInteger32(SQ_IMAGE_CLASSDEF));
+    SQObjectPtr base;
+    if (c->_base) {
+        base = c->_base;
+    }
+    if (!FreezeValue(v, w, base, depth + 1)
+        || !FreezeValue(v, w, SQObjectPtr(c->_members), depth + 1)) {
+        return false;
+    }
+    SQClassMemberVec * const vecs[2] = { &c->_defaultvalues, &c->_methods };
+    for (SQClassMemberVec * vec : vecs) {
+        SQInteger const n = SQInteger(vec->size());
+        w.Put(n);
+        for (SQInteger i = 0; i < n; i++) {
+            if (!FreezeValue(v, w, (*vec)[i].val, depth + 1) || !FreezeValue(v, w, (*vec)[i].attrs, depth + 1)) {
+                return false;
+            }
+        }
+    }
+    for (SQInteger i = 0; i < MT_LAST; i++) {
+        if (!FreezeValue(v, w, c->_metamethods[i], depth + 1)) {
+            return false;
+        }
+    }
+    if (!FreezeValue(v, w, c->_attributes, depth + 1)) {
+        return false;
+    }
+    w.Put(c->_constructoridx);
+    w.Put(uint8_t(c->_locked));
+    return true;
+}
+
+// outside snapshots classes travel by name: the receiving VM must have the
+// same class in its root table (script classes) or registry (native classes)
+static bool FreezeClass(SQVM * v, SQImageWriter & w, SQClass * c, int depth) {
+    SQObjectPtr const o(c);
+    if (w.PutRef(o)) {
+        return true;
+    }
+    if (w._snapshot) {
+        bool done;
+        if (!FreezeBaseline(v, w, o, done, depth)) {
+            return false;
+        }
+        return done || FreezeClassDef(v, w, c, depth);
+    }
+    SQObjectPtr name;
+    uint8_t where;
+    if (FindClassName(v->_roottable, c, name)) {
+        where = SQ_IMAGE_ROOT;
+    } else if (FindClassName(_ss(v)->_registry, c, name)) {
+        where = SQ_IMAGE_REGISTRY;
+    } else {
+        v->Raise_Error(_SC("cannot freeze a class that is not bound in the root table or registry"));
+        return false;
+    }
+    w.Put(SQUnsignedInteger32(OT_CLASS));
+    w.Put(where);
+    w.Put(_string(name)->_len);
+    w.Put(_stringval(name), sq_rsl(_string(name)->_len));
+    return true;
+}
+
+// instances of classes set up by native code hold state only its hooks
+// know how to save and rebuild
+static bool IsNativeClass(SQClass * c) {
+    for (; c; c = c->_base) {
+        if (c->_typetag || c->_hook || c->_udsize) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool FreezeInstance(SQVM * v, SQImageWriter & w, SQObjectPtr const & o, int depth) {
+    SQInstance * inst = _instance(o);
+    SQClass * c = inst->klass;
+    if ((inst->user_data || inst->_hook || IsNativeClass(c)) && !c->_freezehook) {
+        v->Raise_Error(_SC("cannot freeze an instance with native state and no freeze hook"));
+        return false;
+    }
+    w.Put(SQUnsignedInteger32(OT_INSTANCE));
+    if (!FreezeClass(v, w, c, depth)) {
+        return false;
+    }
+    SQInteger const n = SQInteger(c->_defaultvalues.size());
+    w.Put(n);
+    for (SQInteger i = 0; i < n; i++) {
+        if (!FreezeValue(v, w, inst->_values[i], depth + 1)) {
+            return false;
+        }
+    }
+    if (c->_freezehook) {
+        v->Push(o);
+        SQInteger const res = c->_freezehook(v, -1, image_write, &w);
+        v->Pop();
+        if (SQ_FAILED(res)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool FreezeClosure(SQVM * v, SQImageWriter & w, SQClosure * c, int depth) {
+    SQFunctionProto * f = c->_function;
+    w.Put(SQUnsignedInteger32(OT_CLOSURE));
+    if (!w.PutRef(SQObjectPtr(f))) {
+        w.Put(SQUnsignedInteger32(OT_FUNCPROTO));
+        if (!f->Save(v, &w, image_write, w._snapshot ? nullptr : &w._codes)) {
+            return false;
+        }
+    }
+    if (w._snapshot) {
+        // messages get the root table of the receiver and no environment
+        SQObjectPtr root, env, base;
+        root = c->_root->_obj;
+        if (c->_env) {
+            env = c->_env->_obj;
+        }
+        if (c->_base) {
+            base = c->_base;
+        }
+        if (!FreezeValue(v, w, root, depth + 1)
+            || !FreezeValue(v, w, env, depth + 1)
+            || !FreezeValue(v, w, base, depth + 1)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < f->_noutervalues; i++) {
+        SQObjectPtr const & outer = c->_outervalues[i];
+        if (sq_type(outer) == OT_OUTER && !w._snapshot) {
+            v->Raise_Error(_SC("a closure with free variables bound cannot be frozen"));
+            return false;
+        }
+        if (!FreezeValue(v, w, outer, depth + 1)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < f->_ndefaultparams; i++) {
+        if (!FreezeValue(v, w, c->_defaultparams[i], depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool FreezeValue(SQVM * v, SQImageWriter & w, SQObjectPtr const & o, int depth) {
+    if (depth > SQ_IMAGE_MAXDEPTH) {
+        v->Raise_Error(_SC("cannot freeze a value nested this deep"));
+        return false;
+    }
+    if (sq_type(o) == OT_CLASS) {
+        return FreezeClass(v, w, _class(o), depth);
+    }
+    if (ISREFCOUNTED(sq_type(o))) {
+        if (w.PutRef(o)) {
+            return true;
+        }
+        if (w._snapshot && sq_type(o) != OT_STRING) {
+            bool done;
+            if (!FreezeBaseline(v, w, o, done, depth)) {
+                return false;
+            }
+            if (done) {
+                return true;
+            }
+        }
+    }
+    switch (sq_type(o)) {
+    case OT_NULL:
+        w.Put(SQUnsignedInteger32(OT_NULL));
+        return true;
+    case OT_BOOL:
+    case OT_INTEGER:
+        w.Put(SQUnsignedInteger32(sq_type(o)));
+        w.Put(_integer(o));
+        return true;
+    case OT_FLOAT:
+        w.Put(SQUnsignedInteger32(OT_FLOAT));
+        w.Put(_float(o));
+        return true;
+    case OT_STRING:
+        w.Put(SQUnsignedInteger32(OT_STRING));
+        w.Put(_string(o)->_len);
+        w.Put(_stringval(o), sq_rsl(_string(o)->_len));
+        return true;
+    case OT_ARRAY: {
+        SQArray * a = _array(o);
+        SQInteger const n = SQInteger(a->Size());
+        w.Put(SQUnsignedInteger32(OT_ARRAY));
+        w.Put(n);
+        SQObjectPtr e;
+        for (SQInteger i = 0; i < n; i++) {
+            if (a->_kind == OT_NULL) {
+                e = a->_values[i];
+            } else {
+                a->Get(i, e);
+            }
+            if (!FreezeValue(v, w, e, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case OT_TABLE: {
+        SQTable * t = _table(o);
+        w.Put(SQUnsignedInteger32(OT_TABLE));
+        w.Put(SQInteger(t->CountUsed()));
+        w.Put(t->GetWeakMode());
+        SQObjectPtr key, val;
+        SQInteger idx = 0;
+        // weak slots hold internal weak references, store what they point at
+        while ((idx = t->Next(t->GetWeakMode() == 0, idx, key, val)) != -1) {
+            if (!FreezeValue(v, w, key, depth + 1) || !FreezeValue(v, w, val, depth + 1)) {
+                return false;
+            }
+        }
+        if (w._snapshot) {
+            SQObjectPtr delegate;
+            if (t->_delegate) {
+                delegate = t->_delegate;
+            }
+            return FreezeValue(v, w, delegate, depth + 1);
+        }
+        return true;
+    }
+    case OT_INSTANCE:
+        return FreezeInstance(v, w, o, depth);
+    case OT_CLOSURE:
+        return FreezeClosure(v, w, _closure(o), depth);
+    case OT_OUTER: {
+        SQOuter * outer = _outer(o);
+        if (outer->_valptr != &outer->_value) {
+            v->Raise_Error(_SC("cannot snapshot a function that is still running"));
+            return false;
+        }
+        w.Put(SQUnsignedInteger32(OT_OUTER));
+        return FreezeValue(v, w, outer->_value, depth + 1);
+    }
+    case OT_WEAKREF:
+        w.Put(SQUnsignedInteger32(OT_WEAKREF));
+        return FreezeValue(v, w, SQObjectPtr(_weakref(o)->_obj), depth + 1);
+    default:
+        if (w._snapshot) {
+            v->Raise_Error(_SC("cannot snapshot a %s created after the baseline"), GetTypeName(o));
+        } else {
+            v->Raise_Error(_SC("cannot freeze a %s"), GetTypeName(o));
+        }
+        return false;
+    }
+}
+
+#define _CHECK_READ(exp) { if (!(exp)) { v->Raise_Error(_SC("corrupted image")); return false; } }
+
+static bool ThawString(SQVM * v, SQImageReader & r, SQObjectPtr & o) {
+    SQInteger len;
+    _CHECK_READ(r.Get(&len, sizeof(len)) && len >= 0 && size_t(sq_rsl(len)) <= r._left);
+    o = v->_sharedstate->gc.AddString((SQChar const *)r._p, len);
+    r._p += sq_rsl(len);
+    r._left -= sq_rsl(len);
+    return true;
+}
+
+static bool ThawValue(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth);
+
+static bool ThawBaseline(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth) {
+    size_t const slot = r.Reserve();
+    SQObjectPtr path;
+    if (!ThawValue(v, r, path, depth + 1)) {
+        return false;
+    }
+    _CHECK_READ(r._snapshot && sq_type(path) == OT_ARRAY && _array(path)->Size() > 0);
+    SQArray * keys = _array(path);
+    SQObjectPtr key;
+    keys->Get(0, key);
+    o = ImageRoot(v, uint8_t(_integer(key)));
+    for (size_t i = 1; i < keys->Size(); i++) {
+        SQObjectPtr next;
+        keys->Get(SQInteger(i), key);
+        if (sq_type(o) != OT_TABLE || !_table(o)->Get(key, next)) {
+            v->Raise_Error(_SC("the baseline of the snapshot is missing from this VM"));
+            return false;
+        }
+        o = next;
+    }
+    r._refs[slot] = o;
+    // restored values can be snapshot again
+    _table(_ss(v)->_snapshotbase)->NewSlot(o, path);
+    return true;
+}
+
+static bool ThawClassDef(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth) {
+    _CHECK_READ(r._snapshot);
+    size_t const slot = r.Reserve();
+    SQObjectPtr base, members;
+    if (!ThawValue(v, r, base, depth + 1)) {
+        return false;
+    }
+    _CHECK_READ(sq_type(base) == OT_NULL || sq_type(base) == OT_CLASS);
+    SQClass * c = SQClass::Create(_ss(v), sq_type(base) == OT_CLASS ? _class(base) : nullptr);
+    o = c;
+    r._refs[slot] = o;
+    if (!ThawValue(v, r, members, depth + 1)) {
+        return false;
+    }
+    _CHECK_READ(sq_type(members) == OT_TABLE);
+    c->_members->DecreaseRefCount();
+    c->_members = _table(members);
+    c->_members->IncreaseRefCount();
+    SQClassMemberVec * const vecs[2] = { &c->_defaultvalues, &c->_methods };
+    for (SQClassMemberVec * vec : vecs) {
+        SQInteger n;
+        _CHECK_READ(r.Get(&n, sizeof(n)) && n >= 0 && size_t(n) <= r._left);
+        vec->resize(n);
+        for (SQInteger i = 0; i < n; i++) {
+            if (!ThawValue(v, r, (*vec)[i].val, depth + 1) || !ThawValue(v, r, (*vec)[i].attrs, depth + 1)) {
+                return false;
+            }
+        }
+    }
+    for (SQInteger i = 0; i < MT_LAST; i++) {
+        if (!ThawValue(v, r, c->_metamethods[i], depth + 1)) {
+            return false;
+        }
+    }
+    if (!ThawValue(v, r, c->_attributes, depth + 1)) {
+        return false;
+    }
+    uint8_t locked;
+    _CHECK_READ(r.Get(&c->_constructoridx, sizeof(c->_constructoridx)) && r.Get(&locked, sizeof(locked)));
+    _CHECK_READ(c->_constructoridx >= -1 && c->_constructoridx < SQInteger(c->_methods.size()));
+    c->_locked = locked != 0;
+    return true;
+}
+
+static bool ThawClassName(SQVM * v, SQImageReader & r, SQObjectPtr & o) {
+    uint8_t where;
+    SQObjectPtr name;
+    _CHECK_READ(r.Get(&where, sizeof(where)) && where <= SQ_IMAGE_REGISTRY);
+    if (!ThawString(v, r, name)) {
+        return false;
+    }
+    SQObjectPtr const & table = ImageRoot(v, where);
+    if (sq_type(table) != OT_TABLE || !_table(table)->Get(name, o) || sq_type(o) != OT_CLASS) {
+        v->Raise_Error(_SC("cannot thaw an instance of unknown class '%s'"), _stringval(name));
+        return false;
+    }
+    r._refs.push_back(o);
+    return true;
+}
+
+static bool ThawInstance(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth) {
+    // the instance was numbered before its class
+    size_t const slot = r.Reserve();
+    SQObjectPtr cls;
+    if (!ThawValue(v, r, cls, depth + 1)) {
+        return false;
+    }
+    _CHECK_READ(sq_type(cls) == OT_CLASS);
+    SQClass * c = _class(cls);
+    SQInteger n;
+    _CHECK_READ(r.Get(&n, sizeof(n)));
+    if (n != SQInteger(c->_defaultvalues.size())) {
+        v->Raise_Error(_SC("the layout of the class of a thawed instance differs"));
+        return false;
+    }
+    // no constructor runs, only a thaw hook can set up the native state
+    if (IsNativeClass(c) && !c->_thawhook) {
+        v->Raise_Error(_SC("cannot thaw an instance of a native class with no thaw hook"));
+        return false;
+    }
+    SQInstance * inst = c->CreateInstance();
+    o = inst;
+    r._refs[slot] = o;
+    for (SQInteger i = 0; i < n; i++) {
+        if (!ThawValue(v, r, inst->_values[i], depth + 1)) {
+            return false;
+        }
+    }
+    if (c->_thawhook) {
+        v->Push(o);
+        SQInteger const res = c->_thawhook(v, -1, image_read, &r);
+        v->Pop();
+        if (SQ_FAILED(res)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ThawClosure(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth) {
+    if (!r._code) {
+        v->Raise_Error(_SC("this image may not contain functions"));
+        return false;
+    }
+    size_t const slot = r.Reserve();
+    SQUnsignedInteger32 type;
+    SQObjectPtr func;
+    _CHECK_READ(r.Get(&type, sizeof(type)));
+    if (type == OT_FUNCPROTO) {
+        r._refs.push_back(SQObjectPtr());
+        if (!SQFunctionProto::Load(v, &r, image_read, func, r._shared._codes ? &r._shared : nullptr)) {
+            return false;
+        }
+        r._refs.back() = func;
+    } else {
+        SQInteger idx;
+        _CHECK_READ(type == SQ_IMAGE_BACKREF && r.Get(&idx, sizeof(idx)) && idx >= 0 && size_t(idx) < r._refs.size());
+        func = r._refs[idx];
+        _CHECK_READ(sq_type(func) == OT_FUNCPROTO);
+    }
+    SQFunctionProto * f = _funcproto(func);
+    SQClosure * c = SQClosure::Create(_ss(v), f, _table(v->_roottable)->GetWeakRef(OT_TABLE));
+    o = c;
+    r._refs[slot] = o;
+    if (r._snapshot) {
+        SQObjectPtr root, env, base;
+        if (!ThawValue(v, r, root, depth + 1)
+            || !ThawValue(v, r, env, depth + 1)
+            || !ThawValue(v, r, base, depth + 1)) {
+            return false;
+        }
+        _CHECK_READ(sq_type(root) == OT_TABLE || sq_type(root) == OT_CLASS || sq_type(root) == OT_INSTANCE);
+        c->SetRoot(_refcounted(root)->GetWeakRef(sq_type(root)));
+        if (ISREFCOUNTED(sq_type(env))) {
+            c->_env = _refcounted(env)->GetWeakRef(sq_type(env));
+            c->_env->IncreaseRefCount();
+        }
+        if (sq_type(base) == OT_CLASS) {
+            c->_base = _class(base);
+            c->_base->IncreaseRefCount();
+        }
+    }
+    for (size_t i = 0; i < f->_noutervalues; i++) {
+        if (!ThawValue(v, r, c->_outervalues[i], depth + 1)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < f->_ndefaultparams; i++) {
+        if (!ThawValue(v, r, c->_defaultparams[i], depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ThawValue(SQVM * v, SQImageReader & r, SQObjectPtr & o, int depth) {
+    SQUnsignedInteger32 type;
+    _CHECK_READ(depth <= SQ_IMAGE_MAXDEPTH && r.Get(&type, sizeof(type)));
+    switch (type) {
+    case SQ_IMAGE_BACKREF: {
+        SQInteger idx;
+        _CHECK_READ(r.Get(&idx, sizeof(idx)) && idx >= 0 && size_t(idx) < r._refs.size());
+        o = r._refs[idx];
+        return true;
+    }
+    case SQ_IMAGE_BASELINE:
+        return ThawBaseline(v, r, o, depth);
+    case SQ_IMAGE_CLASSDEF:
+        return ThawClassDef(v, r, o, depth);
+    case OT_NULL:
+        o.Null();
+        return true;
+    case OT_BOOL:
+    case OT_INTEGER: {
+        SQInteger i;
+        _CHECK_READ(r.Get(&i, sizeof(i)));
+        o = i;
+        o._type = SQObjectType(type);
+        return true;
+    }
+    case OT_FLOAT: {
+        SQFloat f;
+        _CHECK_READ(r.Get(&f, sizeof(f)));
+        o = f;
+        return true;
+    }
+    case OT_STRING:
+        if (!ThawString(v, r, o)) {
+            return false;
+        }
+        r._refs.push_back(o);
+        return true;
+    case OT_ARRAY: {
+        SQInteger n;
+        _CHECK_READ(r.Get(&n, sizeof(n)) && n >= 0 && size_t(n) <= r._left);
+        SQArray * a = SQArray::Create(v->_sharedstate, 0, n);
+        o = a;
+        r._refs.push_back(o);
+        SQObjectPtr elem;
+        for (SQInteger i = 0; i < n; i++) {
+            if (!ThawValue(v, r, elem, depth + 1)) {
+                return false;
+            }
+            a->Append(elem);
+        }
+        return true;
+    }
+    case OT_TABLE: {
+        SQInteger n;
+        _CHECK_READ(r.Get(&n, sizeof(n)) && n >= 0 && size_t(n) <= r._left);
+        uint8_t weakmode;
+        _CHECK_READ(r.Get(&weakmode, sizeof(weakmode)) && weakmode <= (SQ_WEAK_KEYS | SQ_WEAK_VALUES));
+        SQTable * t = SQTable::Create(v->_sharedstate, n);
+        t->SetWeakMode(weakmode);
+        o = t;
+        r._refs.push_back(o);
+        SQObjectPtr key, val;
+        for (SQInteger i = 0; i < n; i++) {
+            if (!ThawValue(v, r, key, depth + 1) || !ThawValue(v, r, val, depth + 1)) {
+                return false;
+            }
+            _CHECK_READ(sq_type(key) != OT_NULL);
+            t->NewSlot(key, val);
+        }
+        if (r._snapshot) {
+            SQObjectPtr delegate;
+            if (!ThawValue(v, r, delegate, depth + 1)) {
+                return false;
+            }
+            _CHECK_READ(sq_type(delegate) == OT_NULL || sq_type(delegate) == OT_TABLE);
+            _CHECK_READ(sq_type(delegate) == OT_NULL || t->SetDelegate(_table(delegate)));
+        }
+        return true;
+    }
+    case OT_CLASS:
+        return ThawClassName(v, r, o);
+    case OT_INSTANCE:
+        return ThawInstance(v, r, o, depth);
+    case OT_CLOSURE:
+        return ThawClosure(v, r, o, depth);
+    case OT_OUTER: {
+        _CHECK_READ(r._snapshot);
+        SQOuter * outer = SQOuter::Create(_ss(v), nullptr);
+        outer->_valptr = &outer->_value;
+        o = outer;
+        r._refs.push_back(o);
+        return ThawValue(v, r, outer->_value, depth + 1);
+    }
+    case OT_WEAKREF: {
+        size_t const slot = r.Reserve();
+        SQObjectPtr target;
+        if (!ThawValue(v, r, target, depth + 1)) {
+            return false;
+        }
+        if (ISREFCOUNTED(sq_type(target))) {
+            o = _refcounted(target)->GetWeakRef(sq_type(target));
+        } else {
+            o = target;
+        }
+        r._refs[slot] = o;
+        return true;
+    }
+    default:
+        v->Raise_Error(_SC("corrupted image"));
+        return false;
+    }
+}
+
+SQImage * SQImage::Freeze(SQVM * v, SQObjectPtr const & o) {
+    SQImageWriter w(_ss(v), false);
+    w.Put(SQUnsignedInteger32(SQ_IMAGE_TAG));
+    if (!FreezeValue(v, w, o, 0)) {
+        return nullptr;
+    }
+    SQImage * img = (SQImage *)sq_vm_malloc(sizeof(SQImage) - 1 + w._len);
+    new (img) SQImage(w._len);
+    memcpy(img->_data, w._buf, w._len);
+    if (w._codes.size()) {
+        img->_ncodes = w._codes.size();
+        img->_codes = (SQSharedCode **)sq_vm_malloc(img->_ncodes * sizeof(SQSharedCode *));
+        memcpy(img->_codes, w._codes._vals, img->_ncodes * sizeof(SQSharedCode *));
+        w._codes.resize(0);
+    }
+    return img;
+}
+
+SQImage::~SQImage() {
+    for (size_t i = 0; i < _ncodes; i++) {
+        _codes[i]->Release();
+    }
+    if (_codes) {
+        sq_vm_free(_codes, _ncodes * sizeof(SQSharedCode *));
+    }
+}
+
+static bool ThawImage(SQVM * v, uint8_t const * data, size_t size, bool code, SQSharedCode * const * codes, size_t ncodes, SQObjectPtr & o) {
+    SQImageReader r;
+    r._p = data;
+    r._left = size;
+    r._snapshot = false;
+    r._code = code;
+    r._shared._codes = codes;
+    r._shared._count = ncodes;
+    r._shared._next = 0;
+    SQUnsignedInteger32 tag;
+    _CHECK_READ(r.Get(&tag, sizeof(tag)) && tag == SQ_IMAGE_TAG);
+    return ThawValue(v, r, o, 0);
+}
+
+bool SQImage::Thaw(SQVM * v, SQObjectPtr & o) {
+    return ThawImage(v, _data, _size, true, _codes, _ncodes, o);
+}
+
+bool SQImage::ThawBuffer(SQVM * v, uint8_t const * data, size_t size, bool code, SQObjectPtr & o) {
+    return ThawImage(v, data, size, code, nullptr, 0, o);
+}
+
+static void MarkBaseline(SQTable * base, SQTable * seen, SQObjectPtr const & o, SQArray * path, int depth) {
+    if (!ISREFCOUNTED(sq_type(o)) || sq_type(o) == OT_STRING || depth > SQ_IMAGE_MAXDEPTH) {
+        return;
+    }
+    SQObjectPtr dummy;
+    if (sq_type(o) != OT_TABLE) {
+        if (!base->Get(o, dummy)) {
+            base->NewSlot(o, SQObjectPtr(path->Clone()));
+        }
+        return;
+    }
+    if (seen->Get(o, dummy)) {
+        return;
+    }
+    seen->NewSlot(o, true);
+    SQObjectPtr key, val;
+    SQInteger idx = 0;
+    while ((idx = _table(o)->Next(false, idx, key, val)) != -1) {
+        if (sq_type(key) == OT_STRING || sq_type(key) == OT_INTEGER) {
+            path->Append(key);
+            MarkBaseline(base, seen, val, path, depth + 1);
+            path->Pop();
+        }
+    }
+}
+
+void SQImage::SetBaseline(SQVM * v) {
+    SQSharedState * ss = _ss(v);
+    SQTable * base = SQTable::Create(ss, 0);
+    ss->_snapshotbase = base;
+    SQObjectPtr seen(SQTable::Create(ss, 0));
+    SQObjectPtr path(SQArray::Create(ss, 0));
+    for (SQInteger where = SQ_IMAGE_ROOT; where <= SQ_IMAGE_CONSTS; where++) {
+        _array(path)->Append(SQObjectPtr(where));
+        MarkBaseline(base, _table(seen), ImageRoot(v, uint8_t(where)), _array(path), 0);
+        _array(path)->Pop();
+    }
+}
+
+bool SQImage::Snapshot(SQVM * v, SQWRITEFUNC write, SQUserPointer up) {
+    SQImageWriter w(_ss(v), true);
+    w.Put(SQUnsignedInteger32(SQ_SNAPSHOT_TAG));
+    for (SQInteger where = SQ_IMAGE_ROOT; where <= SQ_IMAGE_CONSTS; where++) {
+        if (!FreezeValue(v, w, ImageRoot(v, uint8_t(where)), 0)) {
+            return false;
+        }
+    }
+    SQInteger const size = SQInteger(w._len);
+    if (write(up, (SQUserPointer)&size, sizeof(size)) != sizeof(size)
+        || write(up, w._buf, size) != size) {
+        v->Raise_Error(_SC("io error"));
+        return false;
+    }
+    return true;
+}
+
+bool SQImage::Restore(SQVM * v, SQREADFUNC read, SQUserPointer up) {
+    SQInteger size;
+    if (read(up, &size, sizeof(size)) != sizeof(size) || size < 0) {
+        v->Raise_Error(_SC("io error"));
+        return false;
+    }
+    uint8_t * buf = (uint8_t *)sq_vm_malloc(size_t(size));
+    bool ok = read(up, buf, size) == size;
+    if (!ok) {
+        v->Raise_Error(_SC("io error"));
+    } else {
+        SQSharedState * ss = _ss(v);
+        if (sq_type(ss->_snapshotbase) != OT_TABLE) {
+            ss->_snapshotbase = SQTable::Create(ss, 0);
+        }
+        SQImageReader r;
+        r._p = buf;
+        r._left = size_t(size);
+        r._snapshot = true;
+        r._code = true;
+        SQObjectPtr roots[3];
+        SQUnsignedInteger32 tag;
+        ok = r.Get(&tag, sizeof(tag)) && tag == SQ_SNAPSHOT_TAG;
+        if (!ok) {
+            v->Raise_Error(_SC("corrupted image"));
+        }
+        // paths into the baseline resolve against this VM before its roots
+        // are replaced
+        for (SQInteger where = SQ_IMAGE_ROOT; ok && where <= SQ_IMAGE_CONSTS; where++) {
+            ok = ThawValue(v, r, roots[where], 0);
+        }
+        if (ok && (sq_type(roots[SQ_IMAGE_ROOT]) != OT_TABLE
+                || sq_type(roots[SQ_IMAGE_REGISTRY]) != OT_TABLE
+                || sq_type(roots[SQ_IMAGE_CONSTS]) != OT_TABLE)) {
+            v->Raise_Error(_SC("corrupted image"));
+            ok = false;
+        }
+        if (ok) {
+            v->_roottable = roots[SQ_IMAGE_ROOT];
+            ss->_registry = roots[SQ_IMAGE_REGISTRY];
+            ss->_consts = roots[SQ_IMAGE_CONSTS];
+        }
+    }
+    sq_vm_free(buf, size_t(size));
+    return ok;
+}
+
+bool SQChannel::Send(SQImage * msg) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_closed) {
+            return false;
+        }
+        _queue.push_back(msg);
+    }
+    _ready.notify_one();
+    return true;
+}
+
+SQImage * SQChannel::Receive(bool wait) {
+    std::unique_lock<std::mutex> guard(_lock);
+    while (wait && _head == _queue.size() && !_closed) {
+        _ready.wait(guard);
+    }
+    if (_head == _queue.size()) {
+        return nullptr;
+    }
+    SQImage * msg = _queue[_head++];
+    if (_head == _queue.size()) {
+        _queue.resize(0);
+        _head = 0;
+    }
+    return msg;
+}
+
+void SQChannel::Close() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _closed = true;
+    }
+    _ready.notify_all();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "sqobject.h"
+
+struct SQSharedCode;
+
+// Frozen byte image of a graph of values or of compiled closures. Shared
+// and cyclic references are preserved, instances refer to their class by
+// the name it is bound to in the root table or registry. It belongs to no
+// shared state and is never written after creation (except for its
+// reference count), so VMs living on other threads can thaw it
+// concurrently. Thawing a closure builds fresh protos in the target VM
+// that run the instructions in _codes read-only, so the bytecode is
+// neither recompiled nor copied. The bytes in _data carry the
+// instructions too and can be thawed on their own with ThawBuffer.
+struct SQImage {
+    std::atomic<size_t> _refs;
+    // instruction blocks of the frozen protos, in the order they were saved
+    SQSharedCode ** _codes;
+    size_t _ncodes;
+    size_t _size;
+    uint8_t _data[1];
+
+    // raises an error in v on unsupported values
+    static SQImage * Freeze(SQVM * v, SQObjectPtr const & o);
+
+    // thaws image bytes that did not necessarily come from an SQImage,
+    // closures only if code is set as their bytecode is not verified
+    static bool ThawBuffer(SQVM * v, uint8_t const * data, size_t size, bool code, SQObjectPtr & o);
+
+    bool Thaw(SQVM * v, SQObjectPtr & o);
+
+    // Heap snapshots: the root table, registry and consts with everything
+    // reachable from them. Objects reachable when the baseline was set
+    // (native closures, native classes and instances, ...) are written as
+    // their path from a root and resolved against the restoring VM, which
+    // must have set up the same baseline.
+    static void SetBaseline(SQVM * v);
+    static bool Snapshot(SQVM * v, SQWRITEFUNC write, SQUserPointer up);
+    static bool Restore(SQVM * v, SQREADFUNC read, SQUserPointer up);
+
+    void AddRef() {
+        _refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t const size = _size;
+            this->~SQImage();
+            sq_vm_free(this, sizeof(SQImage) - 1 + size);
+        }
+    }
+private:
+    SQImage(size_t size)
+        : _refs(1)
+        , _codes(nullptr)
+        , _ncodes(0)
+        , _size(size)
+    {}
+
+    ~SQImage();
+};
+
+// Thread-safe FIFO of frozen messages between VMs
+struct SQChannel {
+    std::atomic<size_t> _refs;
+    std::mutex _lock;
+    std::condition_variable _ready;
+    sqvector<SQImage *> _queue;
+    size_t _head;
+    bool _closed;
+
+    static SQChannel * Create() {
+        SQChannel * ch = (SQChannel *)sq_vm_malloc(sizeof(SQChannel));
+        new (ch) SQChannel();
+        return ch;
+    }
+
+    void AddRef() {
+        _refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~SQChannel();
+            sq_vm_free(this, sizeof(SQChannel));
+        }
+    }
+
+    // takes over the reference to msg, false once the channel is closed
+    bool Send(SQImage * msg);
+
+    // nullptr when empty (and wait is false) or closed and drained
+    SQImage * Receive(bool wait);
+
+    void Close();
+private:
+    SQChannel()
+        : _refs(1)
+        , _queue()
+        , _head(0)
+        , _closed(false)
+    {}
+
+    ~SQChannel() {
+        for (size_t i = _head; i < _queue.size(); i++) {
+            _queue[i]->Release();
+        }
+    }
+};
@@ -22,6 +22,7 @@ public:
             + theclass->_udsize;
         SQInstance * newinst = (SQInstance *)sq_vm_malloc(size);
         new (newinst) SQInstance(ss, theclass, size);
+        ss->gc.Allocated(size);
         if (theclass->_udsize) {
             newinst->user_data = ((unsigned char *)newinst) + (size - theclass->_udsize);
         }
@@ -34,6 +35,7 @@ public:
             + klass->_udsize;
         SQInstance * newinst = (SQInstance *)sq_vm_malloc(size);
         new (newinst) SQInstance(ss, this, size);
+        ss->gc.Allocated(size);
         if (klass->_udsize) {
             newinst->user_data = ((unsigned char *)newinst) + (size - klass->_udsize);
         }
@@ -51,6 +53,7 @@ public:
         }
 
         size_t const size = _memsize;
+        _sharedstate->gc.Freed(size);
         this->~SQInstance();
         sq_vm_free(this, size);
     }
@@ -39,6 +39,7 @@ public:
         SQNativeClosure * nc = (SQNativeClosure*)sq_vm_malloc(size);
         SQObjectPtr * outervalues = reinterpret_cast<SQObjectPtr *>(nc + 1);
         new (nc) SQNativeClosure(ss, func, outervalues, nouters);
+        ss->gc.Allocated(size);
         return nc;
     }
 
@@ -58,6 +59,7 @@ public:
     void Release() {
         size_t const size = sizeof(SQNativeClosure)
             + _noutervalues * sizeof(SQObjectPtr);
+        _sharedstate->gc.Freed(size);
 
         for (size_t i = 0; i < _noutervalues; i++) {
             _outervalues[i].~SQObjectPtr();
@@ -3,6 +3,7 @@
 #include <new>
 
 #include "SQCollectable.hpp"
+#include "sqstate.h"
 
 struct SQOuter : public CHAINABLE_OBJ {
 private:
@@ -16,10 +17,12 @@ public:
     static SQOuter * Create(SQSharedState *ss, SQObjectPtr *outer) {
         SQOuter *nc  = (SQOuter*)sq_vm_malloc(sizeof(SQOuter));
         new (nc) SQOuter(ss, outer);
+        ss->gc.Allocated(sizeof(SQOuter));
         return nc;
     }
 
     void Release() {
+        _sharedstate->gc.Freed(sizeof(SQOuter));
         this->~SQOuter();
         sq_vm_free(this, sizeof(SQOuter));
     }
@@ -15,6 +15,10 @@
 
 #define hashptr(p)  ((SQHash)(((SQInteger)p) >> 3))
 
+#define SQ_TABLE_SMALL 8
+// the array part holds at most 2^SQ_TABLE_ARRAYBITS keys
+#define SQ_TABLE_ARRAYBITS 26
+
 inline SQHash HashObj(SQObject const & key) {
     switch (sq_type(key)) {
     case OT_STRING:
@@ -43,58 +47,197 @@ private:
         {}
     };
 
-    _HashNode * _firstfree;
-    _HashNode * _nodes;
-    size_t _numofnodes;
-    size_t _usednodes;
+    // Metamethods present in this table when it serves as a delegate.
+    // Built on first lookup and rebuilt after any slot change.
+    struct _MetaCache {
+        uint32_t mask;
+        SQObject methods[MT_LAST];
+    };
+
+    // Tables of up to SQ_TABLE_SMALL slots keep bare key/value pairs and
+    // find keys by a linear scan, they switch to hashing when they outgrow it
+    struct _SmallNode {
+        SQObjectPtr val;
+        SQObjectPtr key;
+    };
+
+    union {
+        _HashNode * _firstfree;
+        size_t _npairs;         // pairs in use or emptied by Remove
+    };
+    union {
+        _HashNode * _nodes;
+        _SmallNode * _pairs;
+    };
+    size_t _numofnodes;         // allocated nodes or pairs
+    size_t _usednodes;          // slots in use, array part included
+    // Hashed tables move the integer keys 0.._arraysize-1 here when Rehash
+    // finds them dense enough. Those keys never live in the hash part, bit i
+    // of _arraybits tells whether key i is bound, possibly to null. Both
+    // share one allocation.
+    SQObjectPtr * _arraypart;
+    uint32_t * _arraybits;
+    uint32_t _arraysize;
+    uint32_t _arrayused;
+    _MetaCache * _mmcache;
+    bool _mmstale;
+    bool _small;
+    // SQ_WEAK_KEYS and/or SQ_WEAK_VALUES. Weak slots hold the weak reference
+    // of the object, a slot whose object is released is dead: it is skipped
+    // and emptied on the next Prune(). Weak tables have no array part.
+    uint8_t _weakmode;
 
     SQTable(SQSharedState * ss, size_t nInitialSize);
 
     ~SQTable() {
         SetDelegate(nullptr);
-        for (size_t i = 0; i < _numofnodes; i++) {
-            _nodes[i].~_HashNode();
+        if (_small) {
+            FreePairs();
+        } else {
+            for (size_t i = 0; i < _numofnodes; i++) {
+                _nodes[i].~_HashNode();
+            }
+            sq_vm_free(_nodes, _numofnodes * sizeof(_HashNode));
+            _sharedstate->gc.Freed(_numofnodes * sizeof(_HashNode));
+            FreeArray(_arraypart, _arraysize);
+        }
+        if (_mmcache) {
+            sq_vm_free(_mmcache, sizeof(_MetaCache));
+            _sharedstate->gc.Freed(sizeof(_MetaCache));
         }
-        sq_vm_free(_nodes, _numofnodes * sizeof(_HashNode));
     }
 
+    void AllocPairs(size_t nSize);
+    void FreePairs();
+    void GrowPairs();
     void AllocNodes(size_t nSize);
+    void AllocArray(size_t nSize);
+    void FreeArray(SQObjectPtr * array, size_t nSize);
+    static size_t ArrayBytes(size_t nSize) {
+        return nSize * sizeof(SQObjectPtr) + (nSize + 31) / 32 * sizeof(uint32_t);
+    }
+    bool _InArray(size_t i) const {
+        return (_arraybits[i >> 5] >> (i & 31)) & 1;
+    }
+    size_t ArraySizeFor(size_t & ninarray);
     void Rehash(bool force);
     void _ClearNodes();
+    void _BuildMetaCache(SQSharedState * ss);
+    SQObjectPtr * _FindWeak(SQObject const & key);
+    bool _StoredKey(SQObject const & key, SQObject & stored);
+    bool _IsDead(SQObject const & key, SQObject const & val) const;
+    SQObjectPtr _Weaken(SQObjectPtr const & o, uint8_t mode) const;
+    bool _NewSlot(const SQObjectPtr &key,const SQObjectPtr &val);
 public:
     static SQTable * Create(SQSharedState * ss, SQInteger nInitialSize) {
         auto table = (SQTable *)sq_vm_malloc(sizeof(SQTable));
         new (table) SQTable(ss, std::max(0ll, nInitialSize));
+        ss->gc.Allocated(sizeof(SQTable));
         return table;
     }
 
     void Release() {
+        _sharedstate->gc.Freed(sizeof(*this));
         this->~SQTable();
         sq_vm_free(this, sizeof(*this));
     }
 
     void Finalize();
 
+    // the table and its slot storage
+    size_t MemSize() const {
+        return sizeof(SQTable)
+            + _numofnodes * (_small ? sizeof(_SmallNode) : sizeof(_HashNode))
+            + ArrayBytes(_arraysize)
+            + (_mmcache ? sizeof(_MetaCache) : 0);
+    }
+
     SQTable *Clone();
 
 #ifndef NO_GARBAGE_COLLECTOR
     void Mark(SQCollectable **chain);
     SQObjectType GetType() { return OT_TABLE; }
+    // marks the values whose weak key has been reached since, true if any
+    bool MarkEphemerons(SQCollectable **chain);
+    // empties the weak slots whose object was not reached by the mark
+    void PruneUnmarked();
 #endif
 
     bool Get(const SQObjectPtr &key,SQObjectPtr &val);
+    // Same as Get() with the metamethod name, a bit test when it is absent
+    bool GetMetaMethod(SQSharedState * ss, SQMetaMethod mm, SQObjectPtr & res) {
+        if (_mmstale) {
+            _BuildMetaCache(ss);
+        }
+        if (!(_mmcache->mask & (1u << mm))) {
+            return false;
+        }
+        SQObject const & m = _mmcache->methods[mm];
+        if ((_weakmode & SQ_WEAK_VALUES) && sq_type(m) == OT_WEAKREF
+                && sq_type(_weakref(m)->_obj) == OT_NULL) {
+            return false; // a weak value released since the cache was built
+        }
+        res = _realval(m);
+        return true;
+    }
     void Remove(const SQObjectPtr &key);
     bool Set(const SQObjectPtr &key, const SQObjectPtr &val);
     //returns true if a new slot has been created false if it was already present
-    bool NewSlot(const SQObjectPtr &key,const SQObjectPtr &val);
+    bool NewSlot(const SQObjectPtr &key,const SQObjectPtr &val) {
+        if (_weakmode) {
+            return _NewSlot(_Weaken(key, SQ_WEAK_KEYS), _Weaken(val, SQ_WEAK_VALUES));
+        }
+        return _NewSlot(key, val);
+    }
     SQInteger Next(bool getweakrefs,const SQObjectPtr &refpos, SQObjectPtr &outkey, SQObjectPtr &outval);
 
     size_t CountUsed() {
+        if (_weakmode) {
+            Prune();
+        }
         return _usednodes;
     }
+    // the same count without emptying dead slots, for readers that must
+    // not release anything
+    size_t CountLive();
     void Clear();
+
+    // keeps the live slots, converting them to the new mode
+    void SetWeakMode(uint8_t mode);
+    uint8_t GetWeakMode() const { return _weakmode; }
+    // empties the dead slots, returns how many there were
+    size_t Prune();
 private:
-    inline _HashNode * _Get(SQObjectPtr const & key, SQHash hash) {
+    inline _SmallNode * _GetPair(SQObject const & key) {
+        if (sq_type(key) == OT_NULL) {
+            return nullptr; // would match emptied pairs
+        }
+        for (size_t i = 0; i < _npairs; i++) {
+            _SmallNode * p = &_pairs[i];
+            if (_rawval(p->key) == _rawval(key) && sq_type(p->key) == sq_type(key)) {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    // the value slot of key, nullptr when absent
+    inline SQObjectPtr * _Find(SQObjectPtr const & key) {
+        if (_weakmode) {
+            return _FindWeak(key);
+        }
+        if (_small) {
+            _SmallNode * p = _GetPair(key);
+            return p ? &p->val : nullptr;
+        }
+        if (sq_type(key) == OT_INTEGER && SQUnsignedInteger(_integer(key)) < _arraysize) {
+            return _InArray(size_t(_integer(key))) ? &_arraypart[_integer(key)] : nullptr;
+        }
+        _HashNode * n = _Get(key, HashObj(key) & (_numofnodes - 1));
+        return n ? &n->val : nullptr;
+    }
+
+    inline _HashNode * _Get(SQObject const & key, SQHash hash) {
         _HashNode * n = &_nodes[hash];
 
         do {
@@ -25,6 +25,7 @@ public:
     static SQUserData * Create(SQSharedState * ss, size_t size) {
         SQUserData* ud = (SQUserData*)sq_vm_malloc(sizeof(SQUserData) + size);
         new (ud) SQUserData(ss, size);
+        ss->gc.Allocated(sizeof(SQUserData) + size);
         return ud;
     }
 
@@ -34,6 +35,7 @@ public:
             _hook(SQUserPointer(this + 1), user_data_size);
         }
 
+        _sharedstate->gc.Freed(sizeof(SQUserData) + user_data_size);
         this->~SQUserData();
         sq_vm_free(this, sizeof(SQUserData) + user_data_size);
     }
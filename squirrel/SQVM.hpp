@@ -3,6 +3,7 @@
 #include "SQCollectable.hpp"
 #include "sqopcodes.h"
 #include "sqobject.h"
+#include "sqstate.h"
 
 #define MIN_STACK_OVERHEAD 15
 
@@ -10,37 +11,18 @@
 #define SQ_TAILCALL_FLAG -777
 #define DONT_FALL_BACK 666
 
+// _budget of a VM without a budget, reset whenever it runs out
+#define SQ_BUDGET_OFF ((SQInteger)(~(SQUnsignedInteger)0 >> 1))
+
 #define GET_FLAG_RAW                0x00000001
 #define GET_FLAG_DO_NOT_RAISE_ERROR 0x00000002
 
-struct SQExceptionTrap {
-    SQInteger _stackbase;
-    SQInteger _stacksize;
-    SQInstruction *_ip;
-    SQInteger _extarget;
-
-    SQExceptionTrap()
-        : _stackbase(0)
-        , _stacksize(0)
-        , _ip(nullptr)
-        , _extarget(0)
-    {}
-
-    SQExceptionTrap(SQInteger ss, SQInteger stackbase, SQInstruction * ip, SQInteger ex_target)
-        : _stackbase(stackbase)
-        , _stacksize(ss)
-        , _ip(ip)
-        , _extarget(ex_target)
-    {}
-};
-
 struct SQVM : public CHAINABLE_OBJ {
     struct CallInfo {
         SQInstruction * _ip;
         SQObjectPtr * _literals;
         SQObjectPtr _closure;
         SQGenerator * _generator;
-        SQInt32 _etraps;
         SQInt32 _prevstkbase;
         SQInt32 _prevtop;
         SQInt32 _target;
@@ -62,6 +44,52 @@ struct SQVM : public CHAINABLE_OBJ {
         {}
     };
 public:
+    // A callee invoked over and over from native code with the same number
+    // of arguments, like the function given to the higher-order builtins.
+    // Its kind is resolved once and its argument slots stay reserved on top
+    // of the stack, along with room for its frame, so a call only rewrites
+    // them. Nothing may be pushed above the slots while it is alive; they
+    // are popped when it goes out of scope.
+    struct PreparedCall {
+        typedef bool (PreparedCall::*InvokeFunc)(SQObjectPtr & res, SQBool raiseerror);
+
+        SQVM * _vm;
+        SQObjectPtr _callee;
+        SQInteger _nargs;
+        SQInteger _base;
+        InvokeFunc _invoke;
+
+        PreparedCall(SQVM * v)
+            : _vm(v)
+            , _callee()
+            , _nargs(0)
+            , _base(0)
+            , _invoke(nullptr)
+        {}
+
+        ~PreparedCall() {
+            _vm->Pop(_nargs);
+        }
+
+        // raises an error if callee cannot be called
+        bool Prepare(SQObjectPtr const & callee, SQInteger nargs);
+
+        // argument n, 0 being this
+        SQObjectPtr & Arg(SQInteger n) {
+            return _vm->_stack._vals[_base + n];
+        }
+
+        bool Invoke(SQObjectPtr & res, SQBool raiseerror = SQFalse) {
+            assert(_vm->stack_top == _base + _nargs);
+            return (this->*_invoke)(res, raiseerror);
+        }
+
+    private:
+        bool InvokeClosure(SQObjectPtr & res, SQBool raiseerror);
+        bool InvokeNative(SQObjectPtr & res, SQBool raiseerror);
+        bool InvokeClass(SQObjectPtr & res, SQBool raiseerror);
+    };
+
     SQSharedState * _sharedstate;
     SQRELEASEHOOK release_hook;
     SQUserPointer release_hook_user_pointer;
@@ -81,7 +109,6 @@ public:
     SQDEBUGHOOK _debughook_native;
     SQObjectPtr _debughook_closure;
 
-    sqvector<SQExceptionTrap> _etraps;
     CallInfo *ci;
 
     size_t n_metamethod_calls;
@@ -89,11 +116,15 @@ public:
     //suspend infos
     bool is_suspended;
     SQInteger _suspended_target;
+
+    // safepoints (loop back-edges and script calls) left before the VM
+    // suspends itself, see sq_setbudget()
+    SQInteger _budget;
+    bool _budgeted;
 private:
     SQOuter * _openouters;
     size_t n_native_calls;
     bool _suspended_root;
-    SQInteger _suspended_traps;
     SQObjectPtr temp_reg;
 public:
     enum ExecutionType {
@@ -111,6 +142,7 @@ public:
     ~SQVM();
 
     void Release() {
+        _sharedstate->gc.Freed(sizeof(*this));
         this->~SQVM();
         sq_vm_free(this, sizeof(*this));
     }
@@ -119,6 +151,9 @@ public:
 	bool TailCall(SQClosure *closure, SQInteger firstparam, SQInteger nparams);
     bool Call(SQObjectPtr &closure, SQInteger nparams, SQInteger stackbase, SQObjectPtr &outres,SQBool raiseerror);
     SQRESULT Suspend();
+    bool Preempt();
+    // true if a try block of the frames run by the current Execute covers the error
+    bool IsTrapped();
     void CallDebugHook(SQInteger type,SQInteger forcedline=0);
     bool Get(const SQObjectPtr &self, const SQObjectPtr &key, SQObjectPtr &dest, SQUnsignedInteger getflags, SQInteger selfidx);
     bool Set(const SQObjectPtr &self, const SQObjectPtr &key, const SQObjectPtr &val, SQInteger selfidx);
@@ -151,6 +186,14 @@ public:
 
     void Remove(SQInteger n);
 
+    // resizes the stack to hold at least size slots
+    void GrowStack(size_t size);
+
+    // bytes of the value and call stacks
+    size_t StackBytes() {
+        return _stack.capacity() * sizeof(SQObjectPtr) + call_stack.capacity() * sizeof(CallInfo);
+    }
+
     inline void Pop() {
         _stack[--stack_top].Null();
     }
@@ -167,9 +210,14 @@ public:
     SQObjectPtr &GetUp(SQInteger n);
     SQObjectPtr &GetAt(SQInteger n);
 private:
+    // tells the collector how much StackBytes() moved from before
+    void StackResized(size_t before);
     void GrowCallStack();
+    // the dispatch loop behind Execute, with or without the line hook check
+    template<bool hooked> bool Run(SQObjectPtr &outres, SQBool raiseerror, bool throwing);
     bool CallNative(SQNativeClosure * nclosure, SQInteger nargs, SQInteger newbase, SQObjectPtr & retval, SQInt32 target, bool & suspend, bool & tailcall);
     bool StartCall(SQClosure * closure, SQInteger target, SQInteger nargs, SQInteger stackbase, bool tailcall);
+    bool AdjustParams(SQClosure * closure, SQInteger nargs, SQInteger stackbase);
     void CallErrorHandler(SQObjectPtr &e);
     SQInteger FallBackGet(const SQObjectPtr &self,const SQObjectPtr &key,SQObjectPtr &dest);
     bool InvokeDefaultDelegate(const SQObjectPtr &self,const SQObjectPtr &key,SQObjectPtr &dest);
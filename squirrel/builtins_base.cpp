@@ -9,6 +9,7 @@
 #include "SQTable.hpp"
 #include "SQVM.hpp"
 #include "SQArray.hpp"
+#include "SQCensus.hpp"
 #include "SQFunctionProto.hpp"
 #include "SQClosure.hpp"
 #include "SQClass.hpp"
@@ -26,6 +27,15 @@ static SQInteger base_collectgarbage(HSQUIRRELVM v)
     sq_pushinteger(v, sq_collectgarbage(v));
     return 1;
 }
+static SQInteger base_heapcensus(HSQUIRRELVM v)
+{
+    SQInteger ntop = SQ_CENSUS_DUMPTOP;
+    if (sq_gettop(v) > 1) {
+        sq_getinteger(v, 2, &ntop);
+    }
+    sq_heapcensus(v, ntop);
+    return 1;
+}
 static SQInteger base_resurectureachable(HSQUIRRELVM v)
 {
     sq_resurrectunreachable(v);
@@ -188,7 +198,13 @@ static SQInteger base_newthread(HSQUIRRELVM v)
 {
     SQObjectPtr &func = stack_get(v,2);
     SQInteger stksize = (_closure(func)->_function->_stacksize << 1) +2;
-    HSQUIRRELVM newv = sq_newthread(v, (stksize < MIN_STACK_OVERHEAD + 2)? MIN_STACK_OVERHEAD + 2 : stksize);
+    if (stksize < MIN_STACK_OVERHEAD + 2) {
+        stksize = MIN_STACK_OVERHEAD + 2;
+    }
+    if (stksize < SQInteger(_ss(v)->_threadstacksize)) {
+        stksize = SQInteger(_ss(v)->_threadstacksize);
+    }
+    HSQUIRRELVM newv = sq_newthread(v, stksize);
     sq_move(newv,v,-2);
     return 1;
 }
@@ -253,6 +269,7 @@ static const SQRegFunction base_funcs[] = {
 #ifndef NO_GARBAGE_COLLECTOR
     {"collectgarbage",       base_collectgarbage,     0, nullptr},
     {"resurrectunreachable", base_resurectureachable, 0, nullptr},
+    {"heapcensus",           base_heapcensus,        -1, ".n"},
 #endif
     {nullptr, nullptr, 0, nullptr}
 };
@@ -463,8 +480,7 @@ static SQInteger array_resize(HSQUIRRELVM v)
 }
 
 static SQInteger __map_array(SQArray *dest, SQArray *src, HSQUIRRELVM v) {
-    SQObject & closure = stack_get(v, 2);
-    v->Push(closure);
+    SQObjectPtr & closure = stack_get(v, 2);
 
     SQInteger nArgs = 0;
     if (sq_type(closure) == OT_CLOSURE) {
@@ -479,33 +495,41 @@ static SQInteger __map_array(SQArray *dest, SQArray *src, HSQUIRRELVM v) {
         }
     }
 
+    SQVM::PreparedCall call(v);
+    if (!call.Prepare(closure, nArgs)) {
+        return SQ_ERROR;
+    }
+
+    SQObjectPtr temp, res;
     size_t size = src->Size();
     for (size_t i = 0; i < size; i++) {
-        SQObjectPtr temp;
+        temp.Null();
         src->Get(SQInteger(i), temp);
-        v->Push(src);
-        v->Push(temp);
+        call.Arg(0) = src;
+        call.Arg(1) = temp;
         if (nArgs >= 3) {
-            v->Push(SQObjectPtr(SQInteger(i)));
+            call.Arg(2) = SQInteger(i);
         }
         if (nArgs >= 4) {
-            v->Push(src);
+            call.Arg(3) = src;
         }
-        if (SQ_FAILED(sq_call(v,nArgs,SQTrue,SQFalse))) {
+        if (!call.Invoke(res)) {
             return SQ_ERROR;
         }
-        dest->Set(SQInteger(i), v->GetUp(-1));
-        v->Pop();
+        if (dest == src) {
+            dest->Set(SQInteger(i), res);
+        } else {
+            dest->Append(res);
+        }
     }
 
-    v->Pop();
     return 0;
 }
 
 static SQInteger array_map(HSQUIRRELVM v) {
     SQObject & o = stack_get(v, 1);
     SQInteger size = _array(o)->Size();
-    SQObjectPtr ret = SQArray::Create(_ss(v), size);
+    SQObjectPtr ret = SQArray::Create(_ss(v), 0, size);
     if (SQ_FAILED(__map_array(_array(ret), _array(o), v))) {
         return SQ_ERROR;
     }
@@ -524,7 +548,8 @@ static SQInteger array_apply(HSQUIRRELVM v)
 
 static SQInteger array_reduce(HSQUIRRELVM v)
 {
-    SQObject &o = stack_get(v,1);
+    // a copy, the callback may grow the stack
+    SQObjectPtr o = stack_get(v,1);
     SQArray *a = _array(o);
     SQInteger size = a->Size();
     SQObjectPtr res;
@@ -539,20 +564,20 @@ static SQInteger array_reduce(HSQUIRRELVM v)
         iterStart = 1;
     }
     if (size > iterStart) {
+        SQVM::PreparedCall call(v);
+        if (!call.Prepare(stack_get(v,2), 3)) {
+            return SQ_ERROR;
+        }
         SQObjectPtr other;
-        v->Push(stack_get(v,2));
         for (SQInteger n = iterStart; n < size; n++) {
             a->Get(n,other);
-            v->Push(o);
-            v->Push(res);
-            v->Push(other);
-            if(SQ_FAILED(sq_call(v,3,SQTrue,SQFalse))) {
+            call.Arg(0) = o;
+            call.Arg(1) = res;
+            call.Arg(2) = other;
+            if(!call.Invoke(res)) {
                 return SQ_ERROR;
             }
-            res = v->GetUp(-1);
-            v->Pop();
         }
-        v->Pop();
     }
     v->Push(res);
     return 1;
@@ -560,23 +585,29 @@ static SQInteger array_reduce(HSQUIRRELVM v)
 
 static SQInteger array_filter(HSQUIRRELVM v)
 {
-    SQObject &o = stack_get(v,1);
+    // a copy, the callback may grow the stack
+    SQObjectPtr o = stack_get(v,1);
     SQArray *a = _array(o);
     SQObjectPtr ret = SQArray::Create(_ss(v),0);
     SQInteger size = a->Size();
-    SQObjectPtr val;
-    for(SQInteger n = 0; n < size; n++) {
-        a->Get(n,val);
-        v->Push(o);
-        v->Push(n);
-        v->Push(val);
-        if(SQ_FAILED(sq_call(v,3,SQTrue,SQFalse))) {
+    {
+        SQVM::PreparedCall call(v);
+        if (!call.Prepare(stack_get(v,2), 3)) {
             return SQ_ERROR;
         }
-        if(!SQVM::IsFalse(v->GetUp(-1))) {
-            _array(ret)->Append(val);
+        SQObjectPtr val, res;
+        for(SQInteger n = 0; n < size; n++) {
+            a->Get(n,val);
+            call.Arg(0) = o;
+            call.Arg(1) = n;
+            call.Arg(2) = val;
+            if(!call.Invoke(res)) {
+                return SQ_ERROR;
+            }
+            if(!SQVM::IsFalse(res)) {
+                _array(ret)->Append(val);
+            }
         }
-        v->Pop();
     }
     v->Push(ret);
     return 1;
@@ -604,38 +635,45 @@ static SQInteger array_find(HSQUIRRELVM v)
 static bool _sort_compare(
     HSQUIRRELVM v,
     SQArray *arr,
-    SQObjectPtr &a,
-    SQObjectPtr &b,
-    SQInteger func,
+    SQInteger ia,
+    SQInteger ib,
+    SQVM::PreparedCall *func,
     SQInteger &ret
 ) {
-    if(func < 0) {
+    if (!func && arr->_kind == OT_NULL) {
+        return v->ObjCmp(arr->_values[ia], arr->_values[ib], ret);
+    }
+    SQObjectPtr a, b;
+    arr->Get(ia, a);
+    arr->Get(ib, b);
+    if(!func) {
         if (!v->ObjCmp(a,b,ret)) {
             return false;
         }
     }
     else {
-        SQInteger top = sq_gettop(v);
-        sq_push(v, func);
-        sq_pushroottable(v);
-        v->Push(a);
-        v->Push(b);
-		SQObjectPtr *valptr = arr->_values._vals;
-		SQUnsignedInteger precallsize = arr->_values.size();
-        if(SQ_FAILED(sq_call(v, 3, SQTrue, SQFalse))) {
+        func->Arg(0) = v->_roottable;
+        func->Arg(1) = a;
+        func->Arg(2) = b;
+		SQUnsignedInteger precallsize = arr->Size();
+        SQObjectPtr res;
+        if(!func->Invoke(res)) {
             if(!sq_isstring( v->_lasterror))
                 v->Raise_Error(_SC("compare func failed"));
             return false;
         }
-		if(SQ_FAILED(sq_getinteger(v, -1, &ret))) {
+        if (sq_isnumeric(res)) {
+            ret = tointeger(res);
+        } else if (sq_isbool(res)) {
+            ret = SQVM::IsFalse(res) ? SQFalse : SQTrue;
+        } else {
             v->Raise_Error(_SC("numeric value expected as return value of the compare function"));
             return false;
         }
-		if (precallsize != arr->_values.size() || valptr != arr->_values._vals) {
+		if (precallsize != arr->Size()) {
 			v->Raise_Error(_SC("array resized during sort operation"));
 			return false;
 		}
-        sq_settop(v, top);
         return true;
     }
     return true;
@@ -646,7 +684,7 @@ static bool _hsort_sift_down(
     SQArray *arr,
     SQInteger root,
     SQInteger bottom,
-    SQInteger func
+    SQVM::PreparedCall *func
 ) {
     SQInteger maxChild;
     SQInteger done = 0;
@@ -658,7 +696,7 @@ static bool _hsort_sift_down(
             maxChild = root2;
         }
         else {
-            if(!_sort_compare(v,arr,arr->_values[root2],arr->_values[root2 + 1],func,ret))
+            if(!_sort_compare(v,arr,root2,root2 + 1,func,ret))
                 return false;
             if (ret > 0) {
                 maxChild = root2;
@@ -668,7 +706,7 @@ static bool _hsort_sift_down(
             }
         }
 
-        if(!_sort_compare(v,arr,arr->_values[root],arr->_values[maxChild],func,ret))
+        if(!_sort_compare(v,arr,root,maxChild,func,ret))
             return false;
         if (ret < 0) {
             if (root == maxChild) {
@@ -676,7 +714,7 @@ static bool _hsort_sift_down(
                 return false; // We'd be swapping ourselve. The compare function is incorrect
             }
 
-            _Swap(arr->_values[root],arr->_values[maxChild]);
+            arr->Swap(root,maxChild);
             root = maxChild;
         }
         else {
@@ -689,7 +727,7 @@ static bool _hsort_sift_down(
 static bool _hsort(
     HSQUIRRELVM v,
     SQObjectPtr & arr,
-    SQInteger func
+    SQVM::PreparedCall *func
 ) {
     SQArray * a = _array(arr);
     SQInteger i;
@@ -701,7 +739,7 @@ static bool _hsort(
     }
 
     for (i = array_size - 1; i >= 1; i--) {
-        _Swap(a->_values[0], a->_values[i]);
+        a->Swap(0, i);
         if (!_hsort_sift_down(v,a, 0, i-1,func)) {
             return false;
         }
@@ -710,13 +748,15 @@ static bool _hsort(
 }
 
 static SQInteger array_sort(HSQUIRRELVM v) {
-    SQInteger func = -1;
     SQObjectPtr & o = stack_get(v,1);
     if (_array(o)->Size() > 1) {
         if (sq_gettop(v) == 2) {
-            func = 2;
+            SQVM::PreparedCall func(v);
+            if (!func.Prepare(stack_get(v,2), 3) || !_hsort(v, o, &func)) {
+                return SQ_ERROR;
+            }
         }
-        if (!_hsort(v, o, func)) {
+        else if (!_array(o)->SortUnboxed() && !_hsort(v, o, nullptr)) {
             return SQ_ERROR;
         }
     }
@@ -773,11 +813,12 @@ static SQInteger array_slice(HSQUIRRELVM v) {
     size_t s_idx = arg_start;
     size_t e_idx = arg_end;
 
-    SQArray * dst = SQArray::Create(v->_sharedstate, SQInteger(e_idx - s_idx));
+    // appending keeps the values of a numeric array unboxed
+    SQArray * dst = SQArray::Create(v->_sharedstate, 0, SQInteger(e_idx - s_idx));
+    SQObjectPtr tmp;
     for (size_t i = s_idx; i < e_idx; i++) {
-        SQObjectPtr tmp;
         _array(o)->Get(SQInteger(i), tmp);
-        dst->Set(SQInteger(i - s_idx), tmp);
+        dst->Append(tmp);
     }
 
     v->Push(dst);
@@ -909,7 +950,9 @@ static SQInteger _closure_acall(HSQUIRRELVM v, SQBool raiseerror) {
 
     size_t n_args = args->Size();
     for (size_t i = 0; i < n_args; i++) {
-        v->Push(args->_values[i]);
+        SQObjectPtr arg;
+        args->Get(SQInteger(i), arg);
+        v->Push(arg);
     }
     return SQ_SUCCEEDED(sq_call(v, SQInteger(n_args), SQTrue, raiseerror))
         ? 1
@@ -972,6 +1015,7 @@ static SQInteger closure_getinfos(HSQUIRRELVM v) {
         res->NewSlot(v->_sharedstate->gc.AddString("parameters", strlen("parameters")), params);
         res->NewSlot(v->_sharedstate->gc.AddString("varargs", strlen("varargs")), f->_varparams);
         res->NewSlot(v->_sharedstate->gc.AddString("defparams", strlen("defparams")), defparams);
+        res->NewSlot(v->_sharedstate->gc.AddString("stacksize", strlen("stacksize")), f->_stacksize);
     }
     else { //OT_NATIVECLOSURE
         SQNativeClosure *nc = _nativeclosure(o);
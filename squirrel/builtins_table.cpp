@@ -25,27 +25,58 @@ static SQInteger table_getdelegate(HSQUIRRELVM vm) {
         : SQ_ERROR;
 }
 
+// "k", "v" or "kv", the empty string for a strong table
+static SQInteger table_setweakmode(HSQUIRRELVM vm) {
+    SQChar const * str;
+    sq_getstring(vm, 2, &str);
+    SQInteger mode = 0;
+    for (; *str; str++) {
+        switch (*str) {
+        case 'k': mode |= SQ_WEAK_KEYS; break;
+        case 'v': mode |= SQ_WEAK_VALUES; break;
+        default: return sq_throwerror(vm, _SC("weak mode must be made of 'k' and 'v'"));
+        }
+    }
+    sq_setweakmode(vm, 1, mode);
+    sq_push(vm, 1);
+    return 1;
+}
+
+static SQInteger table_getweakmode(HSQUIRRELVM vm) {
+    SQInteger const mode = sq_getweakmode(vm, 1);
+    sq_pushstring(vm, (mode & SQ_WEAK_KEYS) ? ((mode & SQ_WEAK_VALUES) ? _SC("kv") : _SC("k"))
+        : ((mode & SQ_WEAK_VALUES) ? _SC("v") : _SC("")), -1);
+    return 1;
+}
+
 static SQInteger table_filter(HSQUIRRELVM vm) {
-    SQObject & o = stack_get(vm, 1);
+    // a copy, the callback may grow the stack
+    SQObjectPtr o = stack_get(vm, 1);
     SQTable * tbl = _table(o);
     SQObjectPtr ret = SQTable::Create(vm->_sharedstate, 0);
 
-    SQObjectPtr itr, key, val;
-    SQInteger nitr;
-    while((nitr = tbl->Next(false, itr, key, val)) != -1) {
-        itr = (SQInteger)nitr;
-
-        vm->Push(o);
-        vm->Push(key);
-        vm->Push(val);
-        if (SQ_FAILED(sq_call(vm, 3, SQTrue, SQFalse))) {
+    {
+        SQVM::PreparedCall call(vm);
+        if (!call.Prepare(stack_get(vm, 2), 3)) {
             return SQ_ERROR;
         }
 
-        if (!SQVM::IsFalse(vm->GetUp(-1))) {
-            _table(ret)->NewSlot(key, val);
+        SQObjectPtr itr, key, val, res;
+        SQInteger nitr;
+        while((nitr = tbl->Next(false, itr, key, val)) != -1) {
+            itr = (SQInteger)nitr;
+
+            call.Arg(0) = o;
+            call.Arg(1) = key;
+            call.Arg(2) = val;
+            if (!call.Invoke(res)) {
+                return SQ_ERROR;
+            }
+
+            if (!SQVM::IsFalse(res)) {
+                _table(ret)->NewSlot(key, val);
+            }
         }
-        vm->Pop();
     }
 
     vm->Push(ret);
@@ -54,23 +85,36 @@ static SQInteger table_filter(HSQUIRRELVM vm) {
 
 static SQInteger table_map(HSQUIRRELVM v)
 {
-    SQObject &o = stack_get(v, 1);
+    // a copy, the callback may grow the stack
+    SQObjectPtr o = stack_get(v, 1);
     SQTable *tbl = _table(o);
-    SQInteger nitr, n = 0;
-    SQObjectPtr ret = SQArray::Create(_ss(v), tbl->CountUsed());
-    SQObjectPtr itr, key, val;
-    while ((nitr = tbl->Next(false, itr, key, val)) != -1) {
-        itr = (SQInteger)nitr;
-
-        v->Push(o);
-        v->Push(key);
-        v->Push(val);
-        if (SQ_FAILED(sq_call(v, 3, SQTrue, SQFalse))) {
+    SQInteger nitr;
+    SQInteger const size = tbl->CountUsed();
+    SQObjectPtr ret = SQArray::Create(_ss(v), 0, size);
+    {
+        SQVM::PreparedCall call(v);
+        if (!call.Prepare(stack_get(v, 2), 3)) {
             return SQ_ERROR;
         }
-        _array(ret)->Set(n, v->GetUp(-1));
-        v->Pop();
-        n++;
+
+        SQObjectPtr itr, key, val, res;
+        while ((nitr = tbl->Next(false, itr, key, val)) != -1) {
+            itr = (SQInteger)nitr;
+
+            call.Arg(0) = o;
+            call.Arg(1) = key;
+            call.Arg(2) = val;
+            if (!call.Invoke(res)) {
+                return SQ_ERROR;
+            }
+            // the table may grow or shrink under the callback
+            if (SQInteger(_array(ret)->Size()) < size) {
+                _array(ret)->Append(res);
+            }
+        }
+    }
+    if (SQInteger(_array(ret)->Size()) < size) {
+        _array(ret)->Resize(size);
     }
 
     v->Push(ret);
@@ -112,6 +156,8 @@ const SQRegFunction SQSharedState::_table_default_delegate_funcz[] = {
     {"clear",       obj_clear,                 1, "."},
     {"setdelegate", table_setdelegate,         2, ".t|o"},
     {"getdelegate", table_getdelegate,         1, "."},
+    {"setweakmode", table_setweakmode,         2, "ts"},
+    {"getweakmode", table_getweakmode,         1, "t"},
     {"filter",      table_filter,              2, "tc"},
 	{"map",         table_map,                 2, "tc"},
 	{"keys",        table_keys,                1, "t"},
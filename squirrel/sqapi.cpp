@@ -2,8 +2,10 @@
 #include "sqfuncstate.h"
 
 #include "SQArray.hpp"
+#include "SQCensus.hpp"
 #include "SQClass.hpp"
 #include "SQClosure.hpp"
+#include "SQImage.hpp"
 #include "SQInstance.hpp"
 #include "SQNativeClosure.hpp"
 #include "SQOuter.hpp"
@@ -57,6 +59,14 @@ HSQUIRRELVM sq_newthread(HSQUIRRELVM friendvm, SQInteger initial_stack_size) {
     return v;
 }
 
+void sq_setthreadpool(HSQUIRRELVM v, SQInteger maxpooled, SQInteger threadstacksize) {
+    SQSharedState * ss = _ss(v);
+    size_t const n = maxpooled > 0 ? size_t(maxpooled) : 0;
+    ss->_threadstacks.SetLimit(n);
+    ss->_generatorstacks.SetLimit(n);
+    ss->_threadstacksize = threadstacksize > 0 ? size_t(threadstacksize) : 0;
+}
+
 SQInteger sq_getvmstate(HSQUIRRELVM v) {
     if (v->is_suspended) {
         return SQ_VMSTATE_SUSPENDED;
@@ -112,7 +122,7 @@ SQRESULT sq_compile(HSQUIRRELVM v,SQLEXREADFUNC read,SQUserPointer p,const SQCha
 {
     SQObjectPtr o;
 #ifndef NO_COMPILER
-    if(Compile(v, read, p, sourcename, o, raiseerror?true:false, _ss(v)->_debuginfo)) {
+    if(Compile(v, read, p, sourcename, o, raiseerror?true:false)) {
         v->Push(SQClosure::Create(_ss(v), _funcproto(o), _table(v->_roottable)->GetWeakRef(OT_TABLE)));
         return SQ_OK;
     }
@@ -175,6 +185,26 @@ SQUnsignedInteger sq_getvmrefcount(HSQUIRRELVM SQ_UNUSED_ARG(v), const HSQOBJECT
     return po->_unVal.pRefCounted->_uiRef;
 }
 
+HSQREF sq_newref(HSQUIRRELVM v, SQInteger idx) {
+    return _ss(v)->_refs_table.NewHandle(stack_get(v, idx));
+}
+
+SQRESULT sq_pushref(HSQUIRRELVM v, HSQREF ref) {
+    RefTable & refs = _ss(v)->_refs_table;
+    if (!refs.IsHandle(ref)) {
+        return sq_throwerror(v, _SC("invalid reference"));
+    }
+    v->Push(refs.GetHandle(ref));
+    return SQ_OK;
+}
+
+SQRESULT sq_freeref(HSQUIRRELVM v, HSQREF ref) {
+    if (!_ss(v)->_refs_table.FreeHandle(ref)) {
+        return sq_throwerror(v, _SC("invalid reference"));
+    }
+    return SQ_OK;
+}
+
 const SQChar *sq_objtostring(const HSQOBJECT *o)
 {
     if(sq_type(*o) == OT_STRING) {
@@ -276,6 +306,34 @@ void sq_newarray(HSQUIRRELVM v, SQInteger size) {
     v->Push(SQArray::Create(_ss(v), size_t(size)));
 }
 
+SQRESULT sq_newarrayfrom(HSQUIRRELVM v, SQInteger n) {
+    sq_aux_paramscheck(v, n);
+    SQArray * a = SQArray::Create(_ss(v), 0, n);
+    for (SQInteger i = n; i > 0; i--) {
+        a->Append(v->GetUp(-i));
+    }
+    v->Pop(n);
+    v->Push(a);
+    return SQ_OK;
+}
+
+SQRESULT sq_newtablefrom(HSQUIRRELVM v, SQInteger npairs) {
+    sq_aux_paramscheck(v, npairs * 2);
+    SQTable * t = SQTable::Create(_ss(v), npairs);
+    SQObjectPtr o(t);
+    for (SQInteger i = npairs * 2; i > 0; i -= 2) {
+        SQObjectPtr & key = v->GetUp(-i);
+        if (sq_type(key) == OT_NULL) {
+            v->Pop(npairs * 2);
+            return sq_throwerror(v, _SC("null key"));
+        }
+        t->NewSlot(key, v->GetUp(-i + 1));
+    }
+    v->Pop(npairs * 2);
+    v->Push(o);
+    return SQ_OK;
+}
+
 SQRESULT sq_newclass(HSQUIRRELVM v,SQBool hasbase)
 {
     SQClass *baseclass = NULL;
@@ -349,9 +407,7 @@ SQRESULT sq_arrayreverse(HSQUIRRELVM v, SQInteger idx) {
 
     size_t size = arr->Size();
     for (size_t i = 0; i < size / 2; i++) {
-        SQObjectPtr tmp = arr->_values[i];
-        arr->_values[i] = arr->_values[size - i - 1];
-        arr->_values[size - i - 1] = tmp;
+        arr->Swap(i, size - i - 1);
     }
 
     return SQ_OK;
@@ -531,6 +587,24 @@ SQRESULT sq_clear(HSQUIRRELVM v,SQInteger idx)
     return SQ_OK;
 }
 
+SQRESULT sq_setweakmode(HSQUIRRELVM v,SQInteger idx,SQInteger mode)
+{
+    SQObjectPtr *o;
+    _GETSAFE_OBJ(v, idx, OT_TABLE, o);
+    if(mode & ~(SQ_WEAK_KEYS | SQ_WEAK_VALUES)) {
+        return sq_throwerror(v, _SC("invalid weak mode"));
+    }
+    _table(*o)->SetWeakMode(uint8_t(mode));
+    return SQ_OK;
+}
+
+SQInteger sq_getweakmode(HSQUIRRELVM v,SQInteger idx)
+{
+    SQObjectPtr *o;
+    _GETSAFE_OBJ(v, idx, OT_TABLE, o);
+    return _table(*o)->GetWeakMode();
+}
+
 void sq_pushroottable(HSQUIRRELVM v)
 {
     v->Push(v->_roottable);
@@ -678,7 +752,7 @@ SQRESULT sq_getbool(HSQUIRRELVM v,SQInteger idx,SQBool *b)
 
 SQRESULT sq_getstringandsize(HSQUIRRELVM v,SQInteger idx,const SQChar **c,SQInteger *size)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_STRING,o);
     *c = _stringval(*o);
     *size = _string(*o)->_len;
@@ -687,7 +761,7 @@ SQRESULT sq_getstringandsize(HSQUIRRELVM v,SQInteger idx,const SQChar **c,SQInte
 
 SQRESULT sq_getstring(HSQUIRRELVM v,SQInteger idx,const SQChar **c)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_STRING,o);
     *c = _stringval(*o);
     return SQ_OK;
@@ -695,7 +769,7 @@ SQRESULT sq_getstring(HSQUIRRELVM v,SQInteger idx,const SQChar **c)
 
 SQRESULT sq_getthread(HSQUIRRELVM v,SQInteger idx,HSQUIRRELVM *thread)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_THREAD,o);
     *thread = _thread(*o);
     return SQ_OK;
@@ -741,7 +815,7 @@ SQHash sq_gethash(HSQUIRRELVM v, SQInteger idx)
 
 SQRESULT sq_getuserdata(HSQUIRRELVM v,SQInteger idx,SQUserPointer *p,SQUserPointer *typetag)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_USERDATA,o);
     (*p) = _userdataval(*o);
     if(typetag) *typetag = _userdata(*o)->_typetag;
@@ -780,7 +854,7 @@ SQRESULT sq_gettypetag(HSQUIRRELVM v,SQInteger idx,SQUserPointer *typetag)
 
 SQRESULT sq_getuserpointer(HSQUIRRELVM v, SQInteger idx, SQUserPointer *p)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_USERPOINTER,o);
     (*p) = _userpointer(*o);
     return SQ_OK;
@@ -1119,7 +1193,8 @@ const SQChar *sq_getlocal(HSQUIRRELVM v, SQUnsignedInteger level, SQUnsignedInte
         SQClosure *c=_closure(ci._closure);
         SQFunctionProto *func=c->_function;
         if(func->_noutervalues > idx) {
-            v->Push(*_outer(c->_outervalues[idx])->_valptr);
+            SQObjectPtr &ov = c->_outervalues[idx];
+            v->Push(sq_type(ov) == OT_OUTER ? *_outer(ov)->_valptr : ov);
             return _stringval(func->_outervalues[idx]._name);
         }
         idx -= func->_noutervalues;
@@ -1163,7 +1238,7 @@ void sq_getlasterror(HSQUIRRELVM v)
 }
 
 SQRESULT sq_reservestack(HSQUIRRELVM v, SQInteger nsize) {
-    if (SQUnsignedInteger(v->stack_top) + nsize <= v->_stack.size()) {
+    if (SQUnsignedInteger(v->stack_top) + nsize + MIN_STACK_OVERHEAD <= v->_stack.size()) {
         return SQ_OK;
     }
 
@@ -1171,7 +1246,8 @@ SQRESULT sq_reservestack(HSQUIRRELVM v, SQInteger nsize) {
         return sq_throwerror(v, "cannot resize stack while in a metamethod");
     }
 
-    v->_stack.resize(v->_stack.size() + ((v->stack_top + nsize) - v->_stack.size()));
+    // with the slack LeaveFrame expects above the top
+    v->GrowStack(v->stack_top + nsize + MIN_STACK_OVERHEAD);
 
     return SQ_OK;
 }
@@ -1227,6 +1303,18 @@ SQRESULT sq_suspendvm(HSQUIRRELVM v) {
     return v->Suspend();
 }
 
+void sq_setbudget(HSQUIRRELVM v, SQInteger budget) {
+    v->_budgeted = budget > 0;
+    v->_budget = v->_budgeted ? budget : SQ_BUDGET_OFF;
+}
+
+SQInteger sq_getbudget(HSQUIRRELVM v) {
+    if (!v->_budgeted) {
+        return -1;
+    }
+    return v->_budget > 0 ? v->_budget : 0;
+}
+
 SQRESULT sq_wakeupvm(
     HSQUIRRELVM vm,
     SQBool wakeupret,
@@ -1292,7 +1380,7 @@ void sq_setcompilererrorhandler(HSQUIRRELVM v,SQCOMPILERERROR f)
 
 SQRESULT sq_writeclosure(HSQUIRRELVM v,SQWRITEFUNC w,SQUserPointer up)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, -1, OT_CLOSURE,o);
     unsigned short tag = SQ_BYTECODE_STREAM_TAG;
     if(_closure(*o)->_function->_noutervalues)
@@ -1319,6 +1407,116 @@ SQRESULT sq_readclosure(HSQUIRRELVM v,SQREADFUNC r,SQUserPointer up)
     return SQ_OK;
 }
 
+SQRESULT sq_freeze(HSQUIRRELVM v, SQInteger idx, HSQIMAGE * img) {
+    SQImage * i = SQImage::Freeze(v, stack_get(v, idx));
+    if (!i) {
+        return SQ_ERROR;
+    }
+    *img = i;
+    return SQ_OK;
+}
+
+SQRESULT sq_thaw(HSQUIRRELVM v, HSQIMAGE img) {
+    SQObjectPtr o;
+    if (!img->Thaw(v, o)) {
+        return SQ_ERROR;
+    }
+    v->Push(o);
+    return SQ_OK;
+}
+
+SQRESULT sq_thawbuffer(HSQUIRRELVM v, SQUserPointer data, SQInteger size, SQBool allowcode) {
+    SQObjectPtr o;
+    if (!SQImage::ThawBuffer(v, (uint8_t const *)data, size_t(size), allowcode != SQFalse, o)) {
+        return SQ_ERROR;
+    }
+    v->Push(o);
+    return SQ_OK;
+}
+
+void sq_getimagebytes(HSQIMAGE img, SQUserPointer * data, SQInteger * size) {
+    *data = (SQUserPointer)img->_data;
+    *size = SQInteger(img->_size);
+}
+
+// everything reachable from the roots now is expected to be recreated by
+// the host before sq_restore, snapshots only refer to it by path
+void sq_setsnapshotbaseline(HSQUIRRELVM v) {
+    SQImage::SetBaseline(v);
+}
+
+SQRESULT sq_snapshot(HSQUIRRELVM v, SQWRITEFUNC w, SQUserPointer up) {
+    return SQImage::Snapshot(v, w, up) ? SQ_OK : SQ_ERROR;
+}
+
+// replaces the root table, registry and consts with those of the snapshot
+SQRESULT sq_restore(HSQUIRRELVM v, SQREADFUNC r, SQUserPointer up) {
+    return SQImage::Restore(v, r, up) ? SQ_OK : SQ_ERROR;
+}
+
+// hooks carrying the native state of instances through images
+SQRESULT sq_setimagehooks(HSQUIRRELVM v, SQInteger idx, SQFREEZEHOOK freeze, SQTHAWHOOK thaw) {
+    SQObjectPtr & o = stack_get(v, idx);
+    if (sq_type(o) != OT_CLASS) {
+        return sq_throwerror(v, _SC("the object is not a class"));
+    }
+    _class(o)->_freezehook = freeze;
+    _class(o)->_thawhook = thaw;
+    return SQ_OK;
+}
+
+void sq_retainimage(HSQIMAGE img) {
+    img->AddRef();
+}
+
+void sq_releaseimage(HSQIMAGE img) {
+    img->Release();
+}
+
+HSQCHANNEL sq_newchannel() {
+    return SQChannel::Create();
+}
+
+void sq_retainchannel(HSQCHANNEL ch) {
+    ch->AddRef();
+}
+
+void sq_releasechannel(HSQCHANNEL ch) {
+    ch->Release();
+}
+
+void sq_closechannel(HSQCHANNEL ch) {
+    ch->Close();
+}
+
+SQRESULT sq_channelsend(HSQUIRRELVM v, HSQCHANNEL ch, SQInteger idx) {
+    SQImage * msg = SQImage::Freeze(v, stack_get(v, idx));
+    if (!msg) {
+        return SQ_ERROR;
+    }
+    if (!ch->Send(msg)) {
+        msg->Release();
+        return sq_throwerror(v, _SC("the channel is closed"));
+    }
+    return SQ_OK;
+}
+
+// 1 with the message pushed, 0 if there was none, SQ_ERROR on failure
+SQInteger sq_channelrecv(HSQUIRRELVM v, HSQCHANNEL ch, SQBool wait) {
+    SQImage * msg = ch->Receive(wait ? true : false);
+    if (!msg) {
+        return 0;
+    }
+    SQObjectPtr o;
+    bool const ok = msg->Thaw(v, o);
+    msg->Release();
+    if (!ok) {
+        return SQ_ERROR;
+    }
+    v->Push(o);
+    return 1;
+}
+
 SQChar *sq_getscratchpad(HSQUIRRELVM v,SQInteger minsize)
 {
     return _ss(v)->GetScratchPad(minsize < 0 ? 0 : minsize);
@@ -1343,6 +1541,41 @@ SQInteger sq_collectgarbage(HSQUIRRELVM v)
 #endif
 }
 
+void sq_setgcparams(HSQUIRRELVM v, SQGCParams const * params) {
+    _ss(v)->gc.SetParams(*params);
+}
+
+void sq_getgcparams(HSQUIRRELVM v, SQGCParams * params) {
+    *params = _ss(v)->gc.params;
+}
+
+void sq_getgcstats(HSQUIRRELVM v, SQGCStats * stats) {
+    _ss(v)->gc.CountStrings();
+    *stats = _ss(v)->gc.stats;
+}
+
+// for hosts and schedulers that run scripts from a native loop, where the
+// VM safe points never collect; the caller vouches for its own native
+// call, if it is in one, but not for any native that called into it
+SQBool sq_collectifdue(HSQUIRRELVM v) {
+#ifndef NO_GARBAGE_COLLECTOR
+    return _ss(v)->CollectIfDue(1) ? SQTrue : SQFalse;
+#else
+    return SQFalse;
+#endif
+}
+
+// pushes a table describing the heap, see SQCensus::Push
+void sq_heapcensus(HSQUIRRELVM v, SQInteger ntop) {
+    SQCensus census(ntop > 0 ? size_t(ntop) : 0);
+    census.Take(_ss(v));
+    census.Push(v);
+}
+
+void sq_setcensusinterval(HSQUIRRELVM v, SQInteger ncollections) {
+    _ss(v)->_censusinterval = ncollections > 0 ? ncollections : 0;
+}
+
 SQRESULT sq_getcallee(HSQUIRRELVM v) {
     if (v->call_stack_size < 2) {
         return sq_throwerror(v, "no closure in the calls stack");
@@ -1361,7 +1594,8 @@ const SQChar *sq_getfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger n
         SQClosure *clo = _closure(self);
         SQFunctionProto *fp = clo->_function;
         if(((SQUnsignedInteger)fp->_noutervalues) > nval) {
-            v->Push(*(_outer(clo->_outervalues[nval])->_valptr));
+            SQObjectPtr &val = clo->_outervalues[nval];
+            v->Push(sq_type(val) == OT_OUTER ? *(_outer(val)->_valptr) : val);
             SQOuterVar &ov = fp->_outervalues[nval];
             name = _stringval(ov._name);
         }
@@ -1388,7 +1622,12 @@ SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
     case OT_CLOSURE:{
         SQFunctionProto *fp = _closure(self)->_function;
         if(((SQUnsignedInteger)fp->_noutervalues) > nval){
-            *(_outer(_closure(self)->_outervalues[nval])->_valptr) = stack_get(v,-1);
+            SQObjectPtr &val = _closure(self)->_outervalues[nval];
+            if (sq_type(val) == OT_OUTER) {
+                *(_outer(val)->_valptr) = stack_get(v,-1);
+            } else {
+                val = stack_get(v,-1);
+            }
         }
         else return sq_throwerror(v,_SC("invalid free var index"));
                     }
@@ -1408,7 +1647,7 @@ SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
 
 SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-2);
     SQObjectPtr &val = stack_get(v,-1);
@@ -1430,7 +1669,7 @@ SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getattributes(HSQUIRRELVM v,SQInteger idx)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-1);
     SQObjectPtr attrs;
@@ -1450,7 +1689,7 @@ SQRESULT sq_getattributes(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getmemberhandle(HSQUIRRELVM v,SQInteger idx,HSQMEMBERHANDLE *handle)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-1);
     SQTable *m = _class(*o)->_members;
@@ -1519,9 +1758,107 @@ SQRESULT sq_setbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handl
     return SQ_OK;
 }
 
+void sq_internkey(HSQUIRRELVM v, const SQChar * s, SQInteger len, HSQKEY * key) {
+    if (len < 0) {
+        len = strlen(s);
+    }
+    SQObjectPtr str = SQObjectPtr(_ss(v)->gc.AddString(s, len));
+    key->_key = str;
+    key->_ref = _ss(v)->_refs_table.NewHandle(str);
+}
+
+SQRESULT sq_releasekey(HSQUIRRELVM v, HSQKEY * key) {
+    if (!_ss(v)->_refs_table.FreeHandle(key->_ref)) {
+        return sq_throwerror(v, _SC("invalid key"));
+    }
+    key->_ref = 0;
+    sq_resetobject(&key->_key);
+    return SQ_OK;
+}
+
+SQRESULT sq_getbykey(HSQUIRRELVM v, SQInteger idx, const HSQKEY * key) {
+    SQObjectPtr & self = stack_get(v, idx);
+    SQObjectPtr val;
+    if (!v->Get(self, key->_key, val, 0, DONT_FALL_BACK)) {
+        return SQ_ERROR;
+    }
+    v->Push(val);
+    return SQ_OK;
+}
+
+SQRESULT sq_rawgetbykey(HSQUIRRELVM v, SQInteger idx, const HSQKEY * key) {
+    SQObjectPtr & self = stack_get(v, idx);
+    SQObjectPtr const k = key->_key;
+    SQObjectPtr val;
+    bool found;
+    switch (sq_type(self)) {
+    case OT_TABLE:
+        found = _table(self)->Get(k, val);
+        break;
+    case OT_CLASS:
+        found = _class(self)->Get(k, val);
+        break;
+    case OT_INSTANCE:
+        found = _instance(self)->Get(k, val);
+        break;
+    default:
+        return sq_throwerror(v, _SC("rawget works only on table/instance and class"));
+    }
+    if (!found) {
+        return sq_throwerror(v, _SC("the index doesn't exist"));
+    }
+    v->Push(val);
+    return SQ_OK;
+}
+
+SQRESULT sq_setbykey(HSQUIRRELVM v, SQInteger idx, const HSQKEY * key) {
+    SQObjectPtr & self = stack_get(v, idx);
+    if (!v->Set(self, key->_key, v->GetUp(-1), DONT_FALL_BACK)) {
+        return SQ_ERROR;
+    }
+    v->Pop();
+    return SQ_OK;
+}
+
+SQRESULT sq_rawsetbykey(HSQUIRRELVM v, SQInteger idx, const HSQKEY * key) {
+    SQObjectPtr & self = stack_get(v, idx);
+    SQObjectPtr const k = key->_key;
+    switch (sq_type(self)) {
+    case OT_TABLE:
+        _table(self)->NewSlot(k, v->GetUp(-1));
+        break;
+    case OT_CLASS:
+        _class(self)->NewSlot(_ss(v), k, v->GetUp(-1), false);
+        break;
+    case OT_INSTANCE:
+        if (!_instance(self)->Set(k, v->GetUp(-1))) {
+            v->Pop();
+            v->Raise_IdxError(k);
+            return SQ_ERROR;
+        }
+        break;
+    default:
+        v->Pop();
+        return sq_throwerror(v, _SC("rawset works only on table/class and instance"));
+    }
+    v->Pop();
+    return SQ_OK;
+}
+
+SQRESULT sq_newslotbykey(HSQUIRRELVM v, SQInteger idx, const HSQKEY * key, SQBool bstatic) {
+    SQObjectPtr & self = stack_get(v, idx);
+    if (sq_type(self) != OT_TABLE && sq_type(self) != OT_CLASS) {
+        v->Pop();
+        return sq_throwerror(v, _SC("newslot works only on table and class"));
+    }
+    bool const ok = v->NewSlot(self, key->_key, v->GetUp(-1), bstatic ? true : false);
+    v->Pop();
+    return ok ? SQ_OK : SQ_ERROR;
+}
+
 SQRESULT sq_getbase(HSQUIRRELVM v,SQInteger idx)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     if(_class(*o)->_base)
         v->Push(SQObjectPtr(_class(*o)->_base));
@@ -1532,7 +1869,7 @@ SQRESULT sq_getbase(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getclass(HSQUIRRELVM v,SQInteger idx)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_INSTANCE,o);
     v->Push(SQObjectPtr(_instance(*o)->klass));
     return SQ_OK;
@@ -1540,7 +1877,7 @@ SQRESULT sq_getclass(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_createinstance(HSQUIRRELVM v,SQInteger idx)
 {
-    SQObjectPtr *o = NULL;
+    SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     v->Push(_class(*o)->CreateInstance());
     return SQ_OK;
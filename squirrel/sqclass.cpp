@@ -9,12 +9,16 @@ SQClass::SQClass(SQSharedState * ss, SQClass * base)
     _base = base;
     _typetag = 0;
     _hook = NULL;
+    _freezehook = NULL;
+    _thawhook = NULL;
     _udsize = 0;
     _locked = false;
     _constructoridx = -1;
     if(_base) {
         _constructoridx = _base->_constructoridx;
         _udsize = _base->_udsize;
+        _freezehook = _base->_freezehook;
+        _thawhook = _base->_thawhook;
         _defaultvalues.copy(base->_defaultvalues);
         _methods.copy(base->_methods);
         _COPY_VECTOR(_metamethods,base->_metamethods,MT_LAST);
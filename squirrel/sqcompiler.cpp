@@ -1,4 +1,5 @@
 #ifndef NO_COMPILER
+#include <math.h>
 #include <stdarg.h>
 #include <setjmp.h>
 
@@ -49,10 +50,8 @@ struct SQScope {
                         _scope = __oldscope__; \
                     }
 
-#define END_SCOPE() {   SQInteger oldouters = _fs->_outers;\
-                        if(_fs->GetStackSize() != _scope.stacksize) { \
-                            _fs->SetStackSize(_scope.stacksize); \
-                            if(oldouters != _fs->_outers) { \
+#define END_SCOPE() {   if(_fs->GetStackSize() != _scope.stacksize) { \
+                            if(_fs->SetStackSize(_scope.stacksize)) { \
                                 _fs->AddInstruction(_OP_CLOSE,0,_scope.stacksize); \
                             } \
                         } \
@@ -74,7 +73,6 @@ class SQCompiler {
     SQObjectPtr _sourcename;
     SQLexer lexer;
     LexerState * lexer_state;
-    bool _lineinfo;
     bool _raiseerror;
     SQExpState   _es;
     SQScope _scope;
@@ -87,13 +85,11 @@ public:
         SQLEXREADFUNC rg,
         SQUserPointer up,
         const SQChar* sourcename,
-        bool raiseerror,
-        bool lineinfo
+        bool raiseerror
     )
         : _fs()
         , _sourcename(v->_sharedstate->gc.AddString(sourcename, strlen(sourcename)))
         , lexer_state(nullptr)
-        , _lineinfo(lineinfo)
         , _raiseerror(raiseerror)
 
         , _vm(v)
@@ -232,7 +228,7 @@ public:
 
             // Shouldn't this be already at same level?
             _fs->SetStackSize(stacksize);
-            _fs->AddLineInfos(lexer_state->current_line, _lineinfo, true);
+            _fs->AddLineInfos(lexer_state->current_line);
             _fs->AddInstruction(_OP_RETURN, 0xFF);
             _fs->SetStackSize(0);
             o = _fs->BuildProto();
@@ -268,7 +264,7 @@ public:
     }
 
     void Statement(bool closeframe = true) {
-        _fs->AddLineInfos(lexer_state->current_line, _lineinfo);
+        _fs->AddLineInfos(lexer_state->current_line);
 
         switch (lexer_state->token) {
             case ';':
@@ -316,15 +312,13 @@ public:
                     SQInteger retexp = _fs->GetCurrentPos() + 1;
                     CommaExpr();
                     if(op == _OP_RETURN && _fs->_traps > 0) {
-                        _fs->AddInstruction(_OP_POPTRAP, _fs->_traps, 0);
+                        // a tail call would leave the try block before the callee runs
+                        _fs->SnoozeOpt();
                     }
                     _fs->_returnexp = retexp;
                     // GetStackSize might be 0x100?
                     _fs->AddInstruction(op, 1, _fs->PopTarget(), _fs->GetStackSize());
                 } else {
-                    if(op == _OP_RETURN && _fs->_traps > 0) {
-                        _fs->AddInstruction(_OP_POPTRAP, _fs->_traps, 0);
-                    }
                     _fs->_returnexp = -1;
                     _fs->AddInstruction(op, 0xFF, 0, _fs->GetStackSize());
                 }
@@ -333,9 +327,6 @@ public:
             }
             case TK_BREAK:
                 if(_fs->_breaktargets.size() <= 0)Error("'break' has to be in a loop block");
-                if(_fs->_breaktargets.top() > 0){
-                    _fs->AddInstruction(_OP_POPTRAP, _fs->_breaktargets.top(), 0);
-                }
                 RESOLVE_OUTERS();
                 _fs->AddInstruction(_OP_JMP, 0, -1234);
                 _fs->_unresolvedbreaks.push_back(_fs->GetCurrentPos());
@@ -343,9 +334,6 @@ public:
                 break;
             case TK_CONTINUE:
                 if(_fs->_continuetargets.size() <= 0)Error("'continue' has to be in a loop block");
-                if(_fs->_continuetargets.top() > 0) {
-                    _fs->AddInstruction(_OP_POPTRAP, _fs->_continuetargets.top(), 0);
-                }
                 RESOLVE_OUTERS();
                 _fs->AddInstruction(_OP_JMP, 0, -1234);
                 _fs->_unresolvedcontinues.push_back(_fs->GetCurrentPos());
@@ -415,6 +403,14 @@ public:
         _fs->AddInstruction(op, _fs->PushNewTarget(), p1, p2, p3);
     }
 
+    void MarkAssigned(ExpressionType etype, SQInteger pos) {
+        if (etype == LOCAL) {
+            _fs->MarkLocalAssigned(pos);
+        } else if (etype == OUTER) {
+            _fs->MarkOuterAssigned(pos);
+        }
+    }
+
     void EmitCompoundArith(uint16_t tok, ExpressionType etype, SQInteger pos) {
         /* Generate code depending on the expression type */
         switch (etype) {
@@ -486,6 +482,7 @@ public:
 
             uint16_t op = lexer_state->token;
             SQInteger pos = _es.epos;
+            MarkAssigned(ds, pos);
 
             Lex(); Expression();
 
@@ -511,6 +508,7 @@ public:
                     uint8_t const src = _fs->PopTarget();
                     uint8_t const dst = _fs->PushNewTarget();
                     _fs->AddInstruction(_OP_SETOUTER, dst, pos, src);
+                    break;
                 }
                 case EXPR:
                 case BASE:
@@ -571,13 +569,23 @@ public:
         (this->*f)();
         _es = es;
     }
-    template<typename T> void BIN_EXP(SQOpcode op, T f,SQInteger op3 = 0)
+    // lstart is the last position before the code of the left operand
+    template<typename T> void BIN_EXP(SQInteger lstart, SQOpcode op, T f,SQInteger op3 = 0)
     {
         Lex();
+        SQInteger const lpos = _fs->GetCurrentPos();
+        SQObjectPtr lhs, rhs, res;
+        bool const lconst = _fs->_optimization && lpos == lstart + 1
+            && GetConstLoad(lpos, _fs->TopTarget(), lhs);
         INVOKE_EXP(f);
         uint8_t const op1 = _fs->PopTarget();
         uint8_t const op2 = _fs->PopTarget();
-        _fs->AddInstruction(op, _fs->PushNewTarget(), op1, op2, op3);
+        if (lconst && GetConstLoad(lpos, op2, op1, rhs) && FoldBinary(op, op3, lhs, rhs, res)) {
+            _fs->PopInstructions(_fs->GetCurrentPos() - lpos + 1);
+            EmitLoadConst(res, _fs->PushNewTarget());
+        } else {
+            _fs->AddInstruction(op, _fs->PushNewTarget(), op1, op2, op3);
+        }
         _es.etype = EXPR;
     }
     void LogicalOrExp()
@@ -625,55 +633,61 @@ public:
     }
     void BitwiseOrExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         BitwiseXorExp();
         for(;;) if(lexer_state->token == '|')
-        {BIN_EXP(_OP_BITW, &SQCompiler::BitwiseXorExp,BW_OR);
+        {BIN_EXP(start, _OP_BITW, &SQCompiler::BitwiseXorExp,BW_OR);
         }else return;
     }
     void BitwiseXorExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         BitwiseAndExp();
         for(;;) if(lexer_state->token == '^')
-        {BIN_EXP(_OP_BITW, &SQCompiler::BitwiseAndExp,BW_XOR);
+        {BIN_EXP(start, _OP_BITW, &SQCompiler::BitwiseAndExp,BW_XOR);
         }else return;
     }
     void BitwiseAndExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         EqExp();
         for(;;) if(lexer_state->token == '&')
-        {BIN_EXP(_OP_BITW, &SQCompiler::EqExp,BW_AND);
+        {BIN_EXP(start, _OP_BITW, &SQCompiler::EqExp,BW_AND);
         }else return;
     }
     void EqExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         CompExp();
         for(;;) switch(lexer_state->token) {
-        case TK_EQ: BIN_EXP(_OP_EQ, &SQCompiler::CompExp); break;
-        case TK_NE: BIN_EXP(_OP_NE, &SQCompiler::CompExp); break;
-        case TK_3WAYSCMP: BIN_EXP(_OP_CMP, &SQCompiler::CompExp,CMP_3W); break;
+        case TK_EQ: BIN_EXP(start, _OP_EQ, &SQCompiler::CompExp); break;
+        case TK_NE: BIN_EXP(start, _OP_NE, &SQCompiler::CompExp); break;
+        case TK_3WAYSCMP: BIN_EXP(start, _OP_CMP, &SQCompiler::CompExp,CMP_3W); break;
         default: return;
         }
     }
     void CompExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         ShiftExp();
         for(;;) switch(lexer_state->token) {
-        case '>': BIN_EXP(_OP_CMP, &SQCompiler::ShiftExp,CMP_G); break;
-        case '<': BIN_EXP(_OP_CMP, &SQCompiler::ShiftExp,CMP_L); break;
-        case TK_GE: BIN_EXP(_OP_CMP, &SQCompiler::ShiftExp,CMP_GE); break;
-        case TK_LE: BIN_EXP(_OP_CMP, &SQCompiler::ShiftExp,CMP_LE); break;
-        case TK_IN: BIN_EXP(_OP_EXISTS, &SQCompiler::ShiftExp); break;
-        case TK_INSTANCEOF: BIN_EXP(_OP_INSTANCEOF, &SQCompiler::ShiftExp); break;
+        case '>': BIN_EXP(start, _OP_CMP, &SQCompiler::ShiftExp,CMP_G); break;
+        case '<': BIN_EXP(start, _OP_CMP, &SQCompiler::ShiftExp,CMP_L); break;
+        case TK_GE: BIN_EXP(start, _OP_CMP, &SQCompiler::ShiftExp,CMP_GE); break;
+        case TK_LE: BIN_EXP(start, _OP_CMP, &SQCompiler::ShiftExp,CMP_LE); break;
+        case TK_IN: BIN_EXP(start, _OP_EXISTS, &SQCompiler::ShiftExp); break;
+        case TK_INSTANCEOF: BIN_EXP(start, _OP_INSTANCEOF, &SQCompiler::ShiftExp); break;
         default: return;
         }
     }
 
     void ShiftExp() {
+        SQInteger const start = _fs->GetCurrentPos();
         PlusExp();
         for(;;) switch(lexer_state->token) {
-        case TK_USHIFTR: BIN_EXP(_OP_BITW, &SQCompiler::PlusExp,BW_USHIFTR); break;
-        case TK_SHIFTL: BIN_EXP(_OP_BITW, &SQCompiler::PlusExp,BW_SHIFTL); break;
-        case TK_SHIFTR: BIN_EXP(_OP_BITW, &SQCompiler::PlusExp,BW_SHIFTR); break;
+        case TK_USHIFTR: BIN_EXP(start, _OP_BITW, &SQCompiler::PlusExp,BW_USHIFTR); break;
+        case TK_SHIFTL: BIN_EXP(start, _OP_BITW, &SQCompiler::PlusExp,BW_SHIFTL); break;
+        case TK_SHIFTR: BIN_EXP(start, _OP_BITW, &SQCompiler::PlusExp,BW_SHIFTR); break;
         default: return;
         }
     }
@@ -706,20 +720,22 @@ public:
 
     void PlusExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         MultExp();
         for(;;) switch(lexer_state->token) {
         case '+': case '-':
-            BIN_EXP(ChooseArithOpByToken(lexer_state->token), &SQCompiler::MultExp); break;
+            BIN_EXP(start, ChooseArithOpByToken(lexer_state->token), &SQCompiler::MultExp); break;
         default: return;
         }
     }
 
     void MultExp()
     {
+        SQInteger const start = _fs->GetCurrentPos();
         PrefixedExpr();
         for(;;) switch(lexer_state->token) {
         case '*': case '/': case '%':
-            BIN_EXP(ChooseArithOpByToken(lexer_state->token), &SQCompiler::PrefixedExpr); break;
+            BIN_EXP(start, ChooseArithOpByToken(lexer_state->token), &SQCompiler::PrefixedExpr); break;
         default: return;
         }
     }
@@ -787,10 +803,12 @@ public:
                             break;
                         case LOCAL: {
                             uint8_t const src = _fs->PopTarget();
+                            _fs->MarkLocalAssigned(src);
                             _fs->AddInstruction(_OP_PINCL, _fs->PushNewTarget(), src, 0, diff);
                                     }
                             break;
                         case OUTER: {
+                            _fs->MarkOuterAssigned(_es.epos);
                             uint8_t const tmp1 = _fs->PushNewTarget();
                             uint8_t const tmp2 = _fs->PushNewTarget();
                             _fs->AddInstruction(_OP_GETOUTER, tmp2, _es.epos);
@@ -1025,13 +1043,229 @@ public:
     }
     void UnaryOP(SQOpcode op)
     {
+        SQInteger const pos = _fs->GetCurrentPos() + 1;
         PrefixedExpr();
         if (_fs->_targetstack.size() == 0) {
             Error("cannot evaluate unary operator");
         }
         uint8_t const src = _fs->PopTarget();
+        SQObjectPtr val, res;
+        if (_fs->_optimization && GetConstLoad(pos, src, val) && FoldUnary(op, val, res)) {
+            _fs->PopInstructions(1);
+            EmitLoadConst(res, _fs->PushNewTarget());
+            return;
+        }
         _fs->AddInstruction(op, _fs->PushNewTarget(), src);
     }
+
+    void EmitLoadConst(SQObjectPtr const & val, SQInteger target) {
+        // the folded instructions may have been a jump target
+        _fs->SnoozeOpt();
+        switch (sq_type(val)) {
+        case OT_INTEGER: EmitLoadConstInt(_integer(val), target); break;
+        case OT_FLOAT: EmitLoadConstFloat(_float(val), target); break;
+        case OT_BOOL: _fs->AddInstruction(_OP_LOADBOOL, target, _integer(val)); break;
+        default: _fs->AddInstruction(_OP_LOAD, target, _fs->GetConstant(val)); break;
+        }
+    }
+
+    /* Constant folding. An operand folds when the whole of its code is the
+     * single last instruction (at pos) and that instruction loads a scalar
+     * literal into a temporary. Literals and const/enum values both compile
+     * to such loads, and so does the result of an earlier fold.
+     */
+    bool GetConstLoad(SQInteger pos, uint8_t target, SQObjectPtr & val) {
+        if (pos != _fs->GetCurrentPos() || _fs->IsLocal(target)) {
+            return false;
+        }
+
+        SQInstruction & i = _fs->GetInstruction(pos);
+        if (i._arg0 != target) {
+            return false;
+        }
+
+        switch (i.op) {
+        case _OP_LOADINT:
+            val = SQInteger(i._arg1);
+            return true;
+        case _OP_LOADFLOAT:
+            val = *((const SQFloat *)&i._arg1);
+            return true;
+        case _OP_LOADBOOL:
+            val = i._arg1 != 0;
+            return true;
+        case _OP_LOAD:
+            return _fs->GetLiteral(i._arg1, val) && IsFoldable(val);
+        default:
+            return false;
+        }
+    }
+
+    /* Right hand side of a binary operator whose left side loads into ltarget
+     * at lpos. Two string or big number loads get merged into a single
+     * _OP_DLOAD by the peephole optimizer.
+     */
+    bool GetConstLoad(SQInteger lpos, uint8_t ltarget, uint8_t target, SQObjectPtr & val) {
+        if (!_fs->_optimization) {
+            return false;
+        }
+
+        if (_fs->GetCurrentPos() == lpos + 1) {
+            return GetConstLoad(lpos + 1, target, val);
+        }
+
+        if (_fs->GetCurrentPos() != lpos || _fs->IsLocal(target)) {
+            return false;
+        }
+
+        SQInstruction & i = _fs->GetInstruction(lpos);
+        return i.op == _OP_DLOAD && i._arg0 == ltarget && i._arg2 == target
+            && _fs->GetLiteral(i._arg3, val) && IsFoldable(val);
+    }
+
+    static bool IsFoldable(SQObjectPtr const & val) {
+        switch (sq_type(val)) {
+        case OT_INTEGER: case OT_FLOAT: case OT_BOOL: case OT_STRING:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Folds only what the VM evaluates without errors or metamethods, and
+    // with the exact same semantics. Everything else is left to the runtime.
+    bool FoldBinary(SQOpcode op, SQInteger op3, SQObjectPtr const & a, SQObjectPtr const & b, SQObjectPtr & res) {
+        switch (op) {
+        case _OP_ADD:
+            if (sq_type(a) == OT_STRING || sq_type(b) == OT_STRING) {
+                return _vm->StringCat(a, b, res);
+            }
+            return FoldArith(op, a, b, res);
+        case _OP_SUB:
+        case _OP_MUL:
+        case _OP_DIV:
+        case _OP_MOD:
+            return FoldArith(op, a, b, res);
+        case _OP_BITW:
+            return FoldBitwise(op3, a, b, res);
+        case _OP_EQ:
+        case _OP_NE: {
+            bool eq;
+            SQVM::IsEqual(a, b, eq);
+            res = (op == _OP_EQ) == eq;
+            return true;
+        }
+        case _OP_CMP:
+            return FoldCompare(op3, a, b, res);
+        default:
+            return false;
+        }
+    }
+
+    bool FoldArith(SQOpcode op, SQObjectPtr const & a, SQObjectPtr const & b, SQObjectPtr & res) {
+        if (!sq_isnumeric(a) || !sq_isnumeric(b)) {
+            return false;
+        }
+
+        if (sq_type(a) == OT_INTEGER && sq_type(b) == OT_INTEGER) {
+            SQInteger const i1 = _integer(a);
+            SQInteger const i2 = _integer(b);
+            switch (op) {
+            case _OP_ADD: res = SQInteger(SQUnsignedInteger(i1) + SQUnsignedInteger(i2)); return true;
+            case _OP_SUB: res = SQInteger(SQUnsignedInteger(i1) - SQUnsignedInteger(i2)); return true;
+            case _OP_MUL: res = SQInteger(SQUnsignedInteger(i1) * SQUnsignedInteger(i2)); return true;
+            case _OP_DIV:
+            case _OP_MOD:
+                // division by zero and overflow are reported at runtime
+                if (i2 == 0 || i2 == -1) {
+                    return false;
+                }
+                res = (op == _OP_DIV) ? i1 / i2 : i1 % i2;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        SQFloat const f1 = tofloat(a);
+        SQFloat const f2 = tofloat(b);
+        switch (op) {
+        case _OP_ADD: res = SQFloat(f1 + f2); return true;
+        case _OP_SUB: res = SQFloat(f1 - f2); return true;
+        case _OP_MUL: res = SQFloat(f1 * f2); return true;
+        case _OP_DIV: res = SQFloat(f1 / f2); return true;
+        case _OP_MOD: res = SQFloat(fmod(double(f1), double(f2))); return true;
+        default: return false;
+        }
+    }
+
+    bool FoldBitwise(SQInteger op3, SQObjectPtr const & a, SQObjectPtr const & b, SQObjectPtr & res) {
+        if (sq_type(a) != OT_INTEGER || sq_type(b) != OT_INTEGER) {
+            return false;
+        }
+
+        SQInteger const i1 = _integer(a);
+        SQInteger const i2 = _integer(b);
+        switch (op3) {
+        case BW_AND: res = i1 & i2; return true;
+        case BW_OR: res = i1 | i2; return true;
+        case BW_XOR: res = i1 ^ i2; return true;
+        case BW_SHIFTL:
+        case BW_SHIFTR:
+        case BW_USHIFTR:
+            if (i2 < 0 || i2 >= SQInteger(sizeof(SQInteger) * 8)) {
+                return false;
+            }
+            switch (op3) {
+            case BW_SHIFTL: res = i1 << i2; break;
+            case BW_SHIFTR: res = i1 >> i2; break;
+            default: res = SQInteger(SQUnsignedInteger(i1) >> i2); break;
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool FoldCompare(SQInteger op3, SQObjectPtr const & a, SQObjectPtr const & b, SQObjectPtr & res) {
+        bool const numeric = sq_isnumeric(a) && sq_isnumeric(b);
+        bool const strings = sq_type(a) == OT_STRING && sq_type(b) == OT_STRING;
+        SQInteger r;
+        if ((!numeric && !strings) || !_vm->ObjCmp(a, b, r)) {
+            return false;
+        }
+
+        switch (op3) {
+        case CMP_G: res = r > 0; return true;
+        case CMP_GE: res = r >= 0; return true;
+        case CMP_L: res = r < 0; return true;
+        case CMP_LE: res = r <= 0; return true;
+        case CMP_3W: res = r; return true;
+        default: return false;
+        }
+    }
+
+    bool FoldUnary(SQOpcode op, SQObjectPtr & val, SQObjectPtr & res) {
+        switch (op) {
+        case _OP_NOT:
+            res = SQVM::IsFalse(val);
+            return true;
+        case _OP_NEG:
+            switch (sq_type(val)) {
+            case OT_INTEGER: res = SQInteger(-SQUnsignedInteger(_integer(val))); return true;
+            case OT_FLOAT: res = -_float(val); return true;
+            default: return false;
+            }
+        case _OP_BWNOT:
+            if (sq_type(val) != OT_INTEGER) {
+                return false;
+            }
+            res = SQInteger(~_integer(val));
+            return true;
+        default:
+            return false;
+        }
+    }
     bool NeedGet()
     {
         switch(lexer_state->token) {
@@ -1223,9 +1457,24 @@ public:
     void IfStatement() {
         Lex();
         Expect('(');
+        SQInteger const condpos = _fs->GetCurrentPos() + 1;
         CommaExpr();
         Expect(')');
 
+        SQObjectPtr cond;
+        if (_fs->_optimization && GetConstLoad(condpos, _fs->TopTarget(), cond)) {
+            _fs->PopTarget();
+            _fs->PopInstructions(1);
+            _fs->SnoozeOpt();
+            bool const taken = !SQVM::IsFalse(cond);
+            ConstIfBlock(taken);
+            if (lexer_state->token == TK_ELSE) {
+                Lex();
+                ConstIfBlock(!taken);
+            }
+            return;
+        }
+
         _fs->AddInstruction(_OP_JZ, _fs->PopTarget());
         SQInteger jnepos = _fs->GetCurrentPos();
 
@@ -1243,6 +1492,26 @@ public:
         }
         _fs->SetInstructionParam(jnepos, 1, endifblock - jnepos + (haselse?1:0));
     }
+    // Branch of an if with a constant condition, the untaken one is compiled
+    // for diagnostics and then thrown away
+    void ConstIfBlock(bool taken) {
+        if (taken) {
+            IfBlock();
+            return;
+        }
+
+        SQInteger const pos = _fs->GetCurrentPos();
+        SQInteger const nlocalvarinfos = _fs->_localvarinfos.size();
+        SQInteger const nlineinfos = _fs->_lineinfos.size();
+        SQInteger const nfunctions = _fs->_functions.size();
+        SQInteger const nbreaks = _fs->_unresolvedbreaks.size();
+        SQInteger const ncontinues = _fs->_unresolvedcontinues.size();
+        IfBlock();
+        _fs->_unresolvedbreaks.resize(nbreaks);
+        _fs->_unresolvedcontinues.resize(ncontinues);
+        _fs->DiscardCode(pos, nlocalvarinfos, nlineinfos, nfunctions);
+    }
+
     void WhileStatement()
     {
         SQInteger jzpos, jmppos;
@@ -1285,7 +1554,7 @@ public:
         if(lexer_state->token == TK_LOCAL) LocalDeclStatement();
         else if(lexer_state->token != ';'){
             CommaExpr();
-            _fs->PopTarget();
+            _fs->DiscardTarget();
         }
         Expect(';');
         _fs->SnoozeOpt();
@@ -1297,7 +1566,7 @@ public:
         SQInteger expstart = _fs->GetCurrentPos() + 1;
         if(lexer_state->token != ')') {
             CommaExpr();
-            _fs->PopTarget();
+            _fs->DiscardTarget();
         }
         Expect(')');
         _fs->SnoozeOpt();
@@ -1309,20 +1578,55 @@ public:
                 exp.push_back(_fs->GetInstruction(expstart + i));
             _fs->PopInstructions(expsize);
         }
+        bool const counted = CountedLoop(jmppos, jzpos, exp);
         BEGIN_BREAKBLE_BLOCK()
         Statement();
         SQInteger continuetrg = _fs->GetCurrentPos();
-        if(expsize > 0) {
-            for(SQInteger i = 0; i < expsize; i++)
-                _fs->AddInstruction(exp[i]);
+        if(counted) {
+            SQInstruction const cond = _fs->GetInstruction(jzpos);
+            uint8_t flags = cond._arg3 & CMP_OP_MASK;
+            if (int8_t(exp[0]._arg3) < 0) {
+                flags |= FORLOOP_DOWN;
+            }
+            _fs->AddInstruction(_OP_FORLOOP, exp[0]._arg0, expstart - _fs->GetCurrentPos() - 2, cond._arg0, flags);
+        }
+        else {
+            if(expsize > 0) {
+                for(SQInteger i = 0; i < expsize; i++)
+                    _fs->AddInstruction(exp[i]);
+            }
+            _fs->AddInstruction(_OP_JMP, 0, jmppos - _fs->GetCurrentPos() - 1, 0);
         }
-        _fs->AddInstruction(_OP_JMP, 0, jmppos - _fs->GetCurrentPos() - 1, 0);
         if(jzpos>  0) _fs->SetInstructionParam(jzpos, 1, _fs->GetCurrentPos() - jzpos);
         
         END_BREAKBLE_BLOCK(continuetrg);
 
 		END_SCOPE();
     }
+    // 'for (...; i < n; i++)' where n is a local or an integer literal: the
+    // condition is tested once on entry and the step and re-test after the
+    // body become a single _OP_FORLOOP
+    bool CountedLoop(SQInteger jmppos, SQInteger jzpos, SQInstructionVec &step)
+    {
+        if (jzpos < 0 || step.size() != 1 || step[0].op != _OP_INCL) {
+            return false;
+        }
+        SQInstruction const cond = _fs->GetInstruction(jzpos);
+        if (cond.op != _OP_JCMP || cond._arg2 != step[0]._arg0 || cond._arg0 == cond._arg2) {
+            return false;
+        }
+        if (jzpos == jmppos + 1) {
+            return _fs->IsLocal(cond._arg0);
+        }
+        SQInstruction const limit = _fs->GetInstruction(jmppos + 1);
+        if (jzpos == jmppos + 2 && limit.op == _OP_LOADINT && limit._arg0 == cond._arg0
+            && cond._arg0 == _fs->GetStackSize()) {
+            // the literal must survive the body, keep it in a hidden local
+            _fs->PushLocalVariable(_fs->CreateString("@LIMIT@"));
+            return true;
+        }
+        return false;
+    }
     void ForEachStatement()
     {
         SQObject idxname, valname;
@@ -1347,6 +1651,9 @@ public:
         //push the value local var
         uint8_t const valuepos = _fs->PushLocalVariable(valname);
         _fs->AddInstruction(_OP_LOADNULLS, valuepos, 1);
+        //rewritten on every iteration, closures must share them
+        _fs->MarkLocalAssigned(indexpos);
+        _fs->MarkLocalAssigned(valuepos);
         //push reference index
         uint8_t const itrpos = _fs->PushLocalVariable(_fs->CreateString("@ITERATOR@")); //use invalid id to make it inaccessible
         _fs->AddInstruction(_OP_LOADNULLS, itrpos, 1);
@@ -1535,25 +1842,24 @@ public:
         Lex();
     }
 
+    // No code guards the try block, its range goes to the function's trap
+    // table and the VM looks it up only when an error is raised
     void TryCatchStatement() {
         Lex();
-        _fs->AddInstruction(_OP_PUSHTRAP,0,0);
         _fs->_traps++;
-        if(_fs->_breaktargets.size()) _fs->_breaktargets.top()++;
-        if(_fs->_continuetargets.size()) _fs->_continuetargets.top()++;
-        SQInteger trappos = _fs->GetCurrentPos();
+        // keep the block's first and last instructions inside its range
+        _fs->SnoozeOpt();
+        SQInteger const trystart = _fs->GetCurrentPos() + 1;
         {
             BEGIN_SCOPE();
             Statement();
             END_SCOPE();
         }
         _fs->_traps--;
-        _fs->AddInstruction(_OP_POPTRAP, 1, 0);
-        if(_fs->_breaktargets.size()) _fs->_breaktargets.top()--;
-        if(_fs->_continuetargets.size()) _fs->_continuetargets.top()--;
+        SQInteger const tryend = _fs->GetCurrentPos() + 1;
+        _fs->SnoozeOpt();
         _fs->AddInstruction(_OP_JMP, 0, 0);
         SQInteger jmppos = _fs->GetCurrentPos();
-        _fs->SetInstructionParam(trappos, 1, (_fs->GetCurrentPos() - trappos));
 
         Expect(TK_CATCH);
         Expect('(');
@@ -1562,7 +1868,8 @@ public:
         {
             BEGIN_SCOPE();
             uint8_t const ex_target = _fs->PushLocalVariable(exid);
-            _fs->SetInstructionParam(trappos, 0, ex_target);
+            _fs->AddTrap(trystart, tryend, jmppos + 1, ex_target);
+            _fs->SnoozeOpt();
             Statement();
             _fs->SetInstructionParams(jmppos, 0, (_fs->GetCurrentPos() - jmppos), 0);
             END_SCOPE();
@@ -1661,10 +1968,12 @@ public:
         }
         else if(_es.etype==LOCAL) {
             uint8_t const src = _fs->TopTarget();
+            _fs->MarkLocalAssigned(src);
             _fs->AddInstruction(_OP_INCL, src, src, 0, diff);
 
         }
         else if(_es.etype==OUTER) {
+            _fs->MarkOuterAssigned(_es.epos);
             uint8_t tmp = _fs->PushNewTarget();
             _fs->AddInstruction(_OP_GETOUTER, tmp, _es.epos);
             _fs->AddInstruction(_OP_INCL,     tmp, tmp, 0, diff);
@@ -1724,13 +2033,14 @@ public:
         funcstate->AddLineInfos(
             lexer_state->prev_token == '\n'
                 ? lexer_state->last_token_line
-                : lexer_state->current_line,
-            _lineinfo,
-            true);
+                : lexer_state->current_line);
         funcstate->AddInstruction(_OP_RETURN, -1);
         funcstate->SetStackSize(0);
 
         SQFunctionProto *func = funcstate->BuildProto();
+#ifdef _DEBUG_DUMP
+        funcstate->Dump(func);
+#endif
         _fs = currchunk;
         _fs->_functions.push_back(func);
         _fs->PopChildState();
@@ -1757,9 +2067,9 @@ public:
     }
 };
 
-bool Compile(SQVM *vm,SQLEXREADFUNC rg, SQUserPointer up, const SQChar *sourcename, SQObjectPtr &out, bool raiseerror, bool lineinfo)
+bool Compile(SQVM *vm,SQLEXREADFUNC rg, SQUserPointer up, const SQChar *sourcename, SQObjectPtr &out, bool raiseerror)
 {
-    SQCompiler p(vm, rg, up, sourcename, raiseerror, lineinfo);
+    SQCompiler p(vm, rg, up, sourcename, raiseerror);
     return p.Compile(out);
 }
 
@@ -14,6 +14,5 @@ bool Compile(
 	SQUserPointer up,
 	const SQChar *sourcename,
 	SQObjectPtr &out,
-	bool raiseerror,
-	bool lineinfo
+	bool raiseerror
 );
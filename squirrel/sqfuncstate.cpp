@@ -77,6 +77,27 @@ SQInstructionDesc g_InstrDesc[]={
     {_SC("_OP_NEWSLOTA")},
     {_SC("_OP_GETBASE")},
     {_SC("_OP_CLOSE")},
+    {_SC("_OP_ADDI")},
+    {_SC("_OP_SUBI")},
+    {_SC("_OP_MULI")},
+    {_SC("_OP_DIVI")},
+    {_SC("_OP_MODI")},
+    {_SC("_OP_ADDF")},
+    {_SC("_OP_SUBF")},
+    {_SC("_OP_MULF")},
+    {_SC("_OP_DIVF")},
+    {_SC("_OP_MODF")},
+    {_SC("_OP_CMPI")},
+    {_SC("_OP_CMPF")},
+    {_SC("_OP_JCMPI")},
+    {_SC("_OP_JCMPF")},
+    {_SC("_OP_ADDK")},
+    {_SC("_OP_SUBK")},
+    {_SC("_OP_MULK")},
+    {_SC("_OP_DIVK")},
+    {_SC("_OP_MODK")},
+    {_SC("_OP_FOREACHA")},
+    {_SC("_OP_FORLOOP")},
 };
 #endif
 void DumpLiteral(SQObjectPtr &o)
@@ -107,11 +128,13 @@ SQFuncState::SQFuncState(
     _optimization = true;
     _parent = parent;
     _stacksize = 0;
+    _prevstacksize = 0;
     _traps = 0;
     _returnexp = 0;
     _varparams = false;
     _bgenerator = false;
     _outers = 0;
+    memset(_reassigned, 0, sizeof(_reassigned));
 }
 
 void SQFuncState::Error(const SQChar *err)
@@ -236,6 +259,7 @@ SQInteger SQFuncState::GetConstant(const SQObject &cons)
     {
         val = _nliterals;
         _table(_literals)->NewSlot(cons,val);
+        _literalvals.push_back(cons);
         _nliterals++;
         if(_nliterals > MAX_LITERALS) {
             val.Null();
@@ -245,6 +269,40 @@ SQInteger SQFuncState::GetConstant(const SQObject &cons)
     return _integer(val);
 }
 
+bool SQFuncState::GetLiteral(SQInteger idx, SQObjectPtr &val) {
+    if (idx < 0 || idx >= (SQInteger)_literalvals.size()) {
+        return false;
+    }
+    val = _literalvals[idx];
+    return true;
+}
+
+// Drops all instructions after pos along with the debug infos and nested
+// functions that were emitted for them. Used for code the compiler proved
+// unreachable, the caller is responsible for any pending jumps into it.
+void SQFuncState::DiscardCode(SQInteger pos, SQInteger nlocalvarinfos, SQInteger nlineinfos, SQInteger nfunctions) {
+    PopInstructions(GetCurrentPos() - pos);
+    _localvarinfos.resize(nlocalvarinfos);
+    _lineinfos.resize(nlineinfos);
+    // try blocks are added once closed, the discarded ones start after pos
+    SQInteger ntraps = _trapinfos.size();
+    while (ntraps > 0 && _trapinfos[ntraps - 1]._start > pos) {
+        ntraps--;
+    }
+    _trapinfos.resize(ntraps);
+    _functions.resize(nfunctions);
+    SQInteger ncaptures = _captures.size();
+    while (ncaptures > 0 && _captures[ncaptures - 1]._func >= nfunctions) {
+        ncaptures--;
+    }
+    _captures.resize(ncaptures);
+    _lastline = _lineinfos.size() > 0 ? _lineinfos.back()._line : 0;
+    if (_returnexp > pos) {
+        _returnexp = -1;
+    }
+    SnoozeOpt();
+}
+
 void SQFuncState::SetInstructionParams(SQInteger pos,SQInteger arg0,SQInteger arg1,SQInteger arg2,SQInteger arg3)
 {
     _instructions[pos]._arg0=(unsigned char)*((SQUnsignedInteger *)&arg0);
@@ -271,11 +329,6 @@ uint8_t SQFuncState::AllocStackPos() {
 
     uint8_t const pos = _vlocals.size();
     _vlocals.push_back(SQLocalVarInfo());
-
-    if (_vlocals.size() > _stacksize) {
-        _stacksize = _vlocals.size();
-    }
-
     return pos;
 }
 
@@ -322,20 +375,45 @@ SQInteger SQFuncState::CountOuters(SQInteger stacksize) {
     return outers;
 }
 
-void SQFuncState::SetStackSize(SQInteger n) {
+SQInteger SQFuncState::SetStackSize(SQInteger n) {
     SQInteger size = _vlocals.size();
+    SQInteger closed = 0;
     while (size > n) {
         size--;
         SQLocalVarInfo lvi = _vlocals.back();
         if (sq_type(lvi._name) != OT_NULL) {
             if (lvi._end_op == UINT_MINUS_ONE) { //this means is an outer
                 _outers--;
+                if (!ResolveCaptures(size)) {
+                    closed++;
+                }
             }
             lvi._end_op = GetCurrentPos();
             _localvarinfos.push_back(lvi);
         }
         _vlocals.pop_back();
     }
+    return closed;
+}
+
+// Returns true when every closure capturing the local at pos now holds
+// a copy of its value, i.e. the local was never assigned after its
+// declaration and needs no SQOuter
+bool SQFuncState::ResolveCaptures(SQInteger pos) {
+    bool const byvalue = !(_reassigned[pos >> 6] & (uint64_t(1) << (pos & 63)));
+    SQInteger i = 0;
+    while (i < SQInteger(_captures.size())) {
+        SQOuterCapture &c = _captures[i];
+        if (c._pos != pos) {
+            i++;
+            continue;
+        }
+        if (byvalue) {
+            _funcproto(_functions[c._func])->_outervalues[c._outer]._type = otVALUE;
+        }
+        _captures.remove(i);
+    }
+    return byvalue;
 }
 
 bool SQFuncState::IsConstant(SQObject const & name, SQObject & e) {
@@ -369,11 +447,7 @@ uint8_t SQFuncState::PushLocalVariable(SQObject const & name) {
     lvi._start_op = GetCurrentPos() + 1;
     lvi._pos = _vlocals.size();
     _vlocals.push_back(lvi);
-
-    if (_vlocals.size() > _stacksize) {
-        _stacksize = _vlocals.size();
-    }
-
+    _reassigned[pos >> 6] &= ~(uint64_t(1) << (pos & 63));
     return pos;
 }
 
@@ -396,6 +470,21 @@ void SQFuncState::MarkLocalAsOuter(SQInteger pos)
     _outers++;
 }
 
+void SQFuncState::MarkLocalAssigned(SQInteger pos)
+{
+    _reassigned[pos >> 6] |= uint64_t(1) << (pos & 63);
+}
+
+void SQFuncState::MarkOuterAssigned(SQInteger idx)
+{
+    SQOuterVar &ov = _outervalues[idx];
+    if (ov._type == otLOCAL) {
+        _parent->MarkLocalAssigned(_integer(ov._src));
+    } else {
+        _parent->MarkOuterAssigned(_integer(ov._src));
+    }
+}
+
 SQInteger SQFuncState::GetOuterVariable(const SQObject &name)
 {
     SQInteger outers = _outervalues.size();
@@ -416,6 +505,11 @@ SQInteger SQFuncState::GetOuterVariable(const SQObject &name)
         else {
             _parent->MarkLocalAsOuter(pos);
             _outervalues.push_back(SQOuterVar(name,SQObjectPtr(SQInteger(pos)),otLOCAL)); //local
+            SQOuterCapture c;
+            c._func = _parent->_functions.size();
+            c._outer = _outervalues.size() - 1;
+            c._pos = pos;
+            _parent->_captures.push_back(c);
             return _outervalues.size() - 1;
 
 
@@ -429,21 +523,31 @@ void SQFuncState::AddParameter(SQObject const & name) {
     _parameters.push_back(name);
 }
 
-void SQFuncState::AddLineInfos(SQInteger line, bool lineop, bool force) {
-    if(_lastline!=line || force){
+void SQFuncState::AddLineInfos(SQInteger line) {
+    if(_lastline!=line){
         SQLineInfo li;
         li._line = line;
         li._op = (GetCurrentPos()+1);
-        if (lineop) {
-            AddInstruction(_OP_LINE, 0, line);
+        // a line that produced no code leaves its first instruction to this one
+        if(_lineinfos.size() > 0 && _lineinfos.back()._op == li._op) {
+            _lineinfos.back()._line = line;
         }
-        if(_lastline!=line) {
+        else {
             _lineinfos.push_back(li);
         }
         _lastline=line;
     }
 }
 
+void SQFuncState::AddTrap(SQInteger start, SQInteger end, SQInteger handler, SQInteger extarget) {
+    SQTrapInfo ti;
+    ti._start = start;
+    ti._end = end;
+    ti._handler = handler;
+    ti._extarget = extarget;
+    _trapinfos.push_back(ti);
+}
+
 void SQFuncState::DiscardTarget()
 {
     SQInteger discardedtarget = PopTarget();
@@ -455,12 +559,30 @@ void SQFuncState::DiscardTarget()
             if(pi._arg0 == discardedtarget) {
                 pi._arg0 = 0xFF;
             }
+            break;
+        case _OP_PINCL:
+            // 'i++' as a statement: the old value is never read, so
+            // increment in place and give back the temporary's slot
+            if(pi._arg0 == discardedtarget) {
+                pi.op = _OP_INCL;
+                pi._arg0 = pi._arg1;
+                ReleaseTemporary();
+            }
+            break;
         }
     }
 }
 
 void SQFuncState::AddInstruction(SQInstruction &i)
 {
+    // The frame only has to cover slots that emitted code can touch;
+    // when a peephole below folds away the temporary written by the
+    // previous instruction, its slot stops counting
+    uint16_t const stacksize = _stacksize;
+    if (_vlocals.size() > _stacksize) {
+        _stacksize = _vlocals.size();
+    }
+
     SQInteger size = _instructions.size();
     if(size > 0 && _optimization){ //simple optimizer
         SQInstruction &pi = _instructions[size-1];//previous instruction
@@ -470,6 +592,7 @@ void SQFuncState::AddInstruction(SQInstruction &i)
                 pi.op = _OP_JCMP;
                 pi._arg0 = (unsigned char)pi._arg1;
                 pi._arg1 = i._arg1;
+                ReleaseTemporary();
                 return;
             }
             break;
@@ -497,7 +620,7 @@ void SQFuncState::AddInstruction(SQInstruction &i)
                 pi._arg2 = (unsigned char)i._arg1;
                 pi.op = _OP_GETK;
                 pi._arg0 = i._arg0;
-
+                ReleaseTemporary();
                 return;
             }
         break;
@@ -507,6 +630,7 @@ void SQFuncState::AddInstruction(SQInstruction &i)
                 pi._arg0 = i._arg0;
                 pi._arg2 = i._arg2;
                 pi._arg3 = i._arg3;
+                ReleaseTemporary();
                 return;
             }
             break;
@@ -524,6 +648,7 @@ void SQFuncState::AddInstruction(SQInstruction &i)
                 pi._arg0 = i._arg0;
                 pi._arg2 = (unsigned char)aat;
                 pi._arg3 = MAX_FUNC_STACKSIZE;
+                ReleaseTemporary();
                 return;
             }
                               }
@@ -531,13 +656,17 @@ void SQFuncState::AddInstruction(SQInstruction &i)
         case _OP_MOVE:
             switch(pi.op) {
             case _OP_GET: case _OP_ADD: case _OP_SUB: case _OP_MUL: case _OP_DIV: case _OP_MOD: case _OP_BITW:
+            case _OP_ADDK: case _OP_SUBK: case _OP_MULK: case _OP_DIVK: case _OP_MODK:
             case _OP_LOADINT: case _OP_LOADFLOAT: case _OP_LOADBOOL: case _OP_LOAD:
+            case _OP_GETK: case _OP_GETOUTER: case _OP_EQ: case _OP_NE: case _OP_CMP:
+            case _OP_NEG: case _OP_NOT: case _OP_BWNOT:
 
                 if(pi._arg0 == i._arg1)
                 {
                     pi._arg0 = i._arg0;
                     _optimization = false;
                     //_result_elimination = false;
+                    ReleaseTemporary();
                     return;
                 }
             }
@@ -559,12 +688,40 @@ void SQFuncState::AddInstruction(SQInstruction &i)
             }
             break;
         case _OP_EQ:case _OP_NE:
-            if(pi.op == _OP_LOAD && pi._arg0 == i._arg1 && (!IsLocal(pi._arg0) ))
+            if((pi.op == _OP_LOAD || pi.op == _OP_LOADINT || pi.op == _OP_LOADBOOL)
+                && pi._arg0 == i._arg1 && (!IsLocal(pi._arg0) ))
             {
+                // compare against the literal directly instead of a loaded temporary
+                if(pi.op == _OP_LOADINT) {
+                    pi._arg1 = GetNumericConstant(SQInteger(pi._arg1));
+                } else if(pi.op == _OP_LOADBOOL) {
+                    pi._arg1 = GetConstant(SQObjectPtr(pi._arg1 != 0));
+                }
                 pi.op = i.op;
                 pi._arg0 = i._arg0;
                 pi._arg2 = i._arg2;
                 pi._arg3 = MAX_FUNC_STACKSIZE;
+                ReleaseTemporary();
+                return;
+            }
+            break;
+        case _OP_ADD: case _OP_SUB: case _OP_MUL: case _OP_DIV: case _OP_MOD:
+            // a constant right operand goes in the instruction, division
+            // by 0 and -1 stay generic for their runtime errors
+            if(pi.op == _OP_LOADINT && pi._arg0 == i._arg1 && pi._arg0 != i._arg2 && (!IsLocal(pi._arg0))
+                && !((i.op == _OP_DIV || i.op == _OP_MOD) && (pi._arg1 == 0 || pi._arg1 == -1)))
+            {
+                switch(i.op) {
+                case _OP_ADD: pi.op = _OP_ADDK; break;
+                case _OP_SUB: pi.op = _OP_SUBK; break;
+                case _OP_MUL: pi.op = _OP_MULK; break;
+                case _OP_DIV: pi.op = _OP_DIVK; break;
+                default: pi.op = _OP_MODK; break;
+                }
+                pi._arg0 = i._arg0;
+                pi._arg2 = i._arg2;
+                pi._arg3 = 0;
+                ReleaseTemporary();
                 return;
             }
             break;
@@ -576,18 +733,21 @@ void SQFuncState::AddInstruction(SQInstruction &i)
                 return;
             }
             break;
-        case _OP_LINE:
-            if(pi.op == _OP_LINE) {
-                _instructions.pop_back();
-                _lineinfos.pop_back();
-            }
-            break;
         }
     }
     _optimization = true;
+    _prevstacksize = stacksize;
     _instructions.push_back(i);
 }
 
+void SQFuncState::ReleaseTemporary()
+{
+    _stacksize = _prevstacksize;
+    if (_vlocals.size() > _stacksize) {
+        _stacksize = _vlocals.size();
+    }
+}
+
 SQObject SQFuncState::CreateString(const SQChar *s,SQInteger len) {
     if (len < 0) {
         len = strlen(s);
@@ -614,7 +774,8 @@ SQFunctionProto *SQFuncState::BuildProto() {
         _outervalues.size(),
         _lineinfos.size(),
         _localvarinfos.size(),
-        _defaultparams.size());
+        _defaultparams.size(),
+        _trapinfos.size());
 
     SQObjectPtr refidx,key,val;
     SQInteger idx;
@@ -635,6 +796,7 @@ SQFunctionProto *SQFuncState::BuildProto() {
     for(SQUnsignedInteger nl = 0; nl < _localvarinfos.size(); nl++) f->_localvarinfos[nl] = _localvarinfos[nl];
     for(SQUnsignedInteger ni = 0; ni < _lineinfos.size(); ni++) f->_lineinfos[ni] = _lineinfos[ni];
     for(SQUnsignedInteger nd = 0; nd < _defaultparams.size(); nd++) f->_defaultparams[nd] = _defaultparams[nd];
+    for(SQUnsignedInteger nt = 0; nt < _trapinfos.size(); nt++) f->_traps[nt] = _trapinfos[nt];
 
     memcpy(f->_instructions,&_instructions[0],_instructions.size()*sizeof(SQInstruction));
 
@@ -7,6 +7,13 @@
 
 #include "SQFunctionProto.hpp"
 
+// A child function capturing one of our locals; resolved when the local dies
+struct SQOuterCapture {
+    SQInteger _func;
+    SQInteger _outer;
+    SQInteger _pos;
+};
+
 class SQFuncState {
     CompilerErrorFunc _errfunc;
     void *_errtarget;
@@ -15,6 +22,7 @@ public:
     sqvector<SQLocalVarInfo> _vlocals;
     sqvector<uint8_t> _targetstack;
     uint16_t _stacksize;
+    uint16_t _prevstacksize;
     bool _varparams;
     bool _bgenerator;
     sqvector<SQInteger> _unresolvedbreaks;
@@ -25,19 +33,23 @@ public:
     SQInstructionVec _instructions;
     sqvector<SQLocalVarInfo> _localvarinfos;
     SQObjectPtr _literals;
+    sqvector<SQObjectPtr> _literalvals; // _literals inverted, by index
     SQObjectPtr _strings;
     SQObjectPtr _name;
     SQObjectPtr _sourcename;
     SQInteger _nliterals;
     SQLineInfoVec _lineinfos;
+    SQTrapInfoVec _trapinfos;
     SQFuncState *_parent;
     sqvector<SQInteger> _scope_blocks;
     sqvector<SQInteger> _breaktargets;
     sqvector<SQInteger> _continuetargets;
     sqvector<SQInteger> _defaultparams;
     SQInteger _lastline;
-    SQInteger _traps; //contains number of nested exception traps
+    SQInteger _traps; //contains number of nested try blocks
     SQInteger _outers;
+    sqvector<SQOuterCapture> _captures;
+    uint64_t _reassigned[4]; // one bit per stack slot holding a local
     bool _optimization;
     SQSharedState *_sharedstate;
     sqvector<SQFuncState*> _childstates;
@@ -59,7 +71,7 @@ public:
     void SetInstructionParam(SQInteger pos,SQInteger arg,SQInteger val);
     SQInstruction &GetInstruction(SQInteger pos){return _instructions[pos];}
     void PopInstructions(SQInteger size){for(SQInteger i=0;i<size;i++)_instructions.pop_back();}
-    void SetStackSize(SQInteger n);
+    SQInteger SetStackSize(SQInteger n);
     SQInteger CountOuters(SQInteger stacksize);
     void SnoozeOpt(){_optimization=false;}
     void AddDefaultParam(SQInteger trg) { _defaultparams.push_back(trg); }
@@ -71,11 +83,14 @@ public:
     void AddParameter(const SQObject &name);
     SQInteger GetLocalVariable(const SQObject &name);
     void MarkLocalAsOuter(SQInteger pos);
+    void MarkLocalAssigned(SQInteger pos);
+    void MarkOuterAssigned(SQInteger idx);
     SQInteger GetOuterVariable(const SQObject &name);
     SQInteger GenerateCode();
     uint16_t GetStackSize();
     SQInteger CalcStackFrameSize();
-    void AddLineInfos(SQInteger line,bool lineop,bool force=false);
+    void AddLineInfos(SQInteger line);
+    void AddTrap(SQInteger start, SQInteger end, SQInteger handler, SQInteger extarget);
     SQFunctionProto *BuildProto();
     uint8_t PushNewTarget();
     void PushTarget(uint8_t n);
@@ -87,6 +102,10 @@ public:
     SQObject CreateTable();
     bool IsConstant(const SQObject &name,SQObject &e);
     SQInteger GetConstant(const SQObject &cons);
+    bool GetLiteral(SQInteger idx, SQObjectPtr &val);
+    void DiscardCode(SQInteger pos, SQInteger nlocalvarinfos, SQInteger nlineinfos, SQInteger nfunctions);
 private:
     uint8_t AllocStackPos();
+    void ReleaseTemporary();
+    bool ResolveCaptures(SQInteger pos);
 };
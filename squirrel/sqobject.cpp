@@ -132,6 +132,40 @@ SQInteger SQFunctionProto::GetLine(SQInstruction *curr)
     return line;
 }
 
+bool SQFunctionProto::LineStart(SQInstruction *curr, SQInteger & line)
+{
+    SQInteger op = (SQInteger)(curr-_instructions);
+    SQInteger low = 0;
+    SQInteger high = _nlineinfos - 1;
+    while(low <= high)
+    {
+        SQInteger mid = low + ((high - low) >> 1);
+        SQInteger curop = _lineinfos[mid]._op;
+        if(curop > op) {
+            high = mid - 1;
+        }
+        else if(curop < op) {
+            low = mid + 1;
+        }
+        else {
+            line = _lineinfos[mid]._line;
+            return true;
+        }
+    }
+    return false;
+}
+
+const SQTrapInfo * SQFunctionProto::FindTrap(SQInstruction *curr)
+{
+    SQInteger op = (SQInteger)(curr-_instructions);
+    for(size_t i = 0; i < _ntraps; i++) {
+        if(_traps[i]._start <= op && op < _traps[i]._end) {
+            return &_traps[i];
+        }
+    }
+    return NULL;
+}
+
 SQClosure::~SQClosure() {
     assert(_root);
     _root->DecreaseRefCount();
@@ -241,10 +275,14 @@ bool ReadObject(HSQUIRRELVM v, SQUserPointer up, SQREADFUNC read, SQObjectPtr &
 #define SQ_CLOSURESTREAM_HEAD (('S'<<24)|('Q'<<16)|('I'<<8)|('R'))
 #define SQ_CLOSURESTREAM_PART (('P'<<24)|('A'<<16)|('R'<<8)|('T'))
 #define SQ_CLOSURESTREAM_TAIL (('T'<<24)|('A'<<16)|('I'<<8)|('L'))
+// bumped whenever the instruction set or the proto layout changes;
+// 2: no _OP_LINE, try blocks in the trap table
+#define SQ_CLOSURESTREAM_VERSION 2
 
 bool SQClosure::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
 {
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_HEAD));
+    _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_VERSION));
     _CHECK_IO(WriteTag(v,write,up,sizeof(SQChar)));
     _CHECK_IO(WriteTag(v,write,up,sizeof(SQInteger)));
     _CHECK_IO(WriteTag(v,write,up,sizeof(SQFloat)));
@@ -256,6 +294,12 @@ bool SQClosure::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
 bool SQClosure::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret)
 {
     _CHECK_IO(CheckTag(v,read,up,SQ_CLOSURESTREAM_HEAD));
+    SQUnsignedInteger32 version;
+    _CHECK_IO(SafeRead(v,read,up,&version,sizeof(version)));
+    if(version != SQ_CLOSURESTREAM_VERSION) {
+        v->Raise_Error(_SC("closure stream version %d, expected %d"),(int)version,SQ_CLOSURESTREAM_VERSION);
+        return false;
+    }
     _CHECK_IO(CheckTag(v,read,up,sizeof(SQChar)));
     _CHECK_IO(CheckTag(v,read,up,sizeof(SQInteger)));
     _CHECK_IO(CheckTag(v,read,up,sizeof(SQFloat)));
@@ -274,12 +318,12 @@ SQFunctionProto::SQFunctionProto(SQSharedState *ss)
     _bgenerator=false;
 }
 
-bool SQFunctionProto::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
+bool SQFunctionProto::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write,sqvector<SQSharedCode *> *share)
 {
     SQInteger i,nliterals = _nliterals,nparameters = _nparameters;
     SQInteger noutervalues = _noutervalues,nlocalvarinfos = _nlocalvarinfos;
     SQInteger nlineinfos=_nlineinfos,ninstructions = _ninstructions,nfunctions=_nfunctions;
-    SQInteger ndefaultparams = _ndefaultparams;
+    SQInteger ndefaultparams = _ndefaultparams,ntraps = _ntraps;
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
     _CHECK_IO(WriteObject(v,up,write,_sourcename));
     _CHECK_IO(WriteObject(v,up,write,_name));
@@ -292,6 +336,7 @@ bool SQFunctionProto::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
     _CHECK_IO(SafeWrite(v,write,up,&ndefaultparams,sizeof(ndefaultparams)));
     _CHECK_IO(SafeWrite(v,write,up,&ninstructions,sizeof(ninstructions)));
     _CHECK_IO(SafeWrite(v,write,up,&nfunctions,sizeof(nfunctions)));
+    _CHECK_IO(SafeWrite(v,write,up,&ntraps,sizeof(ntraps)));
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
     for(i=0;i<nliterals;i++){
         _CHECK_IO(WriteObject(v,up,write,_literals[i]));
@@ -324,12 +369,24 @@ bool SQFunctionProto::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
     _CHECK_IO(SafeWrite(v,write,up,_defaultparams,sizeof(SQInteger)*ndefaultparams));
 
+    _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
+    _CHECK_IO(SafeWrite(v,write,up,_traps,sizeof(SQTrapInfo)*ntraps));
+
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
     _CHECK_IO(SafeWrite(v,write,up,_instructions,sizeof(SQInstruction)*ninstructions));
+    if(share) {
+        if(_sharedcode) {
+            _sharedcode->AddRef();
+            share->push_back(_sharedcode);
+        }
+        else {
+            share->push_back(SQSharedCode::Create(_instructions,_ninstructions));
+        }
+    }
 
     _CHECK_IO(WriteTag(v,write,up,SQ_CLOSURESTREAM_PART));
     for(i=0;i<nfunctions;i++){
-        _CHECK_IO(_funcproto(_functions[i])->Save(v,up,write));
+        _CHECK_IO(_funcproto(_functions[i])->Save(v,up,write,share));
     }
     _CHECK_IO(SafeWrite(v,write,up,&_stacksize,sizeof(_stacksize)));
     _CHECK_IO(SafeWrite(v,write,up,&_bgenerator,sizeof(_bgenerator)));
@@ -337,11 +394,11 @@ bool SQFunctionProto::Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write)
     return true;
 }
 
-bool SQFunctionProto::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret)
+bool SQFunctionProto::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret,SQSharedCodes *shared)
 {
     SQInteger i, nliterals,nparameters;
     SQInteger noutervalues ,nlocalvarinfos ;
-    SQInteger nlineinfos,ninstructions ,nfunctions,ndefaultparams ;
+    SQInteger nlineinfos,ninstructions ,nfunctions,ndefaultparams,ntraps ;
     SQObjectPtr sourcename, name;
     SQObjectPtr o;
     _CHECK_IO(CheckTag(v,read,up,SQ_CLOSURESTREAM_PART));
@@ -357,10 +414,15 @@ bool SQFunctionProto::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr
     _CHECK_IO(SafeRead(v,read,up, &ndefaultparams, sizeof(ndefaultparams)));
     _CHECK_IO(SafeRead(v,read,up, &ninstructions, sizeof(ninstructions)));
     _CHECK_IO(SafeRead(v,read,up, &nfunctions, sizeof(nfunctions)));
+    _CHECK_IO(SafeRead(v,read,up, &ntraps, sizeof(ntraps)));
+    if(nliterals < 0 || nparameters < 0 || noutervalues < 0 || nlocalvarinfos < 0 || nlineinfos < 0
+        || ndefaultparams < 0 || ninstructions < 0 || nfunctions < 0 || ntraps < 0) {
+        v->Raise_Error(_SC("invalid or corrupted closure stream"));
+        return false;
+    }
 
-
-    SQFunctionProto *f = SQFunctionProto::Create(_opt_ss(v),ninstructions,nliterals,nparameters,
-            nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams);
+    SQFunctionProto *f = SQFunctionProto::Create(_opt_ss(v),shared ? 0 : ninstructions,nliterals,nparameters,
+            nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams,ntraps);
     SQObjectPtr proto = f; //gets a ref in case of failure
     f->_sourcename = sourcename;
     f->_name = name;
@@ -404,35 +466,129 @@ bool SQFunctionProto::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr
     _CHECK_IO(SafeRead(v,read,up, f->_defaultparams, sizeof(SQInteger)*ndefaultparams));
 
     _CHECK_IO(CheckTag(v,read,up,SQ_CLOSURESTREAM_PART));
-    _CHECK_IO(SafeRead(v,read,up, f->_instructions, sizeof(SQInstruction)*ninstructions));
+    _CHECK_IO(SafeRead(v,read,up, f->_traps, sizeof(SQTrapInfo)*ntraps));
+
+    _CHECK_IO(CheckTag(v,read,up,SQ_CLOSURESTREAM_PART));
+    if(shared) {
+        if(shared->_next >= shared->_count
+            || shared->_codes[shared->_next]->_ninstructions != size_t(ninstructions)) {
+            v->Raise_Error(_SC("invalid or corrupted closure stream"));
+            return false;
+        }
+        f->ShareCode(shared->_codes[shared->_next++]);
+        _CHECK_IO(SafeRead(v,read,up, nullptr, sizeof(SQInstruction)*ninstructions));
+    }
+    else {
+        _CHECK_IO(SafeRead(v,read,up, f->_instructions, sizeof(SQInstruction)*ninstructions));
+    }
 
     _CHECK_IO(CheckTag(v,read,up,SQ_CLOSURESTREAM_PART));
     for(i = 0; i < nfunctions; i++){
-        _CHECK_IO(_funcproto(o)->Load(v, up, read, o));
+        _CHECK_IO(_funcproto(o)->Load(v, up, read, o, shared));
         f->_functions[i] = o;
     }
     _CHECK_IO(SafeRead(v,read,up, &f->_stacksize, sizeof(f->_stacksize)));
     _CHECK_IO(SafeRead(v,read,up, &f->_bgenerator, sizeof(f->_bgenerator)));
     _CHECK_IO(SafeRead(v,read,up, &f->_varparams, sizeof(f->_varparams)));
 
+    for(i = 0; i < ntraps; i++) {
+        SQTrapInfo &t = f->_traps[i];
+        if(t._start < 0 || t._start > t._end || t._end > ninstructions
+            || t._handler < 0 || t._handler >= ninstructions
+            || t._extarget < 0 || t._extarget >= f->_stacksize) {
+            v->Raise_Error(_SC("invalid or corrupted closure stream"));
+            return false;
+        }
+    }
+
     ret = f;
     return true;
 }
 
 #ifndef NO_GARBAGE_COLLECTOR
 
+// False for a weak reference whose object the mark has not reached (yet)
+static bool reached(SQObject const & o)
+{
+    if(sq_type(o) != OT_WEAKREF) return true;
+    SQObject const & target = _weakref(o)->_obj;
+    switch(sq_type(target)) {
+    case OT_NULL: return false;
+    case OT_STRING:
+    case OT_WEAKREF: return true;
+    default: return (target._unVal.pRefCounted->_uiRef & MARK_FLAG) != 0;
+    }
+}
+
 void SQTable::Mark(SQCollectable **chain)
 {
     START_MARK()
         if(_delegate) _delegate->Mark(chain);
-        SQInteger len = _numofnodes;
-        for(SQInteger i = 0; i < len; i++){
-            GC::MarkObject(_nodes[i].key, chain);
-            GC::MarkObject(_nodes[i].val, chain);
+        // values under weak keys wait for their key, see MarkEphemerons()
+        bool const ephemerons = (_weakmode & SQ_WEAK_KEYS) != 0;
+        if(_weakmode) _sharedstate->_weaktables.push_back(this);
+        if(_small) {
+            for(size_t i = 0; i < _npairs; i++){
+                GC::MarkObject(_pairs[i].key, chain);
+                if(!ephemerons || reached(_pairs[i].key)) GC::MarkObject(_pairs[i].val, chain);
+            }
+        }
+        else {
+            SQInteger len = _numofnodes;
+            for(SQInteger i = 0; i < len; i++){
+                GC::MarkObject(_nodes[i].key, chain);
+                if(!ephemerons || reached(_nodes[i].key)) GC::MarkObject(_nodes[i].val, chain);
+            }
+            for(size_t i = 0; i < _arraysize; i++){
+                GC::MarkObject(_arraypart[i], chain);
+            }
         }
     END_MARK()
 }
 
+bool SQTable::MarkEphemerons(SQCollectable **chain)
+{
+    if(!(_weakmode & SQ_WEAK_KEYS)) return false;
+    bool marked = false;
+    size_t const n = _small ? _npairs : _numofnodes;
+    for(size_t i = 0; i < n; i++) {
+        SQObjectPtr & key = _small ? _pairs[i].key : _nodes[i].key;
+        SQObjectPtr & val = _small ? _pairs[i].val : _nodes[i].val;
+        if(sq_type(key) == OT_WEAKREF && reached(key)
+            && ISREFCOUNTED(sq_type(val)) && sq_type(val) != OT_STRING && sq_type(val) != OT_WEAKREF
+            && !(_refcounted(val)->_uiRef & MARK_FLAG)) {
+            GC::MarkObject(val, chain);
+            marked = true;
+        }
+    }
+    return marked;
+}
+
+void SQTable::PruneUnmarked()
+{
+    size_t const n = _small ? _npairs : _numofnodes;
+    size_t pruned = 0;
+    for(size_t i = 0; i < n; i++) {
+        SQObjectPtr & key = _small ? _pairs[i].key : _nodes[i].key;
+        SQObjectPtr & val = _small ? _pairs[i].val : _nodes[i].val;
+        if(sq_type(key) != OT_NULL
+            && (((_weakmode & SQ_WEAK_KEYS) && !reached(key)) || ((_weakmode & SQ_WEAK_VALUES) && !reached(val)))) {
+            key.Null();
+            val.Null();
+            pruned++;
+        }
+    }
+    if(!pruned) return;
+    _usednodes -= pruned;
+    _mmstale = true;
+    if(_small) {
+        while(_npairs && sq_type(_pairs[_npairs - 1].key) == OT_NULL) _npairs--;
+    }
+    else {
+        Rehash(false);
+    }
+}
+
 void SQClass::Mark(SQCollectable **chain)
 {
     START_MARK()
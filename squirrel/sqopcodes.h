@@ -26,6 +26,18 @@ enum CmpOP {
     CMP_3W = 5
 };
 
+// _OP_CMP/_OP_JCMP keep the CmpOP in the low bits of arg3; the high bits
+// count how many times a quickened variant fell back to the generic opcode.
+#define CMP_OP_MASK 0x0F
+#define CMP_DEOPT_SHIFT 4
+
+// A site that deoptimized this many times stays generic for good.
+#define QUICKEN_MAX_DEOPTS 4
+
+// _OP_FORLOOP keeps the CmpOP of the loop condition in the low bits of arg3;
+// this bit selects a step of -1 instead of +1.
+#define FORLOOP_DOWN 0x10
+
 enum NewObjectType {
     NOT_TABLE = 0,
     NOT_ARRAY = 1,
@@ -42,7 +54,7 @@ enum AppendArrayType {
 
 enum SQOpcode
 {
-    _OP_LINE=               0x00,
+    _OP_LINE=               0x00, // unused, lines live in _lineinfos
     _OP_LOAD=               0x01,
     _OP_LOADINT=            0x02,
     _OP_LOADFLOAT=          0x03,
@@ -98,12 +110,45 @@ enum SQOpcode
     _OP_POSTFOREACH=        0x34,
     _OP_CLONE=              0x35,
     _OP_TYPEOF=             0x36,
-    _OP_PUSHTRAP=           0x37,
-    _OP_POPTRAP=            0x38,
+    _OP_PUSHTRAP=           0x37, // unused, try blocks live in _traps
+    _OP_POPTRAP=            0x38, // unused
     _OP_THROW=              0x39,
     _OP_NEWSLOTA=           0x3A,
     _OP_GETBASE=            0x3B,
-    _OP_CLOSE=              0x3C
+    _OP_CLOSE=              0x3C,
+
+    // Quickened variants, never emitted by the compiler. The VM rewrites the
+    // generic opcode in place after observing the operand types and rewrites
+    // it back when a guard fails.
+    _OP_ADDI=               0x3D,
+    _OP_SUBI=               0x3E,
+    _OP_MULI=               0x3F,
+    _OP_DIVI=               0x40,
+    _OP_MODI=               0x41,
+    _OP_ADDF=               0x42,
+    _OP_SUBF=               0x43,
+    _OP_MULF=               0x44,
+    _OP_DIVF=               0x45,
+    _OP_MODF=               0x46,
+    _OP_CMPI=               0x47,
+    _OP_CMPF=               0x48,
+    _OP_JCMPI=              0x49,
+    _OP_JCMPF=              0x4A,
+
+    // Arithmetic with the integer constant arg1 as right operand, emitted by
+    // the peephole optimizer in place of a _OP_LOADINT into a temporary. The
+    // constant's type is known, so the other operand is tested inline
+    // instead of quickening.
+    _OP_ADDK=               0x4B,
+    _OP_SUBK=               0x4C,
+    _OP_MULK=               0x4D,
+    _OP_DIVK=               0x4E,
+    _OP_MODK=               0x4F,
+
+    _OP_FOREACHA=           0x50,
+
+    // Step and condition of a counted 'for' loop in one instruction
+    _OP_FORLOOP=            0x51
 };
 
 struct SQInstructionDesc {
@@ -1,8 +1,10 @@
 #include "sqstate.h"
 
 #include <algorithm>
+#include <chrono>
 
 #include "GC.hpp"
+#include "SQCensus.hpp"
 #include "SQArray.hpp"
 #include "SQClass.hpp"
 #include "SQFunctionProto.hpp"
@@ -101,6 +103,9 @@ SQSharedState::SQSharedState()
 
     , _metamethods()
     , _systemstrings()
+    , _threadstacksize(0)
+    , _nativecalls(0)
+    , _censusinterval(0)
     , _compilererrorhandler(nullptr)
     , _printfunc(nullptr)
     , _errorfunc(nullptr)
@@ -167,11 +172,16 @@ SQSharedState::~SQSharedState() {
         _releasehook(_foreignptr, 0);
     }
 
+    // nothing released from here on is worth keeping
+    _threadstacks.SetLimit(0);
+    _generatorstacks.SetLimit(0);
+
     // We must drop all current refs,
     // so that GC below can collect all remaining refs
     // This also helps detect any leaks
     _registry.Null();
     _consts.Null();
+    _snapshotbase.Null();
     _metamethodsmap.Null();
     _root_vm.Null();
     _table_default_delegate.Null();
@@ -241,6 +251,7 @@ void SQSharedState::RunMark(SQCollectable ** tchain) {
     _refs_table.Mark(tchain);
     GC::MarkObject(_registry,tchain);
     GC::MarkObject(_consts,tchain);
+    GC::MarkObject(_snapshotbase,tchain);
     GC::MarkObject(_metamethodsmap,tchain);
     GC::MarkObject(_table_default_delegate,tchain);
     GC::MarkObject(_array_default_delegate,tchain);
@@ -252,12 +263,23 @@ void SQSharedState::RunMark(SQCollectable ** tchain) {
     GC::MarkObject(_class_default_delegate,tchain);
     GC::MarkObject(_instance_default_delegate,tchain);
     GC::MarkObject(_weakref_default_delegate,tchain);
+
+    // a value under a weak key is reachable once its key is, which may take
+    // any number of passes
+    bool marked = true;
+    while(marked) {
+        marked = false;
+        for(size_t i = 0; i < _weaktables.size(); i++) {
+            marked = _weaktables[i]->MarkEphemerons(tchain) || marked;
+        }
+    }
 }
 
 void SQSharedState::ResurrectUnreachable(SQVM * vm) {
     SQCollectable * tchain = NULL;
 
     RunMark(&tchain);
+    _weaktables.resize(0);
 
     SQCollectable *resurrected = gc.chain_root;
     SQCollectable *t = resurrected;
@@ -304,12 +326,30 @@ void SQSharedState::ResurrectUnreachable(SQVM * vm) {
     }
 }
 
-SQInteger SQSharedState::CollectGarbage() {
+bool SQSharedState::CollectIfDue(size_t nativecalls) {
+    if (!gc.due || _nativecalls > nativecalls) {
+        return false;
+    }
+    // release hooks may run scripts, which must not start another one
+    _nativecalls++;
+    CollectGarbage(true);
+    _nativecalls--;
+    return true;
+}
+
+SQInteger SQSharedState::CollectGarbage(bool automatic) {
+    auto const start = std::chrono::steady_clock::now();
     SQInteger n = 0;
     SQCollectable *tchain = NULL;
 
     RunMark(&tchain);
 
+    // slots of unreachable objects go before the objects do
+    for(size_t i = 0; i < _weaktables.size(); i++) {
+        _weaktables[i]->PruneUnmarked();
+    }
+    _weaktables.resize(0);
+
     SQCollectable *t = gc.chain_root;
     SQCollectable *nx = NULL;
     if(t) {
@@ -335,6 +375,13 @@ SQInteger SQSharedState::CollectGarbage() {
     }
     gc.chain_root = tchain;
 
+    auto const pause = std::chrono::steady_clock::now() - start;
+    gc.Collected(n, std::chrono::duration_cast<std::chrono::microseconds>(pause).count(), automatic);
+    if (_censusinterval && gc.stats.collections % _censusinterval == 0) {
+        SQCensus census(SQ_CENSUS_DUMPTOP);
+        census.Take(this);
+        census.Print(_thread(_root_vm));
+    }
     return n;
 }
 #endif
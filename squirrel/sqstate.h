@@ -13,6 +13,46 @@ struct SQTable;
 
 struct SQObjectPtr;
 
+#define SQ_STACKPOOL_MAX 64
+#define SQ_STACKPOOL_DEFAULT 16
+
+// Storage of dead thread and generator stacks kept for reuse, so that
+// short-lived coroutines do not go through the allocator every time
+struct SQStackPool {
+    size_t limit;
+    size_t count;
+    sqvector<SQObjectPtr> stacks[SQ_STACKPOOL_MAX];
+
+    SQStackPool()
+        : limit(SQ_STACKPOOL_DEFAULT)
+        , count(0)
+    {}
+
+    // stack must be empty, on return it holds size nulls
+    void Acquire(sqvector<SQObjectPtr> & stack, size_t size) {
+        if (count) {
+            stack.swap(stacks[--count]);
+        }
+        stack.resize(size);
+    }
+
+    // releases the contents of stack and keeps its storage if there is room
+    void Recycle(sqvector<SQObjectPtr> & stack) {
+        stack.resize(0);
+        if (count < limit && stack.capacity()) {
+            stacks[count++].swap(stack);
+        }
+    }
+
+    void SetLimit(size_t n) {
+        limit = n < SQ_STACKPOOL_MAX ? n : SQ_STACKPOOL_MAX;
+        while (count > limit) {
+            sqvector<SQObjectPtr> dropped;
+            dropped.swap(stacks[--count]);
+        }
+    }
+};
+
 struct SQSharedState {
 public:
     GC gc;
@@ -31,7 +71,10 @@ public:
     SQInteger GetMetaMethodIdxByName(const SQObjectPtr &name);
 
 #ifndef NO_GARBAGE_COLLECTOR
-    SQInteger CollectGarbage();
+    SQInteger CollectGarbage(bool automatic = false);
+    // runs a collection if pacing asks for one and no more native calls
+    // are in progress than the nativecalls the caller knows to be safe
+    bool CollectIfDue(size_t nativecalls);
     void RunMark(SQCollectable ** tchain);
     void ResurrectUnreachable(SQVM * vm);
 #endif
@@ -40,8 +83,23 @@ public:
     SQObjectPtr _metamethodsmap;
     sqvector<SQObjectPtr> _systemstrings;
     RefTable _refs_table;
+#ifndef NO_GARBAGE_COLLECTOR
+    // weak tables reached by the mark in progress
+    sqvector<SQTable *> _weaktables;
+#endif
+    SQStackPool _threadstacks;
+    SQStackPool _generatorstacks;
+    // minimum stack size of threads created by newthread()
+    size_t _threadstacksize;
+    // native calls in progress on all VMs; they may hold objects the
+    // collector cannot see, so automatic collection waits for them
+    size_t _nativecalls;
+    // print a heap census after every this many collections, 0 for never
+    SQInteger _censusinterval;
     SQObjectPtr _registry;
     SQObjectPtr _consts;
+    // objects present at sq_setsnapshotbaseline, mapped to their paths
+    SQObjectPtr _snapshotbase;
 
     SQObjectPtr _root_vm;
     SQObjectPtr _table_default_delegate;
@@ -68,7 +126,7 @@ public:
     SQCOMPILERERROR _compilererrorhandler;
     SQPRINTFUNCTION _printfunc;
     SQPRINTFUNCTION _errorfunc;
-    bool _debuginfo;
+    bool _debuginfo; // kept for sq_enabledebuginfo, lines are always recorded
     bool _notifyallexceptions;
 };
 
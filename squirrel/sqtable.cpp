@@ -8,7 +8,19 @@ SQTable::SQTable(SQSharedState *ss, size_t nInitialSize)
     , _nodes(nullptr)
     , _numofnodes(0)
     , _usednodes(0)
+    , _arraypart(nullptr)
+    , _arraybits(nullptr)
+    , _arraysize(0)
+    , _arrayused(0)
+    , _mmcache(nullptr)
+    , _mmstale(true)
+    , _small(nInitialSize <= SQ_TABLE_SMALL)
+    , _weakmode(0)
 {
+    if (_small) {
+        AllocPairs(nInitialSize);
+        return;
+    }
     size_t pow2size = 4;
     while (nInitialSize > pow2size) {
         pow2size = pow2size << 1;
@@ -16,18 +28,110 @@ SQTable::SQTable(SQSharedState *ss, size_t nInitialSize)
     AllocNodes(pow2size);
 }
 
-void SQTable::Remove(SQObjectPtr const & key) {
+// Objects held through their weak reference in a weak slot. Strings are
+// values like numbers and stay strong. A weak reference used as a key is
+// held through its own weak reference, so it comes back as itself; as a
+// value it is already weak and reads through like in any table.
+static inline bool weakable(SQObject const & o, uint8_t mode) {
+    return ISREFCOUNTED(sq_type(o)) && sq_type(o) != OT_STRING
+        && (sq_type(o) != OT_WEAKREF || mode == SQ_WEAK_KEYS);
+}
+
+static inline bool released(SQObject const & o) {
+    return sq_type(o) == OT_WEAKREF && sq_type(_weakref(o)->_obj) == OT_NULL;
+}
+
+void SQTable::AllocPairs(size_t nSize) {
+    _pairs = nSize ? (_SmallNode *)sq_vm_malloc(sizeof(_SmallNode) * nSize) : nullptr;
+    _sharedstate->gc.Allocated(sizeof(_SmallNode) * nSize);
+    for (size_t i = 0; i < nSize; i++) {
+        new (&_pairs[i]) _SmallNode();
+    }
+    _numofnodes = nSize;
+    _npairs = 0;
+}
+
+void SQTable::FreePairs() {
+    for (size_t i = 0; i < _numofnodes; i++) {
+        _pairs[i].~_SmallNode();
+    }
+    if (_numofnodes) {
+        sq_vm_free(_pairs, _numofnodes * sizeof(_SmallNode));
+    }
+    _sharedstate->gc.Freed(_numofnodes * sizeof(_SmallNode));
+}
+
+// called when every pair is in use
+void SQTable::GrowPairs() {
+    _SmallNode * old = _pairs;
+    size_t const oldsize = _numofnodes;
+    if (oldsize < SQ_TABLE_SMALL) {
+        size_t const newsize = oldsize ? std::min<size_t>(oldsize * 2, SQ_TABLE_SMALL) : 2;
+        AllocPairs(newsize);
+        for (size_t i = 0; i < oldsize; i++) {
+            _pairs[i].key = old[i].key;
+            _pairs[i].val = old[i].val;
+        }
+        _npairs = oldsize;
+    } else {
+        _small = false;
+        AllocNodes(SQ_TABLE_SMALL * 2);
+        _usednodes = 0;
+        for (size_t i = 0; i < oldsize; i++) {
+            _NewSlot(old[i].key, old[i].val);
+        }
+    }
+    for (size_t i = 0; i < oldsize; i++) {
+        old[i].~_SmallNode();
+    }
+    if (oldsize) {
+        sq_vm_free(old, oldsize * sizeof(_SmallNode));
+    }
+    _sharedstate->gc.Freed(oldsize * sizeof(_SmallNode));
+}
+
+void SQTable::Remove(SQObjectPtr const & o) {
+    SQObject key = o;
+    if (_weakmode && !_StoredKey(o, key)) {
+        return;
+    }
+    if (_small) {
+        _SmallNode * p = _GetPair(key);
+        if (p) {
+            p->val.Null();
+            p->key.Null();
+            _usednodes--;
+            _mmstale = true;
+            while (_npairs && sq_type(_pairs[_npairs - 1].key) == OT_NULL) {
+                _npairs--;
+            }
+        }
+        return;
+    }
+    if (sq_type(key) == OT_INTEGER && SQUnsignedInteger(_integer(key)) < _arraysize) {
+        size_t const i = size_t(_integer(key));
+        if (_InArray(i)) {
+            _arraypart[i].Null();
+            _arraybits[i >> 5] &= ~(1u << (i & 31));
+            _arrayused--;
+            _usednodes--;
+            _mmstale = true;
+        }
+        return;
+    }
     _HashNode *n = _Get(key, HashObj(key) & (_numofnodes - 1));
     if (n) {
         n->val.Null();
         n->key.Null();
         _usednodes--;
+        _mmstale = true;
         Rehash(false);
     }
 }
 
 void SQTable::AllocNodes(size_t nSize) {
     _HashNode * nodes = (_HashNode *)sq_vm_malloc(sizeof(_HashNode) * nSize);
+    _sharedstate->gc.Allocated(sizeof(_HashNode) * nSize);
 
     for (size_t i = 0; i < nSize; i++) {
         _HashNode & n = nodes[i];
@@ -39,6 +143,74 @@ void SQTable::AllocNodes(size_t nSize) {
     _firstfree = &_nodes[_numofnodes - 1];
 }
 
+void SQTable::AllocArray(size_t nSize) {
+    _arraypart = nSize ? (SQObjectPtr *)sq_vm_malloc(ArrayBytes(nSize)) : nullptr;
+    _sharedstate->gc.Allocated(ArrayBytes(nSize));
+    for (size_t i = 0; i < nSize; i++) {
+        new (&_arraypart[i]) SQObjectPtr();
+    }
+    _arraybits = (uint32_t *)(_arraypart + nSize);
+    memset(_arraybits, 0, ArrayBytes(nSize) - nSize * sizeof(SQObjectPtr));
+    _arraysize = uint32_t(nSize);
+    _arrayused = 0;
+}
+
+void SQTable::FreeArray(SQObjectPtr * array, size_t nSize) {
+    for (size_t i = 0; i < nSize; i++) {
+        array[i].~SQObjectPtr();
+    }
+    if (nSize) {
+        sq_vm_free(array, ArrayBytes(nSize));
+    }
+    _sharedstate->gc.Freed(ArrayBytes(nSize));
+}
+
+// the slots an array part needs for key k
+static size_t array_bits(SQUnsignedInteger k) {
+    size_t b = 0;
+    while (k) {
+        k >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// Same rule as Lua: the largest power of two n such that more than half
+// of the keys 0..n-1 are present. ninarray receives how many those are.
+size_t SQTable::ArraySizeFor(size_t & ninarray) {
+    if (_weakmode) {
+        ninarray = 0;
+        return 0;
+    }
+    size_t nums[SQ_TABLE_ARRAYBITS + 1] = {};
+    size_t total = 0;
+    for (size_t i = 0; i < _arraysize; i++) {
+        if (_InArray(i)) {
+            nums[array_bits(i)]++;
+            total++;
+        }
+    }
+    for (size_t i = 0; i < _numofnodes; i++) {
+        _HashNode & n = _nodes[i];
+        if (sq_type(n.key) == OT_INTEGER
+            && SQUnsignedInteger(_integer(n.key)) < (SQUnsignedInteger(1) << SQ_TABLE_ARRAYBITS)) {
+            nums[array_bits(_integer(n.key))]++;
+            total++;
+        }
+    }
+    size_t best = 0;
+    size_t a = 0;
+    ninarray = 0;
+    for (size_t b = 0, twotob = 1; b <= SQ_TABLE_ARRAYBITS && twotob / 2 < total; b++, twotob <<= 1) {
+        a += nums[b];
+        if (a > twotob / 2) {
+            best = twotob;
+            ninarray = a;
+        }
+    }
+    return best;
+}
+
 void SQTable::Rehash(bool force) {
     size_t oldsize = _numofnodes;
 
@@ -48,30 +220,65 @@ void SQTable::Rehash(bool force) {
     }
 
     _HashNode * nold = _nodes;
-    size_t nelems = CountUsed();
+    size_t nelems = CountUsed() - _arrayused;
+    size_t newsize;
     if (nelems >= oldsize - oldsize / 4)  /* using more than 3/4? */
-        AllocNodes(oldsize * 2);
+        newsize = oldsize * 2;
     else if (nelems <= oldsize/4 &&  /* less than 1/4? */
         oldsize > 4)
-        AllocNodes(oldsize/2);
+        newsize = oldsize / 2;
     else if(force)
-        AllocNodes(oldsize);
+        newsize = oldsize;
     else
         return;
-    _usednodes = 0;
+
+    // dense integer keys move to the array part and the hash part is sized
+    // for the rest
+    size_t ninarray;
+    size_t const arraysize = ArraySizeFor(ninarray);
+    SQObjectPtr * aold = nullptr;
+    size_t const aoldsize = _arraysize;
+    if (arraysize != aoldsize) {
+        // _NewSlot places its key before it rehashes, so that key may be
+        // counted in ninarray but not yet in CountUsed()
+        size_t const used = CountUsed();
+        size_t const left = used > ninarray ? used - ninarray : 0;
+        newsize = 4;
+        while (left >= newsize - newsize / 4) {
+            newsize <<= 1;
+        }
+        aold = _arraypart;
+        AllocArray(arraysize);
+    }
+    AllocNodes(newsize);
+    _usednodes = _arrayused;
+    if (aold) {
+        uint32_t const * bold = (uint32_t const *)(aold + aoldsize);
+        for (size_t i = 0; i < aoldsize; i++) {
+            if ((bold[i >> 5] >> (i & 31)) & 1) {
+                _NewSlot(SQObjectPtr(SQInteger(i)), aold[i]);
+            }
+        }
+        FreeArray(aold, aoldsize);
+    }
     for (size_t i = 0; i < oldsize; i++) {
         _HashNode *old = nold+i;
         if (sq_type(old->key) != OT_NULL)
-            NewSlot(old->key,old->val);
+            _NewSlot(old->key,old->val);
     }
     for(size_t k=0;k<oldsize;k++)
         nold[k].~_HashNode();
     sq_vm_free(nold,oldsize*sizeof(_HashNode));
+    _sharedstate->gc.Freed(oldsize * sizeof(_HashNode));
 }
 
 SQTable *SQTable::Clone()
 {
-    SQTable *nt=Create(_opt_ss(this),_numofnodes);
+    SQTable *nt=Create(_opt_ss(this),_small ? _usednodes : _numofnodes);
+    nt->_weakmode = _weakmode;
+    if (!nt->_small && _arraysize) {
+        nt->AllocArray(_arraysize);
+    }
 #ifdef _FAST_CLONE
     _HashNode *basesrc = _nodes;
     _HashNode *basedst = nt->_nodes;
@@ -108,23 +315,61 @@ bool SQTable::Get(SQObjectPtr const & key, SQObjectPtr & val) {
         return false;
     }
 
-    _HashNode *n = _Get(key, HashObj(key) & (_numofnodes - 1));
-    if (n) {
-        val = _realval(n->val);
+    SQObjectPtr * slot = _Find(key);
+    if (slot) {
+        val = _realval(*slot);
         return true;
     }
 
     return false;
 }
 
-bool SQTable::NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
+// key and val as stored, see NewSlot()
+bool SQTable::_NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
 {
     assert(sq_type(key) != OT_NULL);
+    _mmstale = true;
+    if (_small) {
+        _SmallNode * p = _GetPair(key);
+        if (p) {
+            // a dead pair is gone for the script, filling it adds the key
+            bool const dead = _weakmode && _IsDead(p->key, p->val);
+            p->val = val;
+            return dead;
+        }
+        // reuse a pair emptied by Remove, then free ones
+        if (_usednodes < _npairs) {
+            for (p = _pairs; sq_type(p->key) != OT_NULL; p++) {}
+        } else if (_npairs < _numofnodes) {
+            p = &_pairs[_npairs++];
+        } else if (_weakmode && Prune()) {
+            return _NewSlot(key, val);
+        } else {
+            GrowPairs();
+            return _NewSlot(key, val);
+        }
+        p->key = key;
+        p->val = val;
+        _usednodes++;
+        return true;
+    }
+    if (sq_type(key) == OT_INTEGER && SQUnsignedInteger(_integer(key)) < _arraysize) {
+        size_t const i = size_t(_integer(key));
+        _arraypart[i] = val;
+        if (_InArray(i)) {
+            return false;
+        }
+        _arraybits[i >> 5] |= 1u << (i & 31);
+        _arrayused++;
+        _usednodes++;
+        return true;
+    }
     SQHash h = HashObj(key) & (_numofnodes - 1);
     _HashNode *n = _Get(key, h);
     if (n) {
+        bool const dead = _weakmode && _IsDead(n->key, n->val);
         n->val = val;
-        return false;
+        return dead;
     }
     _HashNode *mp = &_nodes[h];
     n = mp;
@@ -171,20 +416,41 @@ bool SQTable::NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
         else (_firstfree)--;
     }
     Rehash(true);
-    return NewSlot(key, val);
+    return _NewSlot(key, val);
 }
 
 SQInteger SQTable::Next(bool getweakrefs,const SQObjectPtr &refpos, SQObjectPtr &outkey, SQObjectPtr &outval)
 {
     SQUnsignedInteger idx = TranslateIndex(refpos);
+    if (_small) {
+        for (; idx < _npairs; idx++) {
+            _SmallNode & p = _pairs[idx];
+            if (sq_type(p.key) != OT_NULL && !(_weakmode && _IsDead(p.key, p.val))) {
+                outkey = (_weakmode & SQ_WEAK_KEYS) ? _realval(p.key) : (SQObject)p.key;
+                outval = getweakrefs ? (SQObject)p.val : _realval(p.val);
+                return ++idx;
+            }
+        }
+        return -1;
+    }
+    // the array part comes first
+    for (; idx < _arraysize; idx++) {
+        if (_InArray(idx)) {
+            SQObjectPtr & v = _arraypart[idx];
+            outkey = SQInteger(idx);
+            outval = getweakrefs ? (SQObject)v : _realval(v);
+            return ++idx;
+        }
+    }
+    idx -= _arraysize;
     while (idx < _numofnodes) {
-        if (sq_type(_nodes[idx].key) != OT_NULL) {
+        if (sq_type(_nodes[idx].key) != OT_NULL && !(_weakmode && _IsDead(_nodes[idx].key, _nodes[idx].val))) {
             //first found
             _HashNode &n = _nodes[idx];
-            outkey = n.key;
+            outkey = (_weakmode & SQ_WEAK_KEYS) ? _realval(n.key) : (SQObject)n.key;
             outval = getweakrefs?(SQObject)n.val:_realval(n.val);
             //return idx for the next iteration
-            return ++idx;
+            return _arraysize + ++idx;
         }
         ++idx;
     }
@@ -195,20 +461,57 @@ SQInteger SQTable::Next(bool getweakrefs,const SQObjectPtr &refpos, SQObjectPtr
 
 bool SQTable::Set(const SQObjectPtr &key, const SQObjectPtr &val)
 {
-    _HashNode *n = _Get(key, HashObj(key) & (_numofnodes - 1));
-    if (n) {
-        n->val = val;
-        return true;
+    SQObjectPtr * slot = _Find(key);
+    if (!slot) {
+        return false;
     }
-    return false;
+    if (_weakmode & SQ_WEAK_VALUES) {
+        *slot = _Weaken(val, SQ_WEAK_VALUES);
+    } else {
+        *slot = val;
+    }
+    _mmstale = true;
+    return true;
 }
 
 void SQTable::_ClearNodes() {
+    if (_small) {
+        for (size_t i = 0; i < _npairs; i++) {
+            _pairs[i].key.Null();
+            _pairs[i].val.Null();
+        }
+        _mmstale = true;
+        return;
+    }
     for (size_t i = 0; i < _numofnodes; i++) {
         _HashNode &n = _nodes[i];
         n.key.Null();
         n.val.Null();
     }
+    for (size_t i = 0; i < _arraysize; i++) {
+        _arraypart[i].Null();
+    }
+    if (_arraysize) {
+        memset(_arraybits, 0, ArrayBytes(_arraysize) - _arraysize * sizeof(SQObjectPtr));
+    }
+    _arrayused = 0;
+    _mmstale = true;
+}
+
+void SQTable::_BuildMetaCache(SQSharedState * ss) {
+    if (!_mmcache) {
+        _mmcache = (_MetaCache *)sq_vm_malloc(sizeof(_MetaCache));
+        ss->gc.Allocated(sizeof(_MetaCache));
+    }
+    _mmcache->mask = 0;
+    for (uint32_t mm = 0; mm < MT_LAST; mm++) {
+        SQObjectPtr * slot = _Find(ss->_metamethods[mm]);
+        if (slot) {
+            _mmcache->mask |= 1u << mm;
+            _mmcache->methods[mm] = *slot;
+        }
+    }
+    _mmstale = false;
 }
 
 void SQTable::Finalize()
@@ -221,5 +524,114 @@ void SQTable::Clear()
 {
     _ClearNodes();
     _usednodes = 0;
+    if (_small) {
+        _npairs = 0;
+        return;
+    }
     Rehash(true);
 }
+
+// the slot of key in a weak table, nullptr when absent or dead
+SQObjectPtr * SQTable::_FindWeak(SQObject const & key) {
+    SQObject k = key;
+    if (!_StoredKey(key, k)) {
+        return nullptr;
+    }
+    if (_small) {
+        _SmallNode * p = _GetPair(k);
+        return p && !_IsDead(p->key, p->val) ? &p->val : nullptr;
+    }
+    _HashNode * n = _Get(k, HashObj(k) & (_numofnodes - 1));
+    return n && !_IsDead(n->key, n->val) ? &n->val : nullptr;
+}
+
+// With weak keys an object is stored as its weak reference, an object
+// that has none cannot be a key
+bool SQTable::_StoredKey(SQObject const & key, SQObject & stored) {
+    stored = key;
+    if (!(_weakmode & SQ_WEAK_KEYS) || !weakable(key, SQ_WEAK_KEYS)) {
+        return true;
+    }
+    SQWeakRef * w = key._unVal.pRefCounted->_weakref;
+    if (!w) {
+        return false;
+    }
+    stored._type = OT_WEAKREF;
+    stored._unVal.pWeakRef = w;
+    return true;
+}
+
+bool SQTable::_IsDead(SQObject const & key, SQObject const & val) const {
+    return ((_weakmode & SQ_WEAK_KEYS) && released(key))
+        || ((_weakmode & SQ_WEAK_VALUES) && released(val));
+}
+
+SQObjectPtr SQTable::_Weaken(SQObjectPtr const & o, uint8_t mode) const {
+    if ((_weakmode & mode) && weakable(o, mode)) {
+        return SQObjectPtr(o._unVal.pRefCounted->GetWeakRef(sq_type(o)));
+    }
+    return o;
+}
+
+size_t SQTable::Prune() {
+    size_t n = 0;
+    if (_small) {
+        for (size_t i = 0; i < _npairs; i++) {
+            _SmallNode & p = _pairs[i];
+            if (sq_type(p.key) != OT_NULL && _IsDead(p.key, p.val)) {
+                p.key.Null();
+                p.val.Null();
+                n++;
+            }
+        }
+        while (_npairs && sq_type(_pairs[_npairs - 1].key) == OT_NULL) {
+            _npairs--;
+        }
+    } else {
+        for (size_t i = 0; i < _numofnodes; i++) {
+            _HashNode & node = _nodes[i];
+            if (sq_type(node.key) != OT_NULL && _IsDead(node.key, node.val)) {
+                node.key.Null();
+                node.val.Null();
+                n++;
+            }
+        }
+    }
+    if (n) {
+        _usednodes -= n;
+        _mmstale = true;
+    }
+    return n;
+}
+
+size_t SQTable::CountLive() {
+    if (!_weakmode) {
+        return _usednodes;
+    }
+    size_t n = 0;
+    SQObjectPtr key, val;
+    SQInteger idx = 0;
+    while ((idx = Next(true, idx, key, val)) != -1) {
+        n++;
+    }
+    return n;
+}
+
+void SQTable::SetWeakMode(uint8_t mode) {
+    if (mode == _weakmode) {
+        return;
+    }
+    sqvector<SQObjectPtr> slots;
+    slots.reserve(CountUsed() * 2);
+    SQObjectPtr key, val;
+    SQInteger idx = 0;
+    while ((idx = Next(true, idx, key, val)) != -1) {
+        slots.push_back(key);
+        slots.push_back((_weakmode & SQ_WEAK_VALUES) ? _realval(val) : (SQObject)val);
+    }
+    _weakmode = mode;
+    Clear();
+    for (size_t i = 0; i < slots.size(); i += 2) {
+        NewSlot(slots[i], slots[i + 1]);
+    }
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 
 #include "sqmem.h"
 
@@ -8,16 +10,21 @@ template<typename T>
 class sqvector {
     size_t len;
     size_t cap;
+    // _vals is storage owned by someone else, see borrow()
+    bool borrowed;
 public:
     T* _vals;
 
     sqvector()
         : len(0)
         , cap(0)
+        , borrowed(false)
         , _vals(nullptr)
     {}
 
-    sqvector(sqvector<T> const & v) {
+    sqvector(sqvector<T> const & v)
+        : sqvector()
+    {
         copy(v);
     }
 
@@ -38,15 +45,23 @@ public:
     }
 
     ~sqvector() {
-        if(cap) {
-            for(size_t i = 0; i < len; i++) {
-                _vals[i].~T();
-            }
-
+        for(size_t i = 0; i < len; i++) {
+            _vals[i].~T();
+        }
+        if(cap && !borrowed) {
             sq_vm_free(_vals, cap * sizeof(T));
         }
     }
 
+    // Starts an empty vector on caller-owned storage, such as space inline
+    // in the owning object. It moves to the heap once it outgrows it.
+    void borrow(T * storage, size_t capacity) {
+        assert(!cap);
+        _vals = storage;
+        cap = capacity;
+        borrowed = true;
+    }
+
     void reserve(size_t newsize) {
         _realloc(newsize);
     }
@@ -69,8 +84,24 @@ public:
         }
     }
 
+    // exchanges storage with another vector, no element is copied
+    void swap(sqvector<T> & v) {
+        size_t const l = len;
+        size_t const c = cap;
+        bool const b = borrowed;
+        T * const vals = _vals;
+        len = v.len;
+        cap = v.cap;
+        borrowed = v.borrowed;
+        _vals = v._vals;
+        v.len = l;
+        v.cap = c;
+        v.borrowed = b;
+        v._vals = vals;
+    }
+
     void shrinktofit() {
-        if (len > 4) {
+        if (len > 4 && !borrowed) {
             _realloc(len);
         }
     }
@@ -123,6 +154,10 @@ public:
         return cap;
     }
 
+    bool isborrowed() const {
+        return borrowed;
+    }
+
     inline T & back() const {
         return _vals[len - 1];
     }
@@ -135,7 +170,14 @@ private:
         newsize = (newsize > 0)
             ? newsize
             : 4;
-        _vals = (T*)sq_vm_realloc(_vals, cap * sizeof(T), newsize * sizeof(T));
+        if (borrowed) {
+            T * vals = (T*)sq_vm_malloc(newsize * sizeof(T));
+            memcpy((void*)vals, _vals, (len < newsize ? len : newsize) * sizeof(T));
+            _vals = vals;
+            borrowed = false;
+        } else {
+            _vals = (T*)sq_vm_realloc(_vals, cap * sizeof(T), newsize * sizeof(T));
+        }
         cap = newsize;
     }
 };
@@ -210,18 +210,22 @@ SQVM::SQVM(SQSharedState * ss, SQVM * friend_vm, size_t stack_size)
 
     , is_suspended(false)
 
+    , _budget(SQ_BUDGET_OFF)
+    , _budgeted(false)
+
     , n_native_calls(0)
 
     , temp_reg()
 {
+    ss->gc.Allocated(sizeof(SQVM));
     // TODO: no stack size checks?
     // initial stack must fit base lib at the very least
-    _stack.resize(stack_size);
+    ss->_threadstacks.Acquire(_stack, stack_size);
     call_stack.resize(4);
+    ss->gc.Allocated(StackBytes());
 
     _suspended_target = -1;
     _suspended_root = false;
-    _suspended_traps = -1;
 
     _lasterror.Null();
     _errorhandler.Null();
@@ -248,6 +252,8 @@ SQVM::SQVM(SQSharedState * ss, SQVM * friend_vm, size_t stack_size)
 
 SQVM::~SQVM() {
     Finalize();
+    _sharedstate->gc.Freed(StackBytes());
+    _sharedstate->_threadstacks.Recycle(_stack);
 }
 
 void SQVM::Finalize() {
@@ -275,8 +281,19 @@ void SQVM::Finalize() {
     }
 }
 
+void SQVM::StackResized(size_t before) {
+    size_t const after = StackBytes();
+    if (after > before) {
+        _sharedstate->gc.Allocated(after - before);
+    } else if (after < before) {
+        _sharedstate->gc.Freed(before - after);
+    }
+}
+
 void SQVM::GrowCallStack() {
+    size_t const before = StackBytes();
     call_stack.resize(call_stack.size() * 2);
+    StackResized(before);
 }
 
 bool SQVM::ArithMetaMethod(uint8_t op,const SQObjectPtr &o1,const SQObjectPtr &o2,SQObjectPtr &dest) {
@@ -445,23 +462,54 @@ bool SQVM::ObjCmp(const SQObjectPtr &o1, const SQObjectPtr &o2, SQInteger &resul
     }
 }
 
-bool SQVM::CMP_OP(CmpOP op, SQObjectPtr const & o1, SQObjectPtr const & o2, SQObjectPtr & res) {
-    SQInteger r;
-    if (!ObjCmp(o1, o2, r)) {
-        return false;
+// Same ordering as ObjCmp for two integers or two floats, without the type dispatch
+static inline SQInteger IntCmp(SQObjectPtr const & o1, SQObjectPtr const & o2) {
+    if (_integer(o1) == _integer(o2)) {
+        return 0;
     }
+    return _integer(o1) < _integer(o2) ? -1 : 1;
+}
+
+static inline SQInteger FloatCmp(SQObjectPtr const & o1, SQObjectPtr const & o2) {
+    if (_rawval(o1) == _rawval(o2)) {
+        return 0;
+    }
+    return _float(o1) < _float(o2) ? -1 : 1;
+}
 
+static inline void CmpResult(CmpOP op, SQInteger r, SQObjectPtr & res) {
     switch(op) {
-    case CMP_G: res = (r > 0); return true;
-    case CMP_GE: res = (r >= 0); return true;
-    case CMP_L: res = (r < 0); return true;
-    case CMP_LE: res = (r <= 0); return true;
-    case CMP_3W: res = r; return true;
+    case CMP_G: res = (r > 0); return;
+    case CMP_GE: res = (r >= 0); return;
+    case CMP_L: res = (r < 0); return;
+    case CMP_LE: res = (r <= 0); return;
+    case CMP_3W: res = r; return;
     default:
         assert(0); // todo?
     }
 }
 
+// Branch condition of _OP_JCMP, equivalent to !IsFalse() on the CmpResult
+static inline bool CmpTest(CmpOP op, SQInteger r) {
+    switch(op) {
+    case CMP_G: return r > 0;
+    case CMP_GE: return r >= 0;
+    case CMP_L: return r < 0;
+    case CMP_LE: return r <= 0;
+    default: return r != 0;
+    }
+}
+
+bool SQVM::CMP_OP(CmpOP op, SQObjectPtr const & o1, SQObjectPtr const & o2, SQObjectPtr & res) {
+    SQInteger r;
+    if (!ObjCmp(o1, o2, r)) {
+        return false;
+    }
+
+    CmpResult(op, r, res);
+    return true;
+}
+
 bool SQVM::ToString(const SQObjectPtr &o,SQObjectPtr &res)
 {
     switch(sq_type(o)) {
@@ -528,17 +576,10 @@ bool SQVM::TypeOf(SQObjectPtr const & obj1, SQObjectPtr & dest) {
     return true;
 }
 
-bool SQVM::StartCall(
-    SQClosure * closure,
-    SQInteger target,
-    SQInteger nargs,
-    SQInteger stackbase,
-    bool tailcall
-) {
+bool SQVM::AdjustParams(SQClosure * closure, SQInteger nargs, SQInteger stackbase) {
     SQFunctionProto * func = closure->_function;
 
     size_t paramssize = func->_nparameters;
-    size_t newtop = stackbase + func->_stacksize;
     if (func->_varparams) {
         paramssize--;
         if (size_t(nargs) < paramssize) {
@@ -572,6 +613,25 @@ bool SQVM::StartCall(
             return false;
         }
     }
+    return true;
+}
+
+bool SQVM::StartCall(
+    SQClosure * closure,
+    SQInteger target,
+    SQInteger nargs,
+    SQInteger stackbase,
+    bool tailcall
+) {
+    SQFunctionProto * func = closure->_function;
+
+    size_t newtop = stackbase + func->_stacksize;
+    // Fixed arity calls go straight to the frame setup
+    if (func->_varparams || SQInteger(func->_nparameters) != nargs) {
+        if (!AdjustParams(closure, nargs, stackbase)) {
+            return false;
+        }
+    }
 
     if (closure->_env) {
         _stack._vals[stackbase] = closure->_env->_obj;
@@ -626,7 +686,14 @@ bool SQVM::Return(SQInteger _arg0, SQInteger _arg1, SQObjectPtr & retval) {
     }
     if (dest) {
         if(_arg0 != 0xFF) {
-            *dest = _stack._vals[_stackbase+_arg1];
+            // The frame is about to be cleared, so hand the value over
+            // instead of copying it; open outers still need to see it
+            SQObjectPtr &src = _stack._vals[_stackbase+_arg1];
+            if (_openouters) {
+                *dest = src;
+            } else {
+                _Swap(*dest, src);
+            }
         }
         else {
             dest->Null();
@@ -702,6 +769,23 @@ SQRESULT SQVM::Suspend() {
     return SQ_SUSPEND_FLAG;
 }
 
+// Called at a safepoint once the budget is spent. Only the outermost script
+// frames can be suspended; under a native call or a metamethod the budget
+// stays spent and the next safepoint tries again.
+bool SQVM::Preempt() {
+    if (!_budgeted) {
+        _budget = SQ_BUDGET_OFF;
+        return false;
+    }
+    if (is_suspended || n_native_calls != 1) {
+        return false;
+    }
+    is_suspended = true;
+    _suspended_target = -1;
+    _suspended_root = ci->_root ? true : false;
+    return true;
+}
+
 bool SQVM::FOREACH_OP(
     SQObjectPtr &o1,
     SQObjectPtr &o2,
@@ -817,6 +901,60 @@ bool SQVM::FOREACH_OP(
 
 #define _GUARD(exp) { if(!exp) { SQ_THROW();} }
 
+// Automatic collection only runs from the outermost script frames, where
+// every live value is on a VM stack
+#ifndef NO_GARBAGE_COLLECTOR
+#define _GCPOINT() { \
+    if (_sharedstate->gc.due && n_native_calls == 1) { \
+        _sharedstate->CollectIfDue(0); \
+    } \
+}
+#else
+#define _GCPOINT() {}
+#endif
+
+// A hook installed while the plain loop runs moves the rest of this
+// Execute to the hooked loop at the next safepoint or native call
+#define _HOOKPOINT() { \
+    if (!hooked && _debughook) { \
+        return Run<true>(outres, raiseerror, false); \
+    } \
+}
+
+#define _SAFEPOINT() { \
+    _GCPOINT(); \
+    if (--_budget <= 0 && Preempt()) { \
+        outres.Null(); \
+        return true; \
+    } \
+    _HOOKPOINT(); \
+}
+
+// Quickening: generic arithmetic and compare instructions rewrite themselves
+// into a type-specialized variant after seeing int-int or float-float
+// operands. The variant guards on the operand types and rewrites itself back
+// to the generic opcode on mismatch, bumping a deopt counter in arg3 so that
+// polymorphic sites eventually stay generic. Code shared with other shared
+// states (SQSharedCode) is read-only: it runs whatever variant it was frozen
+// with and falls back to the generic path without rewriting anything.
+#define _CODE_WRITABLE() (!_closure(ci->_closure)->_function->_sharedcode)
+
+#define _QUICKEN(o1, o2, cnt, iop, fop) \
+    if ((cnt) < QUICKEN_MAX_DEOPTS && _CODE_WRITABLE()) { \
+        switch (sq_type(o1) | sq_type(o2)) { \
+        case OT_INTEGER: ci->_ip[-1].op = (iop); break; \
+        case OT_FLOAT: ci->_ip[-1].op = (fop); break; \
+        default: break; \
+        } \
+    }
+
+#define _ARITH_QUICKEN(iop, fop) _QUICKEN(STK(arg2), STK(arg1), arg3, iop, fop)
+#define _ARITH_DEOPT(generic) if (_CODE_WRITABLE()) { ci->_ip[-1].op = (generic); ci->_ip[-1]._arg3++; }
+
+#define _CMP_QUICKEN(o1, o2, iop, fop) _QUICKEN(o1, o2, arg3 >> CMP_DEOPT_SHIFT, iop, fop)
+#define _CMP_DEOPT(generic) if (_CODE_WRITABLE()) { ci->_ip[-1].op = (generic); ci->_ip[-1]._arg3 += (1 << CMP_DEOPT_SHIFT); }
+#define _CMPOP CmpOP(arg3 & CMP_OP_MASK)
+
 bool SQVM::CLOSURE_OP(SQObjectPtr &target, SQFunctionProto *func,SQInteger boundtarget)
 {
     SQInteger nouters;
@@ -831,6 +969,9 @@ bool SQVM::CLOSURE_OP(SQObjectPtr &target, SQFunctionProto *func,SQInteger bound
             case otOUTER:
                 closure->_outervalues[i] = _closure(ci->_closure)->_outervalues[_integer(v._src)];
                 break;
+            case otVALUE:
+                closure->_outervalues[i] = STK(_integer(v._src));
+                break;
             }
         }
     }
@@ -937,7 +1078,6 @@ bool SQVM::Execute(
     n_native_calls++;
     AutoDec ad(&n_native_calls);
 
-    SQInteger traps = 0;
     CallInfo *prevci = ci;
 
     switch(et) {
@@ -962,26 +1102,35 @@ bool SQVM::Execute(
             return false;
         }
         ci->_root = SQTrue;
-        traps += ci->_etraps;
         break;
     case ET_RESUME_VM:
     case ET_RESUME_THROW_VM:
-        traps = _suspended_traps;
         ci->_root = _suspended_root ? SQTrue : SQFalse;
         is_suspended = false;
-        if(et  == ET_RESUME_THROW_VM) { SQ_THROW(); }
         break;
     }
 
+    bool throwing = et == ET_RESUME_THROW_VM;
+    return _debughook ? Run<true>(outres, raiseerror, throwing)
+                      : Run<false>(outres, raiseerror, throwing);
+}
+
+// The dispatch loop; only the hooked instance pays for the line hook
+template<bool hooked>
+bool SQVM::Run(SQObjectPtr &outres, SQBool raiseerror, bool throwing)
+{
+    if (throwing) { SQ_THROW(); }
+
 exception_restore:
     for(;;) {
+        if (hooked && _debughook) {
+            SQInteger line;
+            if (_closure(ci->_closure)->_function->LineStart(ci->_ip, line)) {
+                CallDebugHook(_SC('l'), line);
+            }
+        }
         const SQInstruction &_i_ = *ci->_ip++;
         switch (_i_.op) {
-        case _OP_LINE:
-            if (_debughook) {
-                CallDebugHook(_SC('l'), arg1);
-            }
-            continue;
         case _OP_LOAD:
             TARGET = ci->_literals[arg1];
             continue;
@@ -1008,15 +1157,19 @@ exception_restore:
                 if (last_top >= stack_top) {
                     stack_top = last_top;
                 }
+                _SAFEPOINT();
                 continue;
             }
                           }
         case _OP_CALL: {
+                // The slot keeps the closure alive until the frame owns it
+                if (sq_type(STK(arg1)) == OT_CLOSURE) {
+                    _GUARD(StartCall(_closure(STK(arg1)), sarg0, arg3, _stackbase+arg2, false));
+                    _SAFEPOINT();
+                    continue;
+                }
                 SQObjectPtr clo = STK(arg1);
                 switch (sq_type(clo)) {
-                case OT_CLOSURE:
-                    _GUARD(StartCall(_closure(clo), sarg0, arg3, _stackbase+arg2, false));
-                    continue;
                 case OT_NATIVECLOSURE: {
                     bool suspend;
                     bool tailcall;
@@ -1025,13 +1178,13 @@ exception_restore:
                         is_suspended = true;
                         _suspended_target = sarg0;
                         _suspended_root = ci->_root ? true : false;
-                        _suspended_traps = traps;
                         outres = clo;
                         return true;
                     }
                     if(sarg0 != -1 && !tailcall) {
                         STK(arg0) = clo;
                     }
+                    _HOOKPOINT();
                                        }
                     continue;
                 case OT_CLASS:{
@@ -1124,20 +1277,182 @@ exception_restore:
             TARGET = (!res)?true:false;
             } continue;
         case _OP_ADD:
+            _ARITH_QUICKEN(_OP_ADDI, _OP_ADDF);
             _GUARD(_ARITH_('+', TARGET, STK(arg2), STK(arg1)));
             continue;
         case _OP_SUB:
+            _ARITH_QUICKEN(_OP_SUBI, _OP_SUBF);
             _GUARD(_ARITH_('-', TARGET, STK(arg2), STK(arg1)));
             continue;
         case _OP_MUL:
+            _ARITH_QUICKEN(_OP_MULI, _OP_MULF);
             _GUARD(_ARITH_('*', TARGET, STK(arg2), STK(arg1)));
             continue;
         case _OP_DIV:
+            _ARITH_QUICKEN(_OP_DIVI, _OP_DIVF);
             _GUARD(_ARITH_('/', TARGET, STK(arg2), STK(arg1)));
             continue;
         case _OP_MOD:
+            _ARITH_QUICKEN(_OP_MODI, _OP_MODF);
             ARITH_OP('%',TARGET,STK(arg2),STK(arg1));
             continue;
+        case _OP_ADDI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o1)) + SQUnsignedInteger(_integer(o2)));
+                continue;
+            }
+            _ARITH_DEOPT(_OP_ADD);
+            _GUARD(_ARITH_('+', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_SUBI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o1)) - SQUnsignedInteger(_integer(o2)));
+                continue;
+            }
+            _ARITH_DEOPT(_OP_SUB);
+            _GUARD(_ARITH_('-', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_MULI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o1)) * SQUnsignedInteger(_integer(o2)));
+                continue;
+            }
+            _ARITH_DEOPT(_OP_MUL);
+            _GUARD(_ARITH_('*', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_DIVI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER && _integer(o2) != 0) {
+                TARGET = _integer(o1) / _integer(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_DIV);
+            _GUARD(_ARITH_('/', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_MODI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER && _integer(o2) != 0) {
+                TARGET = _integer(o2) == -1 ? 0 : _integer(o1) % _integer(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_MOD);
+            ARITH_OP('%', TARGET, o1, o2);
+            continue;
+        }
+        case _OP_ADDF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                TARGET = _float(o1) + _float(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_ADD);
+            _GUARD(_ARITH_('+', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_SUBF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                TARGET = _float(o1) - _float(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_SUB);
+            _GUARD(_ARITH_('-', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_MULF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                TARGET = _float(o1) * _float(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_MUL);
+            _GUARD(_ARITH_('*', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_DIVF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                TARGET = _float(o1) / _float(o2);
+                continue;
+            }
+            _ARITH_DEOPT(_OP_DIV);
+            _GUARD(_ARITH_('/', TARGET, o1, o2));
+            continue;
+        }
+        case _OP_MODF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                TARGET = SQFloat(fmod(double(_float(o1)), double(_float(o2))));
+                continue;
+            }
+            _ARITH_DEOPT(_OP_MOD);
+            ARITH_OP('%', TARGET, o1, o2);
+            continue;
+        }
+        case _OP_ADDK: {
+            SQObjectPtr & o = STK(arg2);
+            if (sq_type(o) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o)) + SQUnsignedInteger(SQInteger(sarg1)));
+            } else if (sq_type(o) == OT_FLOAT) {
+                TARGET = _float(o) + SQFloat(sarg1);
+            } else {
+                _GUARD(ARITH_OP('+', TARGET, o, SQObjectPtr(SQInteger(sarg1))));
+            }
+            continue;
+        }
+        case _OP_SUBK: {
+            SQObjectPtr & o = STK(arg2);
+            if (sq_type(o) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o)) - SQUnsignedInteger(SQInteger(sarg1)));
+            } else if (sq_type(o) == OT_FLOAT) {
+                TARGET = _float(o) - SQFloat(sarg1);
+            } else {
+                _GUARD(ARITH_OP('-', TARGET, o, SQObjectPtr(SQInteger(sarg1))));
+            }
+            continue;
+        }
+        case _OP_MULK: {
+            SQObjectPtr & o = STK(arg2);
+            if (sq_type(o) == OT_INTEGER) {
+                TARGET = SQInteger(SQUnsignedInteger(_integer(o)) * SQUnsignedInteger(SQInteger(sarg1)));
+            } else if (sq_type(o) == OT_FLOAT) {
+                TARGET = _float(o) * SQFloat(sarg1);
+            } else {
+                _GUARD(ARITH_OP('*', TARGET, o, SQObjectPtr(SQInteger(sarg1))));
+            }
+            continue;
+        }
+        case _OP_DIVK: {
+            // never 0 or -1
+            SQObjectPtr & o = STK(arg2);
+            if (sq_type(o) == OT_INTEGER) {
+                TARGET = _integer(o) / SQInteger(sarg1);
+            } else if (sq_type(o) == OT_FLOAT) {
+                TARGET = _float(o) / SQFloat(sarg1);
+            } else {
+                _GUARD(ARITH_OP('/', TARGET, o, SQObjectPtr(SQInteger(sarg1))));
+            }
+            continue;
+        }
+        case _OP_MODK: {
+            // never 0 or -1
+            SQObjectPtr & o = STK(arg2);
+            if (sq_type(o) == OT_INTEGER) {
+                TARGET = _integer(o) % SQInteger(sarg1);
+            } else if (sq_type(o) == OT_FLOAT) {
+                TARGET = SQFloat(fmod(double(_float(o)), double(SQFloat(sarg1))));
+            } else {
+                _GUARD(ARITH_OP('%', TARGET, o, SQObjectPtr(SQInteger(sarg1))));
+            }
+            continue;
+        }
         case _OP_BITW:
             _GUARD(BW_OP(arg3, TARGET, STK(arg2), STK(arg1)));
             continue;
@@ -1146,7 +1461,6 @@ exception_restore:
                 (ci)->_generator->Kill();
             }
             if (Return(arg0, arg1, temp_reg)) {
-                assert(traps == 0);
                 _Swap(outres,temp_reg);
                 return true;
             }
@@ -1163,17 +1477,72 @@ exception_restore:
             continue;
         case _OP_LOADBOOL: TARGET = arg1?true:false; continue;
         case _OP_DMOVE: STK(arg0) = STK(arg1); STK(arg2) = STK(arg3); continue;
-        case _OP_JMP: ci->_ip += (sarg1); continue;
+        case _OP_JMP:
+            ci->_ip += (sarg1);
+            if (sarg1 < 0) {
+                _SAFEPOINT();
+            }
+            continue;
         //case _OP_JNZ: if(!IsFalse(STK(arg0))) ci->_ip+=(sarg1); continue;
         case _OP_JCMP:
-            _GUARD(CMP_OP((CmpOP)arg3,STK(arg2),STK(arg0),temp_reg));
+            _CMP_QUICKEN(STK(arg2), STK(arg0), _OP_JCMPI, _OP_JCMPF);
+            _GUARD(CMP_OP(_CMPOP,STK(arg2),STK(arg0),temp_reg));
+            if(IsFalse(temp_reg)) ci->_ip+=(sarg1);
+            continue;
+        case _OP_JCMPI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg0);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER) {
+                if (!CmpTest(_CMPOP, IntCmp(o1, o2))) ci->_ip += (sarg1);
+                continue;
+            }
+            _CMP_DEOPT(_OP_JCMP);
+            _GUARD(CMP_OP(_CMPOP, o1, o2, temp_reg));
+            if(IsFalse(temp_reg)) ci->_ip+=(sarg1);
+            continue;
+        }
+        case _OP_JCMPF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg0);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                if (!CmpTest(_CMPOP, FloatCmp(o1, o2))) ci->_ip += (sarg1);
+                continue;
+            }
+            _CMP_DEOPT(_OP_JCMP);
+            _GUARD(CMP_OP(_CMPOP, o1, o2, temp_reg));
             if(IsFalse(temp_reg)) ci->_ip+=(sarg1);
             continue;
+        }
         case _OP_JZ: if(IsFalse(STK(arg0))) ci->_ip+=(sarg1); continue;
+        case _OP_FORLOOP: {
+            SQObjectPtr &i = STK(arg0), &lim = STK(arg2);
+            SQInteger const step = (arg3 & FORLOOP_DOWN) ? -1 : 1;
+            if ((sq_type(i) | sq_type(lim)) == OT_INTEGER) {
+                i._unVal.nInteger = _integer(i) + step;
+                if (CmpTest(_CMPOP, IntCmp(i, lim))) {
+                    ci->_ip += (sarg1);
+                    _SAFEPOINT();
+                }
+                continue;
+            }
+            // same as the _OP_INCL and _OP_JCMP it stands for
+            if (sq_type(i) == OT_INTEGER) {
+                i._unVal.nInteger = _integer(i) + step;
+            } else if (sq_type(i) == OT_FLOAT) {
+                i._unVal.fFloat = _float(i) + SQFloat(step);
+            } else {
+                SQObjectPtr o(step);
+                _GUARD(_ARITH_('+', i, i, o));
+            }
+            _GUARD(CMP_OP(_CMPOP, STK(arg0), STK(arg2), temp_reg));
+            if (!IsFalse(temp_reg)) {
+                ci->_ip += (sarg1);
+                _SAFEPOINT();
+            }
+            continue;
+        }
         case _OP_GETOUTER: {
             SQClosure *cur_cls = _closure(ci->_closure);
-            SQOuter *otr = _outer(cur_cls->_outervalues[arg1]);
-            TARGET = *(otr->_valptr);
+            SQObjectPtr &ov = cur_cls->_outervalues[arg1];
+            TARGET = (sq_type(ov) == OT_OUTER) ? *(_outer(ov)->_valptr) : ov;
             }
         continue;
         case _OP_SETOUTER: {
@@ -1191,8 +1560,7 @@ exception_restore:
                 TARGET = SQTable::Create(_ss(this), arg1);
                 continue;
             case NOT_ARRAY:
-                TARGET = SQArray::Create(_ss(this), 0);
-                _array(TARGET)->Reserve(arg1);
+                TARGET = SQArray::Create(_ss(this), 0, arg1);
                 continue;
             case NOT_CLASS:
                 _GUARD(CLASS_OP(TARGET, arg1, arg2));
@@ -1246,6 +1614,9 @@ exception_restore:
             if(sq_type(a) == OT_INTEGER) {
                 a._unVal.nInteger = _integer(a) + sarg3;
             }
+            else if(sq_type(a) == OT_FLOAT) {
+                a._unVal.fFloat = _float(a) + SQFloat(sarg3);
+            }
             else {
                 SQObjectPtr o(sarg3); //_GUARD(LOCAL_INC('+',TARGET, STK(arg1), o));
                 _GUARD(_ARITH_('+', a, a, o));
@@ -1258,12 +1629,39 @@ exception_restore:
                 TARGET = a;
                 a._unVal.nInteger = _integer(a) + sarg3;
             }
+            else if(sq_type(a) == OT_FLOAT) {
+                TARGET = a;
+                a._unVal.fFloat = _float(a) + SQFloat(sarg3);
+            }
             else {
                 SQObjectPtr o(sarg3); _GUARD(PLOCAL_INC('+',TARGET, STK(arg1), o));
             }
 
                     } continue;
-        case _OP_CMP:   _GUARD(CMP_OP((CmpOP)arg3,STK(arg2),STK(arg1),TARGET))  continue;
+        case _OP_CMP:
+            _CMP_QUICKEN(STK(arg2), STK(arg1), _OP_CMPI, _OP_CMPF);
+            _GUARD(CMP_OP(_CMPOP,STK(arg2),STK(arg1),TARGET))
+            continue;
+        case _OP_CMPI: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_INTEGER) {
+                CmpResult(_CMPOP, IntCmp(o1, o2), TARGET);
+                continue;
+            }
+            _CMP_DEOPT(_OP_CMP);
+            _GUARD(CMP_OP(_CMPOP, o1, o2, TARGET));
+            continue;
+        }
+        case _OP_CMPF: {
+            SQObjectPtr & o1 = STK(arg2), & o2 = STK(arg1);
+            if ((sq_type(o1) | sq_type(o2)) == OT_FLOAT) {
+                CmpResult(_CMPOP, FloatCmp(o1, o2), TARGET);
+                continue;
+            }
+            _CMP_DEOPT(_OP_CMP);
+            _GUARD(CMP_OP(_CMPOP, o1, o2, TARGET));
+            continue;
+        }
         case _OP_EXISTS: TARGET = Get(STK(arg1), STK(arg2), temp_reg, GET_FLAG_DO_NOT_RAISE_ERROR | GET_FLAG_RAW, DONT_FALL_BACK) ? true : false; continue;
         case _OP_INSTANCEOF:
             if(sq_type(STK(arg1)) != OT_CLASS)
@@ -1309,7 +1707,6 @@ exception_restore:
                 }
                 // TODO: fix -1, see yield codegen in the compiler
                 _GUARD(ci->_generator->Yield(this, uint8_t(arg2 - 1)));
-                traps -= ci->_etraps;
                 if (sarg1 <= MAX_FUNC_STACKSIZE) {
                     _Swap(STK(arg1), temp_reg);
                 }
@@ -1319,7 +1716,6 @@ exception_restore:
             }
 
             if (Return(arg0, arg1, temp_reg)) {
-                assert(traps == 0);
                 outres = temp_reg;
                 return true;
             }
@@ -1332,9 +1728,32 @@ exception_restore:
                 SQ_THROW();
             }
             _GUARD(_generator(STK(arg1))->Resume(this, TARGET));
-            traps += ci->_etraps;
             continue;
+        case _OP_FOREACHA: {
+            SQObjectPtr &o = STK(arg0);
+            if (sq_type(o) == OT_ARRAY) {
+                // the iterator slot holds the next index, null on entry
+                SQObjectPtr &itr = STK(arg2 + 2);
+                SQUnsignedInteger idx = sq_type(itr) == OT_INTEGER ? _integer(itr) : 0;
+                if (!_array(o)->Get(SQInteger(idx), STK(arg2 + 1))) {
+                    ci->_ip += sarg1;
+                    continue;
+                }
+                STK(arg2) = SQInteger(idx);
+                itr = SQInteger(idx + 1);
+                ci->_ip += 1;
+                continue;
+            }
+            if (_CODE_WRITABLE()) {
+                ci->_ip[-1].op = _OP_FOREACH;
+                ci->_ip[-1]._arg3++;
+            }
+        }
+        // fallthrough
         case _OP_FOREACH: {
+            if (sq_type(STK(arg0)) == OT_ARRAY && arg3 < QUICKEN_MAX_DEOPTS && _CODE_WRITABLE()) {
+                ci->_ip[-1].op = _OP_FOREACHA;
+            }
             int tojump;
             _GUARD(FOREACH_OP(STK(arg0), STK(arg2), STK(arg2 + 1), STK(arg2 + 2), arg2, sarg1, tojump));
             ci->_ip += tojump;
@@ -1351,19 +1770,6 @@ exception_restore:
         case _OP_TYPEOF:
             _GUARD(TypeOf(STK(arg1), TARGET));
             continue;
-        case _OP_PUSHTRAP:{
-            SQInstruction *_iv = _closure(ci->_closure)->_function->_instructions;
-            _etraps.push_back(SQExceptionTrap(stack_top,_stackbase, &_iv[(ci->_ip-_iv)+arg1], arg0)); traps++;
-            ci->_etraps++;
-            continue;
-        }
-        case _OP_POPTRAP: {
-            for(SQInteger i = 0; i < arg0; i++) {
-                _etraps.pop_back(); traps--;
-                ci->_etraps--;
-            }
-                          }
-            continue;
         case _OP_THROW: Raise_Error(TARGET); SQ_THROW(); continue;
         case _OP_NEWSLOTA:
             _GUARD(NewSlotA(STK(arg1),STK(arg2),STK(arg3),(arg0&NEW_SLOT_ATTRIBUTES_FLAG) ? STK(arg2-1) : SQObjectPtr(),(arg0&NEW_SLOT_STATIC_FLAG)?true:false,false));
@@ -1392,18 +1798,17 @@ exception_trap:
         SQObjectPtr currerror = _lasterror;
         SQInteger last_top = stack_top;
 
-        if(_ss(this)->_notifyallexceptions || (!traps && raiseerror)) {
+        if(_ss(this)->_notifyallexceptions || (raiseerror && !IsTrapped())) {
             CallErrorHandler(currerror);
         }
 
         while( ci ) {
-            if(ci->_etraps > 0) {
-                SQExceptionTrap &et = _etraps.top();
-                ci->_ip = et._ip;
-                stack_top = et._stacksize;
-                _stackbase = et._stackbase;
-                _stack._vals[_stackbase + et._extarget] = currerror;
-                _etraps.pop_back(); traps--; ci->_etraps--;
+            SQFunctionProto *func = sq_type(ci->_closure) == OT_CLOSURE ? _closure(ci->_closure)->_function : NULL;
+            const SQTrapInfo *trap = func ? func->FindTrap(ci->_ip - 1) : NULL;
+            if(trap) {
+                ci->_ip = &func->_instructions[trap->_handler];
+                stack_top = _stackbase + func->_stacksize;
+                _stack._vals[_stackbase + trap->_extarget] = currerror;
                 while(last_top >= stack_top) _stack._vals[last_top--].Null();
                 goto exception_restore;
             }
@@ -1428,6 +1833,19 @@ exception_trap:
     return false;
 }
 
+bool SQVM::IsTrapped() {
+    for (size_t i = call_stack_size; i > 0; i--) {
+        CallInfo & c = call_stack[i - 1];
+        if (sq_type(c._closure) == OT_CLOSURE && _closure(c._closure)->_function->FindTrap(c._ip - 1)) {
+            return true;
+        }
+        if (c._root) {
+            break;
+        }
+    }
+    return false;
+}
+
 void SQVM::CallErrorHandler(SQObjectPtr & error) {
     if (sq_type(_errorhandler) == OT_NULL) {
         return;
@@ -1522,7 +1940,9 @@ bool SQVM::CallNative(
     }
 
     n_native_calls++;
+    _sharedstate->_nativecalls++;
     SQInteger ret = (native_closure->_function)(this);
+    _sharedstate->_nativecalls--;
     n_native_calls--;
 
     if (ret == SQ_TAILCALL_FLAG) {
@@ -1986,6 +2406,61 @@ bool SQVM::Call(SQObjectPtr &closure, SQInteger nparams, SQInteger stackbase, SQ
     return false;
 }
 
+bool SQVM::PreparedCall::Prepare(SQObjectPtr const & callee, SQInteger nargs) {
+    // callee may live on the stack, which growing it below moves
+    _callee = callee;
+    // slots above _base the callee's frame takes
+    SQInteger frame = nargs;
+    switch (sq_type(_callee)) {
+    case OT_CLOSURE: {
+        SQInteger const stacksize = _closure(_callee)->_function->_stacksize;
+        frame = stacksize > nargs ? stacksize : nargs;
+        _invoke = &PreparedCall::InvokeClosure;
+        break;
+    }
+    case OT_NATIVECLOSURE:
+        _invoke = &PreparedCall::InvokeNative;
+        break;
+    case OT_CLASS:
+        _invoke = &PreparedCall::InvokeClass;
+        break;
+    default:
+        _vm->Raise_Error(_SC("attempt to call '%s'"), GetTypeName(_callee));
+        return false;
+    }
+
+    // with the slack EnterFrame expects above the top
+    SQInteger const top = _vm->stack_top + frame + MIN_STACK_OVERHEAD;
+    if (top > (SQInteger)_vm->_stack.size()) {
+        if (_vm->n_metamethod_calls) {
+            _vm->Raise_Error(_SC("cannot resize stack while in a metamethod"));
+            return false;
+        }
+        _vm->GrowStack(top);
+    }
+
+    _base = _vm->stack_top;
+    for (SQInteger i = 0; i < nargs; i++) {
+        _vm->PushNull();
+    }
+    _nargs = nargs;
+    return true;
+}
+
+bool SQVM::PreparedCall::InvokeClosure(SQObjectPtr & res, SQBool raiseerror) {
+    return _vm->Execute(_callee, _nargs, _base, res, raiseerror);
+}
+
+bool SQVM::PreparedCall::InvokeNative(SQObjectPtr & res, SQBool SQ_UNUSED_ARG(raiseerror)) {
+    bool dummy;
+    return _vm->CallNative(_nativeclosure(_callee), _nargs, _base, res, -1, dummy, dummy);
+}
+
+// creates the instance and runs the constructor
+bool SQVM::PreparedCall::InvokeClass(SQObjectPtr & res, SQBool raiseerror) {
+    return _vm->Call(_callee, _nargs, _base, res, raiseerror);
+}
+
 bool SQVM::CallMetaMethod(SQObjectPtr & closure, SQInteger nparams, SQObjectPtr & outres) {
     n_metamethod_calls++;
 
@@ -2027,7 +2502,6 @@ bool SQVM::EnterFrame(SQInteger newbase, SQInteger newtop, bool tailcall) {
         ci = &call_stack[call_stack_size++];
         ci->_prevstkbase = (SQInt32)(newbase - _stackbase);
         ci->_prevtop = (SQInt32)(stack_top - _stackbase);
-        ci->_etraps = 0;
         ci->_ncalls = 1;
         ci->_generator = NULL;
         ci->_root = SQFalse;
@@ -2044,7 +2518,9 @@ bool SQVM::EnterFrame(SQInteger newbase, SQInteger newtop, bool tailcall) {
             Raise_Error(_SC("stack overflow, cannot resize stack while in a metamethod"));
             return false;
         }
+        size_t const before = StackBytes();
         _stack.resize(newtop + (MIN_STACK_OVERHEAD << 2));
+        StackResized(before);
         RelocateOuters();
     }
     return true;
@@ -2072,6 +2548,14 @@ void SQVM::LeaveFrame() {
     }
 }
 
+void SQVM::GrowStack(size_t size) {
+    // geometric, for callers reserving a few slots at a time
+    size_t const before = StackBytes();
+    _stack.resize(size > _stack.size() * 2 ? size : _stack.size() * 2);
+    StackResized(before);
+    RelocateOuters();
+}
+
 void SQVM::RelocateOuters() {
     SQOuter *p = _openouters;
     while (p) {
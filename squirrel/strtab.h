@@ -31,11 +31,14 @@ class SQStringTable {
     SQString ** strings;
     size_t _numofslots;
     size_t _slotused;
+    // bytes of the strings and the slots
+    size_t _bytes;
 public:
     SQStringTable()
         : strings(nullptr)
         , _numofslots(0)
         , _slotused(0)
+        , _bytes(0)
     {
         AllocNodes(128);
     }
@@ -65,6 +68,7 @@ public:
 
         strings[h] = t;
         _slotused++;
+        _bytes += sizeof(SQString) + len;
 
         if (_slotused > _numofslots) {
             Resize(_numofslots * 2);
@@ -106,6 +110,7 @@ public:
         t->_next = strings[h];
         strings[h] = t;
         _slotused++;
+        _bytes += sq_rsl(len) + sizeof(SQString);
 
         if (_slotused > _numofslots) {
             Resize(_numofslots * 2);
@@ -135,6 +140,7 @@ public:
             _slotused--;
 
             size_t slen = s->_len;
+            _bytes -= sizeof(SQString) + slen;
             s->~SQString(); // invalidate weakrefs
             sq_vm_free(s, sizeof(SQString) + slen);
 
@@ -143,6 +149,26 @@ public:
 
         assert(0 && "string not found?");
     }
+
+    size_t Count() const { return _slotused; }
+    size_t Slots() const { return _numofslots; }
+    size_t Bytes() const { return _bytes; }
+
+    // bytes of the strings, buckets in use and the longest bucket chain
+    void Occupancy(size_t & bytes, size_t & used, size_t & longest) const {
+        bytes = sizeof(SQString *) * _numofslots;
+        used = 0;
+        longest = 0;
+        for (size_t i = 0; i < _numofslots; i++) {
+            size_t chain = 0;
+            for (SQString * s = strings[i]; s; s = s->_next) {
+                bytes += sizeof(SQString) + s->_len;
+                chain++;
+            }
+            used += chain ? 1 : 0;
+            longest = chain > longest ? chain : longest;
+        }
+    }
 private:
     void Resize(size_t size) {
         size_t oldsize = _numofslots;
@@ -162,11 +188,13 @@ private:
         }
 
         sq_vm_free(oldtable, sizeof(SQString *) * oldsize);
+        _bytes -= sizeof(SQString *) * oldsize;
     }
 
     void AllocNodes(size_t size) {
         _numofslots = size;
         strings = (SQString **)sq_vm_malloc(sizeof(SQString *) * _numofslots);
         memset(strings, 0, sizeof(SQString *) * _numofslots);
+        _bytes += sizeof(SQString *) * _numofslots;
     }
 };
@@ -0,0 +1,72 @@
+// arithmetic with an integer constant right operand (_OP_ADDK, ...) must
+// behave like the generic instructions for every operand type
+local function k(x) {
+    return [x + 3, x - 3, x * 3, x / 3, x % 3, x + -7, x / -2, x % -5]
+}
+local function g(x, c) {
+    return [x + c, x - c, x * c, x / c, x % c]
+}
+foreach (v in [10, -10, 7.5, -7.25, 0x7fffffffffffffff, 16777217.0]) {
+    local a = k(v), b = g(v, 3), c = g(v, -7), d = g(v, -2), e = g(v, -5)
+    assert(a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3] && a[4] == b[4])
+    assert(a[5] == c[0] && a[6] == d[3] && a[7] == e[4])
+    assert(typeof a[0] == typeof v && typeof a[3] == typeof v)
+}
+assert(k(10)[3] == 3 && k(-10)[4] == -1 && k(7.5)[3] == 2.5)
+
+local function cat(x) return x + 1
+assert(cat("ab") == "ab1")
+local function sub(x) return x - 1
+local raised = false
+try { sub("ab") } catch (e) raised = true
+assert(raised)
+
+local C = class {
+    function _add(o) { return "add" + o }
+    function _sub(o) { return "sub" + o }
+    function _mul(o) { return "mul" + o }
+    function _div(o) { return "div" + o }
+    function _modulo(o) { return "mod" + o }
+}
+local r = k(C())
+assert(r[0] == "add3" && r[1] == "sub3" && r[2] == "mul3" && r[3] == "div3" && r[4] == "mod3")
+
+// division by 0 and -1 keep their runtime checks
+local function div0(x) return x / 0
+raised = false
+try { div0(9) } catch (e) raised = true
+assert(raised)
+assert(div0(1.0) == 1.0 / 0.0)
+
+// quickened sites survive operand types changing under them
+local function add(a, b) return a + b
+local function lt(a, b) return a < b
+for (local i = 0; i < 3; i++) {
+    assert(add(1, 2) == 3 && add(1.5, 2.0) == 3.5 && add(1, 0.5) == 1.5 && add("a", 1) == "a1")
+    assert(lt(1, 2) && !lt(2.0, 1.0) && lt(1, 1.5) && lt("a", "b"))
+}
+local s = 0
+for (local i = 0; i < 100; i++) s = s * 3 % 1000003 + i
+assert(s == 547389)
+
+// every quickened form: compare, compare-and-jump, increments and compound
+// arithmetic on slots, each fed alternating operand types until it gives up
+// specializing
+local function cmp(a, b) { local r = a < b; return r }
+local function jcmp(a, b) { if (a <= b) return 1; return 0 }
+local function inc(x) { local y = x; y++; return y }
+local function incl(x) { local y = x; ++y; return y + 0 }
+local function compound(t, v) { t.x += v; t.y *= v; return t }
+local function loop(n) { local s = 0; for (local i = 0; i < n; i += 1) s += i; return s }
+for (local round = 0; round < 50; round++) {
+    local f = round % 2 == 1
+    local one = f ? 1.0 : 1, two = f ? 2.0 : 2
+    assert(cmp(one, two) && !cmp(two, one) && cmp(1, 1.5) && cmp("a", "b"))
+    assert(jcmp(one, two) == 1 && jcmp(two, one) == 0 && jcmp(2, 2.0) == 1)
+    assert(inc(one) == 2 && typeof inc(one) == typeof one && incl(one) == 2)
+    local t = compound({ x = one, y = two }, two)
+    assert(t.x == 3 && t.y == 4 && typeof t.x == typeof one)
+    assert(compound({ x = "a", y = 1 }, 2).x == "a2")
+    assert(loop(f ? 4.0 : 4) == 6)
+}
+print("ok\n")
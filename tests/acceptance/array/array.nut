@@ -0,0 +1,95 @@
+// arrays keep all-integer and all-float contents unboxed; every operation
+// must behave as on a generic array, across the changes of representation
+local function same(a, b) {
+    if (a.len() != b.len()) return false
+    foreach (i, v in a) {
+        if (typeof v != typeof b[i]) return false
+        if (v != b[i] && !(v != v && b[i] != b[i])) return false
+    }
+    return true
+}
+
+// integers
+local a = []
+for (local i = 0; i < 100; i++) a.append(i * 7 % 100)
+assert(a.len() == 100 && a[3] == 21 && a.top() == 93)
+a[5] = -1
+assert(a[5] == -1 && typeof a[5] == "integer")
+local s = 0
+foreach (v in a) s += v
+assert(s == 4950 - 35 - 1)
+assert(same(a.slice(2, 5), [14, 21, 28]) && same(clone a, a))
+assert(a.find(-1) == 5 && a.find(3.0) == a.find(3) && a.find(1000) == null)
+local sorted = clone a
+sorted.sort()
+assert(sorted[0] == -1 && sorted[1] == 0 && sorted.top() == 99)
+sorted.reverse()
+assert(sorted[0] == 99)
+sorted.sort(@(x, y) x <=> y)
+assert(sorted[0] == -1 && sorted.top() == 99 && typeof sorted[0] == "integer")
+
+// floats
+local f = [1.5, -2.25, 3.0]
+f.push(0.5)
+f.insert(0, 10.0)
+assert(same(f, [10.0, 1.5, -2.25, 3.0, 0.5]))
+f.sort()
+assert(same(f, [-2.25, 0.5, 1.5, 3.0, 10.0]))
+assert(f.pop() == 10.0 && f.remove(0) == -2.25 && same(f, [0.5, 1.5, 3.0]))
+assert(same(f.map(@(v) v * 2), [1.0, 3.0, 6.0]) && f.reduce(@(x, y) x + y) == 5.0)
+local nan = [3.0, 0.0 / 0.0, 1.0]
+nan.sort()
+assert(nan.len() == 3)
+
+// the first value sets the kind of an empty array; other types generalize it
+local g = []
+g.append(1.0)
+assert(typeof g[0] == "float")
+g.append(2)
+assert(typeof g[0] == "float" && typeof g[1] == "integer" && g[1] == 2)
+local h = [1, 2, 3]
+h[1] = 2.5
+assert(same(h, [1, 2.5, 3]))
+h[1] = "x"
+assert(same(h, [1, "x", 3]))
+local n = [1, 2]
+n.append(null)
+assert(n.len() == 3 && n[2] == null)
+local r = [1, 2]
+r.resize(4)
+assert(same(r, [1, 2, null, null]))
+r = [1, 2]
+r.resize(4, 7)
+assert(same(r, [1, 2, 7, 7]))
+r.resize(1)
+assert(same(r, [1]))
+local e = [1, 2]
+e.extend([3.5, 4.5])
+assert(same(e, [1, 2, 3.5, 4.5]))
+e = [1.5]
+e.extend([2.5, 3.5])
+assert(same(e, [1.5, 2.5, 3.5]))
+local c = [1, 2, 3]
+c.clear()
+c.append("s")
+assert(same(c, ["s"]))
+
+// values taken out and put back keep their type
+local big = [0x7fffffffffffffff, -0x7fffffffffffffff - 1]
+assert(big[0] + big[1] == -1 && big[0] > 0 && big[1] < 0)
+local m = [1, 2, 3]
+m.apply(@(v) v * 1.5)
+assert(same(m, [1.5, 3.0, 4.5]))
+assert(same([1, 2, 3, 4].filter(@(i, v) v % 2 == 0), [2, 4]))
+local arr = array(3, 0.25)
+assert(same(arr, [0.25, 0.25, 0.25]))
+arr = array(2)
+assert(same(arr, [null, null]))
+
+// large arrays go through the same paths
+local l = []
+for (local i = 0; i < 10000; i++) l.append(10000 - i)
+l.sort()
+assert(l[0] == 1 && l[9999] == 10000)
+local fl = l.map(@(v) v / 4.0)
+assert(fl[3] == 1.0 && typeof fl[3] == "float")
@@ -0,0 +1,64 @@
+// script calls set up and tear down their frames on every path: fixed arity,
+// varargs, default parameters, errors, tail calls and open outers
+local function failure(f) { try { f() } catch (e) { return e } return null }
+
+local function add3(a, b, c) { return a + b + c }
+assert(add3(1, 2, 3) == 6)
+local function count(...) { return vargv.len() }
+assert(count() == 0 && count(1, 2, 3) == 3)
+local function tail(a, ...) { return a + vargv.reduce(@(x, y) x + y, 0) }
+assert(tail(1) == 1 && tail(1, 2, 3) == 6)
+local function defaults(a, b = 10, c = 20) { return a + b + c }
+assert(defaults(1) == 31 && defaults(1, 2) == 23 && defaults(1, 2, 3) == 6)
+
+assert(failure(@() add3(1, 2)) != null)
+assert(failure(@() add3(1, 2, 3, 4)) != null)
+assert(failure(@() tail()) != null)
+assert(failure(@() defaults()) != null)
+assert(failure(@() defaults(1, 2, 3, 4)) != null)
+
+// deep recursion, with and without tail calls
+function fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2) }
+assert(fib(20) == 6765)
+function loop(n, acc) { if (n == 0) return acc; return loop(n - 1, acc + n) }
+assert(loop(100000, 0) == 5000050000)
+
+// an error thrown deep down releases the locals of every frame it unwinds
+local witnesses = []
+function down(n) {
+    local held = {}
+    witnesses.append(held.weakref())
+    if (n == 0) { assert(witnesses[0] != null); throw "bottom" }
+    return down(n - 1) + 1
+}
+assert(failure(@() down(50)) == "bottom")
+assert(witnesses.len() == 51)
+foreach (w in witnesses) assert(w == null)
+
+// returning a captured local: the closure still sees the value
+local function capture() {
+    local v = [1, 2]
+    local get = @() v
+    return [v, get]
+}
+local r = capture()
+assert(r[0].len() == 2 && r[1]() == r[0])
+local function outer() {
+    local x = 7
+    local f = function() { return x }
+    return x
+}
+assert(outer() == 7)
+
+// a closure that drops the last reference to itself keeps running
+local holder = { f = null }
+holder.f = function() {
+    holder.f = null
+    collectgarbage()
+    local a = [1, 2, 3]
+    return a.len()
+}
+assert(holder.f() == 3 && holder.f == null)
+
+// results of calls used as arguments to calls
+assert(add3(add3(1, 1, 1), defaults(0, 0, 0), count(1, 2)) == 5)
@@ -0,0 +1,90 @@
+// locals that are never written after their declaration are captured by
+// value; any write, from the owner or from a nested function, keeps them shared
+local function fixed() {
+    local a = 1, t = [2]
+    local f = @() a + t[0]
+    t[0] = 5
+    return f
+}
+assert(fixed()() == 6)
+
+// writes after the capture, before and after it is called
+local function late() {
+    local a = 1
+    local f = @() a
+    a = 10
+    local g = @() a
+    a += 5
+    return [f, g]
+}
+local l = late()
+assert(l[0]() == 15 && l[1]() == 15)
+local function bumped() {
+    local n = 0
+    local f = @() n
+    n++
+    return f()
+}
+assert(bumped() == 1)
+
+// a nested function writing the local shares it with its siblings
+local function counter() {
+    local n = 0
+    local inc = function() { n++ }
+    local get = @() n
+    inc()
+    inc()
+    return [get, inc]
+}
+local c = counter()
+assert(c[0]() == 2)
+c[1]()
+assert(c[0]() == 3)
+
+// deeper nesting, writing through an outer chain
+local function chain() {
+    local v = 1
+    local mid = function() {
+        return function() { v = v * 3; return v }
+    }
+    local read = @() v
+    mid()()
+    return read()
+}
+assert(chain() == 3)
+
+// a local declared in a loop body is a fresh capture each iteration, while
+// foreach variables are one pair of locals the loop writes
+local fs = []
+for (local i = 0; i < 3; i++) {
+    local j = i * 2
+    fs.append(@() j)
+}
+assert(fs[0]() == 0 && fs[1]() == 2 && fs[2]() == 4)
+local gs = []
+foreach (k, v in ["a", "b"]) gs.append(@() k + v)
+assert(gs[0]() == "1b" && gs[1]() == "1b")
+
+// lambdas handed straight to natives
+local offset = 100
+assert([1, 2, 3].map(@(x) x + offset).reduce(@(x, y) x + y) == 306)
+local key = "w"
+local sorted = [{ w = 3 }, { w = 1 }, { w = 2 }]
+sorted.sort(@(x, y) x[key] <=> y[key])
+assert(sorted[0].w == 1 && sorted[2].w == 3)
+assert([1, 2, 3, 4].filter(@(i, v) v > offset / 50).len() == 2)
+
+// captures outlive their frame and are not shared between calls
+local function make(x) { local y = x * x; return @() x + y }
+local m1 = make(2), m2 = make(3)
+assert(m1() == 6 && m2() == 12)
+
+// generators capture the same way
+local function gen(n) {
+    local step = n
+    local next = @(i) i + step
+    for (local i = 0; i < 3 * n; i = next(i)) yield i
+}
+local out = []
+foreach (v in gen(2)) out.append(v)
+assert(out.len() == 3 && out[2] == 4)
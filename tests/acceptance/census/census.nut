@@ -0,0 +1,46 @@
+// heapcensus() counts the live objects by type and by class and lists the
+// largest containers
+::Item <- class { v = null; constructor(i) { v = i } }
+local items = []
+for (local i = 0; i < 200; i++) items.append(Item(i))
+local big = array(5000, 1)
+local wide = {}
+for (local i = 0; i < 3000; i++) wide["k" + i] <- i
+
+local c = heapcensus(3)
+assert(c.livebytes > 0)
+assert(c.types.instance.count >= 200 && c.types.instance.bytes > 0)
+assert(c.types.array.count >= 2 && c.types.table.count >= 2 && c.types["class"].count >= 1)
+local entry = null
+foreach (e in c.classes) if (e["class"] == Item) entry = e
+assert(entry != null && entry.count == 200 && entry.bytes > 0)
+
+// largest first
+assert(c.largest.len() == 3)
+assert(c.largest[0].bytes >= c.largest[1].bytes && c.largest[1].bytes >= c.largest[2].bytes)
+local found = 0
+foreach (e in c.largest) {
+    if (e.value == big) { assert(e.size == 5000); found++ }
+    if (e.value == wide) { assert(e.size == 3000); found++ }
+}
+assert(found == 2)
+assert(c.strings.count > 3000 && c.strings.bytes > 0 && c.strings.slots >= c.strings.used)
+
+// the census takes nothing away
+local again = heapcensus(0)
+assert(again.largest.len() == 0 && again.types.instance.count == c.types.instance.count)
+assert(items.len() == 200 && big.len() == 5000 && wide.len() == 3000)
+items = null
+assert(!("instance" in heapcensus(0).types) || heapcensus(0).types.instance.count < 200)
+
+// weak tables are counted without emptying their dead slots, which would free
+// objects the census has already listed
+big = wide = c = null
+local weak = {}
+weak.setweakmode("v")
+local held = [{}, {}, {}]
+foreach (i, v in held) weak[array(20000 + i, i)] <- v
+held = null
+local w = heapcensus(3)
+foreach (e in w.largest) assert(typeof e.value == "array" && e.size >= 20000 && e.value[0] == e.size - 20000)
+assert(w.largest.len() == 3 && weak.len() == 0)
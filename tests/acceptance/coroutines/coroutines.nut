@@ -0,0 +1,73 @@
+// thread and generator stacks are recycled; a recycled stack must behave as a
+// fresh one, and locals must survive a yield unchanged
+local function failure(f) { try { f() } catch (e) { return e } return null }
+
+// many short-lived threads, each seeing clean locals
+local function task(n) {
+    local fresh
+    assert(fresh == null)
+    local big = array(n, n)
+    return big.len() + (fresh == null ? 0 : 1000)
+}
+for (local i = 0; i < 2000; i++) assert(newthread(task).call(i % 50) == i % 50)
+
+// a suspended thread keeps its frame while others come and go
+local function pinger() {
+    local held = [1, 2, 3]
+    local got = suspend(held.len())
+    for (local i = 0; i < 100; i++) newthread(task).call(10)
+    return got + held[2]
+}
+local th = newthread(pinger)
+assert(th.call() == 3)
+assert(th.wakeup(10) == 13)
+
+// a generator's locals, and objects its closures captured, survive yields
+local function gen(n) {
+    local acc = []
+    local log = {}
+    local push = function(i) { acc.append(i); log[i] <- "v" + i }
+    for (local i = 0; i < n; i++) {
+        push(i)
+        yield acc.len() * 100 + log.len()
+    }
+    return acc
+}
+local g = gen(5)
+local out = []
+foreach (v in g) out.append(v)
+assert(out.len() == 5 && out[0] == 101 && out[4] == 505 && out[2] == 303)
+
+// interleaved generators do not see each other's slots
+local g1 = gen(3), g2 = gen(3)
+assert(resume g1 == 101 && resume g2 == 101 && resume g1 == 202 && resume g2 == 202)
+
+// a dropped generator releases what its frame held
+local witness = null
+local function holder() {
+    local t = {}
+    witness = t.weakref()
+    yield 1
+    yield 2
+}
+local function drop() {
+    local h = holder()
+    resume h
+    assert(witness.ref() != null)
+}
+drop()
+collectgarbage()
+assert(witness.ref() == null)
+
+// generators created and finished in bulk reuse their stacks
+local total = 0
+for (local i = 0; i < 1000; i++) foreach (v in gen(i % 4)) total += v
+assert(total > 0)
+
+// an error inside a generator leaves the pools usable
+local function bad() { yield 1; throw "oops" }
+local b = bad()
+resume b
+assert(failure(@() resume b) == "oops")
+assert(newthread(task).call(7) == 7)
+foreach (v in gen(2)) total += v
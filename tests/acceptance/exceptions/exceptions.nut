@@ -0,0 +1,122 @@
+local log = []
+
+// nested try blocks, the inner handler rethrowing to the outer one
+try {
+    try {
+        throw "inner"
+    } catch (e) {
+        log.append(e)
+        throw e + " again"
+    }
+} catch (e) {
+    log.append(e)
+}
+assert(log.len() == 2 && log[0] == "inner" && log[1] == "inner again")
+
+// a throw leaves the innermost try only
+local function nested(n) {
+    local caught = []
+    for (local i = 0; i < n; i++) {
+        try {
+            try {
+                if (i % 2) throw i
+                caught.append("none")
+            } catch (e) {
+                caught.append(e)
+            }
+            if (i == 2) throw "outer"
+        } catch (e) {
+            caught.append(e)
+        }
+    }
+    return caught
+}
+local c = nested(4)
+assert(c.len() == 5 && c[0] == "none" && c[1] == 1 && c[2] == "none" && c[3] == "outer" && c[4] == 3)
+
+// throws unwinding through frames without try blocks
+function depth(n) {
+    if (n == 0) throw { code = 42 }
+    local local_ = n * 2
+    return depth(n - 1) + local_
+}
+local function guarded() {
+    try {
+        return depth(20)
+    } catch (e) {
+        return e.code
+    }
+}
+assert(guarded() == 42)
+
+// native frames in between
+try {
+    [3, 1, 2].sort(function(a, b) { throw "from sort" })
+    assert(false)
+} catch (e) {
+    assert(e == "from sort")
+}
+
+// code after a caught throw keeps its locals
+local function locals() {
+    local a = 1, b = 2
+    try {
+        local x = 10
+        throw x
+    } catch (e) {
+        a += e
+    }
+    return a + b
+}
+assert(locals() == 13)
+
+// try blocks inside loops with break and continue
+local n = 0
+foreach (i in [1, 2, 3, 4]) {
+    try {
+        if (i == 2) continue
+        if (i == 4) break
+        n += i
+    } catch (e) {
+        assert(false)
+    }
+}
+assert(n == 4)
+
+// generators throwing into their caller
+local function gen() {
+    yield 1
+    throw "gen"
+}
+local g = gen()
+assert(resume g == 1)
+try { resume g; assert(false) } catch (e) { assert(e == "gen") }
+
+// the trap table survives a save/load round trip
+local saved = "exceptions.cnut"
+writeclosuretofile(saved, function() {
+    local out = []
+    try {
+        try {
+            throw "a"
+        } catch (e) {
+            out.append(e)
+            throw "b"
+        }
+    } catch (e) {
+        out.append(e)
+    }
+    return out
+})
+local reloaded = loadfile(saved)()
+assert(reloaded.len() == 2 && reloaded[0] == "a" && reloaded[1] == "b")
+
+// streams from an older format are refused
+local f = file(saved, "rb+")
+f.seek(6)
+f.writen(1, 'i')
+f.close()
+local refused = false
+try { loadfile(saved) } catch (e) { refused = true }
+assert(refused)
+remove(saved)
@@ -0,0 +1,55 @@
+// constant expressions fold at compile time and must give what the VM
+// computes for the same operands at runtime
+local function id(x) return x
+const K = 6
+enum E { A = 3, B = "b" }
+
+assert(1 + 2 * 3 - 4 == id(1) + id(2) * id(3) - id(4))
+assert(7 / 2 == id(7) / id(2) && 7 % 3 == id(7) % id(3) && -7 / 2 == id(-7) / id(2))
+assert(7.0 / 2 == id(7.0) / id(2) && 7.5 % 2 == id(7.5) % id(2))
+assert(1.5 * 2 == id(1.5) * id(2) && typeof (1 + 2.0) == "float")
+assert(0x7fffffffffffffff + 1 == id(0x7fffffffffffffff) + id(1))
+assert((6 & 3) == 2 && (6 | 3) == 7 && (6 ^ 3) == 5)
+assert(1 << 62 == id(1) << id(62) && -16 >> 2 == -4 && -16 >>> 60 == id(-16) >>> id(60))
+assert(-K == id(-6) && ~K == id(~6) && !0 == true && !"" == false)
+assert(K * E.A == 18 && E.B + K == "b6" && "x" + 1.5 == "x" + id(1.5))
+assert((1 < 2) == true && (2.5 >= 3) == false && ("a" < "b") == true && (3 <=> 2) == 1)
+assert((1 == 1.0) == (id(1) == id(1.0)) && ("a" != "a") == false)
+
+// operations that raise at runtime are not folded
+local raised = false
+try { local x = 1 / 0 } catch (e) raised = true
+assert(raised)
+raised = false
+try { local x = "a" - 1 } catch (e) raised = true
+assert(raised)
+
+// an operand whose code ends in a jump target is not a constant
+local t = id(true), f = id(false), n = id(null)
+assert((t ? 1 : 2) + 3 == 4 && (f ? 1 : 2) + 3 == 5)
+assert((t ? 1 : 2) * 10 + 1 == 11 && -(t ? 1 : 2) == -1 && !(t ? false : true))
+assert((n || 5) + 1 == 6 && (t && 5) + 1 == 6 && (f || "a") + "b" == "ab")
+if (t ? false : true) assert(false)
+
+// untaken constant branches are dropped, taken ones run
+local hits = 0
+if (K > 5) hits++; else assert(false)
+if (K < 5) assert(false); else hits++
+if (!true) { local fn = function() { return 1 }; assert(false) } else hits++
+for (local i = 0; i < 3; i++) {
+    if (0) break
+    if (1) continue
+    assert(false)
+}
+local function early(x) {
+    if (false) return id(x)
+    return x + 1
+}
+assert(hits == 3 && early(1) == 2)
+
+local function rec(x) {
+    if (false) return rec(x - 1)
+    if (x > 0) return id(x) + 1
+    return 0
+}
+assert(rec(3) == 4 && rec(0) == 0)
@@ -0,0 +1,43 @@
+// collections are paced by allocated bytes: cyclic garbage is reclaimed
+// without an explicit collectgarbage()
+local function cycle() {
+    local a = {}, b = { a = a }
+    a.b <- b
+    return a
+}
+local function paced() {
+    local w = cycle().weakref()
+    for (local i = 0; i < 1000000 && w.ref() != null; i++) cycle()
+    return w.ref() == null
+}
+assert(paced())
+
+// sched.run() collects between rounds, but not when it was called from a
+// native, here array.map(), that holds values only it can see
+local function churn() {
+    for (local i = 0; i < 20; i++) {
+        for (local j = 0; j < 5000; j++) cycle()
+        sched.pass()
+    }
+}
+local function nested() {
+    local out = [1, 2, 3].map(function(v) {
+        if (v == 3) {
+            sched.spawn(churn)
+            sched.run()
+        }
+        return [v * 2]
+    })
+    assert(out.len() == 3)
+    foreach (i, v in out) assert(v.len() == 1 && v[0] == (i + 1) * 2)
+}
+nested()
+
+local function toplevel() {
+    local w = cycle().weakref()
+    sched.spawn(churn)
+    sched.spawn(churn)
+    sched.run()
+    return w.ref() == null
+}
+assert(toplevel())
@@ -0,0 +1,85 @@
+// serialize() freezes a value into a blob, deserialize() rebuilds it
+local function roundtrip(v) return deserialize(serialize(v))
+local function failure(f) {
+    try { f() } catch (e) { return e }
+    return null
+}
+
+// plain values
+assert(roundtrip(null) == null && roundtrip(true) == true && roundtrip(-5) == -5)
+assert(roundtrip(2.5) == 2.5 && roundtrip("text") == "text")
+local nested = roundtrip({ a = [1, 2.5, "x", null], b = { c = false } })
+assert(nested.a.len() == 4 && nested.a[1] == 2.5 && nested.a[2] == "x" && nested.b.c == false)
+
+// values reached twice stay shared, cycles survive
+local shared = [1]
+local t = { x = shared, y = shared, list = [shared] }
+t.self <- t
+local u = roundtrip(t)
+assert(u.x == u.y && u.list[0] == u.x && u.self == u && u != t)
+u.x.append(2)
+assert(u.y.len() == 2 && shared.len() == 1)
+local ring = [null]
+ring[0] = [ring]
+local r = roundtrip(ring)
+assert(r[0][0] == r)
+
+// instances of classes bound in the root table, without their constructor
+::Point <- class {
+    x = 0
+    y = 0
+    static made = [0]
+    constructor(a, b) { x = a; y = b; made[0]++ }
+}
+local p = Point(3, 4)
+local q = roundtrip({ p = p, again = p })
+assert(q.p instanceof Point && q.p.x == 3 && q.p.y == 4 && q.again == q.p)
+assert(Point.made[0] == 1)
+local Local = class {}
+assert(failure(@() serialize(Local())) != null)
+
+// blobs carry their bytes
+local b = blob(8)
+b.writen(0x01020304, 'i')
+local c = roundtrip([b, b])
+assert(c[0] == c[1] && c[0].len() == 8 && c[0][0] == 4 && c[0][3] == 1)
+
+// functions are not accepted from scripts, nor are native instances that
+// have no way to be rebuilt
+local f = serialize(function() {})
+assert(failure(@() deserialize(f)) != null)
+assert(failure(@() serialize(regexp("a+"))) != null)
+// bytes that claim an instance of a native class with no thaw hook
+::Forged <- class {}
+local forged = serialize(Forged())
+local n = 0
+for (local i = 0; i + 6 <= forged.len(); i++) {
+    if (forged[i] == 'F' && forged[i + 1] == 'o' && forged[i + 2] == 'r') {
+        foreach (k, ch in "regexp") forged[i + k] = ch
+        n++
+    }
+}
+assert(n == 1)
+assert(failure(@() deserialize(forged)).find("thaw hook") != null)
+
+// truncated or damaged images are rejected
+local bytes = serialize({ a = [1, 2, 3], b = "str" })
+local cut = blob(bytes.len() - 3)
+for (local i = 0; i < cut.len(); i++) cut[i] = bytes[i]
+assert(failure(@() deserialize(cut)) == "corrupted image")
+
+// weak tables keep their mode, and what only they held goes away
+local keys = {}
+keys.setweakmode("k")
+local held = [1]
+keys[held] <- "held"
+keys[[2]] <- "loose"
+keys.name <- "strong"
+local w = roundtrip({ t = keys, keep = held })
+assert(w.t.getweakmode() == "k" && w.t.len() == 2 && w.t[w.keep] == "held" && w.t.name == "strong")
+local vals = {}
+vals.setweakmode("v")
+vals.a <- held
+vals.b <- [3]
+w = roundtrip({ t = vals, keep = held })
+assert(w.t.getweakmode() == "v" && w.t.len() == 1 && w.t.a == w.keep)
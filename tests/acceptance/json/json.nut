@@ -0,0 +1,61 @@
+// json.decode / json.encode
+local function fails(s) {
+    try { json.decode(s) } catch (e) return true
+    return false
+}
+
+local v = json.decode("{\"a\": [1, 2.5, -3e2, true, false, null], \"b\": {\"c\": \"d\"}, \"e\": []}")
+assert(v.a.len() == 6 && v.a[0] == 1 && v.a[1] == 2.5 && v.a[2] == -300.0 && typeof v.a[2] == "float")
+assert(v.a[3] == true && v.a[4] == false && v.a[5] == null && v.b.c == "d" && v.e.len() == 0)
+assert(typeof json.decode("[1]", true)[0] == "float")
+assert(json.decode(" \"x\" ") == "x" && json.decode("0") == 0 && json.decode("-0.5") == -0.5)
+
+// escapes decode to UTF-8
+assert(json.decode("\"a\\\"\\\\\\/\\b\\f\\n\\r\\t\"") == "a\"\\/\b\f\n\r\t")
+assert(json.decode("\"\\u0041\\u00e9\\u20ac\"") == "A\xc3\xa9\xe2\x82\xac")
+assert(json.decode("\"\\ud83d\\ude00\"") == "\xf0\x9f\x98\x80")
+assert(fails("\"\\ud83d\"") && fails("\"\\ude00\\ud83d\"") && fails("\"\\u12\"") && fails("\"\\q\""))
+
+// raw UTF-8 passes through, malformed UTF-8 is rejected
+local ok = "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xf4\x8f\xbf\xbf\""
+assert(json.decode(ok) == ok.slice(1, ok.len() - 1))
+assert(json.decode("[\"\xc3\xa9\\n\xc3\xa9\"]")[0] == "\xc3\xa9\n\xc3\xa9")
+foreach (bad in ["\x80", "\xc3", "\xc3(", "\xc0\xaf", "\xc1\xbf", "\xe0\x80\xaf", "\xed\xa0\x80",
+                 "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xe2\x82"]) {
+    assert(fails("\"" + bad + "\""))
+    assert(fails("\"\\n" + bad + "\""))
+    assert(fails("{\"k" + bad + "\": 1}"))
+    assert(fails("\"abcdefghijklmnop" + bad + "\""))
+}
+
+// malformed documents
+foreach (bad in ["", "[", "[1,]", "{\"a\" 1}", "{1: 2}", "tru", "01", "1.", "\"a", "\"a\nb\"", "[1] x", "{\"a\":1,}"]) {
+    assert(fails(bad))
+}
+local deep = ""
+for (local i = 0; i < 600; i++) deep += "["
+assert(fails(deep))
+
+// encode round trips
+local doc = {a = [1, 2.5, "x\"y\n", null, true], b = {c = {}}, d = "\xc3\xa9"}
+local back = json.decode(json.encode(doc))
+assert(back.a[0] == 1 && back.a[1] == 2.5 && back.a[2] == "x\"y\n" && back.a[3] == null && back.a[4] == true)
+assert(back.b.c.len() == 0 && back.d == "\xc3\xa9")
+assert(json.encode([1, "a"]) == "[1,\"a\"]")
+
+// blobs in, streams out
+local b = blob(8)
+foreach (c in "[10, 20]") b.writen(c, 'b')
+local arr = json.decode(b)
+assert(arr[0] == 10 && arr[1] == 20)
+local out = blob(8)
+assert(json.encode([3], out) == out && out.tell() == 3 && out[0] == '[' && out[2] == ']')
+
+// big arrays and objects are built from the stack in one go
+local s = "[", o = "{"
+for (local i = 0; i < 5000; i++) {
+    s += (i ? "," : "") + i
+    o += (i ? "," : "") + "\"k" + i + "\":" + i
+}
+local big = json.decode(s + "]"), obj = json.decode(o + "}")
+assert(big.len() == 5000 && big[4999] == 4999 && obj.len() == 5000 && obj.k1234 == 1234)
@@ -0,0 +1,60 @@
+// line numbers come from the line table: hooks see every line, with or
+// without enabledebuginfo(), and stack infos report the right lines
+local events = []
+local function hook(type, src, line, name) {
+    if (name == "probe" || name == "late") events.append(type.tochar() + line)
+}
+local function trace() {
+    local out = events.reduce(@(a, b) a + " " + b, "")
+    events.clear()
+    return out
+}
+
+local function probe(a) {
+    local x = a + 1
+    if (x > 2)
+        x = 0
+    return x
+}
+setdebughook(hook)
+probe(1)
+assert(trace() == " c14 l14 l15 l17 r17")
+probe(5)
+assert(trace() == " c14 l14 l15 l16 l17 r17")
+setdebughook(null)
+probe(1)
+assert(trace() == "")
+
+// a hook set while the function runs takes effect from the next line
+local function late() {
+    local n = 0
+    setdebughook(hook)
+    n++
+    return n
+}
+late()
+setdebughook(null)
+assert(trace() == " l32 l33 r33")
+
+// code compiled later, with and without debug info, reports the same lines
+local src = "local x = 1\nlocal y = x + 1\nreturn y"
+foreach (debug in [false, true]) {
+    enabledebuginfo(debug)
+    local f = compilestring(src, "probe")
+    local lines = []
+    setdebughook(function(type, s, line, name) { if (type == 'l' && s == "probe") lines.append(line) })
+    assert(f() == 2)
+    setdebughook(null)
+    assert(lines.len() == 3 && lines[0] == 1 && lines[2] == 3)
+}
+enabledebuginfo(false)
+
+// stack infos of running frames
+local function where() { return getstackinfos(2).line }
+local function caller() {
+    local a = 1
+
+    local line = where()
+    return line
+}
+assert(caller() == 57)
@@ -0,0 +1,115 @@
+// foreach over arrays and counted for loops run specialized forms; results
+// must match the generic paths whatever the containers and counters hold
+local function keys(c) {
+    local out = []
+    foreach (k, v in c) out.append(k + "=" + v)
+    return out.reduce(@(x, y) x + "," + y, "")
+}
+local function sum(c) {
+    local s = 0
+    foreach (v in c) s += v
+    return s
+}
+
+// one loop site fed different containers, then arrays again
+assert(keys(["a", "b"]) == ",0=a,1=b")
+assert(keys([1.5, 2.5]) == ",0=1.5,1=2.5")
+assert(keys([]) == "")
+local t = keys({ x = 1 })
+assert(t == ",x=1")
+assert(keys("hi") == ",0=104,1=105")
+for (local i = 0; i < 20; i++) assert(sum(i % 2 ? [i, 1] : { a = i, b = 1 }) == i + 1)
+local function g() { yield 3; yield 4 }
+assert(sum(g()) == 7)
+assert(sum([10, 20, 30]) == 60)
+
+// growing or shrinking the array while walking it
+local a = [1, 2, 3]
+local seen = 0
+foreach (v in a) {
+    seen++
+    if (v == 1) a.append(4)
+}
+assert(seen == 4)
+a = [1, 2, 3, 4, 5]
+seen = 0
+foreach (i, v in a) {
+    seen++
+    if (i == 1) a.resize(3)
+}
+assert(seen == 3)
+
+// weak references stored in an array read as their target
+local held = {}
+local w = [held.weakref()]
+foreach (v in w) assert(v == held)
+
+// break and continue, nested loops
+local pairs = 0
+foreach (x in [1, 2, 3]) {
+    if (x == 2) continue
+    foreach (y in [1, 2, 3]) {
+        if (y == 3) break
+        pairs++
+    }
+}
+assert(pairs == 4)
+
+// counted loops in each direction, with literal and local limits
+local n = 0
+for (local i = 0; i < 10; i++) n++
+assert(n == 10)
+n = 0
+for (local i = 0; i <= 10; i++) n++
+assert(n == 11)
+n = 0
+for (local i = 10; i > 0; i--) n++
+assert(n == 10)
+n = 0
+for (local i = 10; i >= 0; i--) n++
+assert(n == 11)
+n = 0
+for (local i = 5; i < 5; i++) n++
+assert(n == 0)
+local lim = 7
+n = 0
+for (local i = 0; i < lim; i++) n++
+assert(n == 7)
+
+// the body may change the counter or the limit
+n = 0
+lim = 10
+for (local i = 0; i < lim; i++) { n++; if (i == 4) lim = 6 }
+assert(n == 6)
+n = 0
+for (local i = 0; i < 10; i++) { n++; i++ }
+assert(n == 5)
+
+// temporaries in the body do not disturb a literal limit
+n = 0
+for (local i = 0; i < 100; i++) {
+    local x = [i, i + 1, i * 2].map(@(v) v + 1)
+    n += x.len()
+}
+assert(n == 300)
+
+// non-integer counters and limits take the generic arithmetic
+n = 0
+for (local i = 0.5; i < 3; i++) n++
+assert(n == 3)
+n = 0
+for (local i = 0; i < 2.5; i++) n++
+assert(n == 3)
+local last = null
+for (local i = 0; i < 3; i++) last = i
+assert(last == 2 && typeof last == "integer")
+
+// locals captured in a counted loop's body
+local fs = []
+for (local i = 0; i < 3; i++) { local j = i; fs.append(@() j) }
+assert(fs[0]() == 0 && fs[2]() == 2)
+
+// a counter that cannot be stepped
+local err = null
+try { for (local i = 0; i < 3; i++) { if (i == 1) i = null } } catch (e) { err = e }
+assert(err != null)
@@ -0,0 +1,71 @@
+// metamethod lookups through delegate tables are cached; every change to the
+// delegate must show on the next lookup
+local function failure(f) { try { f() } catch (e) { return e } return null }
+
+local mt = {}
+local a = { v = 1 }.setdelegate(mt)
+local b = { v = 2 }.setdelegate(mt)
+assert(failure(@() a + b) != null)
+assert(typeof a == "table")
+
+// adding, replacing and removing metamethods
+mt._add <- @(o) { v = this.v + o.v }
+assert((a + b).v == 3)
+mt._add = @(o) { v = this.v * 10 + o.v }
+assert((a + b).v == 12)
+mt.rawset("_add", @(o) { v = 0 })
+assert((a + b).v == 0)
+delete mt._add
+assert(failure(@() a + b) != null)
+mt._typeof <- @() "thing"
+assert(typeof a == "thing" && typeof b == "thing")
+mt.clear()
+assert(typeof a == "table")
+
+// the other lookups going through the same cache
+mt._tostring <- @() "v" + this.v
+assert(a.tostring() == "v1")
+mt._get <- @(k) k + "!"
+assert(a.missing == "missing!" && a.v == 1)
+mt._call <- @(self, x) this.v + x
+assert(a(5) == 6)
+mt._cmp <- @(o) this.v <=> o.v
+assert(a < b && b > a)
+mt._unm <- @() -this.v
+assert(-b == -2)
+
+// a delegate shared by many tables, some of them switching delegates
+local other = { _typeof = @() "other" }
+local many = []
+for (local i = 0; i < 50; i++) many.append({ v = i }.setdelegate(i % 2 ? mt : other))
+mt._typeof <- @() "mt"
+foreach (i, t in many) assert(typeof t == (i % 2 ? "mt" : "other"))
+many[1].setdelegate(other)
+assert(typeof many[1] == "other")
+other._typeof = @() "changed"
+assert(typeof many[0] == "changed" && typeof many[1] == "changed" && typeof many[3] == "mt")
+
+// a delegate with many slots, grown after the first lookup
+for (local i = 0; i < 200; i++) mt["f" + i] <- i
+assert(typeof a == "mt")
+delete mt._typeof
+assert(typeof a == "table")
+
+// a metamethod held weakly disappears with its closure
+local weakmt = {}
+weakmt.setweakmode("v")
+local fn = @() "weak"
+weakmt._typeof <- fn
+local c = {}.setdelegate(weakmt)
+assert(typeof c == "weak")
+fn = null
+collectgarbage()
+assert(typeof c == "table")
+
+// classes keep their own metamethods
+class Vec {
+    x = 0
+    constructor(x) { this.x = x }
+    function _add(o) { return Vec(x + o.x) }
+}
+assert((Vec(1) + Vec(2)).x == 3)
@@ -0,0 +1,55 @@
+local b = pack("<bBhHiIqfd?4sx", -1, 255, -2, 65535, -3, 4000000000, -5, 1.5, 2.25, true, "ab")
+assert(b.len() == 1 + 1 + 2 + 2 + 4 + 4 + 8 + 4 + 8 + 1 + 4 + 1)
+local a = unpack("<bBhHiIqfd?4sx", b)
+assert(a.len() == 11)
+assert(a[0] == -1 && a[1] == 255 && a[2] == -2 && a[3] == 65535)
+assert(a[4] == -3 && a[5] == 4000000000 && a[6] == -5)
+assert(a[7] == 1.5 && a[8] == 2.25 && a[9] == true)
+assert(a[10] == "ab\x00\x00")
+
+local be = pack(">HI", 0x0102, 0x03040506)
+assert(be[0] == 1 && be[1] == 2 && be[2] == 3 && be[5] == 6)
+assert(unpack("!HI", be)[1] == 0x03040506)
+assert(unpack("<H", be, 1)[0] == 0x0302)
+
+local rec = pack("<I(id) H(len) 8s(name) 3h(pts)", {id = 7, len = 300, name = "bob", pts = [1, -2, 3]})
+assert(rec.len() == 4 + 2 + 8 + 6)
+local t = unpack("<I(id) H(len) 8s(name) 3h(pts)", rec)
+assert(t.id == 7 && t.len == 300 && t.name.len() == 8 && t.pts.len() == 3 && t.pts[1] == -2)
+
+local s = blob()
+s.pack("<2i", 10, 20)
+s.pack(">H(x)", {x = 5})
+s.seek(0)
+local r = s.unpack("<2i")
+assert(r[0] == 10 && r[1] == 20)
+assert(s.unpack(">H(x)").x == 5)
+
+local function fails(f) {
+    try { f() } catch (e) { return true }
+    return false
+}
+foreach (bad in ["<k", "3", "I(a) H", "x(a)", "I(", "99999999I"]) {
+    assert(fails(@() pack(bad, 1)))
+}
+assert(fails(@() pack("<H", 1, 2)))
+assert(fails(@() pack("<H", "x")))
+assert(fails(@() unpack("<I", blob(2))))
+assert(fails(@() pack("<I(a)", {b = 1})))
+assert(fails(@() pack("<2I(a)", {a = [1]})))
+
+// offsets near the integer limit must not wrap the bounds check
+assert(fails(@() unpack("<I", blob(8), 0x7fffffffffffffff)))
+assert(fails(@() unpack("<I", blob(8), -1)))
+assert(fails(@() unpack("<I", blob(8), 5)))
+assert(unpack("<I", blob(8), 4)[0] == 0)
+
+// large counts go straight into arrays
+local big = blob(1000000)
+big[999999] = 7
+local bytes = unpack("1000000B", big)
+assert(bytes.len() == 1000000 && bytes[0] == 0 && bytes[999999] == 7)
+local named = unpack("<1000000B(data)", big)
+assert(named.data.len() == 1000000 && named.data[999999] == 7)
+local mixed = unpack("<H 99998B", big)
+assert(mixed.len() == 99999 && mixed[99998] == 0)
@@ -0,0 +1,71 @@
+// the higher-order builtins call their function through a prepared call;
+// the callback may grow the stack under them, and they may be started with
+// the stack nearly full. Every case runs in a thread of its own, which
+// starts with a small stack.
+function deep(n) {
+    if (n == 0) return 0
+    local a = n, b = n, c = n, d = n
+    return deep(n - 1) + 1
+}
+
+local arr = [1, 2, 3, 4]
+local tbl = { a = 1, b = 2, c = 3 }
+local function sum(a) {
+    local s = 0
+    foreach (v in a) s += v
+    return s
+}
+
+local cases = [
+    // a frame much larger than the slack kept above the top, so that
+    // preparing the call has to grow the stack
+    @() sum(arr.map(function(v) {
+        local a0 = v, a1 = v, a2 = v, a3 = v, a4 = v, a5 = v, a6 = v, a7 = v, a8 = v, a9 = v
+        local b0 = v, b1 = v, b2 = v, b3 = v, b4 = v, b5 = v, b6 = v, b7 = v, b8 = v, b9 = v
+        local c0 = v, c1 = v, c2 = v, c3 = v, c4 = v, c5 = v, c6 = v, c7 = v, c8 = v, c9 = v
+        local d0 = v, d1 = v, d2 = v, d3 = v, d4 = v, d5 = v, d6 = v, d7 = v, d8 = v, d9 = v
+        local e0 = v, e1 = v, e2 = v, e3 = v, e4 = v, e5 = v, e6 = v, e7 = v, e8 = v, e9 = v
+        local f0 = v, f1 = v, f2 = v, f3 = v, f4 = v, f5 = v, f6 = v, f7 = v, f8 = v, f9 = v
+        local g0 = v, g1 = v, g2 = v, g3 = v, g4 = v, g5 = v, g6 = v, g7 = v, g8 = v, g9 = v
+        local h0 = v, h1 = v, h2 = v, h3 = v, h4 = v, h5 = v, h6 = v, h7 = v, h8 = v, h9 = v
+        local i0 = v, i1 = v, i2 = v, i3 = v, i4 = v, i5 = v, i6 = v, i7 = v, i8 = v, i9 = v
+        local j0 = v, j1 = v, j2 = v, j3 = v, j4 = v, j5 = v, j6 = v, j7 = v, j8 = v, j9 = v
+        return a0 + j9 - v
+    })) == 10,
+    @() sum(arr.map(@(v) v + deep(300) - 300)) == 10,
+    @() arr.reduce(@(x, y) x + y + deep(300) - 300) == 10,
+    @() arr.reduce(@(x, y) x + y + deep(300) - 300, 5) == 15,
+    @() sum(arr.filter(@(i, v) deep(300) && v % 2 == 0)) == 6,
+    @() sum(tbl.map(@(k, v) v + deep(300) - 300)) == 6,
+    @() tbl.filter(@(k, v) deep(300) && v != 2).len() == 2,
+    function() {
+        local copy = clone arr
+        copy.apply(@(v) v * 2 + deep(300) - 300)
+        return sum(copy) == 20
+    },
+    function() {
+        local s = [3, 1, 2]
+        s.sort(@(x, y) deep(300) && x <=> y)
+        return s[0] == 1 && s[2] == 3
+    },
+]
+
+// at every depth, so that one of the calls prepares its frame right at the
+// end of the stack
+function at(n, f) {
+    if (n == 0) return f()
+    local a = n, b = n, c = n, d = n
+    return at(n - 1, f)
+}
+foreach (f in cases) {
+    for (local n = 0; n < 40; n++) {
+        assert(newthread(at).call(n, f))
+    }
+}
+
+// the function is the only thing that holds itself
+local res = [1, 2, 3].map(function(v) {
+    deep(400)
+    return v * 10
+})
+assert(sum(res) == 60)
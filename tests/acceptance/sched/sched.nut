@@ -0,0 +1,57 @@
+local log = []
+function spin(name, n) { local s = 0; for (local i = 0; i < n; i++) s += i; log.append(name); return s }
+
+// the scheduler only ever sits in the frames of functions, so that no stale
+// stack slot keeps it alive for the last test
+local function basics() {
+    // a task that never yields is still preempted by its budget
+    sched.setbudget(1000)
+    sched.spawn(spin, "a", 100000)
+    sched.spawn(spin, "b", 10)
+    sched.spawn(function() { while (true) {} })
+    assert(sched.count() == 3)
+    sched.step()
+    sched.step()
+    assert(log.len() == 1 && log[0] == "b")
+    for (local k = 0; k < 200; k++) sched.step()
+    assert(log.len() == 2 && log[1] == "a" && sched.count() == 1)
+
+    // sleep, wait, signal and pass
+    local out = []
+    local s = sched
+    s.spawn(function() { out.append("w1 " + s.wait("go")) })
+    s.spawn(function() { out.append("w2 " + s.wait("go")) })
+    s.spawn(function() { s.sleep(0.02); out.append("slept"); out.append(s.signal("go", 42)) })
+    s.spawn(function(x) { for (local i = 0; i < 3; i++) { out.append(x + i); s.pass() } }, "p")
+    s.spawn(function() { s.sleep(0.01); out.append("short") })
+    sched.setbudget(1000000)
+    assert(sched.count() == 6)
+    while (sched.count() > 1) sched.step()
+    assert(out[0] == "p0" && out[1] == "p1" && out[2] == "p2")
+    assert(out.find("short") < out.find("slept"))
+    assert(out.find("w1 42") != null && out.find("w2 42") != null && out.find(2) != null)
+    try { sched.pass(); assert(false) } catch (e) {}
+}
+basics()
+
+// Tasks left in a scheduler that goes away are released with it. These
+// were preempted by their budget, a task parked in wait() or sleep() holds
+// the scheduler through its own stack.
+local weak = []
+local function orphan() {
+    sched.setbudget(100)
+    for (local i = 0; i < 2; i++) {
+        weak.append(sched.spawn(function() { while (true) {} }).weakref())
+    }
+    sched.step()
+    assert(sched.count() == 3)
+    delete getroottable().sched
+}
+// in a thread of its own so that no stale stack slot holds on to the tasks
+local function isolated() {
+    newthread(orphan).call()
+}
+isolated()
+collectgarbage()
+// weak references in an array read as what they point at
+foreach (w in weak) assert(w == null)
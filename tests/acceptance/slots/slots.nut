@@ -0,0 +1,58 @@
+// frames are sized by the slots the code writes: temporaries that are only
+// moved into a local take no slot, and sibling blocks share their locals' slots
+local function size(f) { return f.getinfos().stacksize }
+
+// 'this' and the parameters, then the locals
+assert(size(@() null) <= 2)
+assert(size(function(t) { local v = t.a; local w = t.b.c; return v }) == 4)
+assert(size(function(x) { local y = -x; local z = x == 1; local n = !x; return y }) == 5)
+assert(size(function(x) { local i = 0; i++; i--; return i }) == 3)
+assert(size(function() { { local a = 1, b = 2, c = 3 } { local d = 4, e = 5, f = 6 } }) == 4)
+
+// closures capturing locals whose slots are shared keep their own values
+local fs = []
+for (local round = 0; round < 3; round++) {
+    {
+        local a = round * 10, b = round * 10 + 1
+        fs.append(@() a + b)
+    }
+    {
+        local c = "c" + round, d = [round]
+        fs.append(@() c + d[0])
+        d[0] = -round
+    }
+}
+assert(fs[0]() == 1 && fs[1]() == "c00" && fs[2]() == 21 && fs[3]() == "c1-1" && fs[4]() == 41 && fs[5]() == "c2-2")
+
+local function shared(x) {
+    local out = []
+    if (x) {
+        local p = x * 2
+        out.append(@() p)
+        p++
+    } else {
+        local q = "no"
+        out.append(@() q)
+    }
+    {
+        local r = x + 100
+        out.append(@() r)
+    }
+    return out
+}
+local s = shared(3)
+assert(s[0]() == 7 && s[1]() == 103)
+s = shared(0)
+assert(s[0]() == "no" && s[1]() == 100)
+
+// results that skip a temporary land in the right local
+local function moved(t, x) {
+    local a = t.k
+    local b = x < 3
+    local c = x != 2
+    local d = ~x
+    local e = t.k == 5
+    return [a, b, c, d, e]
+}
+local res = moved({ k = 5 }, 2)
+assert(res[0] == 5 && res[1] == true && res[2] == false && res[3] == ~2 && res[4] == true)
@@ -0,0 +1,106 @@
+// tables of up to 8 slots and arrays of up to 4 values use compact storage;
+// they must behave as the general forms, across the switch to them
+local function failure(f) { try { f() } catch (e) { return e } return null }
+local function count(t) {
+    local n = 0
+    foreach (k, v in t) n++
+    return n
+}
+
+// filling a table one key at a time, past the small limit
+local t = {}
+assert(t.len() == 0 && count(t) == 0 && !("a" in t))
+for (local i = 0; i < 12; i++) {
+    t["k" + i] <- i
+    assert(t.len() == i + 1 && count(t) == i + 1)
+    for (local j = 0; j <= i; j++) assert(t["k" + j] == j)
+    assert(!(("k" + (i + 1)) in t))
+}
+
+// keys of every kind, overwrites, null values and removal
+local keys = ["s", 1, -2, 1.5, true, null, [], {}]
+local m = {}
+foreach (i, k in keys) if (k != null) m[k] <- i
+assert(m.len() == 7 && m[1] == 1 && m[1.5] == 3 && m[true] == 4 && m[keys[6]] == 6)
+assert(failure(@() m[null] <- 1) != null)
+m.s = "again"
+m[-2] = null
+assert(m.s == "again" && -2 in m && m[-2] == null && m.len() == 7)
+delete m.s
+delete m[1]
+assert(m.len() == 5 && !("s" in m) && !(1 in m) && count(m) == 5)
+m.s <- 1
+m.x <- 2
+m.y <- 3
+m.z <- 4
+assert(m.len() == 9 && m.s == 1 && m[keys[7]] == 7)
+assert(failure(@() m.missing) != null && m.rawget(1.5) == 3)
+
+// removing and refilling in place
+local r = { a = 1, b = 2, c = 3 }
+delete r.b
+r.d <- 4
+assert(r.len() == 3 && r.a == 1 && r.c == 3 && r.d == 4 && !("b" in r))
+r.clear()
+assert(r.len() == 0 && count(r) == 0)
+r.e <- 5
+assert(r.e == 5)
+
+// changes during iteration
+local it = { a = 1, b = 2, c = 3, d = 4 }
+local seen = 0
+foreach (k, v in it) { seen++; it[k] = v * 10 }
+assert(seen == 4 && it.a == 10 && it.d == 40)
+seen = 0
+foreach (k, v in it) { seen++; delete it[k] }
+assert(seen == 4 && it.len() == 0)
+local grow = { a = 1, b = 2 }
+seen = 0
+foreach (k, v in grow) {
+    seen++
+    if (seen == 1) for (local i = 0; i < 10; i++) grow["n" + i] <- i
+}
+assert(grow.len() == 12 && grow.n9 == 9)
+
+// clones and delegates of small tables
+local c = clone { a = 1, b = [1, 2] }
+c.a = 2
+assert(c.a == 2 && c.b.len() == 2)
+local d = { x = 1 }.setdelegate({ _get = @(k) "d" + k })
+assert(d.x == 1 && d.y == "dy")
+
+// arrays of each small size, then growing out of the inline storage
+for (local n = 0; n <= 6; n++) {
+    local a = array(n, n)
+    assert(a.len() == n)
+    a.append("x")
+    assert(a.len() == n + 1 && a.top() == "x" && (n == 0 || a[0] == n))
+}
+local a = [1, 2]
+a.insert(0, 0)
+a.extend([3, 4, 5])
+assert(a.len() == 6 && a[0] == 0 && a[5] == 5)
+a.resize(2)
+assert(a.len() == 2 && a[1] == 1)
+a.resize(8, "p")
+assert(a.len() == 8 && a[7] == "p")
+assert(a.remove(0) == 0 && a.pop() == "p" && a.len() == 6)
+local lit = [[], [1], [1, 2], [1, 2, 3], [1, 2, 3, 4], [1, 2, 3, 4, 5]]
+foreach (i, l in lit) {
+    assert(l.len() == i)
+    local k = clone l
+    k.append(0)
+    assert(k.len() == i + 1 && l.len() == i)
+    assert(l.slice(0).len() == i)
+}
+local s = [3, 1, 2]
+s.sort()
+s.reverse()
+assert(s[0] == 3 && s[2] == 1)
+
+// many small records, as parsed rows would be
+local rows = []
+for (local i = 0; i < 10000; i++) rows.append({ id = i, name = "r" + i, tags = [i, -i] })
+local total = 0
+foreach (row in rows) total += row.id + row.tags[1]
+assert(total == 0 && rows[9999].name == "r9999")
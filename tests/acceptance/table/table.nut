@@ -0,0 +1,59 @@
+local function keys(t) {
+    local n = 0
+    foreach (k, v in t) n++
+    return n
+}
+
+// dense integer keys, then nulled while iterating: every key is seen once
+local t = {}
+for (local i = 0; i < 1000; i++) t[i] <- i
+t.name <- "x"
+local seen = {}
+foreach (k, v in t) {
+    assert(!(k in seen))
+    seen[k] <- true
+    t[k] = null
+}
+assert(seen.len() == 1001)
+assert(t.len() == 1001 && keys(t) == 1001)
+foreach (k, v in t) assert(v == null)
+assert(0 in t && 999 in t && t[500] == null)
+
+// slots bound to null can be set again and removed
+t[5] = 55
+assert(t[5] == 55)
+delete t[5]
+assert(!(5 in t) && t.len() == 1000)
+t[5] <- null
+assert(5 in t && t[5] == null && t.len() == 1001)
+
+// new slots created during iteration are not required to show up, but
+// existing ones must be visited once
+local u = {}
+for (local i = 0; i < 64; i++) u[i] <- i
+local count = 0
+foreach (k, v in u) {
+    count++
+    u[k] <- v * 2
+}
+assert(count == 64)
+for (local i = 0; i < 64; i++) assert(u[i] == i * 2)
+
+// sparse and negative integers stay in the hash part
+local s = {}
+s[-1] <- "a"
+s[1 << 40] <- "b"
+s[3] <- "c"
+assert(s[-1] == "a" && s[1 << 40] == "b" && s[3] == "c" && s.len() == 3)
+
+// clone keeps null-bound keys
+local tc = clone t
+assert(tc.len() == t.len() && 7 in tc && tc[7] == null)
+
+// removing everything while iterating
+local r = {}
+for (local i = 0; i < 100; i++) r[i] <- i
+foreach (k, v in r) delete r[k]
+assert(r.len() == 0)
+for (local i = 0; i < 100; i++) r[i] <- i
+assert(r.len() == 100 && r[99] == 99)
@@ -0,0 +1,154 @@
+// weak-keyed and weak-valued tables, with reference counting and with the
+// cycle collector. Objects are made by mk() and tests run in threads of
+// their own, so that no stale stack slot keeps them alive.
+local function count(t) {
+    local n = 0
+    foreach (k, v in t) n++
+    return n
+}
+
+local Obj = class { id = 0; back = null; constructor(i) { id = i } }
+local function mk(i) return Obj(i)
+local function run(f) return newthread(f).call()
+// overwrites the slots a call leaves behind
+local function flush() { local a, b, c, d, e, f, g, h }
+
+// weak keys: an entry lives as long as its key
+local function weakkeys() {
+    local t = {}
+    t.setweakmode("k")
+    assert(t.getweakmode() == "k")
+    local keep = []
+    local function fill(t, keep) {
+        for (local i = 0; i < 20; i++) {
+            if (i % 2 == 0) {
+                keep.append(mk(i))
+                t[keep.top()] <- i
+            } else {
+                t[mk(i)] <- i
+            }
+        }
+    }
+    fill(t, keep)
+    t["s"] <- 1
+    t[7] <- 2
+    assert(count(t) == 12 && t.len() == 12)
+    // backwards, so that the last object on the stack is one that stays
+    for (local i = keep.len() - 1; i >= 0; i--) assert(t[keep[i]] == keep[i].id)
+    keep.resize(5)
+    assert(t.len() == 7)
+    return t
+}
+assert(run(weakkeys).len() == 2)
+
+// weak values: an entry lives as long as its value
+local function weakvalues() {
+    local t = {}
+    t.setweakmode("v")
+    local keep = mk(1)
+    t.a <- keep
+    t.b <- mk(2)
+    t.c <- "str"
+    flush()
+    assert(t.len() == 2 && t.a == keep && !("b" in t) && t.rawget("c") == "str")
+    // filling a dead pair, before anything prunes it, adds the key again
+    local u = {}
+    u.setweakmode("v")
+    u.x <- mk(3)
+    flush()
+    assert(!("x" in u) && !u.rawin("x"))
+    local o = mk(4)
+    u.x <- o
+    assert(u.x == o && u.len() == 1)
+    return [t, keep]
+}
+local r = run(weakvalues)
+assert(r[0].a == r[1])
+r.resize(1)
+assert(r[0].len() == 1 && r[0].c == "str")
+
+// weak references used as keys come back as themselves and stay weak
+local function weakrefkeys() {
+    local t = {}
+    t.setweakmode("k")
+    local target = mk(5)
+    local w = target.weakref()
+    t[w] <- "w"
+    // reading a weak reference out of a container gives its object
+    local function keys(t) {
+        local a = []
+        foreach (k, v in t) a.append(typeof k == "weakref" ? k.ref() : null)
+        return a
+    }
+    local seen = keys(t)
+    assert(seen.len() == 1 && seen[0] == target)
+    assert(t[w] == "w")
+    seen = null
+    target = null
+    flush()
+    assert(t.len() == 1 && t[w] == "w" && w.ref() == null)
+    w = null
+    flush()
+    assert(t.len() == 0)
+    return t
+}
+run(weakrefkeys)
+
+// a metamethod held weakly disappears with its function
+local function weakdelegate() {
+    local d = {}
+    d.setweakmode("v")
+    local f = function() { return "thing" }
+    d._typeof <- f
+    local t = {}.setdelegate(d)
+    assert(typeof t == "thing")
+    f = null
+    assert(typeof t == "table")
+}
+run(weakdelegate)
+
+// the collector frees caches whose values point back at their keys
+local function cycles(t, v) {
+    local keep = mk(0)
+    keep.back = keep
+    t[keep] <- keep
+    local function entry(t, v, i) {
+        local o = mk(i)
+        o.back = o
+        t[o] <- [o]
+        v[i] <- mk(i)
+        v[i].back = v[i]
+    }
+    for (local i = 1; i < 10; i++) entry(t, v, i)
+    v[0] <- keep
+    return keep
+}
+local function collect() {
+    local t = {}, v = {}
+    t.setweakmode("k")
+    v.setweakmode("kv")
+    local keep = newthread(cycles).call(t, v)
+    flush()
+    assert(t.len() == 10 && v.len() == 10)
+    collectgarbage()
+    assert(t.len() == 1 && t[keep] == keep && v.len() == 1 && v[0] == keep)
+    keep.back = null
+    keep = null
+    collectgarbage()
+    assert(t.len() == 0)
+}
+run(collect)
+
+// switching modes keeps the live entries
+local function modes() {
+    local t = {}
+    local o = mk(1)
+    t[o] <- o
+    t.setweakmode("kv")
+    assert(t.len() == 1 && t[o] == o)
+    t.setweakmode("")
+    o = null
+    assert(t.len() == 1)
+    foreach (k, v in t) assert(k == v && k.id == 1)
+}
+run(modes)
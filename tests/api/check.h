@@ -0,0 +1,74 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQ_TEST_CHECK_H_
+#define _SQ_TEST_CHECK_H_
+
+/* helpers for the C API tests: each test is a program that exits with a
+   non-zero status, after printing the failed check, on the first failure */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <squirrel.h>
+#include <sqstdaux.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+static inline void test_print(HSQUIRRELVM v, const SQChar *s, ...) {
+    (void)v;
+    va_list vl;
+    va_start(vl, s);
+    vfprintf(stderr, s, vl);
+    va_end(vl);
+}
+
+static inline HSQUIRRELVM test_open(void) {
+    HSQUIRRELVM v = sq_open(1024);
+    sq_setprintfunc(v, test_print, test_print);
+    sqstd_seterrorhandlers(v);
+    return v;
+}
+
+/* runs src with the root table as 'this' and pushes its result */
+static inline SQRESULT test_run(HSQUIRRELVM v, const SQChar *src) {
+    SQInteger const top = sq_gettop(v);
+    if (SQ_FAILED(sq_compilebuffer(v, src, (SQInteger)strlen(src), "test", SQTrue))) {
+        return SQ_ERROR;
+    }
+    sq_pushroottable(v);
+    if (SQ_FAILED(sq_call(v, 1, SQTrue, SQTrue))) {
+        sq_settop(v, top);
+        return SQ_ERROR;
+    }
+    sq_remove(v, -2);
+    return SQ_OK;
+}
+
+/* true if src runs and returns true */
+static inline SQBool test_true(HSQUIRRELVM v, const SQChar *src) {
+    SQBool b = SQFalse;
+    if (SQ_FAILED(test_run(v, src))) {
+        return SQFalse;
+    }
+    sq_getbool(v, -1, &b);
+    sq_pop(v, 1);
+    return b;
+}
+
+/* true if the last error is a string containing what */
+static inline SQBool test_error_has(HSQUIRRELVM v, const SQChar *what) {
+    const SQChar *s = NULL;
+    SQBool found;
+    sq_getlasterror(v);
+    found = SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strstr(s, what) != NULL;
+    sq_pop(v, 1);
+    return found;
+}
+
+#endif /*_SQ_TEST_CHECK_H_*/
@@ -0,0 +1,269 @@
+/*  see copyright notice in squirrel.h */
+
+/* frozen images carry values and closures between VMs, channels carry them
+   between threads, and code thawed from an image is shared read-only */
+
+#include <pthread.h>
+
+#include "../check.h"
+
+static const SQChar *lib =
+    "::Point <- class { x = 0; y = 0; constructor(a, b) { x = a; y = b } }\n"
+    "::add <- function(a, b) { return a + b }\n"
+    "::less <- function(a, b) { return a < b }\n"
+    "::sum <- function(n) { local s = 0; for (local i = 0; i < n; i++) s += i; return s }\n";
+
+static HSQUIRRELVM open_with_lib(void) {
+    HSQUIRRELVM v = test_open();
+    CHECK(SQ_SUCCEEDED(test_run(v, lib)));
+    sq_pop(v, 1);
+    return v;
+}
+
+/* freezes the result of src */
+static HSQIMAGE freeze(HSQUIRRELVM v, const SQChar *src) {
+    HSQIMAGE img = NULL;
+    CHECK(SQ_SUCCEEDED(test_run(v, src)));
+    CHECK(SQ_SUCCEEDED(sq_freeze(v, -1, &img)));
+    sq_pop(v, 1);
+    return img;
+}
+
+/* thaws img into the root table slot 'got' */
+static SQRESULT thaw_as_got(HSQUIRRELVM v, HSQIMAGE img) {
+    sq_pushroottable(v);
+    sq_pushstring(v, "got", -1);
+    if (SQ_FAILED(sq_thaw(v, img))) {
+        sq_pop(v, 2);
+        return SQ_ERROR;
+    }
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+    return SQ_OK;
+}
+
+static void values(void) {
+    HSQUIRRELVM a = open_with_lib(), b = open_with_lib();
+    HSQIMAGE img = freeze(a,
+        "local t = { n = 1, f = 2.5, s = \"str\", l = [1, [2], null, true] }\n"
+        "t.self <- t\n"
+        "t.shared <- [t.l, t.l]\n"
+        "t.p <- Point(3, 4)\n"
+        "return t");
+    CHECK(SQ_SUCCEEDED(thaw_as_got(b, img)));
+    CHECK(test_true(b,
+        "return got.n == 1 && got.f == 2.5 && got.s == \"str\" && got.l[1][0] == 2"
+        " && got.l[3] == true && got.self == got && got.shared[0] == got.shared[1]"
+        " && got.shared[0] == got.l && got.p instanceof Point && got.p.y == 4"));
+    /* the bytes alone thaw the same, without code */
+    SQUserPointer data;
+    SQInteger size;
+    sq_getimagebytes(img, &data, &size);
+    CHECK(SQ_SUCCEEDED(sq_thawbuffer(b, data, size, SQFalse)));
+    sq_pop(b, 1);
+    CHECK(SQ_FAILED(sq_thawbuffer(b, data, size / 2, SQFalse)));
+    sq_releaseimage(img);
+
+    /* classes travel by name */
+    CHECK(SQ_SUCCEEDED(test_run(a, "local L = class { v = 1 }; return L()")));
+    CHECK(SQ_FAILED(sq_freeze(a, -1, &img)));
+    sq_pop(a, 1);
+    CHECK(test_error_has(a, "not bound"));
+
+    /* so do closures that share a local with their creator */
+    CHECK(SQ_SUCCEEDED(test_run(a, "local n = 1; n++; return @() n")));
+    CHECK(SQ_FAILED(sq_freeze(a, -1, &img)));
+    sq_pop(a, 1);
+    CHECK(test_error_has(a, "free variables"));
+    sq_close(a);
+    sq_close(b);
+}
+
+/* native state of instances only moves through the class hooks */
+static SQInteger freeze_hook(HSQUIRRELVM v, SQInteger idx, SQWRITEFUNC w, SQUserPointer up) {
+    SQUserPointer p;
+    CHECK(SQ_SUCCEEDED(sq_getinstanceup(v, idx, &p, NULL, SQTrue)));
+    return w(up, p, sizeof(SQInteger)) == sizeof(SQInteger) ? SQ_OK : SQ_ERROR;
+}
+
+static SQInteger thaw_hook(HSQUIRRELVM v, SQInteger idx, SQREADFUNC r, SQUserPointer up) {
+    SQUserPointer p;
+    CHECK(SQ_SUCCEEDED(sq_getinstanceup(v, idx, &p, NULL, SQTrue)));
+    return r(up, p, sizeof(SQInteger)) == sizeof(SQInteger) ? SQ_OK : SQ_ERROR;
+}
+
+static SQInteger counter_get(HSQUIRRELVM v) {
+    SQUserPointer p;
+    if (SQ_FAILED(sq_getinstanceup(v, 1, &p, NULL, SQTrue))) {
+        return SQ_ERROR;
+    }
+    sq_pushinteger(v, *(SQInteger *)p);
+    return 1;
+}
+
+static SQInteger counter_ctor(HSQUIRRELVM v) {
+    SQUserPointer p;
+    SQInteger n;
+    if (SQ_FAILED(sq_getinstanceup(v, 1, &p, NULL, SQTrue)) || SQ_FAILED(sq_getinteger(v, 2, &n))) {
+        return SQ_ERROR;
+    }
+    *(SQInteger *)p = n;
+    return 0;
+}
+
+/* a class whose instances carry a native SQInteger, bound as ::Counter */
+static void register_counter(HSQUIRRELVM v, SQBool freezable, SQBool thawable) {
+    sq_pushroottable(v);
+    sq_pushstring(v, "Counter", -1);
+    CHECK(SQ_SUCCEEDED(sq_newclass(v, SQFalse)));
+    CHECK(SQ_SUCCEEDED(sq_setclassudsize(v, -1, sizeof(SQInteger))));
+    sq_pushstring(v, "constructor", -1);
+    sq_newclosure(v, counter_ctor, 0);
+    sq_newslot(v, -3, SQFalse);
+    sq_pushstring(v, "get", -1);
+    sq_newclosure(v, counter_get, 0);
+    sq_newslot(v, -3, SQFalse);
+    if (freezable || thawable) {
+        CHECK(SQ_SUCCEEDED(sq_setimagehooks(v, -1, freezable ? freeze_hook : NULL, thawable ? thaw_hook : NULL)));
+    }
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+}
+
+static void native_instances(void) {
+    HSQIMAGE img;
+    HSQUIRRELVM a = test_open(), b = test_open(), c = test_open();
+    register_counter(a, SQFalse, SQFalse);
+    CHECK(SQ_SUCCEEDED(test_run(a, "return [Counter(5)]")));
+    CHECK(SQ_FAILED(sq_freeze(a, -1, &img)));
+    sq_pop(a, 1);
+    CHECK(test_error_has(a, "no freeze hook"));
+    sq_close(a);
+
+    a = test_open();
+    register_counter(a, SQTrue, SQTrue);
+    register_counter(b, SQTrue, SQTrue);
+    register_counter(c, SQTrue, SQFalse);
+    img = freeze(a, "return [Counter(5), Counter(-9)]");
+    CHECK(SQ_SUCCEEDED(thaw_as_got(b, img)));
+    CHECK(test_true(b, "return got[0].get() == 5 && got[1].get() == -9"));
+    /* no constructor runs on thaw: without the hook the state would be garbage */
+    CHECK(SQ_FAILED(thaw_as_got(c, img)));
+    CHECK(test_error_has(c, "no thaw hook"));
+    sq_releaseimage(img);
+    sq_close(a);
+    sq_close(b);
+    sq_close(c);
+}
+
+/* Code thawed from an image is shared by every VM that thaws it and never
+   rewritten: sites that were quickened for integers before freezing must
+   fall back to the generic instructions for other operand types. */
+static void shared_code(void) {
+    HSQUIRRELVM a = open_with_lib(), b = open_with_lib(), c = open_with_lib();
+    CHECK(test_true(a, "for (local i = 0; i < 10; i++) add(i, 1); return less(1, 2) && sum(10) == 45"));
+    HSQIMAGE img = freeze(a, "return [add, less, sum]");
+    CHECK(SQ_SUCCEEDED(thaw_as_got(b, img)));
+    CHECK(SQ_SUCCEEDED(thaw_as_got(c, img)));
+    static const SQChar *mixed =
+        "local add = got[0], less = got[1]\n"
+        "local V = class { v = 0; constructor(x) { v = x } function _add(o) { return { v = v + o.v } } }\n"
+        "for (local i = 0; i < 40; i++) {\n"
+        "    if (add(1, 2) != 3 || add(1.5, 2.0) != 3.5 || add(1, 0.5) != 1.5) return false\n"
+        "    if (add(\"a\", 1) != \"a1\" || add(V(1), V(2)).v != 3) return false\n"
+        "    if (!less(1, 2) || less(2.5, 1.0) || !less(\"a\", \"b\") || !less(1, 1.5)) return false\n"
+        "}\n"
+        "return got[2](10) == 45 && got[2](2.5) == 3.0";
+    CHECK(test_true(b, mixed));
+    CHECK(test_true(c, mixed));
+    CHECK(test_true(b, "return got[0](2, 3) == 5 && got[1](1, 2)"));
+    CHECK(test_true(a, "return add(2, 3) == 5 && add(0.5, 0.25) == 0.75"));
+    sq_releaseimage(img);
+    sq_close(a);
+    sq_close(b);
+    sq_close(c);
+}
+
+/* workers thaw requests from one channel and answer on another */
+typedef struct {
+    HSQCHANNEL in, out;
+} Worker;
+
+static void *worker(void *arg) {
+    Worker *w = (Worker *)arg;
+    HSQUIRRELVM v = open_with_lib();
+    for (;;) {
+        SQInteger const got = sq_channelrecv(v, w->in, SQTrue);
+        CHECK(got != SQ_ERROR);
+        if (got == 0) {
+            break;
+        }
+        /* [function, argument]: answers function(argument) */
+        sq_pushinteger(v, 0);
+        CHECK(SQ_SUCCEEDED(sq_get(v, -2)));
+        sq_pushroottable(v);
+        sq_pushinteger(v, 1);
+        CHECK(SQ_SUCCEEDED(sq_get(v, -4)));
+        CHECK(SQ_SUCCEEDED(sq_call(v, 2, SQTrue, SQTrue)));
+        CHECK(SQ_SUCCEEDED(sq_channelsend(v, w->out, -1)));
+        sq_pop(v, 3);
+    }
+    sq_close(v);
+    return NULL;
+}
+
+#define NWORKERS 4
+#define NREQUESTS 400
+
+static void channels(void) {
+    HSQUIRRELVM v = open_with_lib();
+    Worker w;
+    pthread_t threads[NWORKERS];
+    w.in = sq_newchannel();
+    w.out = sq_newchannel();
+    for (int i = 0; i < NWORKERS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, worker, &w) == 0);
+    }
+    CHECK(SQ_SUCCEEDED(test_run(v, "return [sum, @(x) [x, x * 2.0, \"s\" + x]]")));
+    for (int i = 0; i < NREQUESTS; i++) {
+        sq_newarray(v, 0);
+        sq_pushinteger(v, i % 2);
+        CHECK(SQ_SUCCEEDED(sq_get(v, -3)));
+        CHECK(SQ_SUCCEEDED(sq_arrayappend(v, -2)));
+        sq_pushinteger(v, i);
+        CHECK(SQ_SUCCEEDED(sq_arrayappend(v, -2)));
+        CHECK(SQ_SUCCEEDED(sq_channelsend(v, w.in, -1)));
+        sq_pop(v, 1);
+    }
+    sq_closechannel(w.in);
+    SQInteger sums = 0, tuples = 0;
+    for (int i = 0; i < NREQUESTS; i++) {
+        CHECK(sq_channelrecv(v, w.out, SQTrue) == 1);
+        if (sq_gettype(v, -1) == OT_INTEGER) {
+            sums++;
+        } else {
+            CHECK(sq_gettype(v, -1) == OT_ARRAY && sq_getsize(v, -1) == 3);
+            tuples++;
+        }
+        sq_pop(v, 1);
+    }
+    CHECK(sums == NREQUESTS / 2 && tuples == NREQUESTS / 2);
+    for (int i = 0; i < NWORKERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(sq_channelrecv(v, w.in, SQFalse) == 0);
+    sq_pushinteger(v, 1);
+    CHECK(SQ_FAILED(sq_channelsend(v, w.in, -1)));
+    sq_pop(v, 2);
+    sq_releasechannel(w.in);
+    sq_releasechannel(w.out);
+    sq_close(v);
+}
+
+int main(void) {
+    values();
+    native_instances();
+    shared_code();
+    channels();
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*  see copyright notice in squirrel.h */
+
+/* keys interned once with sq_internkey read and write tables, classes and
+   instances like the same string pushed each time */
+
+#include "../check.h"
+
+static SQInteger get_int(HSQUIRRELVM v, SQInteger idx) {
+    SQInteger n = -1;
+    CHECK(SQ_SUCCEEDED(sq_getinteger(v, idx, &n)));
+    return n;
+}
+
+int main(void) {
+    HSQUIRRELVM v = test_open();
+    HSQKEY name, missing, count, fresh;
+    sq_internkey(v, "name", -1, &name);
+    sq_internkey(v, "missing_key", -1, &missing);
+    sq_internkey(v, "count?", 5, &count);
+    /* the handle keeps its string alive when nothing else does */
+    sq_internkey(v, "only_here_123", -1, &fresh);
+    sq_collectgarbage(v);
+
+    /* tables, with and without delegation */
+    CHECK(SQ_SUCCEEDED(test_run(v,
+        "::t <- { name = \"t\", count = 1 }.setdelegate({ missing_key = \"from delegate\" })\n"
+        "return t")));
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &name)));
+    const SQChar *s;
+    CHECK(SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strcmp(s, "t") == 0);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &count)) && get_int(v, -1) == 1);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &missing)));
+    CHECK(SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strcmp(s, "from delegate") == 0);
+    sq_pop(v, 1);
+    CHECK(SQ_FAILED(sq_rawgetbykey(v, -1, &missing)));
+    CHECK(test_error_has(v, "doesn't exist"));
+    sq_pushinteger(v, 2);
+    CHECK(SQ_SUCCEEDED(sq_setbykey(v, -2, &count)));
+    sq_pushinteger(v, 3);
+    CHECK(SQ_FAILED(sq_setbykey(v, -2, &fresh)));
+    sq_pop(v, 1);
+    sq_pushinteger(v, 4);
+    CHECK(SQ_SUCCEEDED(sq_newslotbykey(v, -2, &fresh, SQFalse)));
+    sq_pushinteger(v, 5);
+    CHECK(SQ_SUCCEEDED(sq_rawsetbykey(v, -2, &missing)));
+    CHECK(test_true(v, "return t.count == 2 && t.only_here_123 == 4 && t.rawget(\"missing_key\") == 5"));
+
+    /* classes and their instances */
+    CHECK(SQ_SUCCEEDED(test_run(v,
+        "::C <- class { name = \"default\"; count = 0; function _get(k) { return \"dyn \" + k } }\n"
+        "return C")));
+    sq_pushinteger(v, 10);
+    CHECK(SQ_SUCCEEDED(sq_newslotbykey(v, -2, &fresh, SQTrue)));
+    CHECK(SQ_SUCCEEDED(sq_rawgetbykey(v, -1, &name)));
+    CHECK(SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strcmp(s, "default") == 0);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_createinstance(v, -1)));
+    sq_pushstring(v, "inst", -1);
+    CHECK(SQ_SUCCEEDED(sq_setbykey(v, -2, &name)));
+    sq_pushinteger(v, 7);
+    CHECK(SQ_SUCCEEDED(sq_setbykey(v, -2, &count)));
+    sq_pushinteger(v, 8);
+    CHECK(SQ_SUCCEEDED(sq_rawsetbykey(v, -2, &count)));
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &count)) && get_int(v, -1) == 8);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &fresh)) && get_int(v, -1) == 10);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &name)));
+    CHECK(SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strcmp(s, "inst") == 0);
+    sq_pop(v, 1);
+    /* _get answers what the instance lacks, the raw lookup does not ask it */
+    CHECK(SQ_SUCCEEDED(sq_getbykey(v, -1, &missing)));
+    CHECK(SQ_SUCCEEDED(sq_getstring(v, -1, &s)) && strcmp(s, "dyn missing_key") == 0);
+    sq_pop(v, 1);
+    CHECK(SQ_FAILED(sq_rawgetbykey(v, -1, &missing)));
+    sq_pushinteger(v, 9);
+    CHECK(SQ_FAILED(sq_rawsetbykey(v, -2, &missing)));
+    sq_pushinteger(v, 9);
+    CHECK(SQ_FAILED(sq_newslotbykey(v, -2, &missing, SQFalse)));
+    CHECK(test_error_has(v, "newslot works only"));
+    sq_pop(v, 3);
+
+    /* anything else is refused without disturbing the stack */
+    SQInteger const top = sq_gettop(v);
+    sq_newarray(v, 0);
+    CHECK(SQ_FAILED(sq_rawgetbykey(v, -1, &name)));
+    sq_pushinteger(v, 1);
+    CHECK(SQ_FAILED(sq_rawsetbykey(v, -2, &name)));
+    CHECK(sq_gettop(v) == top + 1);
+    sq_pop(v, 1);
+
+    /* the table keeps the keys it was given after they are released */
+    CHECK(SQ_SUCCEEDED(sq_releasekey(v, &fresh)));
+    sq_collectgarbage(v);
+    CHECK(test_true(v, "return t.only_here_123 == 4 && C.only_here_123 == 10"));
+    CHECK(fresh._ref == 0 && sq_isnull(fresh._key));
+
+    /* released keys are refused */
+    CHECK(SQ_FAILED(sq_releasekey(v, &fresh)));
+    CHECK(test_error_has(v, "invalid key"));
+    sq_releasekey(v, &name);
+    sq_releasekey(v, &missing);
+    sq_releasekey(v, &count);
+    sq_close(v);
+    return 0;
+}
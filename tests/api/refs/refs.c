@@ -0,0 +1,103 @@
+/*  see copyright notice in squirrel.h */
+
+/* handles from sq_newref keep their object alive, GC roots included, until
+   sq_freeref; freed and unknown handles are rejected */
+
+#include "../check.h"
+
+/* true if the object behind ref is the one in the root table slot name */
+static SQBool same_as(HSQUIRRELVM v, HSQREF ref, const SQChar *name) {
+    HSQOBJECT a, b;
+    CHECK(SQ_SUCCEEDED(sq_pushref(v, ref)));
+    sq_pushroottable(v);
+    sq_pushstring(v, name, -1);
+    CHECK(SQ_SUCCEEDED(sq_get(v, -2)));
+    sq_getstackobj(v, -1, &a);
+    sq_getstackobj(v, -3, &b);
+    sq_pop(v, 3);
+    return a._type == b._type && a._unVal.pRefCounted == b._unVal.pRefCounted;
+}
+
+int main(void) {
+    HSQUIRRELVM v = test_open();
+
+    /* a cycle held only by a handle outlives a collection */
+    CHECK(SQ_SUCCEEDED(test_run(v,
+        "local t = { n = 7 }\n"
+        "t.self <- t\n"
+        "::w <- t.weakref()\n"
+        "return t")));
+    HSQREF const cycle = sq_newref(v, -1);
+    CHECK(cycle != 0);
+    sq_pop(v, 1);
+    sq_collectgarbage(v);
+    CHECK(test_true(v, "return w != null && w.self.n == 7"));
+    CHECK(SQ_SUCCEEDED(sq_pushref(v, cycle)));
+    sq_pushstring(v, "n", -1);
+    CHECK(SQ_SUCCEEDED(sq_get(v, -2)));
+    SQInteger n = 0;
+    CHECK(SQ_SUCCEEDED(sq_getinteger(v, -1, &n)) && n == 7);
+    sq_pop(v, 2);
+
+    /* every handle is a reference of its own */
+    CHECK(SQ_SUCCEEDED(test_run(v, "::shared <- []; return shared")));
+    HSQREF const r1 = sq_newref(v, -1), r2 = sq_newref(v, -1);
+    sq_pop(v, 1);
+    CHECK(r1 != r2 && same_as(v, r1, "shared") && same_as(v, r2, "shared"));
+    CHECK(SQ_SUCCEEDED(sq_freeref(v, r1)));
+    CHECK(same_as(v, r2, "shared"));
+
+    /* freed, never issued and null handles */
+    CHECK(SQ_FAILED(sq_pushref(v, r1)));
+    CHECK(test_error_has(v, "invalid reference"));
+    CHECK(SQ_FAILED(sq_freeref(v, r1)));
+    CHECK(SQ_FAILED(sq_freeref(v, 0)));
+    CHECK(SQ_FAILED(sq_pushref(v, 0)));
+    CHECK(SQ_FAILED(sq_pushref(v, (HSQREF)1 << 40)));
+
+    /* freeing the last handle lets the object go */
+    CHECK(SQ_SUCCEEDED(sq_freeref(v, cycle)));
+    sq_collectgarbage(v);
+    CHECK(test_true(v, "return w == null"));
+
+    /* values that are not reference counted */
+    sq_pushinteger(v, 42);
+    HSQREF const num = sq_newref(v, -1);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_pushref(v, num)));
+    CHECK(SQ_SUCCEEDED(sq_getinteger(v, -1, &n)) && n == 42);
+    sq_pop(v, 1);
+    CHECK(SQ_SUCCEEDED(sq_freeref(v, num)));
+
+    /* many handles, freed in any order and reused */
+    enum { N = 10000 };
+    static HSQREF refs[N];
+    for (SQInteger i = 0; i < N; i++) {
+        sq_pushinteger(v, i);
+        refs[i] = sq_newref(v, -1);
+        sq_pop(v, 1);
+    }
+    for (SQInteger i = 0; i < N; i += 2) {
+        CHECK(SQ_SUCCEEDED(sq_freeref(v, refs[i])));
+    }
+    for (SQInteger i = 0; i < N; i += 2) {
+        sq_newtable(v);
+        refs[i] = sq_newref(v, -1);
+        sq_pop(v, 1);
+    }
+    for (SQInteger i = 0; i < N; i++) {
+        CHECK(SQ_SUCCEEDED(sq_pushref(v, refs[i])));
+        CHECK(sq_gettype(v, -1) == ((i & 1) ? OT_INTEGER : OT_TABLE));
+        if (i & 1) {
+            CHECK(SQ_SUCCEEDED(sq_getinteger(v, -1, &n)) && n == i);
+        }
+        sq_pop(v, 1);
+    }
+
+    /* handles still live when the VM closes are released with it */
+    CHECK(SQ_SUCCEEDED(test_run(v, "local a = []; a.append(a); return a")));
+    sq_newref(v, -1);
+    sq_pop(v, 1);
+    sq_close(v);
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*  see copyright notice in squirrel.h */
+
+/* a heap snapshot taken after initialization restores into a fresh VM that
+   set up the same native baseline, without running the initialization */
+
+#include "../check.h"
+
+#include <sqstdmath.h>
+#include <sqstdstring.h>
+
+typedef struct {
+    char *data;
+    SQInteger size, cap, pos;
+} Buffer;
+
+static SQInteger buffer_write(SQUserPointer up, SQUserPointer p, SQInteger size) {
+    Buffer *b = (Buffer *)up;
+    if (b->size + size > b->cap) {
+        b->cap = (b->size + size) * 2;
+        b->data = (char *)realloc(b->data, (size_t)b->cap);
+    }
+    memcpy(b->data + b->size, p, (size_t)size);
+    b->size += size;
+    return size;
+}
+
+static SQInteger buffer_read(SQUserPointer up, SQUserPointer p, SQInteger size) {
+    Buffer *b = (Buffer *)up;
+    if (size > b->size - b->pos) {
+        return -1;
+    }
+    memcpy(p, b->data + b->pos, (size_t)size);
+    b->pos += size;
+    return size;
+}
+
+static SQInteger native_twice(HSQUIRRELVM v) {
+    SQInteger n;
+    if (SQ_FAILED(sq_getinteger(v, 2, &n))) {
+        return SQ_ERROR;
+    }
+    sq_pushinteger(v, n * 2);
+    return 1;
+}
+
+/* what the host sets up before its scripts run, identical in every process */
+static HSQUIRRELVM open_host(void) {
+    HSQUIRRELVM v = test_open();
+    sq_pushroottable(v);
+    CHECK(SQ_SUCCEEDED(sqstd_register_mathlib(v)));
+    CHECK(SQ_SUCCEEDED(sqstd_register_stringlib(v)));
+    sq_pushstring(v, "twice", -1);
+    sq_newclosure(v, native_twice, 0);
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+    sq_pushregistrytable(v);
+    sq_pushstring(v, "host", -1);
+    sq_newtable(v);
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+    sq_setsnapshotbaseline(v);
+    return v;
+}
+
+static const SQChar *init =
+    "const LIMIT = 40\n"
+    "enum Color { red, green = 5 }\n"
+    "::Shape <- class { sides = 0; constructor(n) { sides = n } function twice() { return ::twice(sides) } }\n"
+    "::Square <- class extends Shape { constructor() { base.constructor(4) } }\n"
+    "::shapes <- [Shape(3), Square()]\n"
+    "::config <- { name = \"svc\", limits = [1, 2, LIMIT], nat = twice, sqrt = sqrt }\n"
+    "config.self <- config\n"
+    "local count = 0\n"
+    "::bump <- function() { count++; return count }\n"
+    "::peek <- function() { return count }\n"
+    "::greet <- function(who = \"world\") { return format(\"hello %s\", who) }\n"
+    "bump(); bump()\n";
+
+static const SQChar *checks =
+    "return shapes[0].sides == 3 && shapes[1] instanceof Square && shapes[1] instanceof Shape"
+    " && shapes[1].twice() == 8 && config.self == config && config.limits[2] == 40"
+    " && config.nat == twice && config.sqrt == sqrt && config.sqrt(16.0) == 4.0"
+    " && peek() == 2 && bump() == 3 && peek() == 3 && greet() == \"hello world\""
+    " && Square().sides == 4";
+
+int main(void) {
+    Buffer snap = { NULL, 0, 0, 0 };
+    HSQUIRRELVM a = open_host();
+    CHECK(SQ_SUCCEEDED(test_run(a, init)));
+    sq_pop(a, 1);
+    CHECK(SQ_SUCCEEDED(sq_snapshot(a, buffer_write, &snap)));
+
+    /* a native class made after the baseline has no path to be restored by */
+    CHECK(SQ_SUCCEEDED(sq_newclass(a, SQFalse)));
+    CHECK(SQ_SUCCEEDED(sq_setclassudsize(a, -1, 8)));
+    sq_pushroottable(a);
+    sq_pushstring(a, "Late", -1);
+    sq_push(a, -3);
+    sq_newslot(a, -3, SQFalse);
+    sq_pop(a, 2);
+    Buffer late = { NULL, 0, 0, 0 };
+    CHECK(SQ_FAILED(sq_snapshot(a, buffer_write, &late)));
+    CHECK(test_error_has(a, "after the baseline"));
+    free(late.data);
+    sq_close(a);
+
+    HSQUIRRELVM b = open_host();
+    CHECK(SQ_SUCCEEDED(sq_restore(b, buffer_read, &snap)));
+    CHECK(snap.pos == snap.size);
+    CHECK(test_true(b, checks));
+    /* constants are back for code compiled after the restore */
+    CHECK(test_true(b, "return LIMIT == 40 && Color.green == 5"));
+
+    /* a truncated snapshot fails and leaves the VM as it was */
+    HSQUIRRELVM c = open_host();
+    Buffer cut = snap;
+    cut.pos = 0;
+    cut.size = snap.size / 2;
+    CHECK(SQ_FAILED(sq_restore(c, buffer_read, &cut)));
+    CHECK(test_true(c, "return !(\"shapes\" in getroottable()) && twice(2) == 4"));
+    cut.size = snap.size;
+    cut.pos = 0;
+    cut.data[sizeof(SQInteger) + 1] ^= 0x55;
+    CHECK(SQ_FAILED(sq_restore(c, buffer_read, &cut)));
+    CHECK(test_true(c, "return !(\"shapes\" in getroottable())"));
+
+    sq_close(b);
+    sq_close(c);
+    free(snap.data);
+    return 0;
+}